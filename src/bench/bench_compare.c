@@ -0,0 +1,496 @@
+/** \file
+ * \brief Compares the results of the benchmarks with a baseline, failing when a metric regresses beyond its tolerance.
+ *
+ * The results are the JSON outputs of the benchmarks (`sessionfs-bench -f json`, `ushim-replay -j`, ...), one file per
+ * run: the objects are flattened in dotted names, without the `results` level, and prefixed with a label, which is the
+ * name of the file without the directory, the `.json` extension and a trailing `-[run]`. When a configuration is run
+ * more than once its metrics are the median of the runs, e.g. `copy-rw-1.json` and `copy-rw-2.json` give the metrics
+ * `copy-rw.open.p99_ns`, `copy-rw.sessions_per_s`, ...
+ *
+ * The baseline is a JSON object with the checked metrics and the tolerances:
+ * \code
+ * {
+ * 	"tolerance":{"latency":0.5,"throughput":0.25,"latency_floor_ns":20000,"copy-rw.open.p99_ns":1.0},
+ * 	"metrics":{"copy-rw.open.p99_ns":4456447,"copy-rw.sessions_per_s":483}
+ * }
+ * \endcode
+ * The metrics whose name ends in `_ns` regress when they grow more than `latency` (a fraction of the baseline) and at
+ * least `latency_floor_ns`, the ones that end in `_per_s` regress when they drop more than `throughput`; a tolerance
+ * can be given for a single metric with its name.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+///The maximum length of the name of a metric.
+#define METRIC_NAME_MAX 256
+
+///The maximum size of a JSON file.
+#define JSON_MAX_SIZE (1<<20)
+
+///Default tolerance of the latencies, as a fraction of the baseline.
+#define DEFAULT_LATENCY_TOLERANCE 0.5
+
+///Default tolerance of the throughputs, as a fraction of the baseline.
+#define DEFAULT_THROUGHPUT_TOLERANCE 0.25
+
+///Default change of the latencies that is always tolerated, in nanoseconds.
+#define DEFAULT_LATENCY_FLOOR_NS 20000
+
+///Suffixes of the metrics written in a new baseline, when there is no previous one.
+const char* baseline_suffixes[]={".p50_ns",".p99_ns","sessions_per_s",NULL};
+
+/**
+ * \struct metric
+ * \brief A metric, with the values of each run.
+ * \param name The dotted name of the metric.
+ * \param values The value of each run.
+ * \param num The number of runs.
+ */
+struct metric{
+	char name[METRIC_NAME_MAX];
+	double* values;
+	int num;
+};
+
+/**
+ * \struct metric_set
+ * \brief A set of metrics.
+ * \param metrics The metrics, in order of insertion.
+ * \param num The number of metrics.
+ * \param size The allocated metrics.
+ */
+struct metric_set{
+	struct metric* metrics;
+	int num;
+	int size;
+};
+
+/** \brief Returns a metric of a set.
+ * \param[in] set The set.
+ * \param[in] name The name of the metric.
+ * \returns The metric or `NULL` if it is not in the set.
+ */
+struct metric* find_metric(const struct metric_set* set,const char* name){
+	int i;
+	for(i=0;i<set->num;i++){
+		if(strcmp(set->metrics[i].name,name)==0){
+			return &(set->metrics[i]);
+		}
+	}
+	return NULL;
+}
+
+/** \brief Adds a value to a metric, adding the metric to the set if needed.
+ * \param[in,out] set The set.
+ * \param[in] name The name of the metric.
+ * \param[in] value The value.
+ * \returns 0 or -1 if there is not enough memory.
+ */
+int add_value(struct metric_set* set,const char* name,double value){
+	struct metric* metric=find_metric(set,name), *grown;
+	double* values;
+	if(metric==NULL){
+		if(set->num==set->size){
+			grown=realloc(set->metrics,sizeof(struct metric)*((set->size==0) ? 64 : set->size*2));
+			if(grown==NULL){
+				return -1;
+			}
+			set->metrics=grown;
+			set->size=(set->size==0) ? 64 : set->size*2;
+		}
+		metric=&(set->metrics[set->num++]);
+		snprintf(metric->name,METRIC_NAME_MAX,"%s",name);
+		metric->values=NULL;
+		metric->num=0;
+	}
+	values=realloc(metric->values,sizeof(double)*(metric->num+1));
+	if(values==NULL){
+		return -1;
+	}
+	metric->values=values;
+	metric->values[metric->num++]=value;
+	return 0;
+}
+
+/** \brief Frees the metrics of a set.
+ * \param[in,out] set The set.
+ */
+void free_metrics(struct metric_set* set){
+	int i;
+	for(i=0;i<set->num;i++){
+		free(set->metrics[i].values);
+	}
+	free(set->metrics);
+	memset(set,0,sizeof(struct metric_set));
+}
+
+/** \brief Compares two doubles, for `qsort()`.
+ */
+int compare_doubles(const void* a,const void* b){
+	double da=*(const double*)a, db=*(const double*)b;
+	return (da<db) ? -1 : (da>db);
+}
+
+/** \brief Returns the median of the values of a metric.
+ * \param[in,out] metric The metric, whose values are sorted.
+ */
+double metric_median(struct metric* metric){
+	qsort(metric->values,metric->num,sizeof(double),compare_doubles);
+	if(metric->num%2==1){
+		return metric->values[metric->num/2];
+	}
+	return (metric->values[metric->num/2-1]+metric->values[metric->num/2])/2;
+}
+
+/** \brief Skips the blanks of a JSON text.
+ * \param[in,out] it The position in the text.
+ */
+void skip_blanks(const char** it){
+	while(isspace((unsigned char)**it)){
+		(*it)++;
+	}
+}
+
+/** \brief Parses a JSON string, without unescaping it.
+ * \param[in,out] it The position of the opening quote, moved after the closing one.
+ * \param[out] str The content of the string, truncated if it is too long, can be `NULL`.
+ * \param[in] len The length of `str`.
+ * \returns 0 or -1 if the string is not terminated.
+ */
+int parse_string(const char** it,char* str,size_t len){
+	size_t i=0;
+	for((*it)++;**it!='"';(*it)++){
+		if(**it=='\0'){
+			return -1;
+		}
+		if(**it=='\\' && (*it)[1]!='\0'){
+			(*it)++;
+		}
+		if(str!=NULL && i+1<len){
+			str[i++]=**it;
+		}
+	}
+	(*it)++;
+	if(str!=NULL){
+		str[i]='\0';
+	}
+	return 0;
+}
+
+/** \brief Parses a JSON value, adding its numbers to a set with their dotted names.
+ * \param[in,out] it The position of the value, moved after it.
+ * \param[in] name The dotted name of the value.
+ * \param[in,out] set The set.
+ * \returns 0 or -1 on a syntax error or if there is not enough memory.
+ *
+ * The `results` objects are not part of the names, the strings, booleans and nulls are ignored.
+ */
+int parse_value(const char** it,const char* name,struct metric_set* set){
+	char key[METRIC_NAME_MAX], child[METRIC_NAME_MAX];
+	const char* end;
+	double value;
+	int index=0;
+	char close;
+	skip_blanks(it);
+	if(**it=='{' || **it=='['){
+		close=(**it=='{') ? '}' : ']';
+		(*it)++;
+		skip_blanks(it);
+		while(**it!=close){
+			if(close=='}'){
+				if(**it!='"' || parse_string(it,key,sizeof(key))<0){
+					return -1;
+				}
+				skip_blanks(it);
+				if(**it!=':'){
+					return -1;
+				}
+				(*it)++;
+			} else {
+				snprintf(key,sizeof(key),"%d",index++);
+			}
+			if(strcmp(key,"results")==0){
+				snprintf(child,sizeof(child),"%s",name);
+			} else if(name[0]=='\0'){
+				snprintf(child,sizeof(child),"%s",key);
+			} else if(snprintf(child,sizeof(child),"%s.%s",name,key)>=(int)sizeof(child)){
+				return -1;
+			}
+			if(parse_value(it,child,set)<0){
+				return -1;
+			}
+			skip_blanks(it);
+			if(**it==','){
+				(*it)++;
+				skip_blanks(it);
+			} else if(**it!=close){
+				return -1;
+			}
+		}
+		(*it)++;
+		return 0;
+	}
+	if(**it=='"'){
+		return parse_string(it,NULL,0);
+	}
+	if(strncmp(*it,"true",4)==0 || strncmp(*it,"null",4)==0){
+		*it+=4;
+		return 0;
+	}
+	if(strncmp(*it,"false",5)==0){
+		*it+=5;
+		return 0;
+	}
+	value=strtod(*it,(char**)&end);
+	if(end==*it){
+		return -1;
+	}
+	*it=end;
+	return add_value(set,name,value);
+}
+
+/** \brief Reads the metrics of a JSON file.
+ * \param[in] pathname The pathname of the file.
+ * \param[in] label The prefix of the names of the metrics, can be empty.
+ * \param[in,out] set The set where the metrics are added.
+ * \returns 0, or -1 on error after printing a message.
+ */
+int read_metrics(const char* pathname,const char* label,struct metric_set* set){
+	const char* it;
+	char* text;
+	size_t len;
+	FILE* in;
+	int res;
+	in=fopen(pathname,"r");
+	if(in==NULL){
+		fprintf(stderr,"can't open %s: %s\n",pathname,strerror(errno));
+		return -1;
+	}
+	text=malloc(JSON_MAX_SIZE);
+	if(text==NULL){
+		fclose(in);
+		fprintf(stderr,"not enough memory to read %s\n",pathname);
+		return -1;
+	}
+	len=fread(text,1,JSON_MAX_SIZE-1,in);
+	fclose(in);
+	text[len]='\0';
+	it=text;
+	res=parse_value(&it,label,set);
+	if(res==0){
+		skip_blanks(&it);
+		res=(*it=='\0') ? 0 : -1;
+	}
+	if(res<0){
+		fprintf(stderr,"%s is not valid JSON, or it is too large\n",pathname);
+	}
+	free(text);
+	return res;
+}
+
+/** \brief Returns the label of a results file, its name without the directory, the extension and the run number.
+ * \param[in] pathname The pathname of the file.
+ * \param[out] label The label.
+ * \param[in] len The length of `label`.
+ */
+void results_label(const char* pathname,char* label,size_t len){
+	const char* name=strrchr(pathname,'/');
+	char* it;
+	snprintf(label,len,"%s",(name!=NULL) ? name+1 : pathname);
+	it=strrchr(label,'.');
+	if(it!=NULL && strcmp(it,".json")==0){
+		*it='\0';
+	}
+	it=strrchr(label,'-');
+	if(it!=NULL && it[1]!='\0' && strspn(it+1,"0123456789")==strlen(it+1)){
+		*it='\0';
+	}
+}
+
+/** \brief Returns a tolerance of the baseline.
+ * \param[in] baseline The metrics of the baseline.
+ * \param[in] name The name of the tolerance, without the `tolerance.` prefix.
+ * \param[in] def The default value.
+ */
+double get_tolerance(const struct metric_set* baseline,const char* name,double def){
+	char key[METRIC_NAME_MAX];
+	struct metric* metric;
+	snprintf(key,sizeof(key),"tolerance.%s",name);
+	metric=find_metric(baseline,key);
+	return (metric!=NULL && metric->num>0) ? metric->values[0] : def;
+}
+
+/** \brief Returns whether a string ends with a suffix.
+ */
+int ends_with(const char* str,const char* suffix){
+	size_t len=strlen(str), slen=strlen(suffix);
+	return len>=slen && strcmp(str+len-slen,suffix)==0;
+}
+
+/** \brief Compares the results with the baseline, printing a line for each metric.
+ * \param[in] baseline The metrics of the baseline.
+ * \param[in,out] results The metrics of the results.
+ * \returns The number of metrics that have regressed or are missing.
+ */
+int compare(const struct metric_set* baseline,struct metric_set* results){
+	double latency=get_tolerance(baseline,"latency",DEFAULT_LATENCY_TOLERANCE);
+	double throughput=get_tolerance(baseline,"throughput",DEFAULT_THROUGHPUT_TOLERANCE);
+	double floor_ns=get_tolerance(baseline,"latency_floor_ns",DEFAULT_LATENCY_FLOOR_NS);
+	double base,current,change,tolerance;
+	struct metric* metric;
+	const char* name, *status;
+	int i,checked=0,failed=0;
+	printf("%-40s %14s %14s %9s %8s  %s\n","metric","baseline","current","change","limit","status");
+	for(i=0;i<baseline->num;i++){
+		if(strncmp(baseline->metrics[i].name,"metrics.",8)!=0){
+			continue;
+		}
+		name=baseline->metrics[i].name+8;
+		base=baseline->metrics[i].values[0];
+		metric=find_metric(results,name);
+		checked++;
+		if(metric==NULL){
+			printf("%-40s %14.0f %14s %9s %8s  %s\n",name,base,"-","-","-","MISSING");
+			failed++;
+			continue;
+		}
+		current=metric_median(metric);
+		change=(base!=0) ? (current-base)/base : 0;
+		if(ends_with(name,"_per_s")){
+			tolerance=get_tolerance(baseline,name,throughput);
+			status=(current<base*(1-tolerance)) ? "REGRESSED" : "ok";
+			printf("%-40s %14.0f %14.0f %+8.1f%% %+7.0f%%  %s\n",name,base,current,change*100,-tolerance*100,status);
+		} else if(ends_with(name,"_ns")){
+			tolerance=get_tolerance(baseline,name,latency);
+			status=(current>base*(1+tolerance) && current-base>floor_ns) ? "REGRESSED" : "ok";
+			printf("%-40s %14.0f %14.0f %+8.1f%% %+7.0f%%  %s\n",name,base,current,change*100,tolerance*100,status);
+		} else {
+			printf("%-40s %14.0f %14.0f %+8.1f%% %8s  %s\n",name,base,current,change*100,"-","unchecked");
+			continue;
+		}
+		if(strcmp(status,"ok")!=0){
+			failed++;
+		}
+	}
+	printf("bench-compare: %d metrics, %d regressed or missing\n",checked,failed);
+	return failed;
+}
+
+/** \brief Writes a new baseline with the median of the results.
+ * \param[in] pathname The pathname of the new baseline.
+ * \param[in] baseline The previous baseline, whose metrics and tolerances are kept, can be empty.
+ * \param[in,out] results The metrics of the results.
+ * \returns 0, or -1 on error after printing a message.
+ *
+ * Without a previous baseline the latency percentiles and the throughputs are written, with the default tolerances.
+ */
+int write_baseline(const char* pathname,const struct metric_set* baseline,struct metric_set* results){
+	struct metric* metric;
+	const char* name;
+	FILE* out;
+	int i,j,first=1,keep;
+	out=fopen(pathname,"w");
+	if(out==NULL){
+		fprintf(stderr,"can't create %s: %s\n",pathname,strerror(errno));
+		return -1;
+	}
+	fprintf(out,"{\n\t\"tolerance\":{");
+	if(find_metric(baseline,"tolerance.latency")==NULL){
+		fprintf(out,"\"latency\":%g,\"throughput\":%g,\"latency_floor_ns\":%d",DEFAULT_LATENCY_TOLERANCE,
+			DEFAULT_THROUGHPUT_TOLERANCE,DEFAULT_LATENCY_FLOOR_NS);
+	} else {
+		for(i=0;i<baseline->num;i++){
+			if(strncmp(baseline->metrics[i].name,"tolerance.",10)==0){
+				fprintf(out,"%s\"%s\":%g",(first) ? "" : ",",baseline->metrics[i].name+10,baseline->metrics[i].values[0]);
+				first=0;
+			}
+		}
+	}
+	fprintf(out,"},\n\t\"metrics\":{");
+	first=1;
+	for(i=0;i<results->num;i++){
+		name=results->metrics[i].name;
+		if(baseline->num>0){
+			keep=0;
+			for(j=0;j<baseline->num && !keep;j++){
+				keep=strncmp(baseline->metrics[j].name,"metrics.",8)==0 && strcmp(baseline->metrics[j].name+8,name)==0;
+			}
+		} else {
+			keep=0;
+			for(j=0;baseline_suffixes[j]!=NULL && !keep;j++){
+				keep=ends_with(name,baseline_suffixes[j]);
+			}
+		}
+		if(!keep){
+			continue;
+		}
+		metric=&(results->metrics[i]);
+		fprintf(out,"%s\n\t\t\"%s\":%.0f",(first) ? "" : ",",name,metric_median(metric));
+		first=0;
+	}
+	fprintf(out,"\n\t}\n}\n");
+	if(fclose(out)!=0){
+		fprintf(stderr,"can't write %s: %s\n",pathname,strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/** \brief Prints the usage of the tool.
+ * \param[in] name The name of the program.
+ */
+void usage(const char* name){
+	printf("usage: %s [-w new baseline] baseline results...\n",name);
+	printf("  -w  write a new baseline with the median of the results, keeping the metrics and tolerances of the baseline\n");
+	printf("  the results are the JSON outputs of the benchmarks, named [configuration]-[run].json\n");
+}
+
+int main(int argc, char** argv){
+	struct metric_set baseline={0}, results={0};
+	char label[METRIC_NAME_MAX];
+	const char* update=NULL;
+	int i,opt,res=EXIT_SUCCESS;
+	while((opt=getopt(argc,argv,"w:h"))!=-1){
+		switch(opt){
+			case 'w':
+				update=optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if(argc-optind<2){
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	//a missing baseline is created from scratch
+	if(access(argv[optind],F_OK)!=0 && update==NULL){
+		fprintf(stderr,"%s does not exist, create it with the bench-baseline target\n",argv[optind]);
+		return EXIT_FAILURE;
+	}
+	if(access(argv[optind],F_OK)==0 && read_metrics(argv[optind],"",&baseline)<0){
+		return EXIT_FAILURE;
+	}
+	for(i=optind+1;i<argc;i++){
+		results_label(argv[i],label,sizeof(label));
+		if(read_metrics(argv[i],label,&results)<0){
+			res=EXIT_FAILURE;
+			break;
+		}
+	}
+	if(res==EXIT_SUCCESS){
+		if(update!=NULL){
+			res=(write_baseline(update,&baseline,&results)<0) ? EXIT_FAILURE : EXIT_SUCCESS;
+		} else {
+			res=(compare(&baseline,&results)>0) ? EXIT_FAILURE : EXIT_SUCCESS;
+		}
+	}
+	free_metrics(&baseline);
+	free_metrics(&results);
+	return res;
+}
@@ -0,0 +1,104 @@
+/** \file
+ * \brief Implementation of the latency histograms.
+ *
+ * The values below ::HIST_SUB_COUNT have a bucket each, the others are shifted right until they fit in
+ * [::HIST_HALF_COUNT,::HIST_SUB_COUNT), and the bucket is given by the shift and the shifted value.
+ */
+#include <string.h>
+
+#include "latency_hist.h"
+
+///The highest value that can be recorded.
+#define HIST_MAX_VALUE ((UINT64_C(1)<<HIST_MAX_BITS)-1)
+
+/** \brief Returns the bucket of a value.
+ * \param[in] value The value, at most ::HIST_MAX_VALUE.
+ */
+int hist_bucket(uint64_t value){
+	int shift;
+	if(value<HIST_SUB_COUNT){
+		return value;
+	}
+	//the shift that leaves HIST_SUB_BITS significant bits
+	shift=63-__builtin_clzll(value)-(HIST_SUB_BITS-1);
+	return HIST_SUB_COUNT+(shift-1)*HIST_HALF_COUNT+(int)((value>>shift)-HIST_HALF_COUNT);
+}
+
+/** \brief Returns the highest value recorded in a bucket.
+ * \param[in] bucket The bucket.
+ */
+uint64_t hist_bucket_value(int bucket){
+	int shift;
+	uint64_t sub;
+	if(bucket<HIST_SUB_COUNT){
+		return bucket;
+	}
+	shift=(bucket-HIST_SUB_COUNT)/HIST_HALF_COUNT+1;
+	sub=(bucket-HIST_SUB_COUNT)%HIST_HALF_COUNT+HIST_HALF_COUNT;
+	return ((sub+1)<<shift)-1;
+}
+
+void hist_init(struct latency_hist* hist){
+	memset(hist,0,sizeof(struct latency_hist));
+	hist->min=UINT64_MAX;
+}
+
+void hist_record(struct latency_hist* hist,uint64_t value){
+	if(value>HIST_MAX_VALUE){
+		value=HIST_MAX_VALUE;
+	}
+	hist->counts[hist_bucket(value)]++;
+	hist->count++;
+	hist->sum+=value;
+	if(value<hist->min){
+		hist->min=value;
+	}
+	if(value>hist->max){
+		hist->max=value;
+	}
+}
+
+void hist_merge(struct latency_hist* dst,const struct latency_hist* src){
+	int i;
+	for(i=0;i<HIST_BUCKETS;i++){
+		dst->counts[i]+=src->counts[i];
+	}
+	dst->count+=src->count;
+	dst->sum+=src->sum;
+	if(src->min<dst->min){
+		dst->min=src->min;
+	}
+	if(src->max>dst->max){
+		dst->max=src->max;
+	}
+}
+
+/**
+ * The percentile is the first bucket in which the cumulative count reaches `percentile` percent of the values.
+ */
+uint64_t hist_percentile(const struct latency_hist* hist,double percentile){
+	uint64_t target,seen=0,value;
+	int i;
+	if(hist->count==0){
+		return 0;
+	}
+	if(percentile>100){
+		percentile=100;
+	}
+	target=(uint64_t)(percentile/100*hist->count+0.5);
+	if(target==0){
+		target=1;
+	}
+	for(i=0;i<HIST_BUCKETS;i++){
+		seen+=hist->counts[i];
+		if(seen>=target){
+			value=hist_bucket_value(i);
+			return (value>hist->max) ? hist->max : value;
+		}
+	}
+	return hist->max;
+}
+
+double hist_mean(const struct latency_hist* hist){
+	return (hist->count==0) ? 0 : hist->sum/hist->count;
+}
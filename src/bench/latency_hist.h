@@ -0,0 +1,74 @@
+/** \file
+ * \brief Latency histograms with HdrHistogram-style buckets, used by the benchmarks.
+ *
+ * The values, in nanoseconds, are recorded in log-linear buckets: each power of two is split in ::HIST_HALF_COUNT
+ * linear sub-buckets, so every value is reported with a relative error below 1/::HIST_HALF_COUNT and the histogram has a
+ * fixed size, independent of the number of recorded values.
+ */
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+
+///The number of bits of the linear sub-buckets.
+#define HIST_SUB_BITS 7
+
+///The number of values recorded exactly, before the first power of two split in sub-buckets.
+#define HIST_SUB_COUNT (1<<HIST_SUB_BITS)
+
+///The number of sub-buckets of each power of two.
+#define HIST_HALF_COUNT (HIST_SUB_COUNT/2)
+
+///The base 2 logarithm of the highest value that can be recorded, higher values are clamped.
+#define HIST_MAX_BITS 40
+
+///The number of buckets of a histogram.
+#define HIST_BUCKETS (HIST_SUB_COUNT+(HIST_MAX_BITS-HIST_SUB_BITS)*HIST_HALF_COUNT)
+
+/**
+ * \struct latency_hist
+ * \brief A latency histogram.
+ * \param counts The number of values recorded in each bucket.
+ * \param count The number of recorded values.
+ * \param min The lowest recorded value.
+ * \param max The highest recorded value.
+ * \param sum The sum of the recorded values, used for the mean.
+ */
+struct latency_hist{
+	uint64_t counts[HIST_BUCKETS];
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	double sum;
+};
+
+/** \brief Initializes an empty histogram.
+ * \param[out] hist The histogram.
+ */
+void hist_init(struct latency_hist* hist);
+
+/** \brief Records a value in a histogram.
+ * \param[in,out] hist The histogram.
+ * \param[in] value The value, in nanoseconds.
+ */
+void hist_record(struct latency_hist* hist,uint64_t value);
+
+/** \brief Adds the values of a histogram to another one.
+ * \param[in,out] dst The histogram that receives the values.
+ * \param[in] src The histogram whose values are added.
+ */
+void hist_merge(struct latency_hist* dst,const struct latency_hist* src);
+
+/** \brief Computes a percentile of the recorded values.
+ * \param[in] hist The histogram.
+ * \param[in] percentile The percentile, in [0,100].
+ * \returns The highest value equivalent to the percentile, clamped to the recorded maximum, or 0 if the histogram is empty.
+ */
+uint64_t hist_percentile(const struct latency_hist* hist,double percentile);
+
+/** \brief Computes the mean of the recorded values.
+ * \param[in] hist The histogram.
+ * \returns The mean, or 0 if the histogram is empty.
+ */
+double hist_mean(const struct latency_hist* hist);
+#endif
@@ -0,0 +1,95 @@
+/** \file
+ * \brief Implementation of the reader of the binary traces.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "session_trace.h"
+
+///The number of records read with each `fread()`.
+#define READ_BATCH 1024
+
+/** \brief Returns whether a record has a known version and operation.
+ * \param[in] record The record.
+ */
+int valid_record(const struct sess_record* record){
+	return record->version==RECORD_VERSION && (record->op==RECORD_OPEN || record->op==RECORD_CLOSE);
+}
+
+int is_session_trace(const char* pathname){
+	struct sess_record record;
+	FILE* in=fopen(pathname,"rb");
+	int res;
+	if(in==NULL){
+		return 0;
+	}
+	//the version and operation bytes are never both valid in a text trace
+	res=fread(&record,sizeof(struct sess_record),1,in)==1 && valid_record(&record);
+	fclose(in);
+	return res;
+}
+
+int read_session_trace(const char* pathname,struct session_trace* trace){
+	struct sess_record* records;
+	size_t read,i;
+	FILE* in;
+	in=fopen(pathname,"rb");
+	if(in==NULL){
+		fprintf(stderr,"can't open %s: %s\n",pathname,strerror(errno));
+		return -1;
+	}
+	do{
+		if(trace->size-trace->num<READ_BATCH){
+			records=realloc(trace->records,sizeof(struct sess_record)*(trace->size*2+READ_BATCH));
+			if(records==NULL){
+				fprintf(stderr,"not enough memory to read %s\n",pathname);
+				fclose(in);
+				return -1;
+			}
+			trace->records=records;
+			trace->size=trace->size*2+READ_BATCH;
+		}
+		read=fread(trace->records+trace->num,sizeof(struct sess_record),READ_BATCH,in);
+		for(i=0;i<read;i++){
+			if(valid_record(&(trace->records[trace->num]))){
+				trace->num++;
+			} else {
+				trace->skipped++;
+				memmove(trace->records+trace->num,trace->records+trace->num+1,sizeof(struct sess_record)*(read-i-1));
+			}
+		}
+	} while(read==READ_BATCH);
+	if(ferror(in)){
+		fprintf(stderr,"can't read %s\n",pathname);
+		fclose(in);
+		return -1;
+	}
+	fclose(in);
+	return 0;
+}
+
+/** \brief Compares two records by timestamp, for `qsort()`.
+ * \param[in] a The first record.
+ * \param[in] b The second record.
+ * \returns A negative, zero or positive value.
+ *
+ * An open precedes a close with the same timestamp, so that the close of an incarnation is never sorted before its open.
+ */
+int compare_records(const void* a,const void* b){
+	const struct sess_record* ra=a, *rb=b;
+	if(ra->ts_ns!=rb->ts_ns){
+		return (ra->ts_ns<rb->ts_ns) ? -1 : 1;
+	}
+	return (int)ra->op-(int)rb->op;
+}
+
+void sort_session_trace(struct session_trace* trace){
+	qsort(trace->records,trace->num,sizeof(struct sess_record),compare_records);
+}
+
+void free_session_trace(struct session_trace* trace){
+	free(trace->records);
+	memset(trace,0,sizeof(struct session_trace));
+}
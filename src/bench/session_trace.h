@@ -0,0 +1,52 @@
+/** \file
+ * \brief Reader of the binary traces of the session operations, recorded by the module, used by the replay tools.
+ *
+ * A trace is a sequence of `::sess_record`(s), as read from the `record[cpu]` files of the module in debugfs; the
+ * files of the CPUs can be concatenated or given separately, since the records are sorted by timestamp after reading.
+ */
+#ifndef SESSION_TRACE_H
+#define SESSION_TRACE_H
+
+#include "../kmodule/sessionfs_record.h"
+
+/**
+ * \struct session_trace
+ * \brief The records of a trace.
+ * \param records The records, sorted by timestamp by `sort_session_trace()`.
+ * \param num The number of records.
+ * \param size The allocated records.
+ * \param skipped The records skipped because of an unknown version or operation.
+ */
+struct session_trace{
+	struct sess_record* records;
+	long num;
+	long size;
+	long skipped;
+};
+
+/** \brief Returns whether a file starts with a recorded operation, to tell a binary trace from a text one.
+ * \param[in] pathname The pathname of the file.
+ * \returns 1 if the file is a binary trace, 0 otherwise.
+ */
+int is_session_trace(const char* pathname);
+
+/** \brief Appends the records of a file to a trace.
+ * \param[in] pathname The pathname of the file.
+ * \param[in,out] trace The trace, zeroed before the first call.
+ * \returns 0 or -1 on error, after printing a message.
+ *
+ * A truncated record at the end of the file is ignored.
+ */
+int read_session_trace(const char* pathname,struct session_trace* trace);
+
+/** \brief Sorts the records of a trace by timestamp, the opens before the closes with the same timestamp.
+ * \param[in,out] trace The trace.
+ */
+void sort_session_trace(struct session_trace* trace);
+
+/** \brief Frees the records of a trace.
+ * \param[in,out] trace The trace.
+ */
+void free_session_trace(struct session_trace* trace);
+
+#endif
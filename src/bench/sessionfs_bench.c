@@ -0,0 +1,422 @@
+/** \file
+ * \brief Latency benchmark of the session operations.
+ *
+ * Each thread opens a file with the ::O_SESS flag, reads its first block, writes a block and closes it, in a loop, and
+ * the latency of each of the four operations is recorded separately in a `::latency_hist`.
+ * The files are created, with the requested size, before the measures, in a directory that must be a session root.
+ * The percentiles are printed as a human-readable table, as JSON or as CSV.
+ *
+ * The benchmark needs the SessionFS kernel module and must be linked with libsessionfs, which wraps `open`; `close`
+ * commits the session, since the incarnation file is released.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "../shared_lib/libsessionfs.h"
+#include "latency_hist.h"
+
+///Default directory of the benchmark files, the default session root of the module.
+#define DEFAULT_DIR "/mnt"
+
+///Default size of the benchmark files.
+#define DEFAULT_FILE_SIZE 4096
+
+///Default size of the block that is read and written.
+#define DEFAULT_BLOCK_SIZE 4096
+
+///Default number of threads.
+#define DEFAULT_THREADS 1
+
+///Default number of sessions opened by each thread.
+#define DEFAULT_ITERATIONS 1000
+
+///Permissions of the benchmark files.
+#define DEFAULT_PERM 0644
+
+/** \enum bench_op
+ * \brief The measured operations.
+ */
+enum bench_op{
+	OP_OPEN,	///< `open` with the ::O_SESS flag, which copies the original file over the incarnation.
+	OP_READ,	///< The read of the first block of the incarnation.
+	OP_WRITE,	///< The write of a block at the start of the incarnation.
+	OP_CLOSE,	///< `close`, which commits the incarnation over the original file.
+	OP_NUM		///< Number of measured operations.
+};
+
+///Names of the measured operations, indexed by `::bench_op`.
+const char* op_names[OP_NUM]={"open","read","write","close"};
+
+/** \enum bench_format
+ * \brief The output formats.
+ */
+enum bench_format{
+	FORMAT_TEXT,	///< A human-readable table, in microseconds.
+	FORMAT_JSON,	///< A JSON object, in nanoseconds.
+	FORMAT_CSV	///< A CSV table, in nanoseconds.
+};
+
+/**
+ * \struct bench_config
+ * \brief The parameters of the benchmark.
+ * \param dir The directory of the benchmark files.
+ * \param file_size The size of the benchmark files.
+ * \param block_size The size of the block that is read and written.
+ * \param threads The number of threads.
+ * \param iterations The number of sessions opened by each thread.
+ * \param shared Non-zero if all the threads use the same file, to measure the contention on a single session.
+ * \param format The output format.
+ */
+struct bench_config{
+	const char* dir;
+	long file_size;
+	long block_size;
+	int threads;
+	long iterations;
+	int shared;
+	enum bench_format format;
+};
+
+/**
+ * \struct bench_thread
+ * \brief The state of a benchmark thread.
+ * \param config The parameters of the benchmark.
+ * \param thread The pthread that runs the loop.
+ * \param tid The thread number.
+ * \param pathname The file used by the thread.
+ * \param hist The latency of each operation.
+ * \param error The `errno` of the first failed operation, 0 if there are none.
+ * \param failed_op The operation that has failed.
+ */
+struct bench_thread{
+	const struct bench_config* config;
+	pthread_t thread;
+	int tid;
+	char pathname[PATH_MAX];
+	struct latency_hist hist[OP_NUM];
+	int error;
+	enum bench_op failed_op;
+};
+
+/** \brief Returns the current time of the monotonic clock, in nanoseconds.
+ */
+uint64_t now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+/** \brief Creates a benchmark file, without the session semantic.
+ * \param[in] pathname The pathname of the file.
+ * \param[in] size The size of the file.
+ * \returns 0 on success or -1, setting `errno`.
+ */
+int create_file(const char* pathname,long size){
+	char buf[DEFAULT_BLOCK_SIZE];
+	long written=0;
+	ssize_t res;
+	int fd;
+	fd=open(pathname,O_CREAT | O_TRUNC | O_WRONLY,DEFAULT_PERM);
+	if(fd<0){
+		return -1;
+	}
+	memset(buf,'a',sizeof(buf));
+	while(written<size){
+		res=write(fd,buf,(size-written<(long)sizeof(buf)) ? size-written : (long)sizeof(buf));
+		if(res<0){
+			close(fd);
+			return -1;
+		}
+		written+=res;
+	}
+	return close(fd);
+}
+
+/** \brief Records the latency of an operation that has started at `start`.
+ * \param[in,out] t The thread state.
+ * \param[in] op The operation.
+ * \param[in] start The start of the operation, from `now_ns()`.
+ */
+void record_op(struct bench_thread* t,enum bench_op op,uint64_t start){
+	hist_record(&(t->hist[op]),now_ns()-start);
+}
+
+/** \brief Body of a benchmark thread.
+ * \param[in,out] arg The `::bench_thread` of the thread.
+ * \returns `NULL`, the errors are saved in the `::bench_thread`.
+ *
+ * The loop stops at the first failed operation.
+ */
+void* bench_thread_fn(void* arg){
+	struct bench_thread* t=arg;
+	const struct bench_config* config=t->config;
+	char* buf;
+	uint64_t start;
+	long i;
+	int fd;
+	buf=malloc(config->block_size);
+	if(buf==NULL){
+		t->error=ENOMEM;
+		t->failed_op=OP_OPEN;
+		return NULL;
+	}
+	memset(buf,'b',config->block_size);
+	for(i=0;i<config->iterations;i++){
+		start=now_ns();
+		fd=open(t->pathname,O_RDWR | O_SESS);
+		if(fd<0){
+			t->error=errno;
+			t->failed_op=OP_OPEN;
+			break;
+		}
+		record_op(t,OP_OPEN,start);
+		start=now_ns();
+		if(pread(fd,buf,config->block_size,0)<0){
+			t->error=errno;
+			t->failed_op=OP_READ;
+			close(fd);
+			break;
+		}
+		record_op(t,OP_READ,start);
+		start=now_ns();
+		if(pwrite(fd,buf,config->block_size,0)<0){
+			t->error=errno;
+			t->failed_op=OP_WRITE;
+			close(fd);
+			break;
+		}
+		record_op(t,OP_WRITE,start);
+		start=now_ns();
+		if(close(fd)<0){
+			t->error=errno;
+			t->failed_op=OP_CLOSE;
+			break;
+		}
+		record_op(t,OP_CLOSE,start);
+	}
+	free(buf);
+	return NULL;
+}
+
+/** \brief Prints the results as a table, in microseconds.
+ * \param[in] config The parameters of the benchmark.
+ * \param[in] hist The merged latency of each operation.
+ * \param[in] elapsed The duration of the benchmark, in nanoseconds.
+ */
+void print_text(const struct bench_config* config,const struct latency_hist* hist,uint64_t elapsed){
+	int i;
+	printf("sessionfs-bench: dir %s, file size %ld, block size %ld, threads %d%s, iterations %ld, %.0f sessions/s\n",
+		config->dir,config->file_size,config->block_size,config->threads,(config->shared) ? " (shared file)" : "",
+		config->iterations,(elapsed>0) ? hist[OP_CLOSE].count*1e9/elapsed : 0);
+	printf("%-6s %10s %10s %10s %10s %10s %10s %10s\n","op","count","min us","mean us","p50 us","p99 us","p999 us","max us");
+	for(i=0;i<OP_NUM;i++){
+		printf("%-6s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",op_names[i],(unsigned long long)hist[i].count,
+			(hist[i].count>0) ? hist[i].min/1e3 : 0,hist_mean(&hist[i])/1e3,hist_percentile(&hist[i],50)/1e3,
+			hist_percentile(&hist[i],99)/1e3,hist_percentile(&hist[i],99.9)/1e3,hist[i].max/1e3);
+	}
+}
+
+/** \brief Prints a string as a JSON string.
+ * \param[in] str The string.
+ */
+void print_json_string(const char* str){
+	putchar('"');
+	for(;*str!='\0';str++){
+		if(*str=='"' || *str=='\\'){
+			putchar('\\');
+		}
+		putchar(*str);
+	}
+	putchar('"');
+}
+
+/** \brief Prints the results as a JSON object, in nanoseconds.
+ * \param[in] config The parameters of the benchmark.
+ * \param[in] hist The merged latency of each operation.
+ * \param[in] elapsed The duration of the benchmark, in nanoseconds.
+ */
+void print_json(const struct bench_config* config,const struct latency_hist* hist,uint64_t elapsed){
+	int i;
+	printf("{\"config\":{\"dir\":");
+	print_json_string(config->dir);
+	printf(",\"file_size\":%ld,\"block_size\":%ld,\"threads\":%d,\"shared\":%s,\"iterations\":%ld},",config->file_size,
+		config->block_size,config->threads,(config->shared) ? "true" : "false",config->iterations);
+	printf("\"elapsed_ns\":%llu,\"sessions_per_s\":%.0f,\"results\":{",(unsigned long long)elapsed,
+		(elapsed>0) ? hist[OP_CLOSE].count*1e9/elapsed : 0);
+	for(i=0;i<OP_NUM;i++){
+		printf("%s\"%s\":{\"count\":%llu,\"min_ns\":%llu,\"mean_ns\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+			(i>0) ? "," : "",op_names[i],(unsigned long long)hist[i].count,(unsigned long long)((hist[i].count>0) ? hist[i].min : 0),
+			hist_mean(&hist[i]),(unsigned long long)hist_percentile(&hist[i],50),(unsigned long long)hist_percentile(&hist[i],99),
+			(unsigned long long)hist_percentile(&hist[i],99.9),(unsigned long long)hist[i].max);
+	}
+	printf("}}\n");
+}
+
+/** \brief Prints the results as a CSV table, in nanoseconds.
+ * \param[in] config The parameters of the benchmark.
+ * \param[in] hist The merged latency of each operation.
+ */
+void print_csv(const struct bench_config* config,const struct latency_hist* hist){
+	int i;
+	printf("op,file_size,block_size,threads,shared,iterations,count,min_ns,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+	for(i=0;i<OP_NUM;i++){
+		printf("%s,%ld,%ld,%d,%d,%ld,%llu,%llu,%.0f,%llu,%llu,%llu,%llu\n",op_names[i],config->file_size,config->block_size,
+			config->threads,config->shared,config->iterations,(unsigned long long)hist[i].count,
+			(unsigned long long)((hist[i].count>0) ? hist[i].min : 0),hist_mean(&hist[i]),
+			(unsigned long long)hist_percentile(&hist[i],50),(unsigned long long)hist_percentile(&hist[i],99),
+			(unsigned long long)hist_percentile(&hist[i],99.9),(unsigned long long)hist[i].max);
+	}
+}
+
+/** \brief Prints the usage of the benchmark.
+ * \param[in] name The name of the program.
+ */
+void usage(const char* name){
+	printf("usage: %s [-d dir] [-s file size] [-b block size] [-t threads] [-i iterations] [-S] [-f text|json|csv]\n",name);
+	printf("  -d  directory of the benchmark files, must be a session root (default %s)\n",DEFAULT_DIR);
+	printf("  -s  size of the benchmark files in bytes (default %d)\n",DEFAULT_FILE_SIZE);
+	printf("  -b  size of the block read and written in each session (default %d)\n",DEFAULT_BLOCK_SIZE);
+	printf("  -t  number of threads (default %d)\n",DEFAULT_THREADS);
+	printf("  -i  number of sessions opened by each thread (default %d)\n",DEFAULT_ITERATIONS);
+	printf("  -S  all the threads open the same file\n");
+	printf("  -f  output format (default text)\n");
+}
+
+/** \brief Parses the command line.
+ * \param[in] argc The number of arguments.
+ * \param[in] argv The arguments.
+ * \param[out] config The parameters of the benchmark.
+ * \returns 0 on success or -1 if the arguments are invalid.
+ */
+int parse_args(int argc,char** argv,struct bench_config* config){
+	int opt;
+	config->dir=DEFAULT_DIR;
+	config->file_size=DEFAULT_FILE_SIZE;
+	config->block_size=DEFAULT_BLOCK_SIZE;
+	config->threads=DEFAULT_THREADS;
+	config->iterations=DEFAULT_ITERATIONS;
+	config->shared=0;
+	config->format=FORMAT_TEXT;
+	while((opt=getopt(argc,argv,"d:s:b:t:i:Sf:h"))!=-1){
+		switch(opt){
+			case 'd':
+				config->dir=optarg;
+				break;
+			case 's':
+				config->file_size=atol(optarg);
+				break;
+			case 'b':
+				config->block_size=atol(optarg);
+				break;
+			case 't':
+				config->threads=atoi(optarg);
+				break;
+			case 'i':
+				config->iterations=atol(optarg);
+				break;
+			case 'S':
+				config->shared=1;
+				break;
+			case 'f':
+				if(strcmp(optarg,"text")==0){
+					config->format=FORMAT_TEXT;
+				} else if(strcmp(optarg,"json")==0){
+					config->format=FORMAT_JSON;
+				} else if(strcmp(optarg,"csv")==0){
+					config->format=FORMAT_CSV;
+				} else {
+					return -1;
+				}
+				break;
+			default:
+				return -1;
+		}
+	}
+	if(config->file_size<0 || config->block_size<=0 || config->threads<=0 || config->iterations<=0 || optind<argc){
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv){
+	struct bench_config config;
+	struct bench_thread* threads;
+	struct latency_hist hist[OP_NUM];
+	uint64_t start,elapsed;
+	int i,j,created,res=EXIT_SUCCESS;
+	if(parse_args(argc,argv,&config)<0){
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	threads=calloc(config.threads,sizeof(struct bench_thread));
+	if(threads==NULL){
+		perror("can't allocate the threads");
+		return EXIT_FAILURE;
+	}
+	//we create the files before starting the measures
+	for(i=0;i<config.threads;i++){
+		threads[i].config=&config;
+		threads[i].tid=i;
+		for(j=0;j<OP_NUM;j++){
+			hist_init(&(threads[i].hist[j]));
+		}
+		snprintf(threads[i].pathname,PATH_MAX,"%s/sessionfs-bench-%d-%d",config.dir,getpid(),(config.shared) ? 0 : i);
+		if((i==0 || !config.shared) && create_file(threads[i].pathname,config.file_size)<0){
+			fprintf(stderr,"can't create %s: %s\n",threads[i].pathname,strerror(errno));
+			for(j=0;j<i;j++){
+				unlink(threads[j].pathname);
+			}
+			free(threads);
+			return EXIT_FAILURE;
+		}
+	}
+	start=now_ns();
+	for(created=0;created<config.threads;created++){
+		if(pthread_create(&(threads[created].thread),NULL,bench_thread_fn,&threads[created])!=0){
+			fprintf(stderr,"can't create thread %d\n",created);
+			res=EXIT_FAILURE;
+			break;
+		}
+	}
+	for(i=0;i<created;i++){
+		pthread_join(threads[i].thread,NULL);
+	}
+	elapsed=now_ns()-start;
+	for(j=0;j<OP_NUM;j++){
+		hist_init(&hist[j]);
+	}
+	for(i=0;i<config.threads;i++){
+		if(threads[i].error!=0){
+			fprintf(stderr,"thread %d: %s failed: %s\n",i,op_names[threads[i].failed_op],strerror(threads[i].error));
+			res=EXIT_FAILURE;
+		}
+		for(j=0;j<OP_NUM;j++){
+			hist_merge(&hist[j],&(threads[i].hist[j]));
+		}
+		if(i==0 || !config.shared){
+			unlink(threads[i].pathname);
+		}
+	}
+	switch(config.format){
+		case FORMAT_TEXT:
+			print_text(&config,hist,elapsed);
+			break;
+		case FORMAT_JSON:
+			print_json(&config,hist,elapsed);
+			break;
+		case FORMAT_CSV:
+			print_csv(&config,hist);
+			break;
+	}
+	free(threads);
+	return res;
+}
@@ -0,0 +1,709 @@
+/** \file
+ * \brief Replays a binary trace of session operations, recorded by the module, against a scratch directory.
+ *
+ * Each original file of the trace is replaced by a file in the scratch directory, created with the size of the file
+ * when it was first opened in the trace; the pathnames of the trace are hashed, so the files are named after their index.
+ * Each incarnation is opened with the ::O_SESS flag at the time of its open record and closed at the time of its close
+ * record, scaled by the replay speed: before the close its size is set to the size that the incarnation had in the trace,
+ * so the commit copies as many bytes as it did when recorded.
+ *
+ * The records of each process are replayed in order by the same thread, the processes are spread over the threads.
+ * The latency of the replayed opens and closes is compared with the latency recorded in the trace, and the delay of each
+ * operation from its scheduled time is reported too, since a replay that can't keep up with the trace is not faithful.
+ *
+ * The tool needs the SessionFS kernel module and must be linked with libsessionfs, which wraps `open`.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "../shared_lib/libsessionfs.h"
+#include "latency_hist.h"
+#include "session_trace.h"
+
+///Default scratch directory, the default session root of the module.
+#define DEFAULT_DIR "/mnt"
+
+///Default number of threads.
+#define DEFAULT_THREADS 1
+
+///Default replay speed, the speed of the trace.
+#define DEFAULT_SPEED 1.0
+
+///Permissions of the scratch files.
+#define DEFAULT_PERM 0644
+
+///Size of the buffer used to fill the files.
+#define FILL_BLOCK_SIZE 65536
+
+/** \enum replay_stat
+ * \brief The reported latencies.
+ */
+enum replay_stat{
+	STAT_OPEN,		///< The replayed `open`, with the ::O_SESS flag.
+	STAT_CLOSE,		///< The replayed `close`, which commits the incarnation.
+	STAT_TRACE_OPEN,	///< The opens, as recorded in the trace.
+	STAT_TRACE_CLOSE,	///< The commits, as recorded in the trace.
+	STAT_LAG,		///< The delay of each operation from its scheduled time.
+	STAT_NUM		///< Number of reported latencies.
+};
+
+///Names of the reported latencies, indexed by `::replay_stat`.
+const char* stat_names[STAT_NUM]={"open","close","trace_open","trace_close","lag"};
+
+/** \enum replay_format
+ * \brief The output formats.
+ */
+enum replay_format{
+	FORMAT_TEXT,	///< A human-readable table, in microseconds.
+	FORMAT_JSON,	///< A JSON object, in nanoseconds.
+	FORMAT_CSV	///< A CSV table, in nanoseconds.
+};
+
+/**
+ * \struct replay_event
+ * \brief An operation of the trace.
+ * \param record The record of the operation.
+ * \param file The original file, an index of the files of the trace.
+ * \param slot The incarnation, an index of the incarnations of the trace.
+ */
+struct replay_event{
+	const struct sess_record* record;
+	int file;
+	int slot;
+};
+
+/**
+ * \struct id_map
+ * \brief Assigns consecutive indexes to the hashes of the trace, with open addressing.
+ * \param keys The hashes.
+ * \param ids The index of each hash plus one, 0 in the empty buckets.
+ * \param size The number of buckets, a power of two.
+ * \param num The number of hashes.
+ */
+struct id_map{
+	uint64_t* keys;
+	int* ids;
+	int size;
+	int num;
+};
+
+/**
+ * \struct replay_config
+ * \brief The parameters of the replay.
+ * \param dir The scratch directory.
+ * \param threads The number of threads.
+ * \param speed The replay speed relative to the trace, 0 replays the operations without waiting.
+ * \param format The output format.
+ * \param traces The pathnames of the trace files.
+ * \param num_traces The number of trace files.
+ */
+struct replay_config{
+	const char* dir;
+	int threads;
+	double speed;
+	enum replay_format format;
+	char** traces;
+	int num_traces;
+};
+
+/**
+ * \struct replay_thread
+ * \brief The state of a replay thread.
+ * \param config The parameters of the replay.
+ * \param thread The pthread that replays the operations.
+ * \param events The operations replayed by the thread, in order.
+ * \param num The number of operations replayed by the thread.
+ * \param size The allocated operations.
+ * \param hist The latencies measured by the thread.
+ * \param errors The number of failed operations.
+ * \param error The `errno` of the first failed operation.
+ */
+struct replay_thread{
+	const struct replay_config* config;
+	pthread_t thread;
+	struct replay_event* events;
+	long num;
+	long size;
+	struct latency_hist hist[STAT_NUM];
+	long errors;
+	int error;
+};
+
+///The file descriptors of the open incarnations, indexed by slot, -1 if the incarnation is closed.
+int* slots=NULL;
+
+///The timestamp of the first record of the trace.
+uint64_t trace_start=0;
+
+///The start of the replay, from `now_ns()`.
+uint64_t replay_start=0;
+
+/** \brief Returns the current time of the monotonic clock, in nanoseconds.
+ */
+uint64_t now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+/** \brief Returns the index of a hash, assigning the next one if requested.
+ * \param[in,out] map The map.
+ * \param[in] key The hash.
+ * \param[in] add If set a new hash gets the next index, otherwise -1 is returned.
+ * \returns The index, or -1 if the hash is not found or there is not enough memory.
+ */
+int map_id(struct id_map* map,uint64_t key,int add){
+	struct id_map grown;
+	int i,pos;
+	if(map->num*2>=map->size){
+		if(!add){
+			//the map is never full when searching, but it could be empty
+			if(map->size==0){
+				return -1;
+			}
+		} else {
+			grown.size=(map->size==0) ? 1024 : map->size*2;
+			grown.num=map->num;
+			grown.keys=calloc(grown.size,sizeof(uint64_t));
+			grown.ids=calloc(grown.size,sizeof(int));
+			if(grown.keys==NULL || grown.ids==NULL){
+				free(grown.keys);
+				free(grown.ids);
+				return -1;
+			}
+			for(i=0;i<map->size;i++){
+				if(map->ids[i]==0){
+					continue;
+				}
+				for(pos=map->keys[i]&(grown.size-1);grown.ids[pos]!=0;pos=(pos+1)&(grown.size-1)){
+				}
+				grown.keys[pos]=map->keys[i];
+				grown.ids[pos]=map->ids[i];
+			}
+			free(map->keys);
+			free(map->ids);
+			*map=grown;
+		}
+	}
+	for(pos=key&(map->size-1);map->ids[pos]!=0;pos=(pos+1)&(map->size-1)){
+		if(map->keys[pos]==key){
+			return map->ids[pos]-1;
+		}
+	}
+	if(!add){
+		return -1;
+	}
+	map->keys[pos]=key;
+	map->ids[pos]=++map->num;
+	return map->ids[pos]-1;
+}
+
+/** \brief Frees a map.
+ * \param[in,out] map The map.
+ */
+void free_map(struct id_map* map){
+	free(map->keys);
+	free(map->ids);
+	memset(map,0,sizeof(struct id_map));
+}
+
+/** \brief Returns the pathname of a scratch file.
+ * \param[in] config The parameters of the replay.
+ * \param[in] file The index of the file.
+ * \param[out] pathname The pathname, ::PATH_MAX bytes long.
+ */
+void file_pathname(const struct replay_config* config,int file,char* pathname){
+	snprintf(pathname,PATH_MAX,"%s/sessionfs-replay-%d-%d",config->dir,getpid(),file);
+}
+
+/** \brief Sets the size of a file, appending data if it grows.
+ * \param[in] fd The file descriptor of the file.
+ * \param[in] size The new size.
+ * \returns 0 on success or -1, setting `errno`.
+ */
+int resize_file(int fd,uint64_t size){
+	static const char buf[FILL_BLOCK_SIZE]={0};
+	struct stat st;
+	uint64_t len;
+	ssize_t res;
+	if(fstat(fd,&st)<0){
+		return -1;
+	}
+	if(size<=(uint64_t)st.st_size){
+		return (size<(uint64_t)st.st_size) ? ftruncate(fd,size) : 0;
+	}
+	for(len=st.st_size;len<size;len+=res){
+		res=pwrite(fd,buf,(size-len<sizeof(buf)) ? size-len : sizeof(buf),len);
+		if(res<0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/** \brief Creates a scratch file, without the session semantic.
+ * \param[in] pathname The pathname of the file.
+ * \param[in] size The size of the file.
+ * \returns 0 on success or -1, setting `errno`.
+ */
+int create_file(const char* pathname,uint64_t size){
+	int fd, res;
+	fd=open(pathname,O_CREAT | O_TRUNC | O_WRONLY,DEFAULT_PERM);
+	if(fd<0){
+		return -1;
+	}
+	res=resize_file(fd,size);
+	if(res<0){
+		res=errno;
+		close(fd);
+		errno=res;
+		return -1;
+	}
+	return close(fd);
+}
+
+/** \brief Waits for the scheduled time of an operation and records the delay.
+ * \param[in,out] t The thread state.
+ * \param[in] record The record of the operation.
+ */
+void wait_record(struct replay_thread* t,const struct sess_record* record){
+	uint64_t target,now;
+	struct timespec ts;
+	if(t->config->speed<=0){
+		return;
+	}
+	target=replay_start+(uint64_t)((record->ts_ns-trace_start)/t->config->speed);
+	now=now_ns();
+	if(now<target){
+		ts.tv_sec=target/1000000000;
+		ts.tv_nsec=target%1000000000;
+		while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL)==EINTR){
+		}
+		now=now_ns();
+	}
+	hist_record(&(t->hist[STAT_LAG]),now-target);
+}
+
+/** \brief Records a failed operation.
+ * \param[in,out] t The thread state.
+ */
+void replay_error(struct replay_thread* t){
+	if(t->errors++==0){
+		t->error=errno;
+	}
+}
+
+/** \brief Body of a replay thread.
+ * \param[in,out] arg The `::replay_thread` of the thread.
+ * \returns `NULL`, the errors are counted in the `::replay_thread`.
+ */
+void* replay_thread_fn(void* arg){
+	struct replay_thread* t=arg;
+	const struct sess_record* record;
+	char pathname[PATH_MAX];
+	uint64_t start;
+	long i;
+	int fd;
+	for(i=0;i<t->num;i++){
+		record=t->events[i].record;
+		wait_record(t,record);
+		if(record->op==RECORD_OPEN){
+			hist_record(&(t->hist[STAT_TRACE_OPEN]),record->latency_ns);
+			file_pathname(t->config,t->events[i].file,pathname);
+			start=now_ns();
+			fd=open(pathname,O_RDWR | O_SESS);
+			if(fd<0){
+				replay_error(t);
+				continue;
+			}
+			hist_record(&(t->hist[STAT_OPEN]),now_ns()-start);
+			slots[t->events[i].slot]=fd;
+		} else {
+			hist_record(&(t->hist[STAT_TRACE_CLOSE]),record->latency_ns);
+			fd=slots[t->events[i].slot];
+			if(fd<0){
+				continue;
+			}
+			slots[t->events[i].slot]=-1;
+			//the data written by the process is replaced by the change of size of the incarnation
+			if(resize_file(fd,record->size)<0){
+				replay_error(t);
+			}
+			start=now_ns();
+			if(close(fd)<0){
+				replay_error(t);
+				continue;
+			}
+			hist_record(&(t->hist[STAT_CLOSE]),now_ns()-start);
+		}
+	}
+	return NULL;
+}
+
+/** \brief Prints the results as a table, in microseconds.
+ * \param[in] config The parameters of the replay.
+ * \param[in] hist The merged latencies.
+ * \param[in] elapsed The duration of the replay, in nanoseconds.
+ * \param[in] errors The number of failed operations.
+ */
+void print_text(const struct replay_config* config,const struct latency_hist* hist,uint64_t elapsed,long errors){
+	int i;
+	printf("sessionfs-replay: dir %s, threads %d, speed %gx, %ld failed operations, %.0f sessions/s\n",config->dir,
+		config->threads,config->speed,errors,(elapsed>0) ? hist[STAT_CLOSE].count*1e9/elapsed : 0);
+	printf("%-12s %10s %10s %10s %10s %10s %10s %10s\n","op","count","min us","mean us","p50 us","p99 us","p999 us","max us");
+	for(i=0;i<STAT_NUM;i++){
+		printf("%-12s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",stat_names[i],(unsigned long long)hist[i].count,
+			(hist[i].count>0) ? hist[i].min/1e3 : 0,hist_mean(&hist[i])/1e3,hist_percentile(&hist[i],50)/1e3,
+			hist_percentile(&hist[i],99)/1e3,hist_percentile(&hist[i],99.9)/1e3,hist[i].max/1e3);
+	}
+}
+
+/** \brief Prints a string as a JSON string.
+ * \param[in] str The string.
+ */
+void print_json_string(const char* str){
+	putchar('"');
+	for(;*str!='\0';str++){
+		if(*str=='"' || *str=='\\'){
+			putchar('\\');
+		}
+		putchar(*str);
+	}
+	putchar('"');
+}
+
+/** \brief Prints the results as a JSON object, in nanoseconds.
+ * \param[in] config The parameters of the replay.
+ * \param[in] hist The merged latencies.
+ * \param[in] elapsed The duration of the replay, in nanoseconds.
+ * \param[in] errors The number of failed operations.
+ */
+void print_json(const struct replay_config* config,const struct latency_hist* hist,uint64_t elapsed,long errors){
+	int i;
+	printf("{\"config\":{\"dir\":");
+	print_json_string(config->dir);
+	printf(",\"threads\":%d,\"speed\":%g},\"elapsed_ns\":%llu,\"sessions_per_s\":%.0f,\"errors\":%ld,\"results\":{",
+		config->threads,config->speed,(unsigned long long)elapsed,(elapsed>0) ? hist[STAT_CLOSE].count*1e9/elapsed : 0,errors);
+	for(i=0;i<STAT_NUM;i++){
+		printf("%s\"%s\":{\"count\":%llu,\"min_ns\":%llu,\"mean_ns\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+			(i>0) ? "," : "",stat_names[i],(unsigned long long)hist[i].count,(unsigned long long)((hist[i].count>0) ? hist[i].min : 0),
+			hist_mean(&hist[i]),(unsigned long long)hist_percentile(&hist[i],50),(unsigned long long)hist_percentile(&hist[i],99),
+			(unsigned long long)hist_percentile(&hist[i],99.9),(unsigned long long)hist[i].max);
+	}
+	printf("}}\n");
+}
+
+/** \brief Prints the results as a CSV table, in nanoseconds.
+ * \param[in] config The parameters of the replay.
+ * \param[in] hist The merged latencies.
+ */
+void print_csv(const struct replay_config* config,const struct latency_hist* hist){
+	int i;
+	printf("op,threads,speed,count,min_ns,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+	for(i=0;i<STAT_NUM;i++){
+		printf("%s,%d,%g,%llu,%llu,%.0f,%llu,%llu,%llu,%llu\n",stat_names[i],config->threads,config->speed,
+			(unsigned long long)hist[i].count,(unsigned long long)((hist[i].count>0) ? hist[i].min : 0),hist_mean(&hist[i]),
+			(unsigned long long)hist_percentile(&hist[i],50),(unsigned long long)hist_percentile(&hist[i],99),
+			(unsigned long long)hist_percentile(&hist[i],99.9),(unsigned long long)hist[i].max);
+	}
+}
+
+/** \brief Prints the usage of the tool.
+ * \param[in] name The name of the program.
+ */
+void usage(const char* name){
+	printf("usage: %s [-d dir] [-t threads] [-x speed] [-f text|json|csv] trace...\n",name);
+	printf("  -d  scratch directory, must be a session root (default %s)\n",DEFAULT_DIR);
+	printf("  -t  number of threads, the processes of the trace are spread over them (default %d)\n",DEFAULT_THREADS);
+	printf("  -x  replay speed relative to the trace, 0 to replay without waiting (default %g)\n",DEFAULT_SPEED);
+	printf("  -f  output format (default text)\n");
+	printf("  the traces are the record files of the module, e.g. /sys/kernel/debug/sessionfs/record0\n");
+}
+
+/** \brief Parses the command line.
+ * \param[in] argc The number of arguments.
+ * \param[in] argv The arguments.
+ * \param[out] config The parameters of the replay.
+ * \returns 0 on success or -1 if the arguments are invalid.
+ */
+int parse_args(int argc,char** argv,struct replay_config* config){
+	int opt;
+	config->dir=DEFAULT_DIR;
+	config->threads=DEFAULT_THREADS;
+	config->speed=DEFAULT_SPEED;
+	config->format=FORMAT_TEXT;
+	while((opt=getopt(argc,argv,"d:t:x:f:h"))!=-1){
+		switch(opt){
+			case 'd':
+				config->dir=optarg;
+				break;
+			case 't':
+				config->threads=atoi(optarg);
+				break;
+			case 'x':
+				config->speed=atof(optarg);
+				break;
+			case 'f':
+				if(strcmp(optarg,"text")==0){
+					config->format=FORMAT_TEXT;
+				} else if(strcmp(optarg,"json")==0){
+					config->format=FORMAT_JSON;
+				} else if(strcmp(optarg,"csv")==0){
+					config->format=FORMAT_CSV;
+				} else {
+					return -1;
+				}
+				break;
+			default:
+				return -1;
+		}
+	}
+	if(config->threads<=0 || config->speed<0 || optind>=argc){
+		return -1;
+	}
+	config->traces=argv+optind;
+	config->num_traces=argc-optind;
+	return 0;
+}
+
+/** \brief Assigns the records of a trace to the threads, mapping the hashes to the scratch files and the incarnations.
+ * \param[in] config The parameters of the replay.
+ * \param[in] trace The sorted trace.
+ * \param[in,out] threads The threads, whose `events` are filled.
+ * \param[out] sizes The size of each scratch file, allocated here.
+ * \param[out] num_files The number of scratch files.
+ * \param[out] num_slots The number of incarnations.
+ * \returns 0 or -1 if there is not enough memory.
+ *
+ * The failed opens are skipped, since the failure can't be reproduced, and so are the closes without a replayed open.
+ */
+int assign_records(const struct replay_config* config,const struct session_trace* trace,struct replay_thread* threads,
+		uint64_t** sizes,int* num_files,int* num_slots){
+	struct id_map files={0}, incarnations={0};
+	struct replay_event event, *events;
+	struct replay_thread* t;
+	uint64_t* grown;
+	pid_t* owners=NULL, *grown_owners;
+	int owners_size=0, sizes_size=0, known, res=0;
+	long i;
+	*sizes=NULL;
+	for(i=0;i<trace->num;i++){
+		event.record=&(trace->records[i]);
+		if(event.record->op==RECORD_OPEN){
+			if(event.record->res<0 || event.record->inc_id==0){
+				continue;
+			}
+			known=files.num;
+			event.file=map_id(&files,event.record->file_id,1);
+			event.slot=map_id(&incarnations,event.record->inc_id,1);
+			if(event.file<0 || event.slot<0){
+				res=-1;
+				break;
+			}
+			if(event.file>=sizes_size){
+				grown=realloc(*sizes,sizeof(uint64_t)*(event.file+1)*2);
+				if(grown==NULL){
+					res=-1;
+					break;
+				}
+				*sizes=grown;
+				sizes_size=(event.file+1)*2;
+			}
+			//the scratch file has the size of the first open of the original file
+			if(files.num>known){
+				(*sizes)[event.file]=event.record->size;
+			}
+			if(event.slot>=owners_size){
+				grown_owners=realloc(owners,sizeof(pid_t)*(event.slot+1)*2);
+				if(grown_owners==NULL){
+					res=-1;
+					break;
+				}
+				owners=grown_owners;
+				owners_size=(event.slot+1)*2;
+			}
+			owners[event.slot]=event.record->pid;
+		} else {
+			event.slot=map_id(&incarnations,event.record->inc_id,0);
+			if(event.slot<0){
+				continue;
+			}
+			event.file=-1;
+		}
+		//the close is replayed by the thread of the open, since the descriptor is owned by it
+		t=&threads[owners[event.slot]%config->threads];
+		if(t->num==t->size){
+			events=realloc(t->events,sizeof(struct replay_event)*((t->size==0) ? 1024 : t->size*2));
+			if(events==NULL){
+				res=-1;
+				break;
+			}
+			t->events=events;
+			t->size=(t->size==0) ? 1024 : t->size*2;
+		}
+		t->events[t->num++]=event;
+	}
+	*num_files=files.num;
+	*num_slots=incarnations.num;
+	free(owners);
+	free_map(&files);
+	free_map(&incarnations);
+	if(res<0){
+		fprintf(stderr,"not enough memory to replay the trace\n");
+	}
+	return res;
+}
+
+/** \brief Removes the scratch files.
+ * \param[in] config The parameters of the replay.
+ * \param[in] num_files The number of files that have been created.
+ */
+void remove_files(const struct replay_config* config,int num_files){
+	char pathname[PATH_MAX];
+	int i;
+	for(i=0;i<num_files;i++){
+		file_pathname(config,i,pathname);
+		unlink(pathname);
+	}
+}
+
+/** \brief Creates the scratch files, replays the trace with the threads and prints the results.
+ * \param[in] config The parameters of the replay.
+ * \param[in,out] threads The threads, with their operations.
+ * \param[in] sizes The size of each scratch file.
+ * \param[in] num_files The number of scratch files.
+ * \param[in] num_slots The number of incarnations.
+ * \param[in] skipped The records of the trace skipped because of an unknown format.
+ * \returns `EXIT_SUCCESS` or `EXIT_FAILURE` if an operation has failed.
+ */
+int replay(const struct replay_config* config,struct replay_thread* threads,const uint64_t* sizes,int num_files,
+		int num_slots,long skipped){
+	struct latency_hist hist[STAT_NUM];
+	char pathname[PATH_MAX];
+	uint64_t elapsed;
+	long errors=0;
+	int i,j,created,res=EXIT_SUCCESS;
+	slots=malloc(sizeof(int)*(num_slots+1));
+	if(slots==NULL){
+		perror("can't allocate the incarnations");
+		return EXIT_FAILURE;
+	}
+	memset(slots,-1,sizeof(int)*(num_slots+1));
+	//we create the files before starting the replay
+	for(i=0;i<num_files;i++){
+		file_pathname(config,i,pathname);
+		if(create_file(pathname,sizes[i])<0){
+			fprintf(stderr,"can't create %s: %s\n",pathname,strerror(errno));
+			remove_files(config,i);
+			free(slots);
+			return EXIT_FAILURE;
+		}
+	}
+	replay_start=now_ns();
+	for(created=0;created<config->threads;created++){
+		threads[created].config=config;
+		for(j=0;j<STAT_NUM;j++){
+			hist_init(&(threads[created].hist[j]));
+		}
+		if(pthread_create(&(threads[created].thread),NULL,replay_thread_fn,&threads[created])!=0){
+			fprintf(stderr,"can't create thread %d\n",created);
+			res=EXIT_FAILURE;
+			break;
+		}
+	}
+	for(i=0;i<created;i++){
+		pthread_join(threads[i].thread,NULL);
+	}
+	elapsed=now_ns()-replay_start;
+	//the incarnations still open at the end of the trace are committed without measuring them
+	for(i=0;i<num_slots;i++){
+		if(slots[i]>=0){
+			close(slots[i]);
+		}
+	}
+	for(j=0;j<STAT_NUM;j++){
+		hist_init(&hist[j]);
+	}
+	for(i=0;i<created;i++){
+		if(threads[i].errors>0){
+			fprintf(stderr,"thread %d: %ld failed operations, the first one with: %s\n",i,threads[i].errors,
+				strerror(threads[i].error));
+			errors+=threads[i].errors;
+			res=EXIT_FAILURE;
+		}
+		for(j=0;j<STAT_NUM;j++){
+			hist_merge(&hist[j],&(threads[i].hist[j]));
+		}
+	}
+	if(skipped>0){
+		fprintf(stderr,"%ld records with an unknown format skipped\n",skipped);
+	}
+	switch(config->format){
+		case FORMAT_TEXT:
+			print_text(config,hist,elapsed,errors);
+			break;
+		case FORMAT_JSON:
+			print_json(config,hist,elapsed,errors);
+			break;
+		case FORMAT_CSV:
+			print_csv(config,hist);
+			break;
+	}
+	remove_files(config,num_files);
+	free(slots);
+	slots=NULL;
+	return res;
+}
+
+int main(int argc, char** argv){
+	struct replay_config config;
+	struct session_trace trace={0};
+	struct replay_thread* threads;
+	uint64_t* sizes=NULL;
+	int i,num_files=0,num_slots=0,res;
+	if(parse_args(argc,argv,&config)<0){
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	for(i=0;i<config.num_traces;i++){
+		if(read_session_trace(config.traces[i],&trace)<0){
+			free_session_trace(&trace);
+			return EXIT_FAILURE;
+		}
+	}
+	if(trace.num==0){
+		fprintf(stderr,"the trace has no records\n");
+		free_session_trace(&trace);
+		return EXIT_FAILURE;
+	}
+	sort_session_trace(&trace);
+	trace_start=trace.records[0].ts_ns;
+	threads=calloc(config.threads,sizeof(struct replay_thread));
+	if(threads==NULL){
+		perror("can't allocate the threads");
+		free_session_trace(&trace);
+		return EXIT_FAILURE;
+	}
+	if(assign_records(&config,&trace,threads,&sizes,&num_files,&num_slots)<0){
+		res=EXIT_FAILURE;
+	} else {
+		res=replay(&config,threads,sizes,num_files,num_slots,trace.skipped);
+	}
+	for(i=0;i<config.threads;i++){
+		free(threads[i].events);
+	}
+	free(threads);
+	free(sizes);
+	free_session_trace(&trace);
+	return res;
+}
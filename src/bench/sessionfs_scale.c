@@ -0,0 +1,596 @@
+/** \file
+ * \brief Scalability harness of the session operations, with multiple processes.
+ *
+ * The harness sweeps every combination of the given numbers of processes, files, incarnations per file and file sizes,
+ * with the files shared by all the processes or disjoint, and with a read-mostly or write-heavy workload.
+ * For each point of the sweep the worker processes, each pinned to a core, open the files with the ::O_SESS flag for a
+ * fixed time: each iteration opens `incarnations` sessions on the same file, reads or writes a block in each of them and
+ * closes them. The latency of `open` and `close`, which take the locks of the session manager, is recorded in a
+ * `::latency_hist` per process, in shared memory, and the throughput is measured in sessions per second.
+ *
+ * The results are printed as a table and can be written, one line per point, in a file that can be plotted with gnuplot.
+ * The harness needs the SessionFS kernel module and must be linked with libsessionfs.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../shared_lib/libsessionfs.h"
+#include "latency_hist.h"
+
+///Default directory of the benchmark files, the default session root of the module.
+#define DEFAULT_DIR "/mnt"
+
+///Default duration of each point of the sweep, in seconds.
+#define DEFAULT_DURATION 2
+
+///Maximum number of values of each swept parameter.
+#define MAX_VALUES 16
+
+///Maximum number of incarnations opened at the same time on a file by a worker.
+#define MAX_INCARNATIONS 64
+
+///Size of the block that is read and written in each session.
+#define BLOCK_SIZE 4096
+
+///In the read-mostly workload one session every `WRITE_RATIO` writes the block.
+#define WRITE_RATIO 10
+
+///Permissions of the benchmark files.
+#define DEFAULT_PERM 0644
+
+/** \enum scale_layout
+ * \brief How the files are assigned to the worker processes.
+ */
+enum scale_layout{
+	LAYOUT_SHARED,		///< All the workers open the same files, contending on the same sessions.
+	LAYOUT_DISJOINT,	///< Each worker has its own files.
+	LAYOUT_NUM		///< Number of layouts.
+};
+
+///Names of the layouts, indexed by `::scale_layout`.
+const char* layout_names[LAYOUT_NUM]={"shared","disjoint"};
+
+/** \enum scale_mix
+ * \brief The operations done in each session.
+ */
+enum scale_mix{
+	MIX_READ,	///< The block is read, and written once every ::WRITE_RATIO sessions.
+	MIX_WRITE,	///< The block is written in every session, so every close commits new content.
+	MIX_NUM		///< Number of workloads.
+};
+
+///Names of the workloads, indexed by `::scale_mix`.
+const char* mix_names[MIX_NUM]={"read","write"};
+
+/**
+ * \struct value_list
+ * \brief The values of a swept parameter.
+ * \param values The values.
+ * \param num The number of values.
+ */
+struct value_list{
+	long values[MAX_VALUES];
+	int num;
+};
+
+/**
+ * \struct scale_config
+ * \brief The parameters of the sweep.
+ * \param dir The directory of the benchmark files.
+ * \param procs The numbers of worker processes.
+ * \param files The numbers of files used by each worker.
+ * \param incarnations The numbers of incarnations opened at the same time on a file.
+ * \param sizes The sizes of the files.
+ * \param layouts Bitmask of the `::scale_layout`(s) to run.
+ * \param mixes Bitmask of the `::scale_mix`(es) to run.
+ * \param duration The duration of each point, in seconds.
+ * \param pin Non-zero if the workers are pinned to a core.
+ * \param data_path The file where the gnuplot data is written, `NULL` if it is not needed.
+ */
+struct scale_config{
+	const char* dir;
+	struct value_list procs;
+	struct value_list files;
+	struct value_list incarnations;
+	struct value_list sizes;
+	int layouts;
+	int mixes;
+	int duration;
+	int pin;
+	const char* data_path;
+};
+
+/**
+ * \struct scale_point
+ * \brief A point of the sweep.
+ * \param procs The number of worker processes.
+ * \param files The number of files used by each worker.
+ * \param incarnations The number of incarnations opened at the same time on a file.
+ * \param size The size of the files.
+ * \param layout How the files are assigned to the workers.
+ * \param mix The operations done in each session.
+ */
+struct scale_point{
+	int procs;
+	int files;
+	int incarnations;
+	long size;
+	enum scale_layout layout;
+	enum scale_mix mix;
+};
+
+/**
+ * \struct worker_slot
+ * \brief The results of a worker process, in shared memory.
+ * \param open The latency of `open`.
+ * \param close The latency of `close`.
+ * \param sessions The number of sessions opened and closed.
+ * \param error The `errno` of the first failed operation, 0 if there are none.
+ */
+struct worker_slot{
+	struct latency_hist open;
+	struct latency_hist close;
+	uint64_t sessions;
+	int error;
+};
+
+/**
+ * \struct scale_shared
+ * \brief The memory shared by the harness and the workers of a point.
+ * \param ready The number of workers ready to start.
+ * \param go Set to 1 by the harness to start the workers.
+ * \param stop Set to 1 by the harness to stop the workers.
+ * \param slots The results of each worker.
+ */
+struct scale_shared{
+	int ready;
+	int go;
+	int stop;
+	struct worker_slot slots[];
+};
+
+/** \brief Returns the current time of the monotonic clock, in nanoseconds.
+ */
+uint64_t now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+/** \brief Creates or removes the files of a point, without the session semantic.
+ * \param[in] dir The directory of the benchmark files.
+ * \param[in] point The point of the sweep.
+ * \param[in] create Non-zero to create the files, zero to remove them.
+ * \returns 0 on success or -1, setting `errno`.
+ */
+int setup_files(const char* dir,const struct scale_point* point,int create){
+	char pathname[PATH_MAX];
+	char buf[BLOCK_SIZE];
+	long written;
+	ssize_t res;
+	int w,f,fd,workers;
+	workers=(point->layout==LAYOUT_SHARED) ? 1 : point->procs;
+	memset(buf,'a',sizeof(buf));
+	for(w=0;w<workers;w++){
+		for(f=0;f<point->files;f++){
+			snprintf(pathname,PATH_MAX,"%s/sessionfs-scale-%d-%d-%d",dir,getpid(),w,f);
+			if(!create){
+				unlink(pathname);
+				continue;
+			}
+			fd=open(pathname,O_CREAT | O_TRUNC | O_WRONLY,DEFAULT_PERM);
+			if(fd<0){
+				return -1;
+			}
+			for(written=0;written<point->size;written+=res){
+				res=write(fd,buf,(point->size-written<BLOCK_SIZE) ? point->size-written : BLOCK_SIZE);
+				if(res<0){
+					close(fd);
+					return -1;
+				}
+			}
+			close(fd);
+		}
+	}
+	return 0;
+}
+
+/** \brief Body of a worker process.
+ * \param[in] config The parameters of the sweep.
+ * \param[in] point The point of the sweep.
+ * \param[in,out] shared The memory shared with the harness.
+ * \param[in] worker The number of the worker.
+ * \param[in] harness The pid of the harness, which names the files.
+ *
+ * The worker waits for the harness to start all the workers, then opens sessions until the harness stops it.
+ */
+void run_worker(const struct scale_config* config,const struct scale_point* point,struct scale_shared* shared,int worker,pid_t harness){
+	struct worker_slot* slot=&(shared->slots[worker]);
+	char pathname[PATH_MAX];
+	char buf[BLOCK_SIZE];
+	int fds[MAX_INCARNATIONS];
+	cpu_set_t cpus;
+	uint64_t start,iteration=0;
+	int i,file,opened;
+	if(config->pin){
+		CPU_ZERO(&cpus);
+		CPU_SET(worker%sysconf(_SC_NPROCESSORS_ONLN),&cpus);
+		sched_setaffinity(0,sizeof(cpu_set_t),&cpus);
+	}
+	memset(buf,'b',sizeof(buf));
+	__atomic_add_fetch(&(shared->ready),1,__ATOMIC_SEQ_CST);
+	while(!__atomic_load_n(&(shared->go),__ATOMIC_ACQUIRE)){
+		sched_yield();
+	}
+	while(!__atomic_load_n(&(shared->stop),__ATOMIC_ACQUIRE)){
+		file=iteration%point->files;
+		snprintf(pathname,PATH_MAX,"%s/sessionfs-scale-%d-%d-%d",config->dir,harness,
+			(point->layout==LAYOUT_SHARED) ? 0 : worker,file);
+		for(opened=0;opened<point->incarnations;opened++){
+			start=now_ns();
+			fds[opened]=open(pathname,O_RDWR | O_SESS);
+			if(fds[opened]<0){
+				slot->error=errno;
+				break;
+			}
+			hist_record(&(slot->open),now_ns()-start);
+		}
+		for(i=0;i<opened;i++){
+			if(point->mix==MIX_WRITE || (iteration+i)%WRITE_RATIO==0){
+				if(pwrite(fds[i],buf,sizeof(buf),0)<0){
+					slot->error=errno;
+				}
+			} else if(pread(fds[i],buf,sizeof(buf),0)<0){
+				slot->error=errno;
+			}
+		}
+		for(i=0;i<opened;i++){
+			start=now_ns();
+			if(close(fds[i])<0){
+				slot->error=errno;
+				continue;
+			}
+			hist_record(&(slot->close),now_ns()-start);
+			slot->sessions++;
+		}
+		if(slot->error!=0){
+			break;
+		}
+		iteration++;
+	}
+}
+
+/**
+ * \struct point_result
+ * \brief The merged results of a point.
+ * \param open The latency of `open`.
+ * \param close The latency of `close`.
+ * \param throughput The sessions opened and closed per second.
+ * \param error The first error of the workers, 0 if there are none.
+ */
+struct point_result{
+	struct latency_hist open;
+	struct latency_hist close;
+	double throughput;
+	int error;
+};
+
+/** \brief Runs a point of the sweep.
+ * \param[in] config The parameters of the sweep.
+ * \param[in] point The point of the sweep.
+ * \param[out] result The merged results of the workers.
+ * \returns 0 on success or -1, setting `errno`, if the point can't be run.
+ */
+int run_point(const struct scale_config* config,const struct scale_point* point,struct point_result* result){
+	struct scale_shared* shared;
+	size_t len;
+	pid_t* pids;
+	pid_t harness=getpid();
+	uint64_t start,elapsed,sessions=0;
+	int i,started;
+	len=sizeof(struct scale_shared)+sizeof(struct worker_slot)*point->procs;
+	shared=mmap(NULL,len,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_ANONYMOUS,-1,0);
+	if(shared==MAP_FAILED){
+		return -1;
+	}
+	pids=calloc(point->procs,sizeof(pid_t));
+	if(pids==NULL){
+		munmap(shared,len);
+		return -1;
+	}
+	for(i=0;i<point->procs;i++){
+		hist_init(&(shared->slots[i].open));
+		hist_init(&(shared->slots[i].close));
+	}
+	if(setup_files(config->dir,point,1)<0){
+		i=errno;
+		setup_files(config->dir,point,0);
+		free(pids);
+		munmap(shared,len);
+		errno=i;
+		return -1;
+	}
+	for(started=0;started<point->procs;started++){
+		pids[started]=fork();
+		if(pids[started]<0){
+			break;
+		}
+		if(pids[started]==0){
+			run_worker(config,point,shared,started,harness);
+			_exit(EXIT_SUCCESS);
+		}
+	}
+	//we wait for the workers to be pinned, then we measure for the duration of the point
+	while(__atomic_load_n(&(shared->ready),__ATOMIC_ACQUIRE)<started){
+		sched_yield();
+	}
+	start=now_ns();
+	__atomic_store_n(&(shared->go),1,__ATOMIC_RELEASE);
+	sleep(config->duration);
+	__atomic_store_n(&(shared->stop),1,__ATOMIC_RELEASE);
+	for(i=0;i<started;i++){
+		waitpid(pids[i],NULL,0);
+	}
+	elapsed=now_ns()-start;
+	hist_init(&(result->open));
+	hist_init(&(result->close));
+	result->error=(started<point->procs) ? EAGAIN : 0;
+	for(i=0;i<started;i++){
+		hist_merge(&(result->open),&(shared->slots[i].open));
+		hist_merge(&(result->close),&(shared->slots[i].close));
+		sessions+=shared->slots[i].sessions;
+		if(result->error==0){
+			result->error=shared->slots[i].error;
+		}
+	}
+	result->throughput=(elapsed>0) ? sessions*1e9/elapsed : 0;
+	setup_files(config->dir,point,0);
+	free(pids);
+	munmap(shared,len);
+	return 0;
+}
+
+/** \brief Prints the header of the table and of the gnuplot data.
+ * \param[in] data The file of the gnuplot data, or `NULL`.
+ */
+void print_header(FILE* data){
+	printf("%5s %5s %4s %9s %-8s %-5s %12s %9s %9s %9s %9s %9s %9s\n","procs","files","incs","size","layout","mix",
+		"sessions/s","open p50","open p99","open p999","close p50","close p99","close p999");
+	if(data!=NULL){
+		fprintf(data,"# procs files incarnations size layout mix sessions_per_s open_p50_us open_p99_us open_p999_us close_p50_us close_p99_us close_p999_us\n");
+	}
+}
+
+/** \brief Prints a point in the table and in the gnuplot data, latencies are in microseconds.
+ * \param[in] data The file of the gnuplot data, or `NULL`.
+ * \param[in] point The point of the sweep.
+ * \param[in] result The results of the point.
+ */
+void print_point(FILE* data,const struct scale_point* point,const struct point_result* result){
+	if(result->error!=0){
+		printf("%5d %5d %4d %9ld %-8s %-5s failed: %s\n",point->procs,point->files,point->incarnations,point->size,
+			layout_names[point->layout],mix_names[point->mix],strerror(result->error));
+		return;
+	}
+	printf("%5d %5d %4d %9ld %-8s %-5s %12.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",point->procs,point->files,
+		point->incarnations,point->size,layout_names[point->layout],mix_names[point->mix],result->throughput,
+		hist_percentile(&(result->open),50)/1e3,hist_percentile(&(result->open),99)/1e3,
+		hist_percentile(&(result->open),99.9)/1e3,hist_percentile(&(result->close),50)/1e3,
+		hist_percentile(&(result->close),99)/1e3,hist_percentile(&(result->close),99.9)/1e3);
+	if(data!=NULL){
+		fprintf(data,"%d %d %d %ld %s %s %.0f %.1f %.1f %.1f %.1f %.1f %.1f\n",point->procs,point->files,
+			point->incarnations,point->size,layout_names[point->layout],mix_names[point->mix],result->throughput,
+			hist_percentile(&(result->open),50)/1e3,hist_percentile(&(result->open),99)/1e3,
+			hist_percentile(&(result->open),99.9)/1e3,hist_percentile(&(result->close),50)/1e3,
+			hist_percentile(&(result->close),99)/1e3,hist_percentile(&(result->close),99.9)/1e3);
+		fflush(data);
+	}
+}
+
+/** \brief Parses a comma separated list of positive numbers.
+ * \param[in] arg The list.
+ * \param[out] list The parsed values.
+ * \returns 0 on success or -1 if the list is invalid.
+ */
+int parse_list(const char* arg,struct value_list* list){
+	char* end;
+	list->num=0;
+	while(*arg!='\0'){
+		if(list->num==MAX_VALUES){
+			return -1;
+		}
+		list->values[list->num]=strtol(arg,&end,10);
+		if(end==arg || list->values[list->num]<=0 || (*end!=',' && *end!='\0')){
+			return -1;
+		}
+		list->num++;
+		arg=(*end==',') ? end+1 : end;
+	}
+	return (list->num>0) ? 0 : -1;
+}
+
+/** \brief Parses a comma separated list of names.
+ * \param[in] arg The list.
+ * \param[in] names The accepted names.
+ * \param[in] num The number of accepted names.
+ * \returns The bitmask of the found names, or -1 if the list is invalid.
+ */
+int parse_names(const char* arg,const char** names,int num){
+	int mask=0,i,len;
+	while(*arg!='\0'){
+		len=strcspn(arg,",");
+		for(i=0;i<num;i++){
+			if((int)strlen(names[i])==len && strncmp(arg,names[i],len)==0){
+				mask|=1<<i;
+				break;
+			}
+		}
+		if(i==num){
+			return -1;
+		}
+		arg+=(arg[len]==',') ? len+1 : len;
+	}
+	return (mask!=0) ? mask : -1;
+}
+
+/** \brief Prints the usage of the harness.
+ * \param[in] name The name of the program.
+ */
+void usage(const char* name){
+	printf("usage: %s [-d dir] [-p procs] [-f files] [-k incarnations] [-s sizes] [-l layouts] [-m mixes] [-T seconds] [-n] [-o data file]\n",name);
+	printf("  -d  directory of the benchmark files, must be a session root (default %s)\n",DEFAULT_DIR);
+	printf("  -p  comma separated numbers of worker processes (default 1,2,4,8)\n");
+	printf("  -f  comma separated numbers of files per worker (default 1,16)\n");
+	printf("  -k  comma separated numbers of incarnations opened at the same time on a file, at most %d (default 1,4)\n",MAX_INCARNATIONS);
+	printf("  -s  comma separated file sizes in bytes (default 4096)\n");
+	printf("  -l  comma separated layouts: shared,disjoint (default both)\n");
+	printf("  -m  comma separated workloads: read,write (default both)\n");
+	printf("  -T  duration of each point in seconds (default %d)\n",DEFAULT_DURATION);
+	printf("  -n  don't pin the workers to a core\n");
+	printf("  -o  file where the gnuplot data is written\n");
+}
+
+/** \brief Parses the command line.
+ * \param[in] argc The number of arguments.
+ * \param[in] argv The arguments.
+ * \param[out] config The parameters of the sweep.
+ * \returns 0 on success or -1 if the arguments are invalid.
+ */
+int parse_args(int argc,char** argv,struct scale_config* config){
+	int opt,i;
+	config->dir=DEFAULT_DIR;
+	parse_list("1,2,4,8",&(config->procs));
+	parse_list("1,16",&(config->files));
+	parse_list("1,4",&(config->incarnations));
+	parse_list("4096",&(config->sizes));
+	config->layouts=(1<<LAYOUT_NUM)-1;
+	config->mixes=(1<<MIX_NUM)-1;
+	config->duration=DEFAULT_DURATION;
+	config->pin=1;
+	config->data_path=NULL;
+	while((opt=getopt(argc,argv,"d:p:f:k:s:l:m:T:no:h"))!=-1){
+		switch(opt){
+			case 'd':
+				config->dir=optarg;
+				break;
+			case 'p':
+				if(parse_list(optarg,&(config->procs))<0){
+					return -1;
+				}
+				break;
+			case 'f':
+				if(parse_list(optarg,&(config->files))<0){
+					return -1;
+				}
+				break;
+			case 'k':
+				if(parse_list(optarg,&(config->incarnations))<0){
+					return -1;
+				}
+				break;
+			case 's':
+				if(parse_list(optarg,&(config->sizes))<0){
+					return -1;
+				}
+				break;
+			case 'l':
+				config->layouts=parse_names(optarg,layout_names,LAYOUT_NUM);
+				if(config->layouts<0){
+					return -1;
+				}
+				break;
+			case 'm':
+				config->mixes=parse_names(optarg,mix_names,MIX_NUM);
+				if(config->mixes<0){
+					return -1;
+				}
+				break;
+			case 'T':
+				config->duration=atoi(optarg);
+				break;
+			case 'n':
+				config->pin=0;
+				break;
+			case 'o':
+				config->data_path=optarg;
+				break;
+			default:
+				return -1;
+		}
+	}
+	for(i=0;i<config->incarnations.num;i++){
+		if(config->incarnations.values[i]>MAX_INCARNATIONS){
+			return -1;
+		}
+	}
+	return (config->duration>0 && optind==argc) ? 0 : -1;
+}
+
+int main(int argc, char** argv){
+	struct scale_config config;
+	struct scale_point point;
+	struct point_result result;
+	FILE* data=NULL;
+	int p,f,k,s,res=EXIT_SUCCESS;
+	if(parse_args(argc,argv,&config)<0){
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if(config.data_path!=NULL){
+		data=fopen(config.data_path,"w");
+		if(data==NULL){
+			perror("can't open the data file");
+			return EXIT_FAILURE;
+		}
+	}
+	print_header(data);
+	for(point.layout=0;point.layout<LAYOUT_NUM;point.layout++){
+		if(!(config.layouts & (1<<point.layout))){
+			continue;
+		}
+		for(point.mix=0;point.mix<MIX_NUM;point.mix++){
+			if(!(config.mixes & (1<<point.mix))){
+				continue;
+			}
+			for(s=0;s<config.sizes.num;s++){
+				for(k=0;k<config.incarnations.num;k++){
+					for(f=0;f<config.files.num;f++){
+						for(p=0;p<config.procs.num;p++){
+							point.procs=config.procs.values[p];
+							point.files=config.files.values[f];
+							point.incarnations=config.incarnations.values[k];
+							point.size=config.sizes.values[s];
+							if(run_point(&config,&point,&result)<0){
+								result.error=errno;
+							}
+							if(result.error!=0){
+								res=EXIT_FAILURE;
+							}
+							print_point(data,&point,&result);
+						}
+						//gnuplot separates the data sets with a blank line
+						if(data!=NULL){
+							fprintf(data,"\n");
+						}
+					}
+				}
+			}
+		}
+	}
+	if(data!=NULL){
+		fclose(data);
+	}
+	return res;
+}
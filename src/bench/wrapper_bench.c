@@ -0,0 +1,198 @@
+/** \file
+ * \brief Microbenchmark of the libsessionfs wrappers on files opened without the session semantic.
+ *
+ * Each function of the open family is called in a loop, both through the wrapper exported by libsessionfs and directly
+ * through the libc implementation, and the difference in nanoseconds per call between the fastest rounds is reported.
+ * The benchmark fails if the overhead of the dispatch, measured without system calls, is above ::MAX_OVERHEAD_NS.
+ * The benchmark doesn't need the SessionFS kernel module, since the ::O_SESS flag is never used.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+///Default number of calls for each measure.
+#define DEFAULT_ITERATIONS 100000
+
+///Overhead per call, in nanoseconds, above which the benchmark fails.
+#define MAX_OVERHEAD_NS 50.0
+
+///Number of interleaved rounds, the fastest round of each function is reported to filter out the noise.
+#define ROUNDS 5
+
+///The file opened by the benchmark.
+#define BENCH_FILE "/tmp/sessionfs-wrapper-bench"
+
+/** \brief Returns the current time of the monotonic clock, in nanoseconds.
+ */
+double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1e9+ts.tv_nsec;
+}
+
+/** \brief Measures the average time of an `open`-like call followed by `close`.
+ * \param[in] open_fn The function to measure.
+ * \param[in] iterations The number of calls.
+ * \returns The average time per call in nanoseconds, or -1 on error.
+ */
+double measure_open(int (*open_fn)(const char*, int, ...), long iterations){
+	long i;
+	int fd;
+	double start=now_ns();
+	for(i=0;i<iterations;i++){
+		fd=open_fn(BENCH_FILE,O_RDONLY);
+		if(fd<0){
+			return -1;
+		}
+		close(fd);
+	}
+	return (now_ns()-start)/iterations;
+}
+
+/** \brief Measures the average time of an `openat`-like call followed by `close`.
+ * \param[in] openat_fn The function to measure.
+ * \param[in] iterations The number of calls.
+ * \returns The average time per call in nanoseconds, or -1 on error.
+ */
+double measure_openat(int (*openat_fn)(int, const char*, int, ...), long iterations){
+	long i;
+	int fd;
+	double start=now_ns();
+	for(i=0;i<iterations;i++){
+		fd=openat_fn(AT_FDCWD,BENCH_FILE,O_RDONLY);
+		if(fd<0){
+			return -1;
+		}
+		close(fd);
+	}
+	return (now_ns()-start)/iterations;
+}
+
+/** \brief Measures the average time of an `fopen`-like call with an invalid mode.
+ * \param[in] fopen_fn The function to measure.
+ * \param[in] iterations The number of calls.
+ * \returns The average time per call in nanoseconds, or -1 on error.
+ *
+ * libc rejects the mode without a system call, so the measure isolates the cost of the dispatch done by the wrapper
+ * from the noise of the kernel.
+ */
+double measure_dispatch(FILE* (*fopen_fn)(const char*, const char*), long iterations){
+	long i;
+	double start=now_ns();
+	for(i=0;i<iterations;i++){
+		if(fopen_fn(BENCH_FILE,"q")!=NULL){
+			return -1;
+		}
+	}
+	return (now_ns()-start)/iterations;
+}
+
+/** \brief Measures the average time of an `fopen`-like call followed by `fclose`.
+ * \param[in] fopen_fn The function to measure.
+ * \param[in] iterations The number of calls.
+ * \returns The average time per call in nanoseconds, or -1 on error.
+ */
+double measure_fopen(FILE* (*fopen_fn)(const char*, const char*), long iterations){
+	long i;
+	FILE* stream;
+	double start=now_ns();
+	for(i=0;i<iterations;i++){
+		stream=fopen_fn(BENCH_FILE,"r");
+		if(stream==NULL){
+			return -1;
+		}
+		fclose(stream);
+	}
+	return (now_ns()-start)/iterations;
+}
+
+///Keeps the minimum between `a` and `b`, ignoring failed measures.
+#define KEEP_MIN(a,b) ((a)<0 || ((b)>=0 && (b)<(a)) ? (b) : (a))
+
+/** \brief Prints a line of the report.
+ * \param[in] name The name of the measured function.
+ * \param[in] wrapped The average time of the libsessionfs wrapper.
+ * \param[in] orig The average time of the libc implementation.
+ * \returns 0 if the overhead is below ::MAX_OVERHEAD_NS, 1 otherwise.
+ */
+int report(const char* name, double wrapped, double orig){
+	double overhead=wrapped-orig;
+	printf("%-8s libc: %8.1f ns\twrapper: %8.1f ns\toverhead: %6.1f ns\n",name,orig,wrapped,overhead);
+	return overhead>MAX_OVERHEAD_NS;
+}
+
+int main(int argc, char** argv){
+	long iterations=DEFAULT_ITERATIONS;
+	void* handle;
+	int (*libc_open)(const char*, int, ...);
+	int (*libc_openat)(int, const char*, int, ...);
+	FILE* (*libc_fopen)(const char*, const char*);
+	double results[8];
+	int fd, i, failed;
+	if(argc>1){
+		iterations=atol(argv[1]);
+		if(iterations<=0){
+			printf("usage: %s [iterations]\n",argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	//we get the libc implementations directly, bypassing the wrappers
+	handle=dlopen("libc.so.6",RTLD_NOLOAD | RTLD_LAZY);
+	if(handle==NULL){
+		printf("can't find libc: %s\n",dlerror());
+		return EXIT_FAILURE;
+	}
+	libc_open=dlsym(handle,"open");
+	libc_openat=dlsym(handle,"openat");
+	libc_fopen=dlsym(handle,"fopen");
+	if(libc_open==NULL || libc_openat==NULL || libc_fopen==NULL || libc_open==open){
+		printf("can't resolve the libc functions, or libsessionfs is not loaded\n");
+		return EXIT_FAILURE;
+	}
+	fd=libc_open(BENCH_FILE,O_CREAT | O_WRONLY,0644);
+	if(fd<0){
+		perror("can't create " BENCH_FILE);
+		return EXIT_FAILURE;
+	}
+	close(fd);
+	//warm up the dentry cache and the lazy bindings
+	measure_open(open,iterations/10+1);
+	measure_open(libc_open,iterations/10+1);
+	for(i=0;i<8;i++){
+		results[i]=-1;
+	}
+	for(i=0;i<ROUNDS;i++){
+		results[0]=KEEP_MIN(results[0],measure_open(open,iterations));
+		results[1]=KEEP_MIN(results[1],measure_open(libc_open,iterations));
+		results[2]=KEEP_MIN(results[2],measure_openat(openat,iterations));
+		results[3]=KEEP_MIN(results[3],measure_openat(libc_openat,iterations));
+		results[4]=KEEP_MIN(results[4],measure_fopen(fopen,iterations));
+		results[5]=KEEP_MIN(results[5],measure_fopen(libc_fopen,iterations));
+		results[6]=KEEP_MIN(results[6],measure_dispatch(fopen,iterations));
+		results[7]=KEEP_MIN(results[7],measure_dispatch(libc_fopen,iterations));
+	}
+	for(i=0;i<8;i++){
+		if(results[i]<0){
+			printf("can't open " BENCH_FILE "\n");
+			unlink(BENCH_FILE);
+			return EXIT_FAILURE;
+		}
+	}
+	//the measures with system calls are too noisy to be compared with the threshold, we only report them
+	report("open",results[0],results[1]);
+	report("openat",results[2],results[3]);
+	report("fopen",results[4],results[5]);
+	failed=report("dispatch",results[6],results[7]);
+	unlink(BENCH_FILE);
+	dlclose(handle);
+	if(failed){
+		printf("overhead above %.0f ns per call\n",MAX_OVERHEAD_NS);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #include "../shared_lib/libsessionfs.h"
@@ -575,11 +576,69 @@ void fork_test(void){
 	free(dummy_content);
 }
 
+/** \brief Test the session semantic with two session paths.
+ *
+ * We create the `multi_root_test_a` and `multi_root_test_b` directories and make them the only session paths, using
+ * `write_sess_path()` and `add_sess_root()`, then we open a file with `::O_SESS` in each of them and one in the current
+ * directory, which is not a session path anymore.
+ * Using `get_sess_path()` we check that both session paths are read, with their length, and using `list_sessions()` we
+ * check that only the first two files have been opened with the session semantic.
+ * Then we close the files and remove them, along with the directories.
+ */
+void multi_root_test(void){
+	const char* names[3]={"multi_root_test_a/file.txt","multi_root_test_b/file.txt","multi_root_test.txt"};
+	int fds[3],num,pid,i,ret;
+	char *buf,*err_buf;
+	pid=getpid();
+	buf=malloc(sizeof(char)*PATH_MAX);
+	err_buf=malloc(sizeof(char)*1024);
+	assert(buf!=NULL && err_buf!=NULL);
+	mkdir("multi_root_test_a",0755);
+	mkdir("multi_root_test_b",0755);
+	//the two directories become the only session paths
+	ret=write_sess_path("multi_root_test_a");
+	assert(ret>=0);
+	ret=add_sess_root("multi_root_test_b",COMMIT_ON_CLOSE,COPY_READ_WRITE);
+	assert(ret>=0);
+	memset(buf,0,sizeof(char)*PATH_MAX);
+	ret=get_sess_path(buf,PATH_MAX-1);
+	printf("%d multi root test: session paths:\n%s\n",pid,buf);
+	//both roots are read, and their length is returned
+	assert(ret>0 && ret==(int)strlen(buf));
+	assert(strstr(buf,"multi_root_test_a")!=NULL && strstr(buf,"multi_root_test_b")!=NULL);
+	for(i=0;i<3;i++){
+		fds[i]=open(names[i],O_CREAT | O_SESS | O_RDWR,DEFAULT_PERM);
+		if(fds[i]<0){
+			memset(err_buf,0,sizeof(char)*1024);
+			snprintf(err_buf,1024,"%d multi root test: error during opening %s with O_SESS",pid,names[i]);
+			perror(err_buf);
+		}
+	}
+	//only the files in the two session paths are sessions
+	memset(buf,0,sizeof(char)*PATH_MAX);
+	num=list_sessions(buf,PATH_MAX);
+	printf("%d multi root test: open sessions:\n%s\n",pid,buf);
+	if(num!=2){
+		printf("%d multi root test error: %d open sessions instead of 2\n",pid,num);
+	}
+	for(i=0;i<3;i++){
+		if(fds[i]>=0){
+			close(fds[i]);
+		}
+		unlink(names[i]);
+	}
+	rmdir("multi_root_test_a");
+	rmdir("multi_root_test_b");
+	free(err_buf);
+	free(buf);
+}
+
 /** \brief Testing of the kernel module
  * \param[in] argc Number of the given arguments, 3 is expected.
  * \param[in] argv The arguments given to the file; we expect two arguments, the maximum number of processes to be used in the test followed by the maximum number of files to be used by each process.
  *
  * We spawn a number of processes from 1 to the number given as first parameter, then in each child process we change the session path to the current directory using `change_sess_path()`, we execute `func_test()`, `sess_change_test()` and `fork_test()`.
+ * When all the child processes have exited, the main process executes `multi_root_test()`, since it changes the session paths of all the processes.
  * If the maximum number of processes used is 1 then all the files created by `func_test()` have a filename that starts with the `single_process` string, otherwise with the `multi_process` string.
  */
 int main(int argc, char** argv){
@@ -628,6 +687,8 @@ int main(int argc, char** argv){
 	for(i=0;i<process_num;i++){
 		wait(NULL);
 	}
+	printf("\n\n\n\t\t\t%d -- multi root test\n",getpid());
+	multi_root_test();
 	///To be able remove the kernel module we need to power down the `SessionFS_dev` device, using the dedicated ioctl as the last operation on the device.
 	printf("requesting device shutdown\n");
 	ret= device_shutdown();
@@ -5,15 +5,23 @@
  * with the path where sessions are enabled.
  */
 
+///Prefix of the messages printed by the char device.
+#define pr_fmt(fmt) "SessionFS char device: " fmt
+
 #include "device_sessionfs.h"
 #include "device_sessionfs_mod.h"
 #include "session_manager.h"
 #include "session_info.h"
+#include "session_stats.h"
+#include "session_roots.h"
+#include "session_owners.h"
 
 // for file_operations struct, register_chrdev unregister_chrdev
 #include <linux/fs.h>
 //for kmalloc
 #include<linux/slab.h>
+//for kvzalloc
+#include<linux/mm.h>
 // for copy_to_user and copy_from_user
 #include<linux/uaccess.h>
 // for PATH_MAX
@@ -24,14 +32,17 @@
 #include<linux/module.h>
 //for error numbers
 #include <uapi/asm-generic/errno.h>
-//for find_get_pid
-#include <linux/pid.h>
-//for struct task_struct
+//for current
 #include <linux/sched.h>
 //for spinlock APIs
 #include <linux/spinlock.h>
 //for signal apis
 #include <linux/sched/signal.h>
+//for the device refcount
+#include <linux/percpu-refcount.h>
+#include <linux/completion.h>
+//for the shutdown lock
+#include <linux/mutex.h>
 
 // dentry management
 #include<linux/namei.h>
@@ -41,26 +52,22 @@
 ///The default session path when the device is initialized
 #define DEFAULT_SESS_PATH "/mnt"
 
-/// Indicates that the given path is contained in `::sess_path`
-#define PATH_OK 1
-
-///Indicates that the device has been disabled and is being removed
-#define DEVICE_DISABLED 1
-
-///Lock that protects the session path from concurrent accesses.
-rwlock_t dev_lock;
-
-/// The path to the directory in which session sematic is enabled
+/// The session path given when the module is loaded, if `NULL` `::DEFAULT_SESS_PATH` is used.
 char* sess_path=NULL;
 
-/// Length of the of the path string
-int path_len=0;
+/** \brief Refcount of the processes that are using the device.
+ *
+ * Every operation on the device takes a reference with `percpu_ref_tryget_live()`, which fails once the device has been
+ * killed by a shutdown, so the device is disabled and drained by `percpu_ref_kill()` without having a global counter
+ * bouncing between the CPUs.
+ */
+struct percpu_ref refcount;
 
-/// Indicates that the device must not be used since is being removed.
-atomic_t device_status;
+///Completed when `::refcount` drops to zero after being killed.
+DECLARE_COMPLETION(refcount_drained);
 
-/// Refcount of the processes that are using the device
-atomic_t refcount;
+///Held by the shutdown in progress, so that `::refcount` is killed and `::refcount_drained` waited by one caller at a time.
+DEFINE_MUTEX(shutdown_lock);
 
 ///File operations allowed on our device
 struct file_operations* dev_ops=NULL;
@@ -71,93 +78,56 @@ struct class* dev_class=NULL;
 ///Device object
 struct device* dev=NULL;
 
-/** \brief Check if the given path is a subpath of `::sess_path`
-*
-* Gets the dentry from the given path and from  `::sess_path` and checks if the second dentry is an ancestor of the first dentry.
-* \param[in] path Path to be checked
-* \returns `::PATH_OK` if the given path is a subpath of `::sess_path` and !`::PATH_OK` otherwise; an error code is returned on error.
-*
-* If the dentry corresponding to the given path cannot be found, the function will check if `::sess_path` is a substring of the given path.
-*/
-int path_check(const char* path){
-	struct path psess,pgiven;
-	struct dentry *dsess,*dgiven, *dentry;
-	int retval;
-	char* p_check=NULL;
-	//get dentry from the sess_path
-	read_lock(&dev_lock);
-	retval=kern_path(sess_path,LOOKUP_FOLLOW,&psess);
-	read_unlock(&dev_lock);
-	if(retval<0){
-		printk(KERN_DEBUG "SessionFS char device: error, can't get %s dentry",sess_path);
-		return retval;
-	}
-	dsess=psess.dentry;
-	//get dentry from given path
-	retval=kern_path(path,LOOKUP_FOLLOW,&pgiven);
-	if(retval<0 && retval!=-ENOENT){
-	printk(KERN_DEBUG "SessionFS char device: can't get %s dentry",path);
-		return retval;
-	}else{
-		//we try to find sess_path as a substring of the given path if the file does not exist
-		read_lock(&dev_lock);
-		printk(KERN_DEBUG "SessionFS char device: %s dentry is non-existent, checking that %s is a substring of the given path",path,sess_path);
-		p_check=strstr(path,sess_path);
-		read_unlock(&dev_lock);
-		if(p_check==NULL){
-			return -ENOENT;
-		} else{
-			return PATH_OK;
-		}
-	}
-	dgiven=pgiven.dentry;
-
-	dentry=dgiven;
-	//check if dsess is an ancestor of dgiven
-	while(!IS_ROOT(dentry)){
-		if(dentry == dsess){
-			return PATH_OK;
-		} else{
-			dentry=dentry->d_parent;
-		}
-	}
-	return 0;
+/** \brief Called when `::refcount` drops to zero, after the device has been killed.
+ * \param[in] ref The `::refcount`.
+ */
+void refcount_release(struct percpu_ref* ref){
+	complete(&refcount_drained);
 }
 
-/** \brief Get the path in which sessions are enabled.
- * \param[out] buffer The buffer in which the path is copied.
+/** \brief Get the paths in which sessions are enabled.
+ * \param[out] buffer The buffer in which the paths are copied.
  * \param[in] buflen The lenght of the supplied buffer.
  * \param file unused, but necessary to fit the function into struct file_operations.
  * \param offset unused, but necessary to fit the function into struct file_operations.
  * \returns The number of bytes written in `buffer`, or an error code (`-EINVAL` if one of the supplied parameters is invalid,
  *  `-EAGAIN` if the `copy_to_user()` failed, `-ENODEV` if the device is disabled).
  *
- * This function will copy the `::sess_path` content in the supplied buffer.
- * The first operations be executed are the check for the device status on `::device_status`, the incrementation of the `::refcount`.
- * Then `::dev_lock` is grabbed for reading; after the operation is completed `::dev_lock` is released and the `::refcount` is decremented.
+ * This function will copy the pathnames of the session roots in the supplied buffer, separated by newlines, using `print_sess_roots()`.
+ * The first operation executed is taking a reference on `::refcount`, which fails if the device is being removed, the
+ * reference is dropped after the copy.
  */
 static ssize_t device_read(struct file* file, char* buffer,size_t buflen,loff_t* offset){
 	int bytes_not_read=0;
-	//we check that the device is not closing
-	if(atomic_read(&device_status)==DEVICE_DISABLED){
+	ssize_t len;
+	char* tmpbuf;
+	//we get a reference on the device, failing if it is closing
+	if(!percpu_ref_tryget_live(&refcount)){
 		return -ENODEV;
 	}
-	atomic_add(1,&refcount);
 	// some basic sanity checks over arguments
-	if(buffer==NULL || buflen<path_len){
-		atomic_sub(1,&refcount);
+	if(buffer==NULL){
+		percpu_ref_put(&refcount);
 		return -EINVAL;
 	}
+	buflen=min_t(size_t,buflen,ROOTS_READ_MAX);
+	tmpbuf=kvzalloc(sizeof(char)*buflen,GFP_KERNEL);
+	if(!tmpbuf){
+		percpu_ref_put(&refcount);
+		return -ENOMEM;
+	}
 
-	printk(KERN_DEBUG "SessionFS char device: reading session path\n");
-	read_lock(&dev_lock);
-	bytes_not_read=copy_to_user(buffer,sess_path,path_len);
-	read_unlock(&dev_lock);
-	atomic_sub(1,&refcount);
+	pr_debug("reading session roots\n");
+	len=print_sess_roots(tmpbuf,buflen);
+	if(len>0){
+		bytes_not_read=copy_to_user(buffer,tmpbuf,len);
+	}
+	kvfree(tmpbuf);
+	percpu_ref_put(&refcount);
 	if(bytes_not_read>0){
 		return -EAGAIN;
 	}
-	return path_len-bytes_not_read;
+	return len;
 }
 
 /** \brief Writes a new path in which sessions must be enabled.
@@ -166,58 +136,104 @@ static ssize_t device_read(struct file* file, char* buffer,size_t buflen,loff_t*
  * \param file unused, but necessary to fit the function into struct file_operations.
  * \param offset unused, but necessary to fit the function into struct file_operations.
  * \returns The number of bytes written in `buffer`, or an error code (`-EINVAL` if one of the supplied parameters are invalid,
- * `-EAGAIN` if the copy_from_user failed, `-ENODEV` if the device is disabled).
+ * `-EAGAIN` if the copy_from_user failed, `-ENODEV` if the device is disabled, `-ENOENT` if the directory does not exist).
  *
- * This function will reset and overwrite `::sess_path`, without affecting existing sessions, if the supplied path is absolute.
- * To do so we check `::device_status` and we increment `::refcount`.
- * Then we check that the supplied path starts with '/', grab `::dev_lock` for write operations, we zero-fill `::sess_path`,
- * copy the new string and add a terminator, just in case.
- * Finally we release `::dev_lock` and decrement `::refcount`.
+ * This function will replace all the session roots with the given one, using `replace_sess_roots()`, without affecting
+ * existing sessions. Session roots can also be added and removed one by one with `::IOCTL_SEQ_ADD_ROOT` and `::IOCTL_SEQ_REMOVE_ROOT`.
+ * To do so we take a reference on `::refcount`, which fails if the device is being removed, and we drop it when the root
+ * has been replaced.
  */
 static ssize_t device_write(struct file* file,const char* buffer,size_t buflen,loff_t* offset){
-	int bytes_not_written=0;
+	int bytes_not_written=0,res;
 	char * tmpbuf;
-	//we check that the device is not closing
-	if(atomic_read(&device_status)==DEVICE_DISABLED){
+	//we get a reference on the device, failing if it is closing
+	if(!percpu_ref_tryget_live(&refcount)){
 		return -ENODEV;
 	}
-	atomic_add(1,&refcount);
-	// some basic sanity checks over arguments
-	if(buffer==NULL || buflen>PATH_MAX){
-		atomic_sub(1,&refcount);
+	// some basic sanity checks over arguments, leaving room for the terminator
+	if(buffer==NULL || buflen>=PATH_MAX){
+		percpu_ref_put(&refcount);
 		return -EINVAL;
 	}
 
-	//we check that the given path is an absolute path (i.e. it starts with '/')
 	tmpbuf=kzalloc(sizeof(char)*PATH_MAX, GFP_KERNEL);
 	if(!tmpbuf){
-		atomic_sub(1,&refcount);
+		percpu_ref_put(&refcount);
 		return -ENOMEM;
 	}
 	bytes_not_written=copy_from_user(tmpbuf,buffer,buflen);
 	if(bytes_not_written>0){
 		kfree(tmpbuf);
-		atomic_sub(1,&refcount);
+		percpu_ref_put(&refcount);
 		return -EINVAL;
 	}
-	if(tmpbuf[0]!='/'){
-		printk(KERN_WARNING "SessionFS char device: relative path specified, session path must be absolute");
-		kfree(tmpbuf);
-		atomic_sub(1,&refcount);
+
+	pr_debug("changing session path to %s\n",tmpbuf);
+	res=replace_sess_roots(tmpbuf);
+	kfree(tmpbuf);
+	percpu_ref_put(&refcount);
+	return res;
+}
+
+/** \brief Adds or removes a session root.
+ * \param[in] num `::IOCTL_SEQ_ADD_ROOT` or `::IOCTL_SEQ_REMOVE_ROOT`.
+ * \param[in] param The `::root_params` struct, in userspace.
+ * \returns 0 on success or an error code.
+ */
+int update_sess_roots(unsigned int num,unsigned long param){
+	struct root_params p;
+	char* pathname;
+	int res;
+	if(copy_from_user(&p,(struct root_params*)param,sizeof(struct root_params))>0){
 		return -EINVAL;
 	}
+	pathname=strndup_user(p.path,PATH_MAX);
+	if(IS_ERR(pathname)){
+		return PTR_ERR(pathname);
+	}
+	if(num==IOCTL_SEQ_ADD_ROOT){
+		res=insert_sess_root(pathname,&(p.policy));
+	} else {
+		res=delete_sess_root(pathname);
+	}
+	kfree(pathname);
+	return res;
+}
 
-	write_lock(&dev_lock);
-	printk(KERN_DEBUG "SessionFS char device: changing session path to %s",tmpbuf);
-	memset(sess_path,0,sizeof(char)*PATH_MAX);
-	memcpy(sess_path,tmpbuf,sizeof(char)*buflen);
-	//adding string terminator
-	sess_path[PATH_MAX-1]='\0';
-	path_len=buflen;
-	write_unlock(&dev_lock);
-	kfree(tmpbuf);
-	atomic_sub(1,&refcount);
-	return 0;
+/** \brief Lists the open sessions of the calling process.
+ * \param[in] param The `::list_params` struct, in userspace.
+ * \returns The number of bytes written in the buffer of `::list_params` or an error code (`-EINVAL` if the buffer is too small).
+ *
+ * The sessions are found in the index of the calling process with `print_owner_incarnations()`, so the cost depends only
+ * on the number of its sessions.
+ */
+long int list_sessions(unsigned long param){
+	struct list_params p;
+	char* buf;
+	ssize_t len;
+	size_t buflen;
+	if(copy_from_user(&p,(struct list_params*)param,sizeof(struct list_params))>0){
+		return -EINVAL;
+	}
+	if(p.buflen<=0){
+		return -EINVAL;
+	}
+	buflen=min_t(size_t,p.buflen,OWNERS_LIST_MAX);
+	buf=kvzalloc(buflen,GFP_KERNEL);
+	if(buf==NULL){
+		return -ENOMEM;
+	}
+	len=print_owner_incarnations(task_tgid_nr(current),buf,buflen,&(p.num));
+	if(len<0){
+		kvfree(buf);
+		return len;
+	}
+	if(copy_to_user(p.buf,buf,len)>0 || copy_to_user((struct list_params*)param,&p,sizeof(struct list_params))>0){
+		kvfree(buf);
+		return -EFAULT;
+	}
+	kvfree(buf);
+	return len;
 }
 
 /** \brief Allows every user to read and write the device file of our virtual device.
@@ -241,185 +257,198 @@ static char *sessionfs_devnode(struct device *dev, umode_t *mode)
 /** \brief Handles the ioctls calls issued to the `SessionFS_dev` device.
  * \param[in] file The special file that represents our char device.
  * \param[in] num The ioctl sequence number, used to identify the operation to be
- * executed, its possible values are `::IOCTL_SEQ_OPEN`, `::IOCTL_SEQ_CLOSE` and `::IOCTL_SEQ_SHUTDOWN`.
- *\param[in,out] param The ioctl param, which is a `::sess_params` struct, that contains the information on the session that must be opened/closed and will be updated with the information on the result of the operation.
- * \returns 0 on success or an error code. (`-ENODEV` if the device is disabled, `-EINVAL` if `path_check()` fails or parameters are invalid, `-EAGAIN` if the `copy_to_user` fails and `-EPIPE` plus a `SIGPIPE` signal if the original file can't be found.)
+ * executed, its possible values are `::IOCTL_SEQ_OPEN`, `::IOCTL_SEQ_CLOSE`, `::IOCTL_SEQ_ADD_ROOT`, `::IOCTL_SEQ_REMOVE_ROOT`, `::IOCTL_SEQ_LIST` and `::IOCTL_SEQ_SHUTDOWN`.
+ *\param[in,out] param The ioctl param, which is a `::sess_params` struct, that contains the information on the session that must be opened/closed and will be updated with the information on the result of the operation, or a `::root_params` struct for the session roots.
+ * \returns 0 on success or an error code. (`-ENODEV` if the device is disabled, `-EINVAL` if the parameters are invalid, `-EAGAIN` if the `copy_to_user` fails and `-EPIPE` plus a `SIGPIPE` signal if the original file can't be found.)
  *
- * This function checks `::device_status`, increments `::refcount`, then copies the `::sess_params` struct and its `orig_pathname` in kernel space.
+ * This function takes a reference on `::refcount`, which fails if the device is being removed, then copies the `::sess_params` struct and its `orig_pathname` in kernel space.
  * Its behaviour differs in base of the ioctl sequence number specified:
- * - `::IOCTL_SEQ_OPEN`: Tries to create a session by invoking `create_session()`.
+ * - `::IOCTL_SEQ_OPEN`: Finds the session root of the file with `find_sess_root()` and tries to create a session, with the policy of the root, by invoking `create_session()`
+ * 	on the pathname resolved by `find_sess_root()`, so that the symbolic links to a file share its session.
+ * 	If the file is not in a session root the `valid` member of `::sess_params` is set to `::OUTSIDE_ROOTS` and 0 is
+ * 	returned, so that the library decides whether to open a session with this ioctl only.
+ * 	The incarnation is charged to the account of the root, if it exceeds a limit of the admission control the ioctl fails with `-EDQUOT`.
  * 	If the session and the incarnation are created successfully the file descriptor of the incarnation is copied into `::sess_params` `filedes`
  * 	member.
  * 	If the incarnation gets corrupted during creation, the `filedes` member of `::sess_params` is updated as in the successful case, but the corresponding error code is
  * 	returned, so that the library can close and remove the corrupted incarnation file.
  *
- * - `::IOCTL_SEQ_CLOSE`: closes an open session using `close_session()` and the incarnation file must be closed and removed by the library. If
- * the original file does not exist anymore it sends `SIGPIPE` to the user process.
+ * - `::IOCTL_SEQ_CLOSE`: commits an open session using `close_session()`, the incarnation file is removed when its file descriptor is closed. If
+ * the original file does not exist anymore it sends `SIGPIPE` to the calling process and fails with `-EPIPE`, the other errors of
+ * `close_session()` are returned unchanged. Sessions are also committed automatically when the
+ * incarnation file is released, so this ioctl is not needed to close a session.
+ *
+ * - `::IOCTL_SEQ_ADD_ROOT` and `::IOCTL_SEQ_REMOVE_ROOT`: add or remove a session root with `update_sess_roots()`.
  *
- * - `::IOCTL_SEQ_SHUTDOWN`: disables the device, setting `::device_status` to `::DEVICE_DISABLED`, to avoid race conditions. Then calls
- * `clean_manager()` to check if there are active sessions.
- * 	If there are no active sessions and the refcount is 1 (we are the only process using the device) then the module is unlocked, using
- * 	`module_put()`. Otherwise the device is re-enabled, setting `::device_status` to `!::DEVICE_DISABLED` and the ioctl fails with `-EAGAIN`.
+ * - `::IOCTL_SEQ_LIST`: writes the open sessions of the calling process with `list_sessions()`.
+ *
+ * - `::IOCTL_SEQ_SHUTDOWN`: disables the device with `percpu_ref_kill()`, so that new operations fail with `-ENODEV`, and waits
+ * for the operations in progress to drop their reference on `::refcount`. Then calls `clean_manager()` to check if there are active sessions.
+ * 	If there are no active sessions and no processes are using the device kobject then the module is unlocked, using
+ * 	`module_put()`. Otherwise the device is re-enabled with `percpu_ref_reinit()` and the ioctl fails with `-EAGAIN`.
+ * 	Shutdowns are serialized by ::shutdown_lock, a shutdown requested while another one is in progress fails with `-EBUSY`.
  */
 long int device_ioctl(struct file * file, unsigned int num, unsigned long param){
-	char* orig_pathname=NULL;
+	char *orig_pathname=NULL,*real_pathname=NULL;
 	int res=0,flag,active_sessions=0;
-	struct sess_params* p=NULL;
+	struct sess_params p;
 	struct incarnation* inc=NULL;
-	struct task_struct* task;
-	struct pid* pid;
+	struct sess_root* root;
+	u64 start=stat_start(),check_start;
 
-	printk(KERN_DEBUG "SessionFS char device: received ioctl with num: %d",num);
-	//we check that the device is not closing
-	if(atomic_read(&device_status)==DEVICE_DISABLED){
+	pr_debug("received ioctl with num: %d\n",num);
+	//we get a reference on the device, failing if it is closing
+	if(!percpu_ref_tryget_live(&refcount)){
 		return -ENODEV;
 	}
-	atomic_add(1,&refcount);
 	//we don't need to copy parameters if the shudown is requested
 	if(num==IOCTL_SEQ_OPEN || num==IOCTL_SEQ_CLOSE){
-		p=kzalloc(sizeof(struct sess_params), GFP_KERNEL);
-		if(!p){
-			atomic_sub(1,&refcount);
-			return -ENOMEM;
-		}
 		//get the parameters struct from userspace
-		res=copy_from_user(p,(struct sess_params*)param,sizeof(struct sess_params));
+		res=copy_from_user(&p,(struct sess_params*)param,sizeof(struct sess_params));
 		if(res>0){
-			kfree(p);
-			atomic_sub(1,&refcount);
+			percpu_ref_put(&refcount);
 			return -EINVAL;
 		}
-		// allocating space for the original file pathname
-		orig_pathname=kzalloc(sizeof(char)*PATH_MAX, GFP_KERNEL);
-		if(!orig_pathname){
-			kfree(p);
-			atomic_sub(1,&refcount);
-			return -ENOMEM;
-		}
-		//copy the pathname string to kernel space
-		res=copy_from_user(orig_pathname,p->orig_path,sizeof(char)*PATH_MAX);
-		if(res>0){
-			kfree(p);
-			kfree(orig_pathname);
-			atomic_sub(1,&refcount);
-			return -EINVAL;
+		pr_debug("copied parameters from userspace\n");
+	}
+	if(num==IOCTL_SEQ_OPEN){
+		//copy the pathname string to kernel space, in a buffer of its length
+		orig_pathname=strndup_user(p.orig_path,PATH_MAX);
+		if(IS_ERR(orig_pathname)){
+			percpu_ref_put(&refcount);
+			return PTR_ERR(orig_pathname);
 		}
-		printk(KERN_DEBUG "SessionFS char device: Copied parameters from userspace");
 	}
 
 	switch(num){
 		case IOCTL_SEQ_OPEN :
-			printk(KERN_DEBUG "SessionFS char device: checking that the original pathname is in %s",sess_path);
-			//we check that the original file pathname has sess_path as ancestor
-			res=path_check(orig_pathname);
-			printk(KERN_DEBUG "SessionFS char device: path_check result: %d",res);
-			if(res != PATH_OK){
+			pr_debug("checking that %s is in the session path\n",orig_pathname);
+			//we find the session root that is an ancestor of the original file pathname
+			check_start=stat_start();
+			root=find_sess_root(orig_pathname,&real_pathname);
+			stat_record(STAT_PATH_CHECK,check_start);
+			if(IS_ERR(root)){
 				kfree(orig_pathname);
-				kfree(p);
-				atomic_sub(1,&refcount);
-				return -EINVAL;
+				percpu_ref_put(&refcount);
+				return PTR_ERR(root);
 			}
-			if(res<0){
+			if(root==NULL){
+				pr_debug("%s is not in a session root\n",orig_pathname);
 				kfree(orig_pathname);
-				kfree(p);
-				atomic_sub(1,&refcount);
-				return res;
+				//the library opens the file without the session semantic
+				p.valid=OUTSIDE_ROOTS;
+				p.filedes=-1;
+				res=copy_to_user((struct sess_params*)param,&p,sizeof(struct sess_params));
+				percpu_ref_put(&refcount);
+				return (res>0) ? -EAGAIN : 0;
 			}
-			printk(KERN_DEBUG "SessionFS char device: path check ok, checking O_SESS flag presence");
+			//the session is keyed by the resolved pathname, which is the same for every symbolic link to the file
+			pr_debug("%s resolved to %s\n",orig_pathname,real_pathname);
+			kfree(orig_pathname);
+			orig_pathname=real_pathname;
+			pr_debug("path check ok, checking O_SESS flag presence\n");
 			//we check if the flags include O_SESS and remove to avoid causing trouble for the open function
-			if(p->flags & O_SESS){
-				flag=p->flags & ~O_SESS;
+			if(p.flags & O_SESS){
+				flag=p.flags & ~O_SESS;
 			}else {
+				put_sess_root(root);
 				kfree(orig_pathname);
-				kfree(p);
-				atomic_sub(1,&refcount);
+				percpu_ref_put(&refcount);
 				return -EINVAL;
 			}
-			printk(KERN_DEBUG "SessionFS char device: flag check ok, creating session");
+			pr_debug("flag check ok, creating session\n");
 			//we create a new session incarnation
-			inc=create_session(orig_pathname,flag,p->pid,p->mode);
+			inc=create_session(orig_pathname,flag,p.pid,p.mode,!NO_FD,&(root->policy),root->name);
+			put_sess_root(root);
+			kfree(orig_pathname);
 			//return the error if we have failed in creating the session
 			if(IS_ERR(inc) || inc==NULL){
-				kfree(p);
-				kfree(orig_pathname);
-				atomic_sub(1,&refcount);
+				percpu_ref_put(&refcount);
 				return (IS_ERR(inc)) ? PTR_ERR(inc) : -EAGAIN ;
 			}
 			//the validity of the session is set by the status of the incarnation
-			p->valid=inc->status;
-			printk(KERN_DEBUG "SessionFS char device: copying parameters to userspace");
+			p.valid=inc->status;
+			pr_debug("copying parameters to userspace\n");
 			//we set the file descriptor into the sess_struct.
-			p->filedes=inc->filedes;
+			p.filedes=inc->filedes;
 			//we overwrite the existing sess_struct in userspace
-			res=copy_to_user((struct sess_params*)param,p,sizeof(struct sess_params));
-			kfree(p);
+			res=copy_to_user((struct sess_params*)param,&p,sizeof(struct sess_params));
 			if(res>0){
-				printk(KERN_DEBUG "SessionFS char device: bytes not copied to userspace: %d, size of strct sess_params: %ld",res, sizeof(struct sess_params));
-				atomic_sub(1,&refcount);
+				pr_debug("bytes not copied to userspace: %d, size of strct sess_params: %ld\n",res, sizeof(struct sess_params));
+				percpu_ref_put(&refcount);
 				return -EAGAIN;
 			}
-			printk(KERN_INFO "SessionFS char device: session creation successful, session status: %d\n",inc->status);
+			pr_debug("session creation successful, session status: %d\n",inc->status);
 			res=inc->status;
+			stat_record(STAT_IOCTL_OPEN,start);
 			break;
 
 		case IOCTL_SEQ_CLOSE :
-			printk(KERN_INFO "SessionFS char device: closing an active incarnation");
-			res=close_session(orig_pathname,p->filedes,p->pid);
-			kfree(orig_pathname);
+			pr_debug("closing an active incarnation\n");
+			res=close_session(p.filedes);
+			if(res==-EPIPE){
+				pr_debug("the original file has been removed, sending SIGPIPE\n");
+				send_sig(SIGPIPE,current,0);
+			}
 			if(res<0){
-				printk(KERN_INFO "SessionFS char device: failed closing the incarnation, sending SIGPIPE");
-				//we get the task struct of the user process
-				pid=find_get_pid(p->pid);
-				if(IS_ERR(pid) || pid==NULL){
-					atomic_sub(1,&refcount);
-					return -EPIPE;
-				}
-				task=get_pid_task(pid,PIDTYPE_PID);
-				if(task == NULL || IS_ERR(task)){
-					atomic_sub(1,&refcount);
-					return -EPIPE;
-				}
-				//we send the SIGPIPE
-				res=send_sig(SIGPIPE,task,0);
-				atomic_sub(1,&refcount);
-				return -EPIPE;
+				percpu_ref_put(&refcount);
+				return res;
 			}
-			kfree(p);
-			printk(KERN_INFO "SessionFS char device: closed incarnation successfully");
+			pr_debug("closed incarnation successfully\n");
+			break;
+
+		case IOCTL_SEQ_ADD_ROOT :
+		case IOCTL_SEQ_REMOVE_ROOT :
+			res=update_sess_roots(num,param);
+			break;
+
+		case IOCTL_SEQ_LIST :
+			res=list_sessions(param);
 			break;
 
 		case IOCTL_SEQ_SHUTDOWN :
-			printk(KERN_INFO "SessionFS char device: requesting device shutdown");
-			//we disable the device to avoid having other preocesses using it
-			atomic_set(&device_status,DEVICE_DISABLED);
+			pr_debug("requesting device shutdown\n");
+			//only one shutdown at a time can kill the refcount and wait for it to drain
+			if(!mutex_trylock(&shutdown_lock)){
+				pr_debug("shutdown already in progress\n");
+				percpu_ref_put(&refcount);
+				return -EBUSY;
+			}
+			//we disable the device to avoid having other processes using it and wait for the ones that are using it
+			reinit_completion(&refcount_drained);
+			percpu_ref_kill(&refcount);
+			percpu_ref_put(&refcount);
+			wait_for_completion(&refcount_drained);
 			//we try to clean the session manager
 			active_sessions=clean_manager();
 			//we write to the user the number of active sessions
 			res=copy_to_user((int*)param,&active_sessions,sizeof(int));
 			if(res>0){
-				printk(KERN_DEBUG "SessionFS char device: bytes not copied to userspace: %d",res);
+				pr_debug("bytes not copied to userspace: %d\n",res);
 			}
-			printk(KERN_DEBUG "SessionFS char device: refcount %d,active_sessions: %d,kobject refcount: %d ",atomic_read(&refcount),active_sessions,kref_read(&(dev->kobj.kref)));
-			/// To allow the unload of the module we need to have no active sessions, no processes that are using the device and no processes that are using the device kobject.
-			if(active_sessions==0 && atomic_read(&refcount)==1 && kref_read(&(dev->kobj.kref))==2){
+			pr_debug("active_sessions: %d,kobject refcount: %d \n",active_sessions,kref_read(&(dev->kobj.kref)));
+			/// To allow the unload of the module we need to have no active sessions and no processes that are using the device kobject, the device has already been drained.
+			if(active_sessions==0 && kref_read(&(dev->kobj.kref))==2){
 				//we wait for the rcu items to be deallocated
 				synchronize_rcu();
-				printk(KERN_INFO "SessionFS char device: shutdown allowed, module unlocked");
+				pr_debug("shutdown allowed, module unlocked\n");
 				// since we are the only ones using the device we can safely unlock it while maintaing it disabled.
 				module_put(THIS_MODULE);
 			} else {
-				printk(KERN_INFO "SessionFS char device: shutdown not allowed, device is in use");
-				//we re-enable the device seince we cannot shut it down while is in use
-				atomic_set(&device_status,!DEVICE_DISABLED);
+				pr_debug("shutdown not allowed, device is in use\n");
+				//we re-enable the device since we cannot shut it down while is in use
+				percpu_ref_reinit(&refcount);
 				res= -EAGAIN;
 			}
-			break;
+			mutex_unlock(&shutdown_lock);
+			//our reference has already been dropped
+			return res;
 	}
-	atomic_sub(1,&refcount);
+	percpu_ref_put(&refcount);
 	return res;
 }
 
-/** Initializes and registers the device by setting `::sess_path`, `::path_len` variables:
+/** Initializes and registers the device by adding the first session root, from `::sess_path` or `::DEFAULT_SESS_PATH`, if the directory exists:
  * `::dev_ops` will contain the operations allowed on the device, which are `device_ioctl()`, `device_read()` and `device_write()`, and the `sessionfs_devnode()` callback to set the inode permissions.
  * The _Session Manager_ submodule is also initialized using  `init_manager()` and the same happens for the
  * _Session Information_ submodule, using `init_info()`, after the device is registered.
@@ -427,74 +456,112 @@ long int device_ioctl(struct file * file, unsigned int num, unsigned long param)
  */
 int init_device(void){
 	int res;
-	//we initilize the flag of the device
-	atomic_set(&device_status,!DEVICE_DISABLED);
-	//we initialize the refcount
-	atomic_set(&refcount,0);
-	//we initialize the read-write lock
-	rwlock_init(&dev_lock);
-	// allocate the path buffer and path_len
-	sess_path=kzalloc(PATH_MAX*sizeof(char),GFP_KERNEL);
-	strcpy(sess_path,DEFAULT_SESS_PATH);
-	path_len=strlen(DEFAULT_SESS_PATH);
+	//we initialize the refcount, the initial reference is dropped when the device is killed
+	res=percpu_ref_init(&refcount,refcount_release,0,GFP_KERNEL);
+	if(res<0){
+		return res;
+	}
+	//we publish the initial session root
+	if(sess_path==NULL || sess_path[0]!='/'){
+		sess_path=DEFAULT_SESS_PATH;
+	}
+	if(replace_sess_roots(sess_path)<0){
+		pr_info("%s can't be used as session root, sessions are disabled until a root is added\n",sess_path);
+	}
 	//allocate and initialize the dev_ops struct
 	dev_ops= kzalloc(sizeof(struct file_operations),GFP_KERNEL);
+	if(!dev_ops){
+		release_roots();
+		percpu_ref_exit(&refcount);
+		return -ENOMEM;
+	}
 	dev_ops->owner=THIS_MODULE;
 	dev_ops->read=device_read;
 	dev_ops->write=device_write;
 	dev_ops->unlocked_ioctl=device_ioctl;
 	//init the session manager
-	init_manager();
+	res=init_manager();
+	if(res<0){
+		kfree(dev_ops);
+		release_roots();
+		percpu_ref_exit(&refcount);
+		return res;
+	}
 	//register the device
 	res=register_chrdev(MAJOR_NUM,DEVICE_NAME,dev_ops);
 	if(res<0){
-		printk(KERN_ALERT "SessionFS char device: failed to register the sessionfs virtual device\n");
+		pr_alert("failed to register the sessionfs virtual device\n");
+		release_manager();
+		release_roots();
+		percpu_ref_exit(&refcount);
 		return res;
 	}
-	printk(KERN_INFO "SessionFS char device: Device %s registered\n", DEVICE_NAME);
+	pr_info("Device %s registered\n", DEVICE_NAME);
 	//register the device class
 	dev_class=class_create(THIS_MODULE,CLASS_NAME);
 	if (IS_ERR(dev_class)){
 		unregister_chrdev(MAJOR_NUM, DEVICE_NAME);
-		printk(KERN_ALERT "SessionFS char device: Failed to register device class\n");
+		pr_alert("Failed to register device class\n");
+		release_manager();
+		release_roots();
+		percpu_ref_exit(&refcount);
 		return PTR_ERR(dev_class);
 	}
 	//setting devnode
 	dev_class->devnode=sessionfs_devnode;
-	printk("SessionFS char device: SessionFS device class registered successfully\n");
+	pr_info("SessionFS device class registered successfully\n");
 	//register the device driver
 	dev = device_create(dev_class, NULL, MKDEV(MAJOR_NUM, 0), NULL, DEVICE_NAME);
 		if(IS_ERR(dev)){
 			class_destroy(dev_class);
 			unregister_chrdev(MAJOR_NUM, DEVICE_NAME);
-			printk(KERN_ALERT "SessionFS char device: Failed to create the device\n");
+			pr_alert("Failed to create the device\n");
+			release_manager();
+			release_roots();
+			percpu_ref_exit(&refcount);
 			return PTR_ERR(dev);
    }
-	printk(KERN_INFO "SessionFS char device: SessionFS driver registered successfully\n");
-	init_info(&(dev->kobj));
+	pr_info("SessionFS driver registered successfully\n");
+	res=init_info(&(dev->kobj));
+	if(res<0){
+		device_destroy(dev_class,MKDEV(MAJOR_NUM,0));
+		class_destroy(dev_class);
+		unregister_chrdev(MAJOR_NUM, DEVICE_NAME);
+		pr_alert("Failed to initialize the session info\n");
+		release_manager();
+		release_roots();
+		percpu_ref_exit(&refcount);
+		return res;
+	}
 	//finally we lock the module
 	try_module_get(THIS_MODULE);
 	return 0;
 }
 
-/** Unregisters the device, cleans the _Session Manager_ just to be sure to avoid memory leaks, releases the _Session Information_ and frees the used memory ( `::dev_ops` and `::sess_path`).
+/** Unregisters the device, cleans the _Session Manager_ just to be sure to avoid memory leaks, releases the _Session Information_ and frees the used memory ( `::dev_ops` and the session roots).
  */
 void release_device(void){
 	//device disable and manager clean are run again here since the module can be forced to be removed
-	atomic_set(&device_status,DEVICE_DISABLED);
+	if(!percpu_ref_is_dying(&refcount)){
+		reinit_completion(&refcount_drained);
+		percpu_ref_kill(&refcount);
+		wait_for_completion(&refcount_drained);
+	}
 	clean_manager();
-	printk(KERN_DEBUG "SessionFS char device: releasing the device resources");
+	pr_debug("releasing the device resources\n");
 	//we check if there are active incarnations
-	printk(KERN_DEBUG "SessionFS char device: unregistering device and freeing used memory");
+	pr_debug("unregistering device and freeing used memory\n");
 	//remove the info on sessions
 	release_info();
-	printk(KERN_DEBUG "SessionFS char device: destroying and unregistering the device");
+	pr_debug("destroying and unregistering the device\n");
 	//unregister the device
 	device_destroy(dev_class,MKDEV(MAJOR_NUM,0));
 	class_destroy(dev_class);
 	unregister_chrdev(MAJOR_NUM,DEVICE_NAME);
 	//free used memory
-	kfree(sess_path);
+	release_manager();
+	release_roots();
 	kfree(dev_ops);
-	printk("SessionFS char device: device release complete");
+	percpu_ref_exit(&refcount);
+	pr_info("device release complete\n");
 }
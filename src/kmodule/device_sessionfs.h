@@ -28,6 +28,15 @@
 /// The ioctl sequence number that idenfies the closing of a session.
 #define IOCTL_SEQ_CLOSE 1
 
+/// The ioctl sequence number that idenfies the addition of a session root.
+#define IOCTL_SEQ_ADD_ROOT 2
+
+/// The ioctl sequence number that idenfies the removal of a session root.
+#define IOCTL_SEQ_REMOVE_ROOT 3
+
+/// The ioctl sequence number that idenfies the listing of the sessions of the calling process.
+#define IOCTL_SEQ_LIST 4
+
 /// The ioctl sequence number that idenfies the request for the device shutdown.
 #define IOCTL_SEQ_SHUTDOWN 10
 
@@ -41,6 +50,9 @@
 ///Defines the validity of a session
 #define VALID_SESS 0
 
+///The value of the `valid` member of `::sess_params` when the file is not in a session root, so it must be opened without the session semantic.
+#define OUTSIDE_ROOTS 1
+
 /**
  * \struct sess_params
  * \param orig_path The pathname of the original file to be opened in a session, or that represents the original file containing the incarnation to be closed.
@@ -48,7 +60,7 @@
  * \param mode The permissions to apply to newly created files.
  * \param pid The pid of the process that requests the creation of an incarnation.
  * \param filedes The file descriptor of the incarnation.
- * \param valid The session can be invalid if there was an error in the copying of the original file over the incarnation file, so the value of this parameter can be <= `::VALID_SESS`.
+ * \param valid The session can be invalid if there was an error in the copying of the original file over the incarnation file, so the value of this parameter can be <= `::VALID_SESS`; it is `::OUTSIDE_ROOTS` if the file is not in a session root.
  *
  * This struct will hold all the necessary parameters used to open and close sessions.
 */
@@ -69,6 +81,7 @@ struct sess_params{
 
 /** \brief We define the ioctl command for closing a session.
  *
+ * Sessions are committed when the incarnation file is released, this command commits the session before closing the file descriptor.
  * We use the macro `_IOWR` since we need to pass to the virtual device the `sess_params` struct.
  */
 #define IOCTL_CLOSE_SESSION _IOWR(MAJOR_NUM,IOCTL_SEQ_CLOSE,struct sess_params*)
@@ -79,4 +92,72 @@ struct sess_params{
  */
 #define IOCTL_DEVICE_SHUTDOWN _IOR(MAJOR_NUM,IOCTL_SEQ_SHUTDOWN,int*)
 
+/// Commit mode of a session root: the last closed incarnation overwrites the original file.
+#define COMMIT_ON_CLOSE 0
+
+/// Commit mode of a session root: incarnations are discarded when closed, the original file is never modified.
+#define COMMIT_DISCARD 1
+
+/// Copy engine of a session root: the files are copied with `kernel_read()` and `kernel_write()`.
+#define COPY_READ_WRITE 0
+
+/// Copy engine of a session root: the files are copied with `vfs_copy_file_range()`, so that filesystems can share extents.
+#define COPY_FILE_RANGE 1
+
+/**
+ * \struct sess_policy
+ * \param commit_mode How incarnations are committed: `::COMMIT_ON_CLOSE` or `::COMMIT_DISCARD`.
+ * \param copy_engine How files are copied: `::COPY_READ_WRITE` or `::COPY_FILE_RANGE`.
+ *
+ * The policy applied to the sessions opened in a session root.
+ */
+struct sess_policy{
+	int commit_mode;
+	int copy_engine;
+};
+
+/**
+ * \struct root_params
+ * \param path The absolute pathname of the directory.
+ * \param policy The policy of the sessions opened in the directory, ignored when the root is removed.
+ *
+ * This struct holds the parameters used to add and remove session roots.
+ */
+struct root_params{
+	const char* path;
+	struct sess_policy policy;
+};
+
+/** \brief We define the ioctl command for adding a session root.
+ *
+ * We use the `_IOW` macro since we need to pass to the virtual device the `::root_params` struct.
+ */
+#define IOCTL_ADD_ROOT _IOW(MAJOR_NUM,IOCTL_SEQ_ADD_ROOT,struct root_params*)
+
+/** \brief We define the ioctl command for removing a session root.
+ *
+ * We use the `_IOW` macro since we need to pass to the virtual device the `::root_params` struct.
+ */
+#define IOCTL_REMOVE_ROOT _IOW(MAJOR_NUM,IOCTL_SEQ_REMOVE_ROOT,struct root_params*)
+
+/**
+ * \struct list_params
+ * \param buf The buffer that will contain the open incarnations of the calling process, one per line as `[fd] [status] [original pathname]`.
+ * \param buflen The length of `buf`.
+ * \param num The number of incarnations written in `buf`.
+ *
+ * This struct holds the parameters used to list the sessions of the calling process.
+ */
+struct list_params{
+	char* buf;
+	int buflen;
+	int num;
+};
+
+/** \brief We define the ioctl command for listing the sessions of the calling process.
+ *
+ * We use the `_IOWR` macro since we need to pass to the virtual device the `::list_params` struct, that will be updated with the number of sessions.
+ */
+#define IOCTL_LIST_SESSIONS _IOWR(MAJOR_NUM,IOCTL_SEQ_LIST,struct list_params*)
+
 #endif
@@ -8,7 +8,7 @@
 #ifndef DEV_MODULE
 #define DEV_MODULE
 
-/// Keeps the path to the directory in which session sematic is enabled (located in ::device_sessionfs.c).
+/// The path to the directory in which session sematic is enabled when the module is loaded (located in ::device_sessionfs.c).
 extern char* sess_path;
 
 /** \brief Device initialization and registration.
@@ -9,6 +9,18 @@
 
 //our custom virtual device
 #include "device_sessionfs_mod.h"
+//the stackable filesystem
+#include "sessionfs_mount.h"
+//the latency statistics
+#include "session_stats.h"
+//the sysfs_objects parameter
+#include "session_info.h"
+//the record_subbufs parameter
+#include "session_record.h"
+//the usage_warn_* parameters
+#include "session_usage.h"
+//the quota_* parameters
+#include "session_quota.h"
 
 /**
  * \brief Specification of the license used by the module.
@@ -25,24 +37,61 @@ MODULE_VERSION("0.5");
 
 /// We set the session path as a read-only module parameter.
 module_param(sess_path,charp,0444);
-MODULE_PARM_DESC(sess_path,"path in which session sematic is enabled");
+MODULE_PARM_DESC(sess_path,"path in which session sematic is enabled when the module is loaded");
 
-/** \brief Loads the device when the kernel module is loaded in the kernel
+/// We set the publication of sessions as kernel objects as a read-only module parameter.
+module_param(sysfs_objects,bool,0444);
+MODULE_PARM_DESC(sysfs_objects,"publish each session and incarnation in SysFS, otherwise they are shown only in /proc/sessionfs/sessions");
+
+/// We set the size of the buffers of the recorder as a read-only module parameter.
+module_param(record_subbufs,uint,0444);
+MODULE_PARM_DESC(record_subbufs,"number of 64 KiB sub-buffers of each CPU used to record the session operations");
+
+/// We set the usage limits as writable module parameters, so that they can be changed while the module is loaded.
+module_param(usage_warn_mem,ulong,0644);
+MODULE_PARM_DESC(usage_warn_mem,"kernel memory, in bytes, over which a warning is printed, 0 to disable it");
+module_param(usage_warn_disk,ulong,0644);
+MODULE_PARM_DESC(usage_warn_disk,"disk space of the incarnation files, in bytes, over which a warning is printed, 0 to disable it");
+
+/// We set the limits of the admission control as writable module parameters, they apply to the next opens.
+module_param(quota_file_bytes,ulong,0644);
+MODULE_PARM_DESC(quota_file_bytes,"bytes of the open incarnations of an original file over which the opens are refused, 0 for no limit");
+module_param(quota_root_bytes,ulong,0644);
+MODULE_PARM_DESC(quota_root_bytes,"bytes of the open incarnations of a session root over which the opens are refused, 0 for no limit");
+module_param(quota_uid_bytes,ulong,0644);
+MODULE_PARM_DESC(quota_uid_bytes,"bytes of the open incarnations of a user over which the opens are refused, 0 for no limit");
+module_param(quota_wait_ms,uint,0644);
+MODULE_PARM_DESC(quota_wait_ms,"milliseconds an open over a limit waits for other incarnations to be closed before failing with EDQUOT");
+
+/** \brief Publishes the statistics, loads the device and registers the stackable filesystem when the kernel module is loaded in the kernel
  * \returns 0 on success, and error code on fail
  */
 static int __init sessionFS_load(void){
 	int ret;
+	init_stats();
 	ret=init_device();
+	if(ret<0){
+		release_stats();
+		return ret;
+	}
+	ret=init_stacked_fs();
+	if(ret<0){
+		release_device();
+		release_stats();
+		return ret;
+	}
 	printk(KERN_INFO "SessionFS: module loaded\n");
 	return ret;
 }
 
 /**
- * Before unloading the module we relase the device.
+ * Before unloading the module we unregister the stackable filesystem and relase the device.
  */
 static void __exit sessionFS_unload(void){
 	printk(KERN_INFO "SessionFS: shutting down the device");
+	release_stacked_fs();
 	release_device();
+	release_stats();
 	printk(KERN_INFO "SessionFS: device powered off");
 }
 /// Specification of the module init function
@@ -1,7 +1,22 @@
 /** \file
  * \brief Implementation of the _Session Information_ submodule.
+ *
+ * Information on the sessions is published in two ways:
+ * - in SysFS, where each `::session` is a kernel object and each `::incarnation` one of its attributes;
+ * - in the `/proc/sessionfs/sessions` table, which is generated when it is read, by walking the sessions list one line
+ *   at a time.
+ *
+ * Creating kernel objects and attributes takes the SysFS locks, so they are not created while opening a session:
+ * `add_session_info()` and `add_incarnation_info()` only queue them in the ::pending_sessions and ::pending_incarnations
+ * lists, which are published in batches by `publish_info()`, running on the system workqueue within ::PUBLISH_DELAY_MS.
+ * Sessions and incarnations closed before being published are simply removed from the lists, without touching SysFS.
+ * Kernel objects can also be disabled with the `sysfs_objects` module parameter, leaving only the global SysFS attributes
+ * and the session table.
  */
 
+///Prefix of the messages printed by the session info component.
+#define pr_fmt(fmt) "SessionFS session info: " fmt
+
 #include "session_info.h"
 //for container_of
 #include <linux/kernel.h>
@@ -9,18 +24,92 @@
 #include <linux/pid.h>
 //for struct task_struct
 #include <linux/sched.h>
+//for put_task_struct
+#include <linux/sched/task.h>
 //for memory APIs
 #include <linux/slab.h>
+//for strreplace
+#include <linux/string.h>
+//for the per-CPU variables
+#include <linux/percpu.h>
+#include <linux/percpu_counter.h>
+//for the session table
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+//for the incarnations list and the pending lists
+#include <linux/list.h>
+#include <linux/spinlock.h>
+//for the deferred publication
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+
+//for next_session
+#include "session_manager.h"
+//for print_usage
+#include "session_usage.h"
+//for print_quota
+#include "session_quota.h"
 
 ///Kernel objects attributes are read only, since we only read information on sessions
 #define KERN_OBJ_PERM 0444
 
-///The number of opened sessions.
-atomic_t sessions_num;
+///The number of opened sessions, kept per-CPU since it changes on every open and close.
+struct percpu_counter sessions_num;
 
  ///The device kobject provided during `init_info()`.
  struct kobject* dev_kobj;
 
+///If false sessions and incarnations are not published as kernel objects, but only in the session table.
+bool sysfs_objects=true;
+
+///The procfs directory which contains the session table.
+struct proc_dir_entry* proc_dir=NULL;
+
+///The `::sess_info`(s) waiting to be published.
+LIST_HEAD(pending_sessions);
+
+///The `::inc_info`(s) waiting to be published.
+LIST_HEAD(pending_incarnations);
+
+///Protects ::pending_sessions and ::pending_incarnations.
+DEFINE_SPINLOCK(pending_lock);
+
+///Held while publishing, so that a removal waits for the publication of its object to be completed.
+DEFINE_MUTEX(publish_lock);
+
+void publish_info(struct work_struct* work);
+
+///The work that publishes the pending kernel objects and attributes.
+DECLARE_DELAYED_WORK(publish_work,publish_info);
+
+/** \struct global_counters
+ * \brief The throughput counters of the whole module, kept per-CPU since they are updated by every session.
+ * \param counters One counter for each `::sess_counter`.
+ */
+struct global_counters{
+	u64 counters[CNT_NUM];
+};
+
+///The per-CPU throughput counters, they are never reset so they survive the removal of the sessions.
+DEFINE_PER_CPU(struct global_counters, session_counters);
+
+///The names of the throughput counters, as shown in the SysFS `counters` files.
+const char* counter_names[CNT_NUM]={"opens","closes","bytes_snapshot","bytes_committed","commits_skipped","failures"};
+
+/** \brief Prints the throughput counters in a SysFS buffer.
+ * \param[out] buf The buffer (which is PAGE_SIZE bytes long).
+ * \param[in] counters The value of each `::sess_counter`.
+ * \returns The number of bytes written (in [0,PAGE_SIZE]).
+ */
+ssize_t print_counters(char* buf, u64* counters){
+	ssize_t len=0;
+	int i;
+	for(i=0;i<CNT_NUM;i++){
+		len+=scnprintf(buf+len,PAGE_SIZE-len,"%s %llu\n",counter_names[i],counters[i]);
+	}
+	return len;
+}
+
 
 /** \brief The function used to read the SysFS `active_sessions_num` attribute file.
  * \param[in] obj The kobject that has the attribute being read.
@@ -30,12 +119,83 @@ atomic_t sessions_num;
  * The file content is the number of active sessions.
  */
  ssize_t active_sessions_num_show(struct kobject *obj, struct kobj_attribute *attr, char* buf){
-	 return scnprintf(buf,PAGE_SIZE,"%d",atomic_read(&sessions_num));
+	 return scnprintf(buf,PAGE_SIZE,"%lld",percpu_counter_sum(&sessions_num));
 }
 
  ///The kernel attribute that will contain the number of open sessions.
  struct kobj_attribute kattr= __ATTR_RO(active_sessions_num);
 
+/** \brief The function used to read the SysFS `session_counters` attribute file.
+ * \param[in] obj The kobject that has the attribute being read.
+ * \param[in] attr The attribute of the kobject that is being read.
+ * \param[out] buf The buffer (which is PAGE_SIZE bytes long) that contains the file contents.
+ * \returns The number of bytes read (in [0,PAGE_SIZE]).
+ * The file content is a line for each throughput counter, summed over all the CPUs.
+ */
+ssize_t session_counters_show(struct kobject *obj, struct kobj_attribute *attr, char* buf){
+	u64 counters[CNT_NUM]={0};
+	int cpu,i;
+	for_each_possible_cpu(cpu){
+		for(i=0;i<CNT_NUM;i++){
+			counters[i]+=READ_ONCE(per_cpu_ptr(&session_counters,cpu)->counters[i]);
+		}
+	}
+	return print_counters(buf,counters);
+}
+
+///The kernel attribute that will contain the global throughput counters.
+struct kobj_attribute counters_kattr= __ATTR_RO(session_counters);
+
+/** \brief The function used to read the SysFS `usage` attribute file.
+ * \param[in] obj The kobject that has the attribute being read.
+ * \param[in] attr The attribute of the kobject that is being read.
+ * \param[out] buf The buffer (which is PAGE_SIZE bytes long) that contains the file contents.
+ * \returns The number of bytes read (in [0,PAGE_SIZE]).
+ * The file content is the memory and disk usage of the module, see `print_usage()`.
+ */
+ssize_t usage_show(struct kobject *obj, struct kobj_attribute *attr, char* buf){
+	return print_usage(buf,PAGE_SIZE);
+}
+
+///The kernel attribute that will contain the memory and disk usage.
+struct kobj_attribute usage_kattr= __ATTR_RO(usage);
+
+/** \brief The function used to read the SysFS `quota` attribute file.
+ * \param[in] obj The kobject that has the attribute being read.
+ * \param[in] attr The attribute of the kobject that is being read.
+ * \param[out] buf The buffer (which is PAGE_SIZE bytes long) that contains the file contents.
+ * \returns The number of bytes read (in [0,PAGE_SIZE]).
+ * The file content is the limits of the admission control and the bytes charged to each account, see `print_quota()`.
+ */
+ssize_t quota_show(struct kobject *obj, struct kobj_attribute *attr, char* buf){
+	return print_quota(buf,PAGE_SIZE);
+}
+
+///The kernel attribute that will contain the limits and the accounts of the admission control.
+struct kobj_attribute quota_kattr= __ATTR_RO(quota);
+
+/** \brief The function used to read the SysFS `counters` attribute file of a session.
+ * \param[in] obj The kobject that has the attribute being read.
+ * \param[in] attr The attribute of the kobject that is being read.
+ * \param[out] buf The buffer (which is PAGE_SIZE bytes long) that contains the file contents.
+ * \returns The number of bytes read (in [0,PAGE_SIZE]).
+ * The file content is a line for each throughput counter of the original file, followed by the bytes charged by its open
+ * incarnations (`bytes_charged`).
+ */
+ssize_t counters_show(struct kobject *obj, struct kobj_attribute *attr, char* buf){
+	struct sess_info* info=container_of(attr,struct sess_info,counters_attr);
+	struct session* session=container_of(info,struct session,info);
+	u64 counters[CNT_NUM];
+	ssize_t len;
+	int i;
+	for(i=0;i<CNT_NUM;i++){
+		counters[i]=atomic64_read(&(info->counters[i]));
+	}
+	len=print_counters(buf,counters);
+	len+=scnprintf(buf+len,PAGE_SIZE-len,"bytes_charged %lld\n",atomic64_read(&(session->charged)));
+	return len;
+}
+
 /** \brief The function used to read the SysFS `active_incarnations_num` attribute file.
  * \param[in] obj The kobject that has the attribute being read.
  * \param[in] attr The attribute of the kobject that is being read.
@@ -56,164 +216,452 @@ atomic_t sessions_num;
  * The file content is the process name that corresponds to the pid used as filename.
  */
  ssize_t proc_name_show(struct kobject *obj, struct kobj_attribute *attr, char* buf){
-	 struct incarnation* inc=container_of(attr,struct incarnation,inc_attr);
+	 struct incarnation* inc=container_of(attr,struct incarnation,info.attr);
 	 //we get the task struct containing the process name
 	 struct task_struct* task;
 	 struct pid* pid;
+	 ssize_t res;
 	 char* name="ERROR: process not found";
 	 pid=find_get_pid(inc->owner_pid);
 	 if(!IS_ERR(pid) && pid){
 		task=get_pid_task(pid,PIDTYPE_PID);
 		if(!IS_ERR(task) && task){
-			name=task->comm;
+			res=scnprintf(buf,PAGE_SIZE,"%s",task->comm);
+			put_task_struct(task);
+			put_pid(pid);
+			return res;
 		}
+		put_pid(pid);
 	 }
 	 return scnprintf(buf,PAGE_SIZE,"%s",name);
 }
 
+/** \brief Prints a line of the session table.
+ * \param[in] session The `::session` to print, on which `next_session()` holds a reference.
+ * \param[in] m The seq_file of the session table.
+ *
+ * The line contains the pathname of the original file, the number of active incarnations and a `pid:name` entry for each
+ * active `::incarnation`.
+ * Since we are in an RCU read-side critical section the task is looked up without taking references, while the
+ * incarnations list is read holding the `inc_lock` of the `::session`.
+ */
+void print_session_line(struct session* session, struct seq_file* m){
+	struct incarnation* incarnation;
+	struct task_struct* task;
+	seq_printf(m,"%s %d",session->pathname,atomic_read(&(session->info.inc_num)));
+	spin_lock(&(session->inc_lock));
+	list_for_each_entry(incarnation,&(session->incarnations),node){
+		if(atomic_read(&(incarnation->closed))!=0){
+			continue;
+		}
+		task=pid_task(find_vpid(incarnation->owner_pid),PIDTYPE_PID);
+		seq_printf(m," %d:%s",incarnation->owner_pid,(task!=NULL) ? task->comm : "?");
+	}
+	spin_unlock(&(session->inc_lock));
+	seq_putc(m,'\n');
+}
+
+/** \brief Starts, or restarts, a read of the session table.
+ * \param[in] m The seq_file of the session table.
+ * \param[in] pos The line to start from.
+ * \returns The `::session` of the line, or `NULL` if the table has less lines.
+ *
+ * The RCU read-side critical section lasts until `sessions_stop()`, the sessions before `pos` are skipped since the
+ * seq_file restarts from the line that didn't fit its buffer.
+ */
+void* sessions_start(struct seq_file* m, loff_t* pos){
+	struct session* session;
+	loff_t i;
+	rcu_read_lock();
+	session=next_session(NULL);
+	for(i=0;session!=NULL && i<*pos;i++){
+		session=next_session(session);
+	}
+	return session;
+}
+
+/** \brief Moves to the next line of the session table.
+ * \param[in] m The seq_file of the session table.
+ * \param[in] v The `::session` of the current line.
+ * \param[in,out] pos The current line, incremented.
+ * \returns The next `::session`, or `NULL` at the end of the table.
+ */
+void* sessions_next(struct seq_file* m, void* v, loff_t* pos){
+	(*pos)++;
+	return next_session(v);
+}
+
+/** \brief Stops a read of the session table.
+ * \param[in] m The seq_file of the session table.
+ * \param[in] v The `::session` of the line that has not been shown, or `NULL`.
+ */
+void sessions_stop(struct seq_file* m, void* v){
+	end_session_walk(v);
+	rcu_read_unlock();
+}
+
+/** \brief Shows a line of the session table.
+ * \param[in] m The seq_file of the session table.
+ * \param[in] v The `::session` of the line.
+ * \returns 0.
+ */
+int sessions_show(struct seq_file* m, void* v){
+	print_session_line(v,m);
+	return 0;
+}
+
+///The iterator of the session table, which walks the sessions one line at a time instead of rendering the whole table.
+const struct seq_operations sessions_seq_ops={
+	.start=sessions_start,
+	.next=sessions_next,
+	.stop=sessions_stop,
+	.show=sessions_show
+};
+
 /**
  * We add an attribute called `active_sessions_num` to the SessionFS device kernel object, which is only readable and its content is the number of active sessions.
+ * The `session_counters` attribute is also added, with the throughput counters of all the sessions, the `usage`
+ * attribute, with the memory and disk usage, and the `quota` attribute, with the accounts of the admission control.
+ * Then the session table is created in procfs.
  */
  int init_info(struct kobject* device_kobj){
 	int res;
-	printk(KERN_DEBUG "SessionFS session info: Initializing the info on the active sessions, device kobject refcount:%d",kref_read(&(device_kobj->kref)));
+	pr_debug("initializing the info on the active sessions, device kobject refcount:%d\n",kref_read(&(device_kobj->kref)));
 	//we initialize the session_num
-	atomic_set(&sessions_num,0);
+	res=percpu_counter_init(&sessions_num,0,GFP_KERNEL);
+	if(res<0){
+		return res;
+	}
 	//we create the session_num attribute
 	//we add the attribute to the device
 	res=sysfs_create_file(device_kobj,&(kattr.attr));
 	if(res<0){
+		percpu_counter_destroy(&sessions_num);
+		return res;
+	}
+	res=sysfs_create_file(device_kobj,&(counters_kattr.attr));
+	if(res<0){
+		sysfs_remove_file(device_kobj,&(kattr.attr));
+		percpu_counter_destroy(&sessions_num);
 		return res;
 	}
-	printk(KERN_DEBUG "SessionFS session info: info added successfully");
+	res=sysfs_create_file(device_kobj,&(usage_kattr.attr));
+	if(res<0){
+		sysfs_remove_file(device_kobj,&(kattr.attr));
+		sysfs_remove_file(device_kobj,&(counters_kattr.attr));
+		percpu_counter_destroy(&sessions_num);
+		return res;
+	}
+	res=sysfs_create_file(device_kobj,&(quota_kattr.attr));
+	if(res<0){
+		sysfs_remove_file(device_kobj,&(kattr.attr));
+		sysfs_remove_file(device_kobj,&(counters_kattr.attr));
+		sysfs_remove_file(device_kobj,&(usage_kattr.attr));
+		percpu_counter_destroy(&sessions_num);
+		return res;
+	}
+	//we create the session table
+	proc_dir=proc_mkdir(PROC_DIR,NULL);
+	if(proc_dir==NULL || proc_create_seq(PROC_SESSIONS,KERN_OBJ_PERM,proc_dir,&sessions_seq_ops)==NULL){
+		proc_remove(proc_dir);
+		proc_dir=NULL;
+		sysfs_remove_file(device_kobj,&(kattr.attr));
+		sysfs_remove_file(device_kobj,&(counters_kattr.attr));
+		sysfs_remove_file(device_kobj,&(usage_kattr.attr));
+		sysfs_remove_file(device_kobj,&(quota_kattr.attr));
+		percpu_counter_destroy(&sessions_num);
+		return -ENOMEM;
+	}
+	pr_debug("info added successfully\n");
 	dev_kobj=device_kobj;
-	printk(KERN_DEBUG "SessionFS session info: device kobject refcount:%d",kref_read(&(dev_kobj->kref)));
+	pr_debug("device kobject refcount:%d\n",kref_read(&(dev_kobj->kref)));
 	return 0;
 }
 
 void release_info(void){
-	printk(KERN_DEBUG "SessionFS session info: removing info on active sessions");
-///We remove the 'active_sessions_num' attribute from the device
+	pr_debug("removing info on active sessions\n");
+	//there are no more sessions, but the work could still be queued
+	cancel_delayed_work_sync(&publish_work);
+///We remove the 'active_sessions_num', 'session_counters', 'usage' and 'quota' attributes from the device
 sysfs_remove_file(dev_kobj,&(kattr.attr));
+sysfs_remove_file(dev_kobj,&(counters_kattr.attr));
+sysfs_remove_file(dev_kobj,&(usage_kattr.attr));
+sysfs_remove_file(dev_kobj,&(quota_kattr.attr));
+	//we remove the session table, waiting for its readers
+	proc_remove(proc_dir);
+	proc_dir=NULL;
+	percpu_counter_destroy(&sessions_num);
 }
 
-/**
- * We add a new folder in sysfs which is represented by the given kobject.
- * The `::session` kobject, represented by the `::sess_info` member the `::session` object will be created as a child of `::dev_kobj`, and the `::dev_kobj` reference counter will be incremented.
+/** \brief Creates the kernel object of a `::session` and its attributes.
+ * \param[in,out] session The information on the session, represented by a struct `::sess_info`.
+ *
+ * Called by `publish_info()` holding ::publish_lock. If the kernel object can't be created the `::session` is only shown in
+ * the session table.
  */
-int add_session_info(const char* name,struct sess_info* session){
-	int res,i,namelen;
+void publish_session(struct sess_info* session){
+	int res;
 	char * f_name=NULL;
-	printk(KERN_DEBUG "SessionFS session info: adding info on a new original file: %s",name);
-	f_name=kzalloc(sizeof(char*)*PATH_MAX, GFP_KERNEL);
+	struct kobject* kobj;
+	///We also format the filename substituting '/' with '-', the kernel object keeps its own copy of the name.
+	f_name=kstrdup(session->name,GFP_KERNEL);
 	if(f_name==NULL){
-		return -ENOMEM;
+		pr_warn("can't publish %s\n",session->name);
+		return;
 	}
-	///We also format the filename substituting '/' with '-'.
-	namelen=strlen(name);
-	for(i=0;i<namelen;i++){
-		if(name[i]!='/'){
-			f_name[i]=name[i];
-		} else {
-			f_name[i]='-';
-		}
-	}
-	session->f_name=f_name;
-	printk(KERN_DEBUG "SessionFS session info: formatted filename: %s",f_name);
+	strreplace(f_name,'/','-');
+	pr_debug("formatted filename: %s\n",f_name);
 	//we add the session kobject as a child of the root kobject
-	session->kobj=kobject_create_and_add(f_name,dev_kobj);
-	if(!session->kobj){
-		kfree(f_name);
-		session->f_name=NULL;
-		kobject_put(dev_kobj);
-		return -ENOMEM;
+	kobj=kobject_create_and_add(f_name,dev_kobj);
+	kfree(f_name);
+	if(!kobj){
+		pr_warn("can't publish %s\n",session->name);
+		return;
 	}
-	printk(KERN_DEBUG "SessionFS session info: folder created, adding info on the active incarnations number");
-	///Finally, initialize the number of incarnations as a kobj_attribute.
-	atomic_set(&(session->inc_num),0);
+	pr_debug("folder created, adding info on the active incarnations number\n");
+	///Then, initialize the number of incarnations as a kobj_attribute.
 	session->inc_num_attr.attr.name="active_incarnations_num";
 	session->inc_num_attr.attr.mode=VERIFY_OCTAL_PERMISSIONS(KERN_OBJ_PERM);
 	session->inc_num_attr.show=active_incarnations_num_show;
 	session->inc_num_attr.store=NULL;
 	//we add the attribute to the device
-	res=sysfs_create_file(session->kobj,&(session->inc_num_attr.attr));
+	res=sysfs_create_file(kobj,&(session->inc_num_attr.attr));
 	if(res<0){
-		kfree(f_name);
-		session->f_name=NULL;
-		kobject_del(session->kobj);
-		return res;
+		kobject_del(kobj);
+		kobject_put(kobj);
+		pr_warn("can't publish %s, error %d\n",session->name,res);
+		return;
+	}
+	///The throughput counters are published in the `counters` attribute.
+	session->counters_attr.attr.name="counters";
+	session->counters_attr.attr.mode=VERIFY_OCTAL_PERMISSIONS(KERN_OBJ_PERM);
+	session->counters_attr.show=counters_show;
+	session->counters_attr.store=NULL;
+	res=sysfs_create_file(kobj,&(session->counters_attr.attr));
+	if(res<0){
+		sysfs_remove_file(kobj,&(session->inc_num_attr.attr));
+		kobject_del(kobj);
+		kobject_put(kobj);
+		pr_warn("can't publish %s, error %d\n",session->name,res);
+		return;
+	}
+	session->kobj=kobj;
+	pr_debug("info added successfully, kobject refcount:%d ,device kobject refcount:%d\n",kref_read(&(kobj->kref)),kref_read(&(dev_kobj->kref)));
+}
+
+/** \brief Creates the kernel object attribute of an `::incarnation`.
+ * \param[in,out] incarnation The information on the incarnation, represented by a struct `::inc_info`.
+ *
+ * Called by `publish_info()` holding ::publish_lock, after the parent `::session` has been published.
+ * The format of the file found on SysFS `[pid]_[file descriptor]`, to allow the same process to have the process open the same file multiple times.
+ */
+void publish_incarnation(struct inc_info* incarnation){
+	int res;
+	char* name;
+	//if the parent session couldn't be published the incarnation is only shown in the session table
+	if(incarnation->parent->kobj==NULL){
+		return;
+	}
+	name=kasprintf(GFP_KERNEL,"%d_%d",incarnation->pid,incarnation->fdes);
+	if(!name){
+		return;
+	}
+	//we get the parent kobject
+	kobject_get(incarnation->parent->kobj);
+	//we create the attribute
+	incarnation->attr.attr.name=name;
+	incarnation->attr.attr.mode=VERIFY_OCTAL_PERMISSIONS(KERN_OBJ_PERM);
+	incarnation->attr.show=proc_name_show;
+	incarnation->attr.store=NULL;
+	//we add the attribute to the device
+	res=sysfs_create_file(incarnation->parent->kobj,&(incarnation->attr.attr));
+	if(res<0){
+		kobject_put(incarnation->parent->kobj);
+		incarnation->attr.attr.name=NULL;
+		kfree(name);
+		return;
+	}
+	//the name is freed with the incarnation
+	usage_alloc(MEM_INCARNATIONS,ksize(name));
+	pr_debug("info added successfully, kobject refcount:%d\n",kref_read(&(incarnation->parent->kobj->kref)));
+}
+
+/** \brief Publishes the pending `::sess_info`(s) and `::inc_info`(s), executed by ::publish_work.
+ * \param[in] work Unused.
+ *
+ * Each element is removed from its list holding ::pending_lock, then published holding ::publish_lock, so a concurrent
+ * removal either finds it in the list or waits for its publication.
+ * The sessions are published before the incarnations, an incarnation whose parent `::session` is still pending is left in
+ * the list and the work is scheduled again.
+ */
+void publish_info(struct work_struct* work){
+	struct sess_info* session;
+	struct inc_info* incarnation;
+	int requeue=0;
+	mutex_lock(&publish_lock);
+	for(;;){
+		spin_lock(&pending_lock);
+		session=list_first_entry_or_null(&pending_sessions,struct sess_info,pending);
+		if(session!=NULL){
+			list_del_init(&(session->pending));
+		}
+		spin_unlock(&pending_lock);
+		if(session==NULL){
+			break;
+		}
+		publish_session(session);
+	}
+	for(;;){
+		spin_lock(&pending_lock);
+		incarnation=list_first_entry_or_null(&pending_incarnations,struct inc_info,pending);
+		if(incarnation!=NULL){
+			if(list_empty(&(incarnation->parent->pending))){
+				list_del_init(&(incarnation->pending));
+			} else {
+				//the parent session has been queued after we emptied the sessions list
+				incarnation=NULL;
+				requeue=1;
+			}
+		}
+		spin_unlock(&pending_lock);
+		if(incarnation==NULL){
+			break;
+		}
+		publish_incarnation(incarnation);
+	}
+	mutex_unlock(&publish_lock);
+	if(requeue){
+		schedule_delayed_work(&publish_work,msecs_to_jiffies(PUBLISH_DELAY_MS));
+	}
+}
+
+/** \brief Queues an element in a pending list and schedules its publication.
+ * \param[in] pending The `pending` member of the element.
+ * \param[in] list The pending list.
+ */
+void queue_publication(struct list_head* pending, struct list_head* list){
+	spin_lock(&pending_lock);
+	list_add_tail(pending,list);
+	spin_unlock(&pending_lock);
+	//if the work is already scheduled the element will be published in its batch
+	schedule_delayed_work(&publish_work,msecs_to_jiffies(PUBLISH_DELAY_MS));
+}
+
+/** \brief Removes an element from its pending list, if it has not been published yet.
+ * \param[in] pending The `pending` member of the element.
+ * \returns 1 if the element was pending, 0 otherwise.
+ */
+int cancel_publication(struct list_head* pending){
+	int res=0;
+	spin_lock(&pending_lock);
+	if(!list_empty(pending)){
+		list_del_init(pending);
+		res=1;
+	}
+	spin_unlock(&pending_lock);
+	return res;
+}
+
+/**
+ * The `::session` kobject, represented by the `::sess_info` member the `::session` object, will be created as a child of `::dev_kobj`
+ * by `publish_info()`, and the `::dev_kobj` reference counter will be incremented.
+ */
+int add_session_info(const char* name,struct sess_info* session){
+	pr_debug("adding info on a new original file: %s\n",name);
+	///If `::sysfs_objects` is false the `::session` is only shown in the session table.
+	if(sysfs_objects){
+		queue_publication(&(session->pending),&pending_sessions);
 	}
-	printk(KERN_DEBUG "SessionFS session info: info added successfully, kobject refcount:%d ,device kobject refcount:%d",kref_read(&(session->kobj->kref)),kref_read(&(dev_kobj->kref)));
 	return 0;
 }
 
 /**
  * Removes the entry corresponding to the given `::session`, represented by its `::sess_info` member, in the device SysFS folder.
- * To do so we also remove the `active_incarnations_num` file of the given `::session` and we decrement the reference counter of the device session kernel object.
+ * To do so we also remove the `active_incarnations_num` and `counters` files of the given `::session` and we decrement the reference counter of the device session kernel object.
+ * If the `::session` has not been published yet it is only removed from the pending list.
  */
 void remove_session_info(struct sess_info* session){
-	printk(KERN_DEBUG "SessionFS session info: removing info on an original file");
-	//we remove the number of incarnations attribute
-	sysfs_remove_file(session->kobj,&(session->inc_num_attr.attr));
-	//we remove the entry from the parent folder
-	kobject_del(session->kobj);
-	printk(KERN_DEBUG "SEssionFS session info: removed info on a session, device kobject refcount:%d",kref_read(&(dev_kobj->kref)));
+	pr_debug("removing info on an original file\n");
+	if(!sysfs_objects || cancel_publication(&(session->pending))){
+		return;
+	}
+	//we wait for a publication in progress
+	mutex_lock(&publish_lock);
+	if(session->kobj!=NULL){
+		//we remove the number of incarnations and the counters attributes
+		sysfs_remove_file(session->kobj,&(session->inc_num_attr.attr));
+		sysfs_remove_file(session->kobj,&(session->counters_attr.attr));
+		//we remove the entry from the parent folder and drop our reference, the kobject is freed when the last reference is dropped
+		kobject_del(session->kobj);
+		kobject_put(session->kobj);
+		session->kobj=NULL;
+	}
+	mutex_unlock(&publish_lock);
+	pr_debug("removed info on a session, device kobject refcount:%d\n",kref_read(&(dev_kobj->kref)));
 }
 
 /**
  * By adding a new incarnation we increment `active_sessions_num` and `active_incarnations_num` for the given `::session`, represented by its `::sess_info` member,
-*  also, a kobject attribute is added to the given `::session` that has the process pid as filename and contains the process name.
-* Finally the reference counter of the given `::session` is also incremented.
-*
-* The format of the file found on SysFS `[pid]_[file descriptor]`, to allow the same process to have the process open the same file multiple times.
+*  also, a kobject attribute will be added to the given `::session` by `publish_info()`, that has the process pid as filename and contains the process name.
+* Finally the reference counter of the given `::session` kernel object is also incremented, when the attribute is published.
 */
-int add_incarnation_info(struct sess_info* parent_session,struct kobj_attribute* incarnation,pid_t pid,int fdes){
-	int res;
-	//we allocate memory for the attribute name
-	char* name=kzalloc(sizeof(char)*512, GFP_KERNEL);
-	if(!name){
-		return -ENOMEM;
-	}
-	printk(KERN_DEBUG "SessionFS session info: adding info on the incarnation created for process %d",pid);
-//we initialize the attribute name
-scnprintf(name,20,"%d_%d",pid,fdes);
+int add_incarnation_info(struct sess_info* parent_session,struct inc_info* incarnation,pid_t pid,int fdes){
+	pr_debug("adding info on the incarnation created for process %d\n",pid);
+	incarnation->attr.attr.name=NULL;
+	incarnation->parent=parent_session;
+	incarnation->pid=pid;
+	incarnation->fdes=fdes;
+	INIT_LIST_HEAD(&(incarnation->pending));
 	//we increment the global number of sessions
-	atomic_add(1,&sessions_num);
+	percpu_counter_inc(&sessions_num);
 	//we increment the number of incarnations for the original file
 	atomic_add(1,&(parent_session->inc_num));
-	//we get the parent kobject
-	kobject_get(parent_session->kobj);
-	//we create the attribute
-	incarnation->attr.name=name;
-	incarnation->attr.mode=VERIFY_OCTAL_PERMISSIONS(KERN_OBJ_PERM);
-	incarnation->show=proc_name_show;
-	incarnation->store=NULL;
-	//we add the attribute to the device
-	res=sysfs_create_file(parent_session->kobj,&(incarnation->attr));
-	if(res<0){
-		kobject_put(parent_session->kobj);
-		atomic_sub(1,&sessions_num);
-		atomic_sub(1,&(parent_session->inc_num));
-		return res;
+	if(sysfs_objects){
+		queue_publication(&(incarnation->pending),&pending_incarnations);
 	}
-	printk(KERN_DEBUG "SessionFS session info: info added successfully,, kobject refcount:%d",kref_read(&(parent_session->kobj->kref)));
 	return 0;
 }
 
 /**
  * By removing an incarnation we decrement `active_sessions_num` and `active_incarnations_num` for the given `::session`, represented by its `::sess_info` member.
- *  Also, the kobject attribute that has the process pid as filename and contains the process name is removed from the given `::session`.
- * Finally the reference counter of the given `::session` is also decremented.
+ *  Also, the kobject attribute that has the process pid as filename and contains the process name is removed from the given `::session`, if it has been published.
+ * Finally the reference counter of the given `::session` kernel object is also decremented.
  */
-void remove_incarnation_info(struct sess_info* parent_session,struct kobj_attribute* incarnation){
-	printk(KERN_DEBUG "SessionFS session info: removing info on an incarnation");
-	//we remove the number of incarnations attribute
-	sysfs_remove_file(parent_session->kobj,&(incarnation->attr));
+void remove_incarnation_info(struct sess_info* parent_session,struct inc_info* incarnation){
+	pr_debug("removing info on an incarnation\n");
+	if(sysfs_objects && !cancel_publication(&(incarnation->pending))){
+		//we wait for a publication in progress
+		mutex_lock(&publish_lock);
+		if(incarnation->attr.attr.name!=NULL){
+			sysfs_remove_file(parent_session->kobj,&(incarnation->attr.attr));
+			//we put the parent kobject
+			kobject_put(parent_session->kobj);
+		}
+		mutex_unlock(&publish_lock);
+	}
 	//we decrement the global number of sessions
-	atomic_sub(1,&sessions_num);
+	percpu_counter_dec(&sessions_num);
 	//we decrement the number of incarnations for the original file
 	atomic_sub(1,&(parent_session->inc_num));
-	//we put the parent kobject
-	kobject_put(parent_session->kobj);
-	printk(KERN_DEBUG "SessionFS session info: info removed, kobject refcount:%d",kref_read(&(parent_session->kobj->kref)));
+}
+
+void init_session_info(const char* name, struct sess_info* session){
+	int i;
+	atomic_set(&(session->inc_num),0);
+	session->kobj=NULL;
+	session->name=name;
+	INIT_LIST_HEAD(&(session->pending));
+	for(i=0;i<CNT_NUM;i++){
+		atomic64_set(&(session->counters[i]),0);
+	}
+}
+
+/**
+ * The global counter is per-CPU, so it's updated without contention, while the counter of the session is an atomic64.
+ */
+void count_session_op(struct sess_info* session, enum sess_counter counter, u64 value){
+	this_cpu_add(session_counters.counters[counter],value);
+	if(session!=NULL){
+		atomic64_add(value,&(session->counters[counter]));
+	}
 }
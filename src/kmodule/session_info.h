@@ -16,7 +16,19 @@
 ///Each attribute group has the same name, but different attributes according to the parent kobject.
 #define ATTR_GROUP_NAME "info"
 
-/** \brief Initializes the SessionFS kobject with general information about the running sessions.
+///Maximum delay, in milliseconds, between the creation of a session or incarnation and its publication in SysFS.
+#define PUBLISH_DELAY_MS 2
+
+///The directory of the session table in procfs.
+#define PROC_DIR "sessionfs"
+
+///The name of the session table in `::PROC_DIR`.
+#define PROC_SESSIONS "sessions"
+
+/// If false sessions and incarnations are not published as kernel objects, but only in the session table (located in ::session_info.c).
+extern bool sysfs_objects;
+
+/** \brief Initializes the SessionFS kobject with general information about the running sessions and creates the session table in procfs.
  * \param[in] device_kobj The SessionFS char device kernel object, in which contains the info on all sessions.
  * \returns 0 on success, an error code on failure.
  */
@@ -28,9 +40,11 @@ int init_info(struct kobject* device_kobj);
 void release_info(void);
 
 /** \brief Adds a new kobject representing an original file, under the SessionFS kobject.
- * \param[in] name The name of the created kobject.
+ * \param[in] name The name of the created kobject, which must remain valid until `remove_session_info()` is called.
  * \param[in,out] session The information on the session, represente by a struct `::sess_info`.
- * \returns a struct kobject* on success, null if the kobject hasn't been created or an error code.
+ * \returns 0 on success or an error code.
+ *
+ * The kobject is published asynchronously, within ::PUBLISH_DELAY_MS milliseconds.
  */
 int add_session_info(const char* name,struct sess_info* session);
 
@@ -41,17 +55,32 @@ void remove_session_info(struct sess_info* session);
 
 /** \brief Adds a new kobject attribute representing an incarnation.
  * \param[in] parent_session The session which has generated the incarnation, represented by a struct `::sess_info`.
- * \param[in] incarnation The incarnation to be added.
+ * \param[in] incarnation The information on the incarnation to be added, represented by a struct `::inc_info`.
  * \param[in] pid The pid of the process that owns the incarnation.
  * \param[in] fdes The file descriptor that identifies the incarnation in the process.
  * \returns 0 on success, or an error code.
  */
-int add_incarnation_info(struct sess_info* parent_session,struct kobj_attribute* incarnation,pid_t pid, int fdes);
+int add_incarnation_info(struct sess_info* parent_session,struct inc_info* incarnation,pid_t pid, int fdes);
 
 /** \brief Removes the kobject attribute incarnation from a kobject
  * \param[in] parent_session The session which has generated the incarnation, represented by a struct `::sess_info`.
- * \param[in] incarnation The incarnation to be added.
+ * \param[in] incarnation The information on the incarnation to be removed, represented by a struct `::inc_info`.
+ */
+void remove_incarnation_info(struct sess_info* parent_session, struct inc_info* incarnation);
+
+/** \brief Initializes the information on a session, before the session can be found by other threads.
+ * \param[in] name The pathname of the original file, which must remain valid until `remove_session_info()` is called.
+ * \param[out] session The information on the session, represented by a struct `::sess_info`.
+ *
+ * The throughput counters and the number of incarnations are set to 0.
+ */
+void init_session_info(const char* name, struct sess_info* session);
+
+/** \brief Adds a value to a throughput counter of a session and to the global one.
+ * \param[in] session The information on the session, represented by a struct `::sess_info`, or `NULL` to update only the global counter.
+ * \param[in] counter The counter to update.
+ * \param[in] value The value to add.
  */
-void remove_incarnation_info(struct sess_info* parent_session, struct kobj_attribute* incarnation);
+void count_session_op(struct sess_info* session, enum sess_counter counter, u64 value);
 
 #endif
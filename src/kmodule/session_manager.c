@@ -5,14 +5,20 @@
  * keeping track of the opened sessions for each file.
  */
 
+///Prefix of the messages printed by the session manager.
+#define pr_fmt(fmt) "SessionFS session manager: " fmt
+
 // for the list_head struct and rcu_head
 #include <linux/types.h>
 // for PATH_MAX
 #include<uapi/linux/limits.h>
-//for read-write locks and spinlocks APIs
+//for spinlocks APIs
 #include <linux/spinlock.h>
-//for lockless list APIs
-#include <linux/llist.h>
+//for the read-write semaphore of the sessions
+#include <linux/rwsem.h>
+//for the periodic sweep
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
 //for simple lists APIs
 #include <linux/list.h>
 //for list using the rcu APIs
@@ -35,17 +41,37 @@
 #include <linux/fsnotify.h>
 //for find_get_pid
 #include <linux/pid.h>
+//for THIS_MODULE and module reference counting
+#include <linux/module.h>
+//for current and the PF_* flags
+#include <linux/sched.h>
+//for send_sig
+#include <linux/sched/signal.h>
+//for dget_parent and d_unlinked
+#include <linux/dcache.h>
+//for mnt_want_write
+#include <linux/mount.h>
+//for isdigit
+#include <linux/ctype.h>
 
 #include "session_manager.h"
 
 #include "session_info.h"
 
+#include "session_stats.h"
+
+#include "session_owners.h"
+
+#include "session_record.h"
+
+#include "session_usage.h"
+
+#include "session_quota.h"
 
-/// Used to toggle the necessity of a file descriptor in `open_file()` and to determine the type of search in `search_session()`.
-#define NO_FD 0
+//the tracepoints are defined in this file
+#define CREATE_TRACE_POINTS
+#include "sessionfs_trace.h"
 
-/// Used to determine the type of search in `search_session()`.
-#define NO_PID 0
 
 ///Permissions to be given to the newly created files.
 #define DEFAULT_PERM 0644
@@ -59,8 +85,17 @@
 ///Used to determine if the content of the incarnation must overwrite the original file on close
 #define OVERWRITE_ORIG 0
 
-///Used to determine is the session manager contains active sessions.
-#define MANAGER_EMPTY 0
+///The maximum number of empty sessions removed by each run of `reap_sessions()`.
+#define REAP_BATCH 32
+
+///The interval, in milliseconds, between two runs of the periodic sweep.
+#define REAP_INTERVAL_MS 10000
+
+///The policy of the sessions created without a session root.
+const struct sess_policy default_policy={
+	.commit_mode=COMMIT_ON_CLOSE,
+	.copy_engine=COPY_READ_WRITE
+};
 
 ///List of the active `::session`(s).
 struct list_head sessions;
@@ -68,6 +103,44 @@ struct list_head sessions;
 ///Spinlock used to update the list of the active `::session`(s)
 spinlock_t sessions_lock;
 
+///Counter used to identify the `::incarnation`(s) that don't have a file descriptor.
+atomic_t incarnation_ids;
+
+///Slab cache of the `::session` objects.
+struct kmem_cache* session_cache=NULL;
+
+///Slab cache of the `::session_rcu` objects.
+struct kmem_cache* session_rcu_cache=NULL;
+
+///Slab cache of the `::incarnation` objects.
+struct kmem_cache* incarnation_cache=NULL;
+
+/** \brief Periodic sweep of the session manager.
+ * \param[in] work The `::reap_work`.
+ *
+ * Incarnations are closed by `incarnation_release()` when the owner process closes them or exits, so the sweep is only a
+ * safety net: it removes at most ::REAP_BATCH empty `::session`(s) with `reap_sessions()`, checks the memory and disk usage
+ * with `check_usage()` and runs again after ::REAP_INTERVAL_MS.
+ */
+void reap_work_fn(struct work_struct* work);
+
+///The periodic sweep of the session manager.
+DECLARE_DELAYED_WORK(reap_work,reap_work_fn);
+
+/** \struct incarnation_fops
+ * \brief File operations installed on an incarnation file.
+ * \param ops Copy of the file operations of the incarnation file, where `release` is replaced by `incarnation_release()`.
+ * \param orig_ops The original file operations of the incarnation file.
+ * \param incarnation The `::incarnation` represented by the file.
+ *
+ * Each incarnation file has its own copy of the file operations, so that we can reach the `::incarnation` from the struct file.
+ */
+struct incarnation_fops{
+	struct file_operations ops;
+	const struct file_operations* orig_ops;
+	struct incarnation* incarnation;
+};
+
 /** \brief Opens a file from kernel space.
  * \param[in] pathname String that represents the file location and name and __must be in kernel memory__
  * \param[in] flags Flags that will regulate the permissions on the file.
@@ -90,14 +163,14 @@ int open_file(const char* pathname, int flags, mode_t mode,int fd_needed, struct
 	} else {
 		perms=mode;
 	}
-	printk(KERN_DEBUG "SessionFS session manager: opening (and creating it if needed): %s",pathname);
+	pr_debug("opening (and creating it if needed): %s\n",pathname);
 	//we don't want to be preempted while opening the file
 	//we try to open the file
 	f=filp_open(pathname,flags,perms);
 	if (IS_ERR(f)) {
 		fd = PTR_ERR(f);
 	} else {
-		printk(KERN_DEBUG "SessionFS session manager: file opened successfully");
+		pr_debug("file opened successfully\n");
 		if(fd_needed){
 			//find a new file descriptor
 			fd=get_unused_fd_flags(flags);
@@ -106,7 +179,7 @@ int open_file(const char* pathname, int flags, mode_t mode,int fd_needed, struct
 				fsnotify_open(f);
 				//register the descriptor in the intermediate table
 				fd_install(fd, f);
-				printk(KERN_DEBUG "SessionFS session manager: associated file with file descriptor: %d",fd);
+				pr_debug("associated file with file descriptor: %d\n",fd);
 			}
 		} else {
 			fd=NO_FD;
@@ -116,38 +189,31 @@ int open_file(const char* pathname, int flags, mode_t mode,int fd_needed, struct
 	return fd;
 }
 
-/** \brief Searches for a `::session` with a given pathname, or with an `::incarnation` with matching pid and file descriptor.
+/** \brief Searches for a `::session` with a given pathname.
  * \param[in] pathname The pathname that identifies the session.
- * \param[in] filedes The file descriptor of an incarnation.
- * \param[in] pid The pid of the process that owns the incarnation.
  * \returns A pointer to the found `::session` or `NULL`.
  *
  * Searches, by navigating the `::sessions` rcu list, a `::session` which matches the given `pathname`.
- * If `pathname` is NULL, `filedes` is differrent from `::NO_FD` and `pid` is differrent from `::NO_PID`
- * then it searches for the session that contains an incarnation with the corresponding pid an file descriptor.
  * While walking the `::sessions` list the reference counter counter of any session currently inspected, `refcount`, will be incremented.
  * If the session is not the one we are looking for then `refcount` will be decremented before inspecting the next `::session`.
  * If a `::session` is invalid it will be skipped.
- *
- * Additionally while walking the `::incarnation` list of a `::session` we grab the `sess_lock` in read mode, to avoid
- * that a concurrent process modifies the list while we are walking it. When we finish walking the list we will release the lock.
  */
-struct session* search_session(const char* pathname,int filedes, pid_t pid){
-	struct incarnation *inc_it,*inc_tmp;
+struct session* search_session(const char* pathname){
 	struct session_rcu *session_rcu_it=NULL;
 	struct session *session_it=NULL,*found=NULL;
 	//paramters check
-	if(pathname==NULL && filedes==NO_FD){
+	if(pathname==NULL){
 		return NULL;
 	}
-	printk(KERN_DEBUG "SessionFS session manager: searching for a session with an incarnation with pathname:%s, pid:%d and fd:%d",pathname, pid, filedes);
+	pr_debug("searching for a session with pathname:%s\n",pathname);
 	//we get the read lock on the rcu
 	rcu_read_lock();
 	//we get the first element of the session list
 	session_rcu_it= list_first_or_null_rcu(&sessions,struct session_rcu,list_node);
 	if(session_rcu_it==NULL){
-		printk(KERN_DEBUG "SessionFS session manager: session list empty on search");
+		pr_debug("session list empty on search\n");
 		rcu_read_unlock();
+		trace_sessionfs_lookup_miss(pathname);
 		return NULL;
 	}
 	//we need to walk all the list to see if we have alredy other sessions opened for the same pathname
@@ -156,24 +222,12 @@ struct session* search_session(const char* pathname,int filedes, pid_t pid){
 		//we increment the refcount
 		atomic_add(1,&(session_it->refcount));
 		if(atomic_read(&(session_it->valid))==VALID_NODE){
-			if(pathname!=NULL && strcmp(session_it->pathname,pathname) == 0){
-				printk(KERN_DEBUG "SessionFS session manager: found session by pathname");
+			if(strcmp(session_it->pathname,pathname) == 0){
+				pr_debug("found session by pathname\n");
 				found=session_it;
 			}
-			if(pathname==NULL && filedes != NO_FD && pid!=NO_PID ){
-				printk("SessionFS session manager: searching incarnation in session %s",found->pathname);
-				read_lock(&(session_it->sess_lock));
-				llist_for_each_entry_safe(inc_it,inc_tmp,session_it->incarnations.first,node){
-					if(inc_it->owner_pid==pid && inc_it->filedes==filedes){
-						printk(KERN_DEBUG "SessionFS session manager: found session by incarnation pid and file descriptor");
-						found=session_it;
-						break;
-					}
-				}
-				read_unlock(&(found->sess_lock));
-			}
 		} else {
-			printk(KERN_DEBUG "SessionFS session manager: found an invalid session during search, skipping");
+			pr_debug("found an invalid session during search, skipping\n");
 		}
 		if(found!=NULL){
 			break;
@@ -182,43 +236,59 @@ struct session* search_session(const char* pathname,int filedes, pid_t pid){
 		}
 	}
 	rcu_read_unlock();
+	if(found==NULL){
+		trace_sessionfs_lookup_miss(pathname);
+	}
 	return found;
 }
 
+/** \brief Deallocates an `::incarnation` when its last reference is dropped.
+ * \param[in] kref The `kref` member of the `::incarnation` to deallocate.
+ *
+ * __DO NOT__ directly call this function, it is called by `kref_put()` when both the parent `::session` and the incarnation
+ * file have dropped their reference.
+ */
+void free_incarnation(struct kref* kref){
+	struct incarnation* incarnation=container_of(kref,struct incarnation,kref);
+	usage_free(MEM_INCARNATIONS,kmem_cache_size(incarnation_cache)+ksize(incarnation->pathname));
+	if(incarnation->info.attr.attr.name!=NULL){
+		usage_free(MEM_INCARNATIONS,ksize(incarnation->info.attr.attr.name));
+	}
+	kfree(incarnation->pathname);
+	kfree(incarnation->info.attr.attr.name);
+	kmem_cache_free(incarnation_cache,incarnation);
+}
+
 /** \brief Deallocates the given session object.
  * \param[in] session The session object to deallocate.
  *
- * This function is used to free the memory used by the session when nobody is accessing it, this is checked using the `::session` `refcount` and the `::session` kernel object refcount, in the `info` member.
+ * This function is used to free the memory used by the session when nobody is accessing it, this is checked using the `::session` `refcount` and the number of published incarnations, in the `info` member.
  *
- * The method will attempt to deallocate the session object, with all its incarnations, if the `::session` `refcount` is 0 and the associated kernel object refcount is 1 (only the current process is using it).
+ * The method will attempt to deallocate the session object, with all its incarnations, if the `::session` `refcount` is 0 and no incarnation is published.
  * Otherwise the method will do nothing.
  *
  */
 void delete_session(struct session* session){
-	struct llist_node *lnode;
 	struct incarnation *it=NULL, *it_tmp=NULL;
-	printk(KERN_DEBUG "SessionFS session manager: checking is someone is using the session object");
-	if(atomic_read(&(session->refcount))>0 || kref_read(&(session->info.kobj->kref))>1){
-		printk(KERN_WARNING "SessionFS session manager: session in use: recount %d kobject refcount :%d , cannot eliminate the object",atomic_read(&(session->refcount)),kref_read(&(session->info.kobj->kref)));
+	pr_debug("checking is someone is using the session object\n");
+	if(atomic_read(&(session->refcount))>0 || atomic_read(&(session->info.inc_num))>0){
+		pr_debug("session in use: recount %d incarnations :%d , cannot eliminate the object\n",atomic_read(&(session->refcount)),atomic_read(&(session->info.inc_num)));
 	} else {
-		printk(KERN_INFO "SessionFS session manager: session object not in use, proceeding with elimination");
+		pr_debug("session object not in use, proceeding with elimination\n");
 
 		//we close the session file
 		filp_close(session->file,NULL);
-		//we free all tne elements of the incarnations llist
-		lnode=llist_del_all(&(session->incarnations));
-		llist_for_each_entry_safe(it,it_tmp,lnode,node){
-			kfree(it->pathname);
-			kfree(it->inc_attr.attr.name);
-			kfree(it);
+		//closed incarnations have already left the list, we free the ones that could have been left behind
+		list_for_each_entry_safe(it,it_tmp,&(session->incarnations),node){
+			list_del(&(it->node));
+			kref_put(&(it->kref),free_incarnation);
 		}
 
-		//we deallocate the filename used by SysFS
-		kfree(session->info.f_name);
 		//we deallocatethe pathname string
+		usage_free(MEM_SESSIONS,kmem_cache_size(session_cache)+ksize(session->pathname));
 		kfree(session->pathname);
 		//finally we deallocate the session
-		kfree(session);
+		kmem_cache_free(session_cache,session);
 	}
 }
 
@@ -231,8 +301,9 @@ void delete_session(struct session* session){
  */
 void delete_session_rcu(struct rcu_head* head){
 	struct session_rcu* session_rcu=container_of(head,struct session_rcu,rcu_head);
-	printk(KERN_DEBUG "SessionFS session manager: deleting unused session_rcu");
-	kfree(session_rcu);
+	pr_debug("deleting unused session_rcu\n");
+	usage_free(MEM_SESSIONS,kmem_cache_size(session_rcu_cache));
+	kmem_cache_free(session_rcu_cache,session_rcu);
 }
 
 /**
@@ -240,6 +311,9 @@ void delete_session_rcu(struct rcu_head* head){
  * \param[in] pathname The path of the original file.
  * \param[in] flags The flags that regulate the access to the original file.
  * \param[in] mode The permissions to apply to newly created files.
+ * \param[in] policy The `::sess_policy` of the new `::session`.
+ *
+ * The `::session` object keeps its own copy of `pathname` and of `policy`.
  *
  * To create a new `::session` object we open the matching file using `open_file()`, then we get the spinlock
  * `::sessions_lock` to avoid race coditions and a search is issued, using `search_session()`, to see if there is already
@@ -252,52 +326,62 @@ void delete_session_rcu(struct rcu_head* head){
  * The original flags will be modified by removing the `O_RDONLY` and `O_WRONLY` in favor of `O_RDWR`, since we will always
  * read and write on this file. In this way we preserve the effects of the `O_EXCL` flag if specified from userspace.
  */
-struct session* init_session(const char* pathname,int flags, mode_t mode){
+struct session* init_session(const char* pathname,int flags, mode_t mode,const struct sess_policy* policy){
 	struct file* file=NULL;
 	int fd=NO_FD;
 	int res=0;
 	int flag;
 	struct session *node=NULL, *node_f=NULL;
 	struct session_rcu* node_rcu;
+	char* node_pathname=NULL;
 	//we allocate the rcu node that will hold the session object
-	node_rcu=kmalloc(sizeof(struct session_rcu), GFP_KERNEL);
+	node_rcu=kmem_cache_alloc(session_rcu_cache,GFP_KERNEL);
 	if(!node_rcu){
 		return ERR_PTR(-ENOMEM);
 	}
 	//we allocate the new session object
-	node=kmalloc(sizeof(struct session),GFP_KERNEL);
+	node=kmem_cache_zalloc(session_cache,GFP_KERNEL);
 	if(!node){
-		kfree(node_rcu);
+		kmem_cache_free(session_rcu_cache,node_rcu);
 		return ERR_PTR(-ENOMEM);
 	}
-	printk(KERN_DEBUG "SessionFS session manager: successfully allocated necessary memory");
+	//the session keeps its own copy of the pathname
+	node_pathname=kstrdup(pathname,GFP_KERNEL);
+	if(!node_pathname){
+		kmem_cache_free(session_cache,node);
+		kmem_cache_free(session_rcu_cache,node_rcu);
+		return ERR_PTR(-ENOMEM);
+	}
+	pr_debug("successfully allocated necessary memory\n");
 
 	//we need to open the original file always with both read and write permissions.
 	flag=(((flags & ~O_RDONLY) & ~O_WRONLY) | O_RDWR);
 	fd=open_file(pathname,flag,mode,NO_FD,&file);
 	if(fd < 0){
-		kfree(node);
-		kfree(node_rcu);
+		kfree(node_pathname);
+		kmem_cache_free(session_cache,node);
+		kmem_cache_free(session_rcu_cache,node_rcu);
 		return ERR_PTR(fd);
 	}
-	printk(KERN_DEBUG "SessionFS session manager: original file opened successfully, populating session object");
+	pr_debug("original file opened successfully, populating session object\n");
 	//we get the spinlock to avoid race conditions while creating the session object
 	spin_lock(&sessions_lock);
-	printk(KERN_DEBUG "SessionFS session manager: checking for an already existing session with the same pathname: %s",pathname);
+	pr_debug("checking for an already existing session with the same pathname: %s\n",pathname);
 	//we check if, while we were searching, the session has been already created
-	node_f=search_session(pathname,NO_FD,NO_FD);
+	node_f=search_session(pathname);
 	if(node_f!=NULL){
-		printk(KERN_DEBUG "SessionFS session manager: found an already existing session");
+		pr_debug("found an already existing session\n");
 		if(atomic_read(&(node_f->valid))!=VALID_NODE){
-			printk(KERN_DEBUG "SessionFS: session manager: Found session is invalid, continuing with creation");
+			pr_debug("found session is invalid, continuing with creation\n");
 			atomic_sub(1,&(node_f->refcount));
 			delete_session(node_f);
 		}
 		spin_unlock(&sessions_lock);
 		//we close the opened file, since we have already a reference on it
 		filp_close(file,NULL);
-		kfree(node);
-		kfree(node_rcu);
+		kfree(node_pathname);
+		kmem_cache_free(session_cache,node);
+		kmem_cache_free(session_rcu_cache,node_rcu);
 		//we return the found session;
 		return node_f;
 	}
@@ -308,19 +392,25 @@ struct session* init_session(const char* pathname,int flags, mode_t mode){
 	INIT_LIST_HEAD(&(node_rcu->list_node));
 	node->rcu_node=node_rcu;
 	node->file=file;
-	node->pathname=pathname;
-	rwlock_init(&(node->sess_lock));
+	node->policy=*policy;
+	reset_session_stats(&(node->stats));
+	init_session_info(node_pathname,&(node->info));
+	node->pathname=node_pathname;
+	init_rwsem(&(node->sess_lock));
 	atomic_set(&(node->refcount),1);
-	node->incarnations.first=NULL;
+	INIT_LIST_HEAD(&(node->incarnations));
+	spin_lock_init(&(node->inc_lock));
 	//we flag the session as valid
 	atomic_set(&(node->valid),VALID_NODE);
-	printk(KERN_DEBUG "SessionFS session manager: adding session object to the rculist");
+	//the memory is counted from when the session can be found, each object is uncounted when it is freed
+	usage_alloc(MEM_SESSIONS,kmem_cache_size(session_cache)+kmem_cache_size(session_rcu_cache)+ksize(node_pathname));
+	pr_debug("adding session object to the rculist\n");
 	// we insert the new session in the rcu list
 	list_add_rcu(&(node_rcu->list_node),&sessions);
 	//we release the spinlock
 	spin_unlock(&sessions_lock);
 	//we update the info on the device kobject
-	res=add_session_info(pathname,&(node->info));
+	res=add_session_info(node_pathname,&(node->info));
 	if(res<0){
 		atomic_set(&(node->valid),!VALID_NODE);
 		//we get the spinlock over the session list, to avoid running concurrently with another list modification primitive
@@ -329,52 +419,347 @@ struct session* init_session(const char* pathname,int flags, mode_t mode){
 		//we release the spinlock
 		spin_unlock(&sessions_lock);
 		//we register a callback to free the memory associated to the session
-		printk(KERN_DEBUG "SessionFS session manager: registering callback to deallocate the session_rcu object");
+		pr_debug("registering callback to deallocate the session_rcu object\n");
 		call_rcu(&(node_rcu->rcu_head),delete_session_rcu);
 		filp_close(file,NULL);
 		if(atomic_read(&(node->refcount))==1){
-			kfree(node);
+			usage_free(MEM_SESSIONS,kmem_cache_size(session_cache)+ksize(node_pathname));
+			kfree(node_pathname);
+			kmem_cache_free(session_cache,node);
 		}
 		return ERR_PTR(res);
 	}
 	return node;
 }
 
-/** \brief Copy the contents of a file into another.
+/** \brief Copy the contents of a file into another with `kernel_read()` and `kernel_write()`.
  * \param[in] src The source file.
  * \param[in] dst The destination file.
- * \returns 0 on success, an error code on failure.
+ * \returns The number of bytes copied on success, an error code on failure.
  *
  *  Reads `::DATA_DIM` bytes from `src` and writes them on `dst`, starting in both files from the beginning and stopping when
  * `src` is has been completely read.
  */
-int copy_file(struct file* src,struct file* dst){
+loff_t copy_file_rw(struct file* src,struct file* dst){
 	unsigned long long offsetr=0,offsetw=0;
-	int read=1,written=1;
+	int read=1,written=1,res=0;
 	//bytes read, set initially to 1 to make the while start for the first time
 	char* data=kzalloc(512*sizeof(char), GFP_USER);
 	if(!data){
 		return -ENOMEM;
 	}
-	printk(KERN_DEBUG "SessionFS session manager: starting file copy");
 	//we read the file until the read function will not read any more bytes
 	while(read>0){
 		read=kernel_read(src,data,DATA_DIM,&offsetr);
 		if(read<0){
-			kfree(data);
-			return read;
+			res=read;
+			break;
 		}
-		//printk(KERN_DEBUG "SessionFS session manager: read %d bytes starting at %lld",read,offsetr);
 		written=kernel_write(dst,data,read,&offsetw);
 		if(written<0){
-			kfree(data);
-			return written;
+			res=written;
+			break;
 		}
-		//printk(KERN_DEBUG "SessionFS session manager: written %d bytes starting at %lld",written,offsetw);
 	}
 	kfree(data);
-	printk(KERN_DEBUG "SessionFS session manager: file copy completed successfully");
-	return 0;
+	return (res<0) ? res : offsetw;
+}
+
+/** \brief Copy the contents of a file into another with `vfs_copy_file_range()`.
+ * \param[in] src The source file.
+ * \param[in] dst The destination file.
+ * \returns The number of bytes copied on success, an error code on failure.
+ *
+ * The filesystem can share the extents of the two files or copy them without moving the data to memory, if the filesystem
+ * can't copy between the two files `copy_file_rw()` is used.
+ */
+loff_t copy_file_range_all(struct file* src,struct file* dst){
+	loff_t offset=0,size=i_size_read(file_inode(src));
+	ssize_t copied=0;
+	while(offset<size){
+		copied=vfs_copy_file_range(src,offset,dst,offset,size-offset,0);
+		if(copied<=0){
+			break;
+		}
+		offset+=copied;
+	}
+	if(offset==0 && (copied==-EOPNOTSUPP || copied==-EXDEV || copied==-EINVAL)){
+		pr_debug("copy_file_range not supported, error %ld, falling back to read and write\n",(long)copied);
+		return copy_file_rw(src,dst);
+	}
+	return (copied<0) ? copied : offset;
+}
+
+/** \brief Copy the contents of a file into another.
+ * \param[in] src The source file.
+ * \param[in] dst The destination file.
+ * \param[in] engine The copy engine of the session root, `::COPY_READ_WRITE` or `::COPY_FILE_RANGE`.
+ * \returns The number of bytes copied on success, an error code on failure.
+ */
+loff_t copy_file(struct file* src,struct file* dst,int engine){
+	loff_t res;
+	trace_sessionfs_copy_start(src,dst);
+	if(engine==COPY_FILE_RANGE){
+		res=copy_file_range_all(src,dst);
+	} else {
+		res=copy_file_rw(src,dst);
+	}
+	trace_sessionfs_copy_end(src,dst,(res<0) ? 0 : res,(res<0) ? res : 0);
+	return res;
+}
+
+/** \brief Removes the incarnation file from its directory.
+ * \param[in] file The incarnation file.
+ *
+ * The incarnation file is unlinked while it is still open, so its content is freed by the filesystem as soon as the
+ * last reference to the file is dropped.
+ */
+void unlink_incarnation(struct file* file){
+	struct dentry *dentry=file->f_path.dentry, *parent;
+	struct inode* dir;
+	int res;
+	res=mnt_want_write(file->f_path.mnt);
+	if(res<0){
+		pr_warn("can't get write access to remove the incarnation file\n");
+		return;
+	}
+	parent=dget_parent(dentry);
+	dir=d_inode(parent);
+	inode_lock_nested(dir,I_MUTEX_PARENT);
+	//the file could have been moved or removed from userspace in the meantime
+	if(dentry->d_parent==parent && !d_unlinked(dentry)){
+		dget(dentry);
+		res=vfs_unlink(dir,dentry,NULL);
+		dput(dentry);
+		if(res<0){
+			pr_warn("can't remove the incarnation file, error %d\n",res);
+		}
+	}
+	inode_unlock(dir);
+	dput(parent);
+	mnt_drop_write(file->f_path.mnt);
+}
+
+/** \brief Commits an `::incarnation` over the original file and marks it as closed.
+ * \param[in] session The session containing the `::incarnation` to be closed.
+ * \param[in] incarnation The `::incarnation` to be closed.
+ * \param[in] overwrite If set to `::OVERWRITE_ORIG` it will overwrite the original file with the content of the `::incarnation` which is going to be removed, otherwise the current `::incarnation` is simply removed.
+ * \returns 0 or an error code (`-EPIPE` if the original file has been removed, `-EDQUOT` if the incarnation has grown
+ * over a limit of session_quota.h).
+ *
+ * The caller must have claimed the `::incarnation`, by setting its `closed` member, and must hold a reference on the
+ * `::session`, and returns the charge of the `::incarnation` afterwards.
+ *
+ * When the incarnation is removed, SysFS is updated with `remove_incarnation_info()`.
+ * The caller removes the `::incarnation` from the `incarnations` list of the `::session` when it is closed, the
+ * `::incarnation` is deallocated when the incarnation file drops its reference too.
+ */
+int commit_incarnation(struct session* session,struct incarnation* incarnation,int overwrite){
+	int res=0;
+	loff_t copied=-1;
+	u64 start, begin=stat_start();
+	//we remove the information on the incarnation
+	remove_incarnation_info(&(session->info),&(incarnation->info));
+	//we overwrite, if necessary, the content of the original file
+	if(overwrite==OVERWRITE_ORIG && incarnation->status == VALID_NODE){
+		///If the original file has been removed the content of the `::incarnation` is discarded and `-EPIPE` is returned.
+		if(d_unlinked(session->file->f_path.dentry)){
+			pr_debug("the original file has been removed, discarding the incarnation\n");
+			res=-EPIPE;
+		///The growth of the `::incarnation` is charged with `recharge_incarnation()`, if it exceeds a limit the content is discarded and `-EDQUOT` is returned.
+		} else if((res=recharge_incarnation(session,&(incarnation->charge),i_size_read(file_inode(incarnation->file))))<0){
+			pr_debug("the incarnation exceeds its quota, discarding it\n");
+		} else {
+			pr_debug("copying the content of the incarnation over the original file\n");
+			//we get the write lock on the session
+			start=stat_start();
+			down_write(&(session->sess_lock));
+			session_stat_record(&(session->stats),STAT_LOCK_WAIT,start);
+			start=stat_start();
+			copied=copy_file(incarnation->file,session->file,session->policy.copy_engine);
+			session_stat_record(&(session->stats),STAT_COMMIT_COPY,start);
+			res=(copied<0) ? copied : 0;
+			//we release the lock
+			up_write(&(session->sess_lock));
+		}
+	}
+	///The `::incarnation` to be closed will be marked as invalid, by setting its `status` member to `-ENOENT`
+	incarnation->status=-ENOENT;
+	count_session_op(&(session->info),CNT_CLOSES,1);
+	if(copied>=0){
+		incarnation->bytes_committed=copied;
+		count_session_op(&(session->info),CNT_BYTES_COMMITTED,copied);
+	} else if(res<0 && res!=-EPIPE){
+		count_session_op(&(session->info),CNT_FAILURES,1);
+	} else {
+		count_session_op(&(session->info),CNT_COMMITS_SKIPPED,1);
+	}
+	trace_sessionfs_commit(session->pathname,incarnation->pathname,overwrite,res);
+	record_session_op(RECORD_CLOSE,session->pathname,incarnation->pathname,incarnation->owner_pid,
+		i_size_read(file_inode(incarnation->file)),(copied<0) ? 0 : copied,policy_record_flags(&(session->policy)),res,begin);
+	return res;
+}
+
+/** \brief Drops a reference to a `::session`, removing it if it has no more incarnations.
+ * \param[in] session The `::session` on which the caller holds a reference.
+ */
+void put_session(struct session* session){
+	/**
+	 *
+	 * To remove a session object we need to check several conditions:
+	 * - The `::session` must be not in use by other threads (refcount==1)
+	 * - The `::session` must have no published incarnations, in the `info` member
+	 * - The `::session` must be still valid and not already marked for deletion
+	 */
+	pr_debug("session status after elimination: recount %d incarnations :%d\n",atomic_read(&(session->refcount)),atomic_read(&(session->info.inc_num)));
+
+	if(atomic_read(&(session->refcount))==1 && atomic_read(&(session->info.inc_num))==0 && atomic_read(&(session->valid))==VALID_NODE){
+		pr_debug("attempting to purge the session object\n");
+		///If the current `::session` must be removed, we flag it as invalid, to avoid having new incarnations created in here before deallocating it and making sure that it will be eventually deallocated.
+		atomic_set(&(session->valid),!VALID_NODE);
+		///We also remove its information on SysFS using `remove_session_info()`.
+		remove_session_info(&(session->info));
+		//we get the spinlock over the session list, to avoid running concurrently with another list modification primitive
+		spin_lock(&sessions_lock);
+		///Then, we can remove the current `::session` object from the rcu list, using the `::sessions_lock` spinlock to avoid concurrent operations.
+		pr_debug("removing the element from the rcu_list\n");
+		list_del_rcu(&(session->rcu_node->list_node));
+		//we release the spinlock
+		spin_unlock(&sessions_lock);
+		//we register a callback to free the memory associated to the session
+		pr_debug("registering callback to deallocate the session_rcu object\n");
+		call_rcu(&(session->rcu_node->rcu_head),delete_session_rcu);
+	}
+	//we decrement the refcount
+	atomic_sub(1,&(session->refcount));
+	///Finally, we try to deallocate the `::session` if is invalid, using `delete_session()`.
+	if(atomic_read(&(session->valid))!=VALID_NODE){
+		delete_session(session);
+	}
+}
+
+/** \brief Closes an `::incarnation`, committing its content if the parent `::session` is still valid.
+ * \param[in] incarnation The `::incarnation` to be closed.
+ * \returns 0 on success or an error code (`-EBADF` if the `::incarnation` has already been closed).
+ *
+ * The `closed` member of the `::incarnation` is used to make sure that only the first caller closes the `::incarnation`,
+ * since the parent `::session` could have been deallocated after that.
+ * The `::incarnation` is closed with `commit_incarnation()` and the reference on the parent `::session` is dropped with
+ * `put_session()`.
+ */
+int release_incarnation(struct incarnation* incarnation){
+	int res=0, commit=OVERWRITE_ORIG;
+	struct session* session=NULL;
+	if(atomic_cmpxchg(&(incarnation->closed),0,1)!=0){
+		pr_debug("incarnation already closed\n");
+		return -EBADF;
+	}
+	//the closed incarnation is no longer listed by its owner
+	unindex_incarnation(incarnation);
+	//the parent session can't be removed while the incarnation info is published, so we can safely get a reference
+	session=incarnation->session;
+	atomic_add(1,&(session->refcount));
+	//If the session if still valid we overwrite the original file, otherwise we simply delete the `::incarnation`.
+	if(atomic_read(&(session->valid))!=VALID_NODE){
+		pr_debug("invalid session, the original file will not be overwritten\n");
+		commit=!OVERWRITE_ORIG;
+	}
+	//the session root can ask to discard every incarnation
+	if(session->policy.commit_mode==COMMIT_DISCARD){
+		commit=!OVERWRITE_ORIG;
+	}
+	//processes that exit without closing their sessions are reaped here, when their files are released
+	if(current->flags & PF_EXITING){
+		trace_sessionfs_reap(session->pathname,incarnation->pathname,incarnation->owner_pid);
+	}
+	res=commit_incarnation(session,incarnation,commit);
+	uncharge_incarnation(session,&(incarnation->charge));
+	//the closed incarnation leaves the session, dropping the reference of the list
+	spin_lock(&(session->inc_lock));
+	list_del_init(&(incarnation->node));
+	spin_unlock(&(session->inc_lock));
+	kref_put(&(incarnation->kref),free_incarnation);
+	put_session(session);
+	return res;
+}
+
+/** \brief Closes an `::incarnation` whose file is being released and removes the incarnation file.
+ * \param[in] incarnation The `::incarnation` to be closed.
+ *
+ * The `::incarnation` is closed with `release_incarnation()`, if the original file has been removed the process receives
+ * `SIGPIPE`, then the incarnation file is unlinked with `unlink_incarnation()`.
+ */
+void end_incarnation(struct incarnation* incarnation){
+	int res=0;
+	pr_debug("releasing incarnation %s\n",incarnation->pathname);
+	res=release_incarnation(incarnation);
+	//exiting processes and the kernel threads that run delayed fputs can't receive the signal
+	if(res==-EPIPE && !(current->flags & (PF_EXITING | PF_KTHREAD))){
+		send_sig(SIGPIPE,current,0);
+	}
+	unlink_incarnation(incarnation->file);
+}
+
+/** \brief Release hook installed on the incarnation files.
+ * \param[in] inode The inode of the incarnation file.
+ * \param[in] file The incarnation file which is being released.
+ * \returns The value returned by the original release operation.
+ *
+ * Called by the VFS on the last `fput()` of the incarnation file, so the session is closed even if the process exits
+ * or closes the file without using the shared library.
+ * The `::incarnation` is closed with `end_incarnation()`, then the original file operations are restored and their
+ * release operation is called.
+ */
+int incarnation_release(struct inode* inode, struct file* file){
+	struct incarnation_fops* fops=container_of(file->f_op,struct incarnation_fops,ops);
+	struct incarnation* incarnation=fops->incarnation;
+	int res=0;
+	end_incarnation(incarnation);
+	//the VFS uses the file operations after the release, so we give back the original ones
+	file->f_op=fops->orig_ops;
+	if(file->f_op->release){
+		res=file->f_op->release(inode,file);
+	}
+	usage_remove_incarnation(incarnation);
+	usage_free(MEM_INCARNATIONS,ksize(fops));
+	kfree(fops);
+	kref_put(&(incarnation->kref),free_incarnation);
+	module_put(THIS_MODULE);
+	return res;
+}
+
+/**
+ * The incarnation file is closed by dropping the reference held by the `::incarnation`, then the reference of the caller
+ * on the `::incarnation` is dropped.
+ */
+void close_session_file(struct incarnation* incarnation){
+	end_incarnation(incarnation);
+	usage_remove_incarnation(incarnation);
+	fput(incarnation->file);
+	kref_put(&(incarnation->kref),free_incarnation);
+}
+
+/**
+ * The last occurrence of ::INCARNATION_INFIX is used, since the name of the original file can contain it too.
+ */
+bool is_incarnation_name(const char* name, int len){
+	int infix=strlen(INCARNATION_INFIX), i, digits=0, fields=1;
+	for(i=len-infix;i>=0 && memcmp(name+i,INCARNATION_INFIX,infix)!=0;i--);
+	if(i<0){
+		return false;
+	}
+	//the infix is followed by the pid and the timestamp, separated by an underscore
+	for(i+=infix;i<len;i++){
+		if(name[i]=='_' && fields==1 && digits>0){
+			fields++;
+			digits=0;
+		} else if(isdigit(name[i])){
+			digits++;
+		} else {
+			return false;
+		}
+	}
+	return fields==2 && digits>0;
 }
 
 /** \brief Creates an `::incarnation` and add it to an existing `::session`.
@@ -382,12 +767,22 @@ int copy_file(struct file* src,struct file* dst){
  * \param[in] flags The flags the regulates how the file must be opened.
  * \param[in] pid The pid of the process that wants the create a new `::incarnation`.
  * \param[in] mode The permissions to apply to newly created files.
- * \returns The file descriptor of the new `::incarnation` or an error code (`-EAGAIN` if the parent session is invalid).
+ * \param[in] fd_needed If set to `::NO_FD` the incarnation file is not installed in the file table of the process.
+ * \param[in] root The pathname of the session root of the open, `NULL` if there is none.
+ * \returns The file descriptor of the new `::incarnation` or an error code (`-EAGAIN` if the parent session is invalid,
+ * `-EDQUOT` if the `::incarnation` is not admitted).
  *
+ * The `::incarnation` is first charged the size of the original file with `charge_incarnation()`, which can wait for other
+ * incarnations to be closed, its growth is charged when it is committed and the charge is returned when it is closed.
  * Creates an `::incarnation` by updating the information on SysFS using `add_incarnation_info()` and opening a new file,
  * using `open_file()`, copying the contents of the original file in the new file, using `copy_file()`.Then creates an
  * `::incarnation` object, filling it with info and adding it to the `incarnations` list of the parent `::session`.
  *
+ * The file operations of the incarnation file are replaced by a copy whose `release` is `incarnation_release()`, and
+ * the file descriptor is installed only when the `::incarnation` is ready.
+ * If `fd_needed` is `::NO_FD` the incarnation file is owned by the caller, that must close it with `close_session_file()`,
+ * and the `filedes` member is a negative number that identifies the `::incarnation`.
+ *
  * The original flags will be modified by adding the `O_CREAT` flag, since the incarnation file must always be created.
  *
  * If the created incarnation is invalid the error code that has invalidated the session can be found in the `::incarnation`
@@ -400,371 +795,407 @@ int copy_file(struct file* src,struct file* dst){
  * The timestamp is obtained by calling `ktime_get_real()`.
  *
  */
-struct incarnation* create_incarnation(struct session* session, int flags, pid_t pid, mode_t mode){
+struct incarnation* create_incarnation(struct session* session, int flags, pid_t pid, mode_t mode,int fd_needed,const char* root){
 	int res=0;
 	struct incarnation* incarnation=NULL;
+	struct incarnation_fops* fops=NULL;
 	struct file* file=NULL;
 	int fd=NO_FD;
 	char *pathname=NULL;
+	loff_t copied;
+	u64 start;
+	struct sess_charge charge;
 
-	//we create the pathname for the incarnation
-	pathname=kzalloc(PATH_MAX*sizeof(char),GFP_KERNEL);
-	if(!pathname){
-		return ERR_PTR(-ENOMEM);
+	//the incarnation is admitted before allocating it, since the admission can wait for other incarnations to be closed
+	res=charge_incarnation(session,root,i_size_read(file_inode(session->file)),&charge);
+	if(res<0){
+		return ERR_PTR(res);
 	}
 	//we create the incarnation object
-	incarnation=kzalloc(sizeof(struct incarnation), GFP_KERNEL);
+	incarnation=kmem_cache_zalloc(incarnation_cache,GFP_KERNEL);
 	if(!incarnation){
-		kfree(pathname);
+		uncharge_incarnation(session,&charge);
+		return ERR_PTR(-ENOMEM);
+	}
+	INIT_LIST_HEAD(&(incarnation->usage_node));
+	//we create the file operations that will hold the release hook
+	fops=kzalloc(sizeof(struct incarnation_fops), GFP_KERNEL);
+	if(!fops){
+		uncharge_incarnation(session,&charge);
+		kmem_cache_free(incarnation_cache,incarnation);
 		return ERR_PTR(-ENOMEM);
 	}
 	//if the current session has been detached and it will be freed shortly we abort the incarnation creation
 	if(atomic_read(&(session->valid))!=VALID_NODE){
-		printk(KERN_INFO "SessionFS session manager: the parent session is invalid, aborting incarnation creation");
-		kfree(pathname);
-		kfree(incarnation);
+		pr_debug("the parent session is invalid, aborting incarnation creation\n");
+		uncharge_incarnation(session,&charge);
+		kmem_cache_free(incarnation_cache,incarnation);
+		kfree(fops);
 		return ERR_PTR(-EAGAIN);
 	}
-	printk(KERN_DEBUG "SessionFS session manager: allocated necessary memory");
+	pr_debug("allocated necessary memory\n");
 	//we use the actual timestamp so we are resistant to multiple opening of the same session by the same process
-	res=snprintf(pathname,PATH_MAX,"%s_incarnation_%d_%lld",session->pathname,pid,ktime_get_real());
-	if(res>=PATH_MAX){
+	pathname=kasprintf(GFP_KERNEL,"%s" INCARNATION_INFIX "%d_%lld",session->pathname,pid,ktime_get_real());
+	if(pathname!=NULL && strlen(pathname)>=PATH_MAX){
 		//we make the file shorter by opening it on /var/tmp
-		snprintf(pathname,PATH_MAX,"/var/tmp/%d_%lld",pid,ktime_get_real());
+		kfree(pathname);
+		pathname=kasprintf(GFP_KERNEL,"/var/tmp/%d_%lld",pid,ktime_get_real());
 	}
-	printk(KERN_DEBUG "SessionFS session manager: opening the incarnation file: %s",pathname);
-	//we try to open the file
-	fd=open_file(pathname,flags | O_CREAT,mode,!NO_FD,&file);
-	if(fd<0){
+	if(!pathname){
+		uncharge_incarnation(session,&charge);
+		kmem_cache_free(incarnation_cache,incarnation);
+		kfree(fops);
+		return ERR_PTR(-ENOMEM);
+	}
+	pr_debug("opening the incarnation file: %s\n",pathname);
+	//we try to open the file, the file descriptor will be installed when the incarnation is ready
+	res=open_file(pathname,flags | O_CREAT,mode,NO_FD,&file);
+	if(res<0){
 		kfree(pathname);
-		kfree(incarnation);
-		return ERR_PTR(fd);
+		uncharge_incarnation(session,&charge);
+		kmem_cache_free(incarnation_cache,incarnation);
+		kfree(fops);
+		return ERR_PTR(res);
 	}
-	printk(KERN_DEBUG "SessionFS session manager: adding incarnation info");
+	if(fd_needed){
+		fd=get_unused_fd_flags(flags);
+		if(fd<0){
+			unlink_incarnation(file);
+			filp_close(file,NULL);
+			kfree(pathname);
+			uncharge_incarnation(session,&charge);
+			kmem_cache_free(incarnation_cache,incarnation);
+			kfree(fops);
+			return ERR_PTR(fd);
+		}
+		//we install the release hook on the incarnation file
+		memcpy(&(fops->ops),file->f_op,sizeof(struct file_operations));
+		fops->ops.release=incarnation_release;
+		fops->orig_ops=file->f_op;
+		fops->incarnation=incarnation;
+		//the hook must stay loaded until the file is released
+		__module_get(THIS_MODULE);
+		file->f_op=&(fops->ops);
+	} else {
+		//the caller will release the file
+		kfree(fops);
+		fd=-atomic_add_return(1,&incarnation_ids);
+	}
+	//one reference is held by the incarnation file and one by the parent session list
+	kref_init(&(incarnation->kref));
+	kref_get(&(incarnation->kref));
+	incarnation->charge=charge;
+	atomic_set(&(incarnation->closed),0);
+	incarnation->session=session;
+	pr_debug("adding incarnation info\n");
 	//we add the information on the new incarnation
-	res=add_incarnation_info(&(session->info),&(incarnation->inc_attr),pid,fd);
+	res=add_incarnation_info(&(session->info),&(incarnation->info),pid,fd);
+	if(res<0){
+		//there is nothing to remove when the incarnation is closed
+		atomic_set(&(incarnation->closed),1);
+		//and it will never be released, so its charge is returned now
+		uncharge_incarnation(session,&(incarnation->charge));
+	}
 	/**
-	 * We need to grab the parent `::session` lock in read mode from when we copy the original file over the incarnation file; since we do not
-	 * need to protect the lockless list when adding elements, but the `::session` incarnations must be created atomically in respect to close
+	 * We need to grab the parent `::session` lock in read mode from when we copy the original file over the incarnation file; since the
+	 * list is protected by `inc_lock`, but the `::session` incarnations must be created atomically in respect to close
 	 * operations on the same original file
 	 * The lock is released when the incarnation has been added to the list.
 	 */
-	read_lock(&(session->sess_lock));
+	start=stat_start();
+	down_read(&(session->sess_lock));
+	session_stat_record(&(session->stats),STAT_LOCK_WAIT,start);
 	if(res==0){
 		// if we fail adding info on the incarnation we avoid copying the original file contents in it, since it will be closed shortly after.
-		printk(KERN_DEBUG "SessionFS session manager: copying the original file over the incarnation and populating the incarnation object");
+		pr_debug("copying the original file over the incarnation and populating the incarnation object\n");
 		//we copy the original file in the new incarnation
-		res=copy_file(session->file,file);
+		start=stat_start();
+		copied=copy_file(session->file,file,session->policy.copy_engine);
+		session_stat_record(&(session->stats),STAT_SNAPSHOT_COPY,start);
+		if(copied<0){
+			res=copied;
+		} else {
+			incarnation->bytes_snapshot=copied;
+			count_session_op(&(session->info),CNT_BYTES_SNAPSHOT,copied);
+		}
+	}
+	count_session_op(&(session->info),CNT_OPENS,1);
+	if(res<0){
+		count_session_op(&(session->info),CNT_FAILURES,1);
 	}
 	// we save the result in the status member of the struct, to make the shred library able to tell is the session is valid
-	printk(KERN_DEBUG "SessionFS session manager: copy result %d",res);
+	pr_debug("copy result %d\n",res);
 	incarnation->status=res;
 	incarnation->file=file;
 	incarnation->pathname=pathname;
 	incarnation->filedes=fd;
-	incarnation->node.next=NULL;
 	incarnation->owner_pid=pid;
-	printk(KERN_DEBUG "SessionFS session manager: adding the incarnation to the llist");
+	pr_debug("adding the incarnation to the session\n");
 	//we add the incarnation to the list of active incarnations
-	llist_add(&(incarnation->node),&(session->incarnations));
+	spin_lock(&(session->inc_lock));
+	list_add(&(incarnation->node),&(session->incarnations));
+	spin_unlock(&(session->inc_lock));
 	//we release the read lock
-	read_unlock(&(session->sess_lock));
-	return incarnation;
-}
-
-/** \brief Removes the given `::incarnation`.
- * \param[in] session The session containing the `::incarnation` to be removed.
- * \param[in] filedes The file descriptor that identifies the `::incarnation`
- * \param[in] pid The pid of the owner of the `::incarnation`.
- * \param[in] overwrite If set to `::OVERWRITE_ORIG` it will overwrite the original file with the content of the `::incarnation` which is going to be removed, otherwise the current `::incarnation` is simply removed.
- * \returns 0 or an error code (`-ENOENT` if the incarnation can't be found).
- *
- * Searches the `incarnations` list of the given `::session` for the current `::incarnation`, copies the contents of the
- * `::incarnation` over the original file (if `overwrite` is set to `::OVERWRITE_ORIG`) and marks it as invalid.
- * The userspace library needs to close and remove the file.
- *
- * When the incarnation is removed, SysFS is updated with `remove_incarnation_info()`.
- * There could be processes still referencing the `::incarnation` associated SysFS files after their removal, so the
- * `::incarnation` will remain in the lockless list and will be deallocated when the `::session` will be deleted.
- *
- */
-int delete_incarnation(struct session* session,int filedes, pid_t pid,int overwrite){
-	int res=0;
-	//we remove the incarnation from the list of incarnations
-	struct llist_node *it=NULL, *first=NULL;
-	struct incarnation* incarnation=NULL;
-	first=session->incarnations.first;
-	printk(KERN_DEBUG "SessionFS session manager: searching for the incarnation to delete");
-	//we search for the previous incarnation
-	//is our incarnation the first in the list?
-	incarnation=llist_entry(first,struct incarnation,node);
-	if(first==NULL || incarnation->owner_pid!=pid || incarnation->filedes!=filedes){
-		incarnation=NULL;
-		printk(KERN_DEBUG "SessionFS session manager: the incarnation to delete is not the first in the llist");
-	}
-
-	if(incarnation==NULL){
-		printk(KERN_DEBUG "SessionFS session manager: navigating the llist to find the incarnation to delete");
-		llist_for_each(it,first){
-			if(it!=NULL){
-				incarnation=llist_entry(it, struct incarnation, node);
-				if(incarnation->owner_pid==pid && incarnation->filedes==filedes){
-					printk(KERN_DEBUG "SessionFS session manager: found the incarnation in the list");
-					break;
-				}else{
-					incarnation=NULL;
-				}
-			}
-		}
-	}
-
-	if(incarnation==NULL){
-		return -ENOENT;
-	}
-
-
-	//we remove the information on the incarnation
-	remove_incarnation_info(&(session->info),&(incarnation->inc_attr));
-	//we overwrite, if necessary, the content of the original file
-	if(overwrite==OVERWRITE_ORIG && incarnation->status == VALID_NODE){
-		printk(KERN_DEBUG "SessionFS session manager: copying the content of the incarnation over the original file");
-		//before freeing the memory we copy the content of the current incarnation in the original file
-		//we get the write lock on the session
-		write_lock(&session->sess_lock);
-		res=copy_file(incarnation->file,session->file);
-		//we release the lock
-		write_unlock(&(session->sess_lock));
+	up_read(&(session->sess_lock));
+	trace_sessionfs_incarnation_create(session->pathname,pathname,pid,fd);
+	//the incarnations that will be closed by their release are indexed by their owner
+	if(fd_needed && atomic_read(&(incarnation->closed))==0){
+		res=index_incarnation(incarnation,task_tgid_nr(current));
 		if(res<0){
-			return res;
+			pr_warn("can't index incarnation %s, error %d\n",pathname,res);
 		}
 	}
-	///The `::incarnation` to be closed will be marked as invalid, by setting its `status` member to `-ENOENT`
-	incarnation->status=-ENOENT;
-	//we leave the incarnation freeing to when the session will be deleted.
-	printk(KERN_DEBUG "SessionFS session manager: incarnation closed successfully");
-	return 0;
+	//the incarnation file is counted until it is released
+	usage_alloc(MEM_INCARNATIONS,kmem_cache_size(incarnation_cache)+ksize(pathname)+(fd_needed ? ksize(fops) : 0));
+	usage_add_incarnation(incarnation);
+	if(fd_needed){
+		//notify processes that a file has been opened
+		fsnotify_open(file);
+		//register the descriptor in the intermediate table
+		fd_install(fd,file);
+		pr_debug("associated incarnation with file descriptor: %d\n",fd);
+	}
+	return incarnation;
 }
 
 /** Initializes the `::sessions` global variable as an empty list. Avoids the RCU initialization since we can't receive
-* requests yet, so no one will use this list for now. Then initializes the `::sessions_lock` spinlock.
+* requests yet, so no one will use this list for now. Then initializes the `::sessions_lock` spinlock and creates the slab
+* caches of the `::session`, `::session_rcu` and `::incarnation` objects.
 */
 int init_manager(void){
 //we initialize the list normally, since we cannot yet read it.
 	INIT_LIST_HEAD(&sessions);
 	//now we initialize the spinlock
 	spin_lock_init(&sessions_lock);
+	atomic_set(&incarnation_ids,0);
+	//we create the slab caches, the objects are allocated on every open
+	session_cache=KMEM_CACHE(session,0);
+	session_rcu_cache=KMEM_CACHE(session_rcu,0);
+	incarnation_cache=KMEM_CACHE(incarnation,0);
+	if(session_cache==NULL || session_rcu_cache==NULL || incarnation_cache==NULL){
+		kmem_cache_destroy(session_cache);
+		kmem_cache_destroy(session_rcu_cache);
+		kmem_cache_destroy(incarnation_cache);
+		return -ENOMEM;
+	}
+	schedule_delayed_work(&reap_work,msecs_to_jiffies(REAP_INTERVAL_MS));
 	return 0;
 }
 
+/** We stop the periodic sweep and wait for the `::session_rcu` objects that are being freed by `call_rcu()` before destroying the slab caches.
+ */
+void release_manager(void){
+	cancel_delayed_work_sync(&reap_work);
+	rcu_barrier();
+	kmem_cache_destroy(session_cache);
+	kmem_cache_destroy(session_rcu_cache);
+	kmem_cache_destroy(incarnation_cache);
+}
+
 /** To create a new session we check if the original file was already opened with session semantic, by searching for an
  * existing `::session` with the same `pathname` using `search_session()`.
  * If the found `::session` is invalid or a matching `::session` object is not found a new `::session` object will be
- * created, using `init_session()`.
- * Then we create a new `::incarnation` of the original file with `create_incarnation()`.
+ * created, using `init_session()`, with the given `policy`: an existing `::session` keeps its own policy.
+ * Then we create a new `::incarnation` of the original file with `create_incarnation()`, charged to the session `root`.
  *
  * When the `::incarnation` has been created the `refcount` of the parent session is decremented.
  *
  * `-EAGAIN` is returned if the created session is invalid.
  */
-struct incarnation* create_session(const char* pathname, int flags, pid_t pid, mode_t mode){
+struct incarnation* create_session(const char* pathname, int flags, pid_t pid, mode_t mode,int fd_needed,const struct sess_policy* policy,
+	const char* root){
 	//we get the first element of the session list
 	struct session* session=NULL;
 	struct incarnation* incarnation=NULL;
-	printk(KERN_DEBUG "SessionFS session manager: searching for an existing session with pathname %s",pathname);
-	session=search_session(pathname,NO_FD,NO_PID);
+	u64 start;
+	u16 record_flags;
+	pr_debug("searching for an existing session with pathname %s\n",pathname);
+	start=stat_start();
+	session=search_session(pathname);
+	stat_record(STAT_LOOKUP,start);
 	/*session_it now is either null or contains the element which represents the session for the file in pathname,
 	 * however if the session is invalid we need to create another valid session object */
 	if(session==NULL || atomic_read(&(session->valid))!=VALID_NODE){
 		if(session!=NULL){
 			atomic_sub(1,&(session->refcount));
-			printk(KERN_DEBUG "SessionFS session manager: the found session has become invalid, trying deallocation");
+			pr_debug("the found session has become invalid, trying deallocation\n");
 			delete_session(session);
 		}
-		printk(KERN_DEBUG "SessionFS session manager: session object not found, creating a new session with pathname %s",pathname);
+		pr_debug("session object not found, creating a new session with pathname %s\n",pathname);
 	//we create the session object if necessary
-		session=init_session(pathname, flags,mode);
+		session=init_session(pathname, flags,mode,(policy!=NULL) ? policy : &default_policy);
 		if(IS_ERR(session)){
+			count_session_op(NULL,CNT_FAILURES,1);
+			trace_sessionfs_session_open(pathname,flags,pid,NO_FD,PTR_ERR(session));
+			record_session_op(RECORD_OPEN,pathname,NULL,pid,0,0,0,PTR_ERR(session),start);
 			//we return the error code (as an incarnation*)
 			return (struct incarnation*)session;
 		}
 	}
 	//we create the file incarnation
-	printk(KERN_DEBUG "SessionFS session manager: adding a new incarnation to session object %s",pathname);
-	incarnation=create_incarnation(session,flags,pid,mode);
+	pr_debug("adding a new incarnation to session object %s\n",pathname);
+	incarnation=create_incarnation(session,flags,pid,mode,fd_needed,root);
+	//the flags are read while we hold the reference, since a failed creation can deallocate the session
+	record_flags=policy_record_flags(&(session->policy));
 	atomic_sub(1,&(session->refcount));
 	//we deallcate the session if it has become invalid during creation
 	if(PTR_ERR(incarnation)==-EAGAIN){
 		delete_session(session);
 	}
-	printk(KERN_DEBUG "SessionFS session manager: incarnation created, check the incarnation status to see if it is valid");
+	if(IS_ERR(incarnation)){
+		trace_sessionfs_session_open(pathname,flags,pid,NO_FD,PTR_ERR(incarnation));
+		record_session_op(RECORD_OPEN,pathname,NULL,pid,0,0,record_flags,PTR_ERR(incarnation),start);
+	} else {
+		trace_sessionfs_session_open(pathname,flags,pid,incarnation->filedes,incarnation->status);
+		//the incarnation keeps the session alive
+		record_session_op(RECORD_OPEN,pathname,incarnation->pathname,pid,i_size_read(file_inode(incarnation->session->file)),
+			incarnation->bytes_snapshot,record_flags,incarnation->status,start);
+	}
 	return incarnation;
 }
 
 /**
- * This function will close one session, by finding the corresponding `::incarnation`, using `search_session()`,
- * copying the incarnation file over the original file (atomically in respect to other session operations
- * on the same original file, and only if the `::session` is valid), and deleting the incarnation, using `delete_incarnation()`.
+ * This function will close one session, by getting the incarnation file from the file descriptor and closing the
+ * corresponding `::incarnation` with `release_incarnation()`, which copies the incarnation file over the original file
+ * (atomically in respect to other session operations on the same original file, and only if the `::session` is valid).
  * If after the incarnation deletion the `::session` has no other `::incarnation`(s) the it will also schedule the `::session` to
  * be removed.
  *
+ * The incarnation file is removed when it is released by the process.
  */
-int  close_session(const char* pathname,int fdes, pid_t pid){
-	//we locate the session in which we need to remove an incarnation
-	int res=0, commit=OVERWRITE_ORIG;
-	struct session* session=NULL;
-	printk(KERN_DEBUG "SessionFS session manager: searching for the incarnation to remove");
-	session=search_session(pathname,fdes,pid);
-	if(session==NULL){
-	/// If we cannot locate the parent session of an incarnation `-EBADF` is returned.
-		printk(KERN_DEBUG "SessionFS session manager: session not found, aborting");
+int close_session(int fdes){
+	int res=0;
+	struct file* file=NULL;
+	struct incarnation_fops* fops=NULL;
+	pr_debug("searching for the incarnation to remove\n");
+	file=fget(fdes);
+	/// If the file descriptor does not refer to an incarnation file `-EBADF` is returned.
+	if(file==NULL){
 		return -EBADF;
 	}
-	//If the session if still valid we overwrite the original file, otherwise we simply delete the `::incarnation`.
-	if(atomic_read(&(session->valid))!=VALID_NODE){
-		printk(KERN_DEBUG "SessionFS session manager: invalid session, the original file will not be overwritten");
-		commit=!OVERWRITE_ORIG;
+	if(file->f_op->release!=incarnation_release){
+		pr_debug("the file is not an incarnation, aborting\n");
+		fput(file);
+		return -EBADF;
 	}
-	//we eliminate the incarnation and we overwrite the original file with the incarnation content.
-	res=delete_incarnation(session, fdes, pid,commit);
+	fops=container_of(file->f_op,struct incarnation_fops,ops);
+	res=release_incarnation(fops->incarnation);
+	fput(file);
 	if(res<0){
 		return res;
 	}
-	printk(KERN_DEBUG "SessionFS session manager: elimination of the incarnation successful");
-	/**
-	 *
-	 * To remove a session object we need to check several conditions:
-	 * - The `::session` must be not in use by other threads (refcount==1)
-	 * - The `::session` kernel object refcount, in the `info` member, must be 1
-	 * - The `::session` must be still valid and not already marked for deletion
-	 */
-	printk(KERN_WARNING "SessionFS session manager: session status after elimination: recount %d kobject refcount :%d",atomic_read(&(session->refcount)),kref_read(&(session->info.kobj->kref)));
+	pr_debug("elimination of the incarnation successful\n");
+	return 0;
+}
 
-	if(atomic_read(&(session->refcount))==1 && kref_read(&(session->info.kobj->kref))==1 && atomic_read(&(session->valid))==VALID_NODE){
-		printk(KERN_DEBUG "SessionFS session manager: attempting to purge the session object");
-		///If the current `::session` must be removed, we flag it as invalid, to avoid having new incarnations created in here before deallocating it and making sure that it will be eventually deallocated.
-		atomic_set(&(session->valid),!VALID_NODE);
-		///We also remove its information on SysFS using `remove_session_info()`.
-		remove_session_info(&(session->info));
-		//we get the spinlock over the session list, to avoid running concurrently with another list modification primitive
-		spin_lock(&sessions_lock);
-		///Then, we can remove the current `::session` object from the rcu list, using the `::sessions_lock` spinlock to avoid concurrent operations.
-		printk(KERN_DEBUG "SessionFS session manager: removing the element from the rcu_list");
-		list_del_rcu(&(session->rcu_node->list_node));
-		//we release the spinlock
-		spin_unlock(&sessions_lock);
-		//we register a callback to free the memory associated to the session
-		printk(KERN_DEBUG "SessionFS session manager: registering callback to deallocate the session_rcu object");
-		call_rcu(&(session->rcu_node->rcu_head),delete_session_rcu);
+/** \brief Removes the valid `::session`(s) that have no incarnations and are not in use.
+ * \param[in] budget The maximum number of `::session`(s) to remove.
+ * \returns The number of `::session`(s) found without incarnations, at most `budget`.
+ *
+ * Incarnations leave their `::session` when they are closed, and `put_session()` removes the `::session` when the last
+ * one is closed; two incarnations closed at the same time can both see the other one holding the `::session`, leaving it
+ * behind. Such `::session`(s) are collected in an RCU walk, holding a reference, and removed with `put_session()` outside
+ * of it, since removing their SysFS information can sleep.
+ */
+int reap_sessions(int budget){
+	struct session_rcu* session_rcu=NULL;
+	struct session* session;
+	struct session* found[REAP_BATCH];
+	int i,num=0;
+	budget=min(budget,REAP_BATCH);
+	rcu_read_lock();
+	list_for_each_entry_rcu(session_rcu,&sessions,list_node,NULL){
+		if(num>=budget){
+			break;
+		}
+		session=session_rcu->session;
+		if(atomic_read(&(session->valid))==VALID_NODE && atomic_read(&(session->info.inc_num))==0 && atomic_read(&(session->refcount))==0){
+			atomic_add(1,&(session->refcount));
+			found[num++]=session;
+		}
 	}
-	//we decrement the refcount
-	atomic_sub(1,&(session->refcount));
-	///Finally, we try to deallocate the `::session` if is invalid, using `delete_session()`.
-	if(atomic_read(&(session->valid))!=VALID_NODE){
-		delete_session(session);
+	rcu_read_unlock();
+	for(i=0;i<num;i++){
+		trace_sessionfs_reap(found[i]->pathname,"",0);
+		put_session(found[i]);
 	}
-	return 0;
+	return num;
+}
+
+void reap_work_fn(struct work_struct* work){
+	reap_sessions(REAP_BATCH);
+	check_usage();
+	schedule_delayed_work(&reap_work,msecs_to_jiffies(REAP_INTERVAL_MS));
 }
 
 /**
- * This method will walk through the `::sessions` list and each `::incarnation` list, deleting all the
- * `::incarnation`(s) and `::session`(s) in which the process that has requested it is not active anymore, leaving the original files untouched.
- * If there is an `::incarnation` that is still in use by an active process it will be preserved.
- *
- * To check if an `::incarnation` is still active we get the struct pid from the pid number included in the `::incarnation`;
- * if we receive it, the process is at most in a zombie state.
- *
- * When walking the `::sessions` list we increment the refcount of the `::session` in use to avoid having it removed while we are using it.
- * We remove all the elements in the `incarnations` lockless list and we add back the objects,
- * closing the others without modifing the original file and updating SysFS with `remove_incarnation_info()`, without deallcoating the  dead `::incarnation`(s).
- * If a `::session` has no active incarnations it will be flagged as invalid and removed during a second walk, where,
- * with `delete_incarnation()`, we remove all the invalid `::session`(s) and deallocate al the associated `::incarnation`(s).
- *
- * __NOTE:__ For dead incarnations that have not been closed we leave the files in the folder, since can't remove them from kernel space.
- * Userspace will need to manually remove incarnations file for invalid processes.
+ * The incarnations of exited processes have already been closed when their files have been released, so we only need
+ * to remove the `::session`(s) without incarnations, with `reap_sessions()`, and to count the incarnations left, which
+ * belong to processes that still have them open.
  */
 int clean_manager(void){
-	int manager_status=MANAGER_EMPTY,active_sessions=0,dead_sessions=0;
-	struct pid* pid;
+	int active_sessions=0;
 	struct session_rcu* session_rcu=NULL;
-	struct incarnation* incarnation=NULL;
-	struct llist_node *llist_it=NULL,*llist_node=NULL,*llist_tmp;
-	struct task_struct* task;
-	//we take the spinlock to be sure to be the last to have accessed this list
-	if(list_first_or_null_rcu(&sessions,struct session_rcu,list_node)!=NULL){
-		rcu_read_lock();
-		printk(KERN_DEBUG "SessionFS session manager: we have elements in the rcu list, checking sessions");
-		list_for_each_entry_rcu(session_rcu,&sessions,list_node){
-			//We skip invalid sessions that will be deleted shortly
-			if(atomic_read(&(session_rcu->session->valid))==VALID_NODE){
-				atomic_add(1,&(session_rcu->session->refcount));
-				//we check the remaining sessions incarnations
-				if(!llist_empty(&(session_rcu->session->incarnations))){
-					// we remove all the elements from the llist
-					llist_node=llist_del_all(&(session_rcu->session->incarnations));
-					//we walk the deleted llist searching for incarnations in use by a valid process
-					incarnation=NULL;
-					llist_for_each_safe(llist_it,llist_tmp,llist_node){
-						incarnation=llist_entry(llist_it,struct incarnation,node);
-						//we try to get the pid struct for the pid in the
-						pid=find_get_pid(incarnation->owner_pid);
-						task=get_pid_task(pid,PIDTYPE_PID);
-						/// We consider as invalid a session which is associated to a dead process.
-						if(pid==NULL || task_is_stopped_or_traced(task)){
-							dead_sessions++;
-							//if we couldn't get the pid struct or if is NULL we consider the process is dead.
-							//we don't close the file associated to the incarnation since the kernel already closes it and we could get a GPF.
-							//if the incarnation is invalid we have already removed the sysfs file associated.
-							if(incarnation->status==0){
-								printk(KERN_DEBUG "SessionFS session manager: %s is owned by a dead process, freeing the session",incarnation->pathname);
-								incarnation->status=-ENOENT;
-								remove_incarnation_info(&(session_rcu->session->info),&(incarnation->inc_attr));
-							}
-						} else {
-							if(IS_ERR(pid)){
-								printk(KERN_WARNING "SessionFS session manager: error while getting pid struct for %d",incarnation->owner_pid);
-							}
-							//we increment the active sessions count
-							active_sessions++;
-						}
-						// we put back the incarnation in the llist
-						incarnation->node.next=NULL;
-						llist_add(&(incarnation->node),&(session_rcu->session->incarnations));
-					}
-				}
-				atomic_sub(1,&(session_rcu->session->refcount));
-				printk(KERN_INFO "SessionFS session manger: session status after cleanup: refcount %d kobject refcount:%d",atomic_read(&(session_rcu->session->refcount)),kref_read(&(session_rcu->session->info.kobj->kref)));
-				if(atomic_read(&(session_rcu->session->refcount))==0 && kref_read(&(session_rcu->session->info.kobj->kref))==1){
-					//we mark the session as invalid for future deletion
-					atomic_set(&(session_rcu->session->valid),!VALID_NODE);
-					remove_session_info(&(session_rcu->session->info));
-				} else {
-					//we note that the manager contains active sessions, since the current session is not invalid
-					manager_status=!MANAGER_EMPTY;
-				}
-			}
-		}
-		rcu_read_unlock();
-		//if we have found some dead incarnations we need to check if their session object can be deallocated
-		if(dead_sessions>0){
-			printk(KERN_DEBUG "SessionFS session manager: checking for invalid session objects");
-			spin_lock(&sessions_lock);
-			list_for_each_entry_rcu(session_rcu,&sessions,list_node){
-				if(atomic_read(&(session_rcu->session->valid))!=VALID_NODE){
-					//we can remove the current session object from the rcu list
-					list_del_rcu(&(session_rcu->list_node));
-					//we register a callback to free the memory associated to the session
-					call_rcu(&(session_rcu->rcu_head),delete_session_rcu);
-					delete_session(session_rcu->session);
-				}
-			}
-			spin_unlock(&sessions_lock);
+	//we remove the empty sessions, in batches
+	while(reap_sessions(REAP_BATCH)==REAP_BATCH){
+		cond_resched();
+	}
+	rcu_read_lock();
+	list_for_each_entry_rcu(session_rcu,&sessions,list_node,NULL){
+		if(atomic_read(&(session_rcu->session->valid))==VALID_NODE){
+			active_sessions+=atomic_read(&(session_rcu->session->info.inc_num));
 		}
 	}
-	if(manager_status==MANAGER_EMPTY){
-		printk(KERN_DEBUG "SessionFS session manager: session list empty, session manager can be released");
+	rcu_read_unlock();
+	if(active_sessions==0){
+		pr_debug("session list empty, session manager can be released\n");
 	} else {
-		printk(KERN_DEBUG "SessionFS session manager: session list contains active sessions, session manager can't be released.");
+		pr_debug("session list contains active sessions, session manager can't be released.\n");
 	}
-	printk(KERN_DEBUG "SessionFS session manger: valid session num: %d, dead sessions: %d",active_sessions,dead_sessions);
+	pr_debug("active incarnations: %d\n",active_sessions);
 	return active_sessions;
 }
+
+/**
+ * Invalid sessions are skipped, the `refcount` of the returned `::session` is incremented, like in `search_session()`.
+ * A `::session` removed from the list while it is held still links to its successor, since `list_del_rcu()` does not
+ * clear the next pointer.
+ */
+struct session* next_session(struct session* session){
+	struct list_head* node=(session!=NULL) ? &(session->rcu_node->list_node) : &sessions;
+	struct session_rcu* session_rcu=NULL;
+	struct session* next=NULL;
+	for(;;){
+		session_rcu=list_next_or_null_rcu(&sessions,node,struct session_rcu,list_node);
+		if(session_rcu==NULL){
+			break;
+		}
+		atomic_add(1,&(session_rcu->session->refcount));
+		if(atomic_read(&(session_rcu->session->valid))==VALID_NODE){
+			next=session_rcu->session;
+			break;
+		}
+		atomic_sub(1,&(session_rcu->session->refcount));
+		node=&(session_rcu->list_node);
+	}
+	end_session_walk(session);
+	return next;
+}
+
+void end_session_walk(struct session* session){
+	if(session!=NULL){
+		atomic_sub(1,&(session->refcount));
+	}
+}
+
+/**
+ * The sessions are walked with `next_session()`.
+ */
+void walk_sessions(void (*fn)(struct session*, void*), void* data){
+	struct session* session;
+	rcu_read_lock();
+	for(session=next_session(NULL);session!=NULL;session=next_session(session)){
+		fn(session,data);
+	}
+	rcu_read_unlock();
+}
@@ -11,13 +11,26 @@
 
 #include "session_types.h"
 
+/// The policy of the sessions created without a session root (located in ::session_manager.c).
+extern const struct sess_policy default_policy;
+
+/// Used to toggle the necessity of a file descriptor in `open_file()` and `create_session()`.
+#define NO_FD 0
+
+/// Placed between the name of the original file and the pid and timestamp in the name of the incarnation files.
+#define INCARNATION_INFIX "_incarnation_"
+
 /** \brief Initialization of the session manager data structures.
  * \returns 0 on success or an error code.
  */
 int init_manager(void);
 
-/** \brief Releases all the incarnations that are associated with a dead/zombie pid.
- * \returns the number of sessions associated with an active pid.
+/** \brief Releases the session manager data structures, must be called after `clean_manager()`.
+ */
+void release_manager(void);
+
+/** \brief Removes the sessions without incarnations.
+ * \returns the number of incarnations still open.
 */
 int clean_manager(void);
 
@@ -26,15 +39,60 @@ int clean_manager(void);
  * \param[in] flags The flags that specify the permissions on the file.
  * \param[in] pid The pid of the process that wants to create the session.
  * \param[in] mode The permissions to apply to newly created files.
- * \returns a pointer to an ::incarnation object, containing all the info on the current incarnation or an error code.
+ * \param[in] fd_needed If set to `::NO_FD` the incarnation file is not installed in the file table of the process and must be closed with `close_session_file()`.
+ * \param[in] policy The `::sess_policy` of the session, used only if the session does not exist yet, `NULL` for the default policy.
+ * \param[in] root The pathname of the session root that contains the file, whose account is charged for the incarnation, `NULL` if there is none.
+ * \returns a pointer to an ::incarnation object, containing all the info on the current incarnation or an error code
+ * (`-EDQUOT` if the incarnation would exceed a limit of the admission control, see session_quota.h).
  */
-struct incarnation* create_session(const char* pathname, int flags, pid_t pid, mode_t mode);
+struct incarnation* create_session(const char* pathname, int flags, pid_t pid, mode_t mode,int fd_needed,const struct sess_policy* policy,
+	const char* root);
 
 /** \brief Closes a session.
- * \param[in] pathname the pathname for the session containing the incarnation that is being closed.
- * \param[in] fdes The file descriptor of a session incarnation.
- * \param[in] pid The owner process pid.
+ * \param[in] fdes The file descriptor of a session incarnation, in the calling process.
  * \return 0 on success or an error code.
+ *
+ * Sessions are also closed automatically when the incarnation file is released, this function can be used to commit an
+ * incarnation before closing its file descriptor.
+ */
+int close_session(int fdes);
+
+/** \brief Closes a session whose incarnation has been created without a file descriptor.
+ * \param[in] incarnation The `::incarnation` returned by `create_session()`.
+ *
+ * The incarnation is committed, its file is closed and removed and the reference of the caller on `incarnation` is dropped.
+ */
+void close_session_file(struct incarnation* incarnation);
+
+/** \brief Checks if a file name is the name of an incarnation file.
+ * \param[in] name The file name, not terminated.
+ * \param[in] len The length of `name`.
+ * \returns True if `name` ends with ::INCARNATION_INFIX followed by a pid and a timestamp.
+ *
+ * Used by the stacked filesystem to hide the incarnation files created in the lower directory.
+ */
+bool is_incarnation_name(const char* name, int len);
+
+/** \brief Gets the valid session that follows another one in the sessions list, to walk it one session at a time.
+ * \param[in] session The current `::session`, whose reference is dropped, or `NULL` to start from the head of the list.
+ * \returns The next valid `::session`, with a reference held, or `NULL` at the end of the list.
+ *
+ * Must be called in an RCU read-side critical section, which must last until the reference of the returned `::session`
+ * is dropped, by the following call or by `end_session_walk()`.
+ */
+struct session* next_session(struct session* session);
+
+/** \brief Ends a walk of the sessions list before its end.
+ * \param[in] session The `::session` returned by the last call to `next_session()`, whose reference is dropped, or `NULL`.
+ */
+void end_session_walk(struct session* session);
+
+/** \brief Calls a function on each valid session.
+ * \param[in] fn The function to call, it receives the `::session` and `data` and must not sleep.
+ * \param[in] data Passed to `fn`.
+ *
+ * The sessions list is walked in an RCU read-side critical section, holding a reference on each `::session` while `fn`
+ * is called.
  */
-int close_session(const char* pathname, int fdes, pid_t pid);
+void walk_sessions(void (*fn)(struct session*, void*), void* data);
 #endif
@@ -0,0 +1,511 @@
+/** \file
+ * \brief KUnit suite of the session manager, built as the `SessionFS-test` module with `make kunit`.
+ *
+ * The tests call the session manager directly, without the device and the shared library, on files created in
+ * ::test_dir, which should be on tmpfs. Each test initializes the session manager and the session information and
+ * releases them at the end, so leaked sessions and incarnations are reported when the slab caches are destroyed.
+ *
+ * The suite also contains timed microbenchmarks of the insertion and the lookup of sessions, whose results are printed
+ * in the test log, from 10^3 sessions up to ::bench_max_sessions.
+ *
+ * The module needs a kernel with `CONFIG_KUNIT`, such as a UML or QEMU guest, and must not be loaded with the
+ * `SessionFS` module, since they publish the same procfs and tracing entries.
+ */
+
+///Prefix of the messages printed by the test suite.
+#define pr_fmt(fmt) "SessionFS test: " fmt
+
+#include <kunit/test.h>
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/string.h>
+#include <linux/err.h>
+#include <uapi/linux/limits.h>
+
+#include "session_manager.h"
+#include "session_info.h"
+#include "session_types.h"
+#include "session_usage.h"
+#include "session_quota.h"
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("KUnit tests and benchmarks of the SessionFS session manager");
+
+///The directory of the test files, should be on tmpfs.
+char* test_dir="/tmp";
+module_param(test_dir,charp,0444);
+MODULE_PARM_DESC(test_dir,"directory of the test files, should be on tmpfs");
+
+///The highest number of sessions of the microbenchmarks.
+int bench_max_sessions=10000;
+module_param(bench_max_sessions,int,0444);
+MODULE_PARM_DESC(bench_max_sessions,"highest number of sessions of the microbenchmarks, from 1000 up to 1000000");
+
+///Number of threads of the stress test.
+#define STRESS_THREADS 8
+
+///Number of sessions opened by each thread of the stress test.
+#define STRESS_ITERATIONS 200
+
+///Number of lookups timed at each size of the microbenchmark.
+#define BENCH_LOOKUPS 1000
+
+///Content of the original files.
+#define ORIG_CONTENT "original content"
+
+///Content written in the incarnations.
+#define NEW_CONTENT "incarnation data"
+
+//internal functions of session_manager.c
+struct session* search_session(const char* pathname);
+struct session* init_session(const char* pathname,int flags, mode_t mode,const struct sess_policy* policy);
+void put_session(struct session* session);
+void unlink_incarnation(struct file* file);
+
+/** \brief Builds the pathname of a test file.
+ * \param[in] test The running test.
+ * \param[in] name The name of the file, without directory.
+ * \param[in] num A number that makes the name unique.
+ * \returns The pathname, freed when the test ends.
+ */
+char* test_pathname(struct kunit* test,const char* name,int num){
+	char* pathname=kunit_kzalloc(test,PATH_MAX,GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test,pathname);
+	snprintf(pathname,PATH_MAX,"%s/sessionfs-kunit-%s-%d",test_dir,name,num);
+	return pathname;
+}
+
+/** \brief Creates a file with the given content, replacing an existing one.
+ * \param[in] pathname The pathname of the file.
+ * \param[in] content The content of the file.
+ * \returns 0 on success or an error code.
+ */
+int write_test_file(const char* pathname,const char* content){
+	struct file* file;
+	loff_t pos=0;
+	ssize_t res;
+	file=filp_open(pathname,O_CREAT | O_TRUNC | O_WRONLY,0644);
+	if(IS_ERR(file)){
+		return PTR_ERR(file);
+	}
+	res=kernel_write(file,content,strlen(content),&pos);
+	filp_close(file,NULL);
+	return (res<0) ? res : 0;
+}
+
+/** \brief Reads the beginning of a file.
+ * \param[in] file The file.
+ * \param[out] buf The buffer, which is always terminated.
+ * \param[in] len The length of `buf`.
+ * \returns The number of bytes read or an error code.
+ */
+ssize_t read_test_file(struct file* file,char* buf,size_t len){
+	loff_t pos=0;
+	ssize_t res;
+	memset(buf,0,len);
+	res=kernel_read(file,buf,len-1,&pos);
+	return res;
+}
+
+/** \brief Checks the content of a file.
+ * \param[in] test The running test.
+ * \param[in] pathname The pathname of the file.
+ * \param[in] content The expected content.
+ */
+void expect_content(struct kunit* test,const char* pathname,const char* content){
+	struct file* file;
+	char buf[64];
+	file=filp_open(pathname,O_RDONLY,0);
+	KUNIT_ASSERT_FALSE(test,IS_ERR(file));
+	KUNIT_EXPECT_EQ(test,read_test_file(file,buf,sizeof(buf)),(ssize_t)strlen(content));
+	KUNIT_EXPECT_STREQ(test,buf,content);
+	filp_close(file,NULL);
+}
+
+/** \brief Removes a test file, if it exists.
+ * \param[in] pathname The pathname of the file.
+ */
+void remove_test_file(const char* pathname){
+	struct file* file;
+	file=filp_open(pathname,O_RDONLY,0);
+	if(IS_ERR(file)){
+		return;
+	}
+	unlink_incarnation(file);
+	filp_close(file,NULL);
+}
+
+/** \brief Initializes the session manager and the session information before each test.
+ * \param[in] test The test that is starting.
+ * \returns 0 on success or an error code.
+ *
+ * The session information is published in a kernel object that replaces the one of the device.
+ */
+int manager_test_init(struct kunit* test){
+	struct kobject* kobj;
+	int res;
+	kobj=kobject_create_and_add("SessionFS_test",kernel_kobj);
+	if(kobj==NULL){
+		return -ENOMEM;
+	}
+	res=init_manager();
+	if(res<0){
+		kobject_put(kobj);
+		return res;
+	}
+	res=init_info(kobj);
+	if(res<0){
+		release_manager();
+		kobject_put(kobj);
+		return res;
+	}
+	test->priv=kobj;
+	return 0;
+}
+
+/** \brief Releases the session manager and the session information after each test.
+ * \param[in] test The test that has ended.
+ *
+ * No session must be left open by the test.
+ */
+void manager_test_exit(struct kunit* test){
+	KUNIT_EXPECT_EQ(test,clean_manager(),0);
+	release_info();
+	release_manager();
+	kobject_put(test->priv);
+}
+
+/** \brief A session can be found by pathname until its last reference is dropped.
+ * \param[in] test The running test.
+ */
+void test_init_search(struct kunit* test){
+	char* pathname=test_pathname(test,"search",0);
+	struct session *session,*found;
+	KUNIT_ASSERT_EQ(test,write_test_file(pathname,ORIG_CONTENT),0);
+	KUNIT_EXPECT_PTR_EQ(test,search_session(pathname),(struct session*)NULL);
+	session=init_session(pathname,O_RDWR,0644,&default_policy);
+	KUNIT_ASSERT_FALSE(test,IS_ERR(session));
+	KUNIT_EXPECT_STREQ(test,session->pathname,pathname);
+	found=search_session(pathname);
+	KUNIT_EXPECT_PTR_EQ(test,found,session);
+	if(found!=NULL){
+		put_session(found);
+	}
+	//a second init returns the existing session
+	found=init_session(pathname,O_RDWR,0644,&default_policy);
+	KUNIT_EXPECT_PTR_EQ(test,found,session);
+	if(!IS_ERR(found)){
+		put_session(found);
+	}
+	//the last reference removes the session, since it has no incarnations
+	put_session(session);
+	KUNIT_EXPECT_PTR_EQ(test,search_session(pathname),(struct session*)NULL);
+	remove_test_file(pathname);
+}
+
+/** \brief An incarnation starts as a copy of the original file and is committed when closed.
+ * \param[in] test The running test.
+ */
+void test_incarnation_commit(struct kunit* test){
+	char* pathname=test_pathname(test,"commit",0);
+	struct incarnation* inc;
+	char buf[64];
+	loff_t pos=0;
+	KUNIT_ASSERT_EQ(test,write_test_file(pathname,ORIG_CONTENT),0);
+	inc=create_session(pathname,O_RDWR,current->pid,0644,NO_FD,NULL,NULL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test,inc);
+	KUNIT_EXPECT_EQ(test,inc->status,0);
+	KUNIT_EXPECT_EQ(test,clean_manager(),1);
+	KUNIT_EXPECT_EQ(test,read_test_file(inc->file,buf,sizeof(buf)),(ssize_t)strlen(ORIG_CONTENT));
+	KUNIT_EXPECT_STREQ(test,buf,ORIG_CONTENT);
+	KUNIT_EXPECT_EQ(test,kernel_write(inc->file,NEW_CONTENT,strlen(NEW_CONTENT),&pos),(ssize_t)strlen(NEW_CONTENT));
+	//the original file is not modified until the incarnation is closed
+	expect_content(test,pathname,ORIG_CONTENT);
+	close_session_file(inc);
+	expect_content(test,pathname,NEW_CONTENT);
+	KUNIT_EXPECT_EQ(test,clean_manager(),0);
+	KUNIT_EXPECT_PTR_EQ(test,search_session(pathname),(struct session*)NULL);
+	remove_test_file(pathname);
+}
+
+/** \brief The incarnations of a session with the `::COMMIT_DISCARD` policy never modify the original file.
+ * \param[in] test The running test.
+ */
+void test_incarnation_discard(struct kunit* test){
+	char* pathname=test_pathname(test,"discard",0);
+	struct sess_policy policy={.commit_mode=COMMIT_DISCARD,.copy_engine=COPY_FILE_RANGE};
+	struct incarnation* inc;
+	loff_t pos=0;
+	KUNIT_ASSERT_EQ(test,write_test_file(pathname,ORIG_CONTENT),0);
+	inc=create_session(pathname,O_RDWR,current->pid,0644,NO_FD,&policy,NULL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test,inc);
+	KUNIT_EXPECT_EQ(test,inc->status,0);
+	KUNIT_EXPECT_EQ(test,kernel_write(inc->file,NEW_CONTENT,strlen(NEW_CONTENT),&pos),(ssize_t)strlen(NEW_CONTENT));
+	close_session_file(inc);
+	expect_content(test,pathname,ORIG_CONTENT);
+	remove_test_file(pathname);
+}
+
+/** \brief The incarnations of the same file share their session, which is removed with the last of them.
+ * \param[in] test The running test.
+ */
+void test_shared_session(struct kunit* test){
+	char* pathname=test_pathname(test,"shared",0);
+	struct incarnation *first,*second;
+	struct session* found;
+	KUNIT_ASSERT_EQ(test,write_test_file(pathname,ORIG_CONTENT),0);
+	first=create_session(pathname,O_RDWR,current->pid,0644,NO_FD,NULL,NULL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test,first);
+	second=create_session(pathname,O_RDWR,current->pid,0644,NO_FD,NULL,NULL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test,second);
+	KUNIT_EXPECT_PTR_EQ(test,first->session,second->session);
+	KUNIT_EXPECT_EQ(test,clean_manager(),2);
+	close_session_file(first);
+	KUNIT_EXPECT_EQ(test,clean_manager(),1);
+	found=search_session(pathname);
+	KUNIT_EXPECT_PTR_EQ(test,found,second->session);
+	if(found!=NULL){
+		//we drop the reference taken by the search
+		atomic_sub(1,&(found->refcount));
+	}
+	close_session_file(second);
+	KUNIT_EXPECT_PTR_EQ(test,search_session(pathname),(struct session*)NULL);
+	remove_test_file(pathname);
+}
+
+/** \brief An incarnation file is counted in the disk usage while it is open, and its memory until it is freed.
+ * \param[in] test The running test.
+ *
+ * The previous tests have freed all their incarnations, so their memory is no longer counted.
+ */
+void test_usage(struct kunit* test){
+	char* pathname=test_pathname(test,"usage",0);
+	char* buf=kunit_kzalloc(test,PAGE_SIZE,GFP_KERNEL);
+	struct incarnation* inc;
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test,buf);
+	KUNIT_ASSERT_EQ(test,write_test_file(pathname,ORIG_CONTENT),0);
+	print_usage(buf,PAGE_SIZE);
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test,strstr(buf,"mem_incarnations 0\n"));
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test,strstr(buf,"incarnations_open 0\n"));
+	inc=create_session(pathname,O_RDWR,current->pid,0644,NO_FD,NULL,NULL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test,inc);
+	print_usage(buf,PAGE_SIZE);
+	KUNIT_EXPECT_PTR_EQ(test,strstr(buf,"mem_incarnations 0\n"),(char*)NULL);
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test,strstr(buf,"incarnations_open 1\n"));
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test,strstr(buf,"disk_size 16\n"));
+	close_session_file(inc);
+	print_usage(buf,PAGE_SIZE);
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test,strstr(buf,"mem_incarnations 0\n"));
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test,strstr(buf,"incarnations_open 0\n"));
+	remove_test_file(pathname);
+}
+
+/** \brief An open over the limit of its original file is refused, and admitted again once the charge is returned.
+ * \param[in] test The running test.
+ */
+void test_quota(struct kunit* test){
+	char* pathname=test_pathname(test,"quota",0);
+	struct incarnation *first,*second;
+	unsigned long limit=quota_file_bytes;
+	unsigned int wait=quota_wait_ms;
+	KUNIT_ASSERT_EQ(test,write_test_file(pathname,ORIG_CONTENT),0);
+	quota_file_bytes=strlen(ORIG_CONTENT);
+	quota_wait_ms=0;
+	first=create_session(pathname,O_RDWR,current->pid,0644,NO_FD,NULL,NULL);
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test,first);
+	second=create_session(pathname,O_RDWR,current->pid,0644,NO_FD,NULL,NULL);
+	KUNIT_EXPECT_EQ(test,PTR_ERR_OR_ZERO(second),-EDQUOT);
+	if(!IS_ERR_OR_NULL(first)){
+		close_session_file(first);
+	}
+	second=create_session(pathname,O_RDWR,current->pid,0644,NO_FD,NULL,NULL);
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test,second);
+	if(!IS_ERR_OR_NULL(second)){
+		close_session_file(second);
+	}
+	quota_file_bytes=limit;
+	quota_wait_ms=wait;
+	remove_test_file(pathname);
+}
+
+/** \brief An incarnation that has grown over the limit of its original file is discarded when it is committed.
+ * \param[in] test The running test.
+ */
+void test_quota_growth(struct kunit* test){
+	char* pathname=test_pathname(test,"quota_growth",0);
+	struct incarnation* inc;
+	unsigned long limit=quota_file_bytes;
+	loff_t pos=strlen(ORIG_CONTENT);
+	KUNIT_ASSERT_EQ(test,write_test_file(pathname,ORIG_CONTENT),0);
+	quota_file_bytes=strlen(ORIG_CONTENT)+1;
+	inc=create_session(pathname,O_RDWR,current->pid,0644,NO_FD,NULL,NULL);
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test,inc);
+	if(!IS_ERR_OR_NULL(inc)){
+		//the open is admitted, the append takes the incarnation over the limit
+		KUNIT_EXPECT_EQ(test,kernel_write(inc->file,NEW_CONTENT,strlen(NEW_CONTENT),&pos),(ssize_t)strlen(NEW_CONTENT));
+		close_session_file(inc);
+	}
+	expect_content(test,pathname,ORIG_CONTENT);
+	quota_file_bytes=limit;
+	remove_test_file(pathname);
+}
+
+/**
+ * \struct stress_thread
+ * \brief The state of a thread of the stress test.
+ * \param pathname The file opened by the thread.
+ * \param done Completed when the thread ends.
+ * \param errors The number of failed operations.
+ */
+struct stress_thread{
+	char* pathname;
+	struct completion done;
+	int errors;
+};
+
+/** \brief Body of a thread of the stress test.
+ * \param[in,out] data The `::stress_thread` of the thread.
+ * \returns 0.
+ *
+ * The sessions that become invalid while they are being opened return `-EAGAIN`, which is not an error.
+ */
+int stress_thread_fn(void* data){
+	struct stress_thread* t=data;
+	struct incarnation* inc;
+	loff_t pos;
+	int i;
+	for(i=0;i<STRESS_ITERATIONS;i++){
+		inc=create_session(t->pathname,O_RDWR,current->pid,0644,NO_FD,NULL,NULL);
+		if(IS_ERR_OR_NULL(inc)){
+			if(PTR_ERR(inc)!=-EAGAIN){
+				t->errors++;
+			}
+			continue;
+		}
+		pos=0;
+		if(inc->status<0 || kernel_write(inc->file,NEW_CONTENT,strlen(NEW_CONTENT),&pos)<0){
+			t->errors++;
+		}
+		close_session_file(inc);
+	}
+	complete(&(t->done));
+	return 0;
+}
+
+/** \brief Opens and closes sessions from several kthreads, half of them on the same file.
+ * \param[in] test The running test.
+ */
+void test_concurrent_stress(struct kunit* test){
+	struct stress_thread* threads;
+	struct task_struct* task;
+	int i;
+	threads=kunit_kzalloc(test,sizeof(struct stress_thread)*STRESS_THREADS,GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test,threads);
+	for(i=0;i<STRESS_THREADS;i++){
+		threads[i].pathname=test_pathname(test,"stress",(i%2==0) ? 0 : i);
+		init_completion(&(threads[i].done));
+		KUNIT_ASSERT_EQ(test,write_test_file(threads[i].pathname,ORIG_CONTENT),0);
+	}
+	for(i=0;i<STRESS_THREADS;i++){
+		task=kthread_run(stress_thread_fn,&threads[i],"sessfs-test-%d",i);
+		if(IS_ERR(task)){
+			threads[i].errors=1;
+			complete(&(threads[i].done));
+		}
+	}
+	for(i=0;i<STRESS_THREADS;i++){
+		wait_for_completion(&(threads[i].done));
+		KUNIT_EXPECT_EQ(test,threads[i].errors,0);
+	}
+	for(i=0;i<STRESS_THREADS;i++){
+		expect_content(test,threads[i].pathname,NEW_CONTENT);
+		KUNIT_EXPECT_PTR_EQ(test,search_session(threads[i].pathname),(struct session*)NULL);
+		remove_test_file(threads[i].pathname);
+	}
+}
+
+/** \brief Times the insertion and the lookup of sessions, from 10^3 sessions up to ::bench_max_sessions.
+ * \param[in] test The running test.
+ *
+ * The sessions are inserted with `init_session()` on new files, then `::BENCH_LOOKUPS` random sessions are searched with
+ * `search_session()`. The average time of each operation is printed in the test log.
+ */
+void bench_insert_lookup(struct kunit* test){
+	struct session** sessions;
+	struct session* found;
+	char* pathname=test_pathname(test,"bench",0);
+	u64 start,insert_ns,lookup_ns;
+	int n,i,inserted;
+	for(n=1000;n<=bench_max_sessions && n<=1000000;n*=10){
+		sessions=kvmalloc_array(n,sizeof(struct session*),GFP_KERNEL | __GFP_ZERO);
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test,sessions);
+		start=ktime_get_ns();
+		for(inserted=0;inserted<n;inserted++){
+			snprintf(pathname,PATH_MAX,"%s/sessionfs-kunit-bench-%d",test_dir,inserted);
+			sessions[inserted]=init_session(pathname,O_RDWR | O_CREAT,0644,&default_policy);
+			if(IS_ERR(sessions[inserted])){
+				break;
+			}
+			cond_resched();
+		}
+		insert_ns=ktime_get_ns()-start;
+		KUNIT_EXPECT_EQ(test,inserted,n);
+		lookup_ns=0;
+		if(inserted==n){
+			start=ktime_get_ns();
+			for(i=0;i<BENCH_LOOKUPS;i++){
+				snprintf(pathname,PATH_MAX,"%s/sessionfs-kunit-bench-%u",test_dir,prandom_u32()%n);
+				found=search_session(pathname);
+				KUNIT_EXPECT_PTR_NE(test,found,(struct session*)NULL);
+				if(found!=NULL){
+					atomic_sub(1,&(found->refcount));
+				}
+				cond_resched();
+			}
+			lookup_ns=ktime_get_ns()-start;
+			kunit_info(test,"%d sessions: insert %llu ns/op, lookup %llu ns/op\n",n,insert_ns/n,lookup_ns/BENCH_LOOKUPS);
+		}
+		for(i=0;i<inserted;i++){
+			unlink_incarnation(sessions[i]->file);
+			put_session(sessions[i]);
+			cond_resched();
+		}
+		kvfree(sessions);
+		if(inserted<n){
+			break;
+		}
+	}
+}
+
+///The test cases of the session manager.
+struct kunit_case session_manager_cases[]={
+	KUNIT_CASE(test_init_search),
+	KUNIT_CASE(test_incarnation_commit),
+	KUNIT_CASE(test_incarnation_discard),
+	KUNIT_CASE(test_shared_session),
+	KUNIT_CASE(test_usage),
+	KUNIT_CASE(test_quota),
+	KUNIT_CASE(test_quota_growth),
+	KUNIT_CASE(test_concurrent_stress),
+	KUNIT_CASE(bench_insert_lookup),
+	{}
+};
+
+///The test suite of the session manager.
+struct kunit_suite session_manager_suite={
+	.name="sessionfs-session-manager",
+	.init=manager_test_init,
+	.exit=manager_test_exit,
+	.test_cases=session_manager_cases,
+};
+
+kunit_test_suite(session_manager_suite);
@@ -0,0 +1,172 @@
+/** \file
+ * \brief Implementation of the index of the incarnations by owner process, component of the _Session Manager_ submodule.
+ *
+ * The owners are published in the ::sess_owners hash table, which is read under RCU, while adding and removing owners is
+ * serialized by ::owners_lock. An owner is removed when its last incarnation leaves the index and freed after a grace period.
+ * The incarnations of an owner are protected by the lock of its xarray.
+ */
+
+///Prefix of the messages printed by the owners index.
+#define pr_fmt(fmt) "SessionFS session owners: " fmt
+
+#include "session_owners.h"
+//for usage_alloc
+#include "session_usage.h"
+
+//for memory APIs
+#include <linux/slab.h>
+//for the hash table APIs
+#include <linux/hashtable.h>
+//for the writers lock
+#include <linux/spinlock.h>
+//for snprintf
+#include <linux/kernel.h>
+//error managemnt macros
+#include <linux/err.h>
+//for error numbers
+#include <uapi/asm-generic/errno.h>
+
+///The owners, indexed by tgid.
+DEFINE_HASHTABLE(sess_owners,OWNERS_HASH_BITS);
+
+///Serializes the writers of `::sess_owners`.
+DEFINE_SPINLOCK(owners_lock);
+
+/** \brief Removes a `::sess_owner` when its last incarnation leaves the index.
+ * \param[in] ref The `ref` member of the `::sess_owner`.
+ *
+ * Called by `kref_put_lock()` holding ::owners_lock, which is released here.
+ */
+void release_sess_owner(struct kref* ref){
+	struct sess_owner* owner=container_of(ref,struct sess_owner,ref);
+	hash_del_rcu(&(owner->node));
+	spin_unlock(&owners_lock);
+	pr_debug("removing owner %d\n",owner->tgid);
+	xa_destroy(&(owner->incarnations));
+	usage_free(MEM_OWNERS,ksize(owner));
+	kfree_rcu(owner,rcu);
+}
+
+/** \brief Drops a reference on a `::sess_owner`.
+ * \param[in] owner The `::sess_owner`.
+ */
+void put_sess_owner(struct sess_owner* owner){
+	kref_put_lock(&(owner->ref),release_sess_owner,&owners_lock);
+}
+
+/** \brief Searches the published `::sess_owner` of a process.
+ * \param[in] tgid The tgid of the process.
+ * \returns The `::sess_owner` of `tgid` with a reference held, or `NULL`.
+ *
+ * Must be called in an RCU read-side critical section or holding ::owners_lock; an owner that is being removed is skipped.
+ */
+struct sess_owner* lookup_sess_owner(pid_t tgid){
+	struct sess_owner* owner;
+	hash_for_each_possible_rcu(sess_owners,owner,node,tgid){
+		if(owner->tgid==tgid && kref_get_unless_zero(&(owner->ref))){
+			return owner;
+		}
+	}
+	return NULL;
+}
+
+/** \brief Gets the `::sess_owner` of a process, creating it if it does not exist.
+ * \param[in] tgid The tgid of the process.
+ * \returns The `::sess_owner` of `tgid` with a reference held, or an error code.
+ */
+struct sess_owner* get_sess_owner(pid_t tgid){
+	struct sess_owner *owner,*found;
+	rcu_read_lock();
+	owner=lookup_sess_owner(tgid);
+	rcu_read_unlock();
+	if(owner!=NULL){
+		return owner;
+	}
+	owner=kzalloc(sizeof(struct sess_owner),GFP_KERNEL);
+	if(owner==NULL){
+		return ERR_PTR(-ENOMEM);
+	}
+	kref_init(&(owner->ref));
+	INIT_HLIST_NODE(&(owner->node));
+	owner->tgid=tgid;
+	xa_init(&(owner->incarnations));
+	//another thread of the process could have added the owner in the meantime
+	spin_lock(&owners_lock);
+	found=lookup_sess_owner(tgid);
+	if(found==NULL){
+		hash_add_rcu(sess_owners,&(owner->node),tgid);
+	}
+	spin_unlock(&owners_lock);
+	if(found!=NULL){
+		kfree(owner);
+		return found;
+	}
+	usage_alloc(MEM_OWNERS,ksize(owner));
+	pr_debug("added owner %d\n",tgid);
+	return owner;
+}
+
+/**
+ * The reference on the `::sess_owner` obtained here is held by the `::incarnation` until `unindex_incarnation()`.
+ */
+int index_incarnation(struct incarnation* incarnation,pid_t tgid){
+	struct sess_owner* owner;
+	void* old;
+	owner=get_sess_owner(tgid);
+	if(IS_ERR(owner)){
+		return PTR_ERR(owner);
+	}
+	old=xa_store(&(owner->incarnations),incarnation->filedes,incarnation,GFP_KERNEL);
+	if(xa_is_err(old)){
+		put_sess_owner(owner);
+		return xa_err(old);
+	}
+	incarnation->owner=owner;
+	return 0;
+}
+
+/**
+ * The entry is removed only if it still refers to `incarnation`, since it could have been replaced by another
+ * `::incarnation` that uses the same file descriptor.
+ */
+void unindex_incarnation(struct incarnation* incarnation){
+	struct sess_owner* owner=incarnation->owner;
+	if(owner==NULL){
+		return;
+	}
+	xa_cmpxchg(&(owner->incarnations),incarnation->filedes,incarnation,NULL,0);
+	incarnation->owner=NULL;
+	put_sess_owner(owner);
+}
+
+/**
+ * The incarnations are read holding the lock of the xarray, so they can't be unindexed, and closed, while they are printed.
+ */
+ssize_t print_owner_incarnations(pid_t tgid,char* buf,size_t buflen,int* num){
+	struct sess_owner* owner;
+	struct incarnation* incarnation;
+	unsigned long fd;
+	size_t len=0;
+	int res;
+	*num=0;
+	rcu_read_lock();
+	owner=lookup_sess_owner(tgid);
+	rcu_read_unlock();
+	if(owner==NULL){
+		return 0;
+	}
+	xa_lock(&(owner->incarnations));
+	xa_for_each(&(owner->incarnations),fd,incarnation){
+		res=snprintf(buf+len,buflen-len,"%lu %d %s\n",fd,incarnation->status,incarnation->session->pathname);
+		if(res>=buflen-len){
+			xa_unlock(&(owner->incarnations));
+			put_sess_owner(owner);
+			return -EINVAL;
+		}
+		len+=res;
+		(*num)++;
+	}
+	xa_unlock(&(owner->incarnations));
+	put_sess_owner(owner);
+	return len;
+}
@@ -0,0 +1,64 @@
+/** \file
+ * \brief Index of the incarnations by the process that owns them, component of the _Session Manager_ submodule.
+ *
+ * Each process (thread group) that has open incarnations is a `::sess_owner`, kept in a hash table indexed by tgid, that
+ * holds its incarnations in an xarray indexed by file descriptor: the operations of a process on its own sessions cost in
+ * proportion to the number of its incarnations, and not to the number of sessions in the system.
+ */
+#ifndef SESSION_OWNERS_H
+#define SESSION_OWNERS_H
+
+#include <linux/kref.h>
+#include <linux/rcupdate.h>
+#include <linux/list.h>
+#include <linux/xarray.h>
+#include <linux/types.h>
+
+#include "session_types.h"
+
+///The number of bits of the hash table that contains the owners.
+#define OWNERS_HASH_BITS 8
+
+///The maximum number of bytes returned when the incarnations of a process are listed.
+#define OWNERS_LIST_MAX 65536
+
+/** \struct sess_owner
+ * \brief A process that has open incarnations.
+ * \param ref The references on the owner, one is held by each indexed `::incarnation`.
+ * \param rcu Used to free the owner after a grace period, since readers can still be looking at it.
+ * \param node Links the owner in the hash table of the owners.
+ * \param tgid The tgid of the process.
+ * \param incarnations The indexed `::incarnation`(s) of the process, indexed by file descriptor.
+ */
+struct sess_owner{
+	struct kref ref;
+	struct rcu_head rcu;
+	struct hlist_node node;
+	pid_t tgid;
+	struct xarray incarnations;
+};
+
+/** \brief Adds an `::incarnation` to the index of its owner process.
+ * \param[in] incarnation The `::incarnation`, whose `filedes` must be a valid file descriptor.
+ * \param[in] tgid The tgid of the process in which the file descriptor is installed.
+ * \returns 0 on success or an error code.
+ *
+ * If the file descriptor is already indexed, since the incarnation file has been closed while another process holds it,
+ * the stale entry is replaced.
+ */
+int index_incarnation(struct incarnation* incarnation,pid_t tgid);
+
+/** \brief Removes an `::incarnation` from the index of its owner process, if it was indexed.
+ * \param[in] incarnation The `::incarnation` added with `index_incarnation()`.
+ */
+void unindex_incarnation(struct incarnation* incarnation);
+
+/** \brief Writes the open incarnations of a process, one per line as `[fd] [status] [original pathname]`.
+ * \param[in] tgid The tgid of the process.
+ * \param[out] buf The buffer where the incarnations are written.
+ * \param[in] buflen The length of `buf`.
+ * \param[out] num The number of incarnations written.
+ * \returns The number of bytes written, without terminator, or `-EINVAL` if `buf` is too small.
+ */
+ssize_t print_owner_incarnations(pid_t tgid,char* buf,size_t buflen,int* num);
+#endif
@@ -0,0 +1,320 @@
+/** \file
+ * \brief Implementation of the admission control of the incarnations, component of the _Session Manager_ submodule.
+ *
+ * The accounts are published in the ::sess_accounts hash table, which is read under RCU, while adding and removing
+ * accounts is serialized by ::accounts_lock, like the owners index. The bytes of an account are updated with a
+ * compare-and-swap, so that concurrent opens can't take it over its limit.
+ * The opens over a limit wait in ::quota_wait, which is woken up every time a charge is returned.
+ */
+
+///Prefix of the messages printed by the admission control.
+#define pr_fmt(fmt) "SessionFS session quota: " fmt
+
+#include "session_quota.h"
+//for usage_alloc
+#include "session_usage.h"
+
+//for memory APIs
+#include <linux/slab.h>
+//for the hash table APIs
+#include <linux/hashtable.h>
+//for full_name_hash
+#include <linux/stringhash.h>
+//for the writers lock
+#include <linux/spinlock.h>
+//for the waiting opens
+#include <linux/wait.h>
+#include <linux/jiffies.h>
+//for current_fsuid
+#include <linux/cred.h>
+//for snprintf and scnprintf
+#include <linux/kernel.h>
+//for string APIs
+#include <linux/string.h>
+//error managemnt macros
+#include <linux/err.h>
+//for error numbers
+#include <uapi/asm-generic/errno.h>
+
+unsigned long quota_file_bytes=0;
+
+unsigned long quota_root_bytes=0;
+
+unsigned long quota_uid_bytes=0;
+
+unsigned int quota_wait_ms=0;
+
+///The accounts, indexed by the hash of their name.
+DEFINE_HASHTABLE(sess_accounts,ACCOUNTS_HASH_BITS);
+
+///Serializes the writers of `::sess_accounts`.
+DEFINE_SPINLOCK(accounts_lock);
+
+///The opens waiting for a charge to be returned.
+DECLARE_WAIT_QUEUE_HEAD(quota_wait);
+
+///The number of opens that have waited for a charge to be returned.
+atomic64_t quota_waited=ATOMIC64_INIT(0);
+
+///The number of opens refused with `-EDQUOT`.
+atomic64_t quota_denied=ATOMIC64_INIT(0);
+
+/** \brief Returns the key of an account in ::sess_accounts.
+ * \param[in] type The `::account_type` of the account.
+ * \param[in] name The name of the account.
+ * \returns The key.
+ */
+u32 account_key(enum account_type type, const char* name){
+	return full_name_hash(NULL,name,strlen(name))+type;
+}
+
+/** \brief Removes a `::sess_account` when its last charge is returned.
+ * \param[in] ref The `ref` member of the `::sess_account`.
+ *
+ * Called by `kref_put_lock()` holding ::accounts_lock, which is released here.
+ */
+void release_sess_account(struct kref* ref){
+	struct sess_account* account=container_of(ref,struct sess_account,ref);
+	hash_del_rcu(&(account->node));
+	spin_unlock(&accounts_lock);
+	pr_debug("removing account %s\n",account->name);
+	usage_free(MEM_ACCOUNTS,ksize(account));
+	kfree_rcu(account,rcu);
+}
+
+/** \brief Drops a reference on a `::sess_account`.
+ * \param[in] account The `::sess_account`.
+ */
+void put_sess_account(struct sess_account* account){
+	kref_put_lock(&(account->ref),release_sess_account,&accounts_lock);
+}
+
+/** \brief Searches a published `::sess_account`.
+ * \param[in] type The `::account_type` of the account.
+ * \param[in] name The name of the account.
+ * \param[in] key The key returned by `account_key()`.
+ * \returns The `::sess_account` with a reference held, or `NULL`.
+ *
+ * Must be called in an RCU read-side critical section or holding ::accounts_lock; an account that is being removed is skipped.
+ */
+struct sess_account* lookup_sess_account(enum account_type type, const char* name, u32 key){
+	struct sess_account* account;
+	hash_for_each_possible_rcu(sess_accounts,account,node,key){
+		if(account->type==type && strcmp(account->name,name)==0 && kref_get_unless_zero(&(account->ref))){
+			return account;
+		}
+	}
+	return NULL;
+}
+
+/** \brief Gets a `::sess_account`, creating it if it does not exist.
+ * \param[in] type The `::account_type` of the account.
+ * \param[in] name The name of the account.
+ * \returns The `::sess_account` with a reference held, or an error code.
+ */
+struct sess_account* get_sess_account(enum account_type type, const char* name){
+	struct sess_account *account,*found;
+	u32 key=account_key(type,name);
+	size_t len=strlen(name);
+	rcu_read_lock();
+	account=lookup_sess_account(type,name,key);
+	rcu_read_unlock();
+	if(account!=NULL){
+		return account;
+	}
+	account=kzalloc(sizeof(struct sess_account)+sizeof(char)*(len+1),GFP_KERNEL);
+	if(account==NULL){
+		return ERR_PTR(-ENOMEM);
+	}
+	kref_init(&(account->ref));
+	INIT_HLIST_NODE(&(account->node));
+	account->type=type;
+	atomic64_set(&(account->bytes),0);
+	memcpy(account->name,name,sizeof(char)*len);
+	//another open could have added the account in the meantime
+	spin_lock(&accounts_lock);
+	found=lookup_sess_account(type,name,key);
+	if(found==NULL){
+		hash_add_rcu(sess_accounts,&(account->node),key);
+	}
+	spin_unlock(&accounts_lock);
+	if(found!=NULL){
+		kfree(account);
+		return found;
+	}
+	usage_alloc(MEM_ACCOUNTS,ksize(account));
+	pr_debug("added account %s\n",name);
+	return account;
+}
+
+/** \brief Adds bytes to a counter, unless it would go over a limit.
+ * \param[in,out] counter The counter.
+ * \param[in] bytes The bytes to add.
+ * \param[in] limit The limit, 0 for no limit.
+ * \returns True if the bytes have been added.
+ */
+bool charge_bytes(atomic64_t* counter, u64 bytes, unsigned long limit){
+	s64 old=atomic64_read(counter);
+	do{
+		if(limit!=0 && old+bytes>limit){
+			return false;
+		}
+	} while(!atomic64_try_cmpxchg(counter,&old,old+bytes));
+	return true;
+}
+
+/** \brief Tries to charge an `::incarnation` to all its accounts.
+ * \param[in] session The parent `::session`.
+ * \param[in] charge The charge, with its accounts.
+ * \returns 0 or `-EDQUOT` if a limit would be exceeded, in which case nothing is charged.
+ */
+int try_charge(struct session* session, struct sess_charge* charge){
+	if(!charge_bytes(&(session->charged),charge->bytes,READ_ONCE(quota_file_bytes))){
+		return -EDQUOT;
+	}
+	if(charge->root!=NULL && !charge_bytes(&(charge->root->bytes),charge->bytes,READ_ONCE(quota_root_bytes))){
+		atomic64_sub(charge->bytes,&(session->charged));
+		return -EDQUOT;
+	}
+	if(!charge_bytes(&(charge->user->bytes),charge->bytes,READ_ONCE(quota_uid_bytes))){
+		if(charge->root!=NULL){
+			atomic64_sub(charge->bytes,&(charge->root->bytes));
+		}
+		atomic64_sub(charge->bytes,&(session->charged));
+		return -EDQUOT;
+	}
+	return 0;
+}
+
+/** \brief Returns whether a charge is larger than one of its limits, so that it can never be admitted.
+ * \param[in] charge The charge.
+ * \returns True if the charge is larger than a limit.
+ */
+bool charge_too_large(struct sess_charge* charge){
+	unsigned long file=READ_ONCE(quota_file_bytes), root=READ_ONCE(quota_root_bytes), uid=READ_ONCE(quota_uid_bytes);
+	return (file!=0 && charge->bytes>file) || (charge->root!=NULL && root!=0 && charge->bytes>root) ||
+		(uid!=0 && charge->bytes>uid);
+}
+
+/** \brief Drops the references on the accounts of a charge and clears it.
+ * \param[in,out] charge The charge.
+ */
+void put_charge_accounts(struct sess_charge* charge){
+	if(charge->root!=NULL){
+		put_sess_account(charge->root);
+	}
+	if(charge->user!=NULL){
+		put_sess_account(charge->user);
+	}
+	memset(charge,0,sizeof(struct sess_charge));
+}
+
+/**
+ * The opens that have been refused and the ones that have waited are counted in ::quota_denied and ::quota_waited.
+ */
+int charge_incarnation(struct session* session, const char* root, u64 bytes, struct sess_charge* charge){
+	char uid[16];
+	long wait;
+	int res;
+	memset(charge,0,sizeof(struct sess_charge));
+	if(root!=NULL){
+		charge->root=get_sess_account(ACCOUNT_ROOT,root);
+		if(IS_ERR(charge->root)){
+			res=PTR_ERR(charge->root);
+			charge->root=NULL;
+			return res;
+		}
+	}
+	snprintf(uid,sizeof(uid),"%u",from_kuid(&init_user_ns,current_fsuid()));
+	charge->user=get_sess_account(ACCOUNT_UID,uid);
+	if(IS_ERR(charge->user)){
+		res=PTR_ERR(charge->user);
+		charge->user=NULL;
+		put_charge_accounts(charge);
+		return res;
+	}
+	charge->bytes=bytes;
+	res=try_charge(session,charge);
+	wait=msecs_to_jiffies(READ_ONCE(quota_wait_ms));
+	if(res==-EDQUOT && wait>0 && !charge_too_large(charge)){
+		atomic64_inc(&quota_waited);
+		wait=wait_event_interruptible_timeout(quota_wait,(res=try_charge(session,charge))!=-EDQUOT,wait);
+		if(wait<0){
+			res=wait;
+		}
+	}
+	if(res<0){
+		if(res==-EDQUOT){
+			atomic64_inc(&quota_denied);
+			pr_debug("open of %s refused, %llu bytes over the limit\n",session->pathname,bytes);
+		}
+		put_charge_accounts(charge);
+	}
+	return res;
+}
+
+void uncharge_incarnation(struct session* session, struct sess_charge* charge){
+	if(charge->user==NULL){
+		return;
+	}
+	atomic64_sub(charge->bytes,&(session->charged));
+	if(charge->root!=NULL){
+		atomic64_sub(charge->bytes,&(charge->root->bytes));
+	}
+	atomic64_sub(charge->bytes,&(charge->user->bytes));
+	put_charge_accounts(charge);
+	//the waiters check the limits again
+	if(wq_has_sleeper(&quota_wait)){
+		wake_up_all(&quota_wait);
+	}
+}
+
+/**
+ * The growth is charged like a new charge of the difference, so a refused commit is counted in ::quota_denied too.
+ */
+int recharge_incarnation(struct session* session, struct sess_charge* charge, u64 bytes){
+	struct sess_charge growth;
+	u64 shrink;
+	//a returned charge has no accounts to update
+	if(charge->user==NULL){
+		return 0;
+	}
+	if(bytes<=charge->bytes){
+		shrink=charge->bytes-bytes;
+		atomic64_sub(shrink,&(session->charged));
+		if(charge->root!=NULL){
+			atomic64_sub(shrink,&(charge->root->bytes));
+		}
+		atomic64_sub(shrink,&(charge->user->bytes));
+		charge->bytes=bytes;
+		if(shrink>0 && wq_has_sleeper(&quota_wait)){
+			wake_up_all(&quota_wait);
+		}
+		return 0;
+	}
+	growth=*charge;
+	growth.bytes=bytes-charge->bytes;
+	if(try_charge(session,&growth)<0){
+		atomic64_inc(&quota_denied);
+		pr_debug("commit of %s refused, %llu bytes over the limit\n",session->pathname,growth.bytes);
+		return -EDQUOT;
+	}
+	charge->bytes=bytes;
+	return 0;
+}
+
+ssize_t print_quota(char* buf, size_t size){
+	struct sess_account* account;
+	ssize_t len;
+	int bkt;
+	len=scnprintf(buf,size,"limit_file %lu\nlimit_root %lu\nlimit_uid %lu\nwait_ms %u\nwaited %lld\ndenied %lld\n",
+		READ_ONCE(quota_file_bytes),READ_ONCE(quota_root_bytes),READ_ONCE(quota_uid_bytes),READ_ONCE(quota_wait_ms),
+		atomic64_read(&quota_waited),atomic64_read(&quota_denied));
+	rcu_read_lock();
+	hash_for_each_rcu(sess_accounts,bkt,account,node){
+		len+=scnprintf(buf+len,size-len,"%s %s %lld\n",(account->type==ACCOUNT_ROOT) ? "root" : "uid",account->name,
+			atomic64_read(&(account->bytes)));
+	}
+	rcu_read_unlock();
+	return len;
+}
@@ -0,0 +1,117 @@
+/** \file
+ * \brief Admission control of the incarnations, component of the _Session Manager_ submodule.
+ *
+ * Each `::incarnation` is charged, when it is created, the size of the original file, which is the size of the
+ * incarnation file after the snapshot, to three accounts:
+ * - the original file, in the `charged` member of its `::session`;
+ * - the session root in which it has been opened, if any, in a `::sess_account`;
+ * - the user that has opened it, by fsuid, in a `::sess_account`.
+ *
+ * The charge is returned when the `::incarnation` is closed. If a charge would take an account over its limit, set with
+ * the ::quota_file_bytes, ::quota_root_bytes and ::quota_uid_bytes module parameters, the open waits up to
+ * ::quota_wait_ms milliseconds for other incarnations to be closed, then fails with `-EDQUOT`. An incarnation larger than
+ * a limit fails immediately.
+ *
+ * The writes are not charged while the `::incarnation` is open, so an account can exceed its limit by the growth of its
+ * open incarnations. The growth is charged when the `::incarnation` is committed, with `recharge_incarnation()`: if it
+ * takes an account over its limit the commit is refused with `-EDQUOT` and the content of the `::incarnation` is
+ * discarded, so the limits always hold for the original files.
+ *
+ * The accounts are shown in the SysFS `quota` attribute of the device, see `print_quota()`, and the charge of each
+ * original file in the `counters` attribute of its session.
+ */
+#ifndef SESSION_QUOTA_H
+#define SESSION_QUOTA_H
+
+#include <linux/kref.h>
+#include <linux/rcupdate.h>
+#include <linux/list.h>
+#include <linux/types.h>
+
+#include "session_types.h"
+
+///The number of bits of the hash table that contains the accounts.
+#define ACCOUNTS_HASH_BITS 6
+
+/** \enum account_type
+ * \brief The types of the `::sess_account`(s).
+ */
+enum account_type{
+	ACCOUNT_ROOT,	///< A session root, identified by its pathname.
+	ACCOUNT_UID	///< A user, identified by its uid in the initial user namespace.
+};
+
+/** \struct sess_account
+ * \brief The bytes charged to a session root or to a user.
+ * \param ref The references on the account, one is held by each charged `::incarnation`.
+ * \param rcu Used to free the account after a grace period, since readers can still be looking at it.
+ * \param node Links the account in the hash table of the accounts.
+ * \param type The `::account_type` of the account.
+ * \param bytes The bytes charged to the account.
+ * \param name The pathname of the session root, or the uid in decimal.
+ *
+ * An account is created by the first charge and removed when its last `::incarnation` is closed.
+ */
+struct sess_account{
+	struct kref ref;
+	struct rcu_head rcu;
+	struct hlist_node node;
+	enum account_type type;
+	atomic64_t bytes;
+	char name[];
+};
+
+///The bytes of the incarnations of an original file over which the opens are refused, 0 for no limit.
+extern unsigned long quota_file_bytes;
+
+///The bytes of the incarnations of a session root over which the opens are refused, 0 for no limit.
+extern unsigned long quota_root_bytes;
+
+///The bytes of the incarnations of a user over which the opens are refused, 0 for no limit.
+extern unsigned long quota_uid_bytes;
+
+///The milliseconds an open waits for the incarnations over a limit to be closed, 0 to fail immediately.
+extern unsigned int quota_wait_ms;
+
+/** \brief Charges a new `::incarnation` to its accounts, waiting if they are over their limit.
+ * \param[in] session The parent `::session`, on which the caller holds a reference.
+ * \param[in] root The pathname of the session root of the open, `NULL` if there is none.
+ * \param[in] bytes The bytes to charge.
+ * \param[out] charge The charge, to be returned with `uncharge_incarnation()`.
+ * \returns 0 on success or an error code (`-EDQUOT` if a limit is still exceeded after ::quota_wait_ms, `-ERESTARTSYS`
+ * if the wait has been interrupted by a signal).
+ *
+ * Must be called without holding locks, since it can sleep.
+ */
+int charge_incarnation(struct session* session, const char* root, u64 bytes, struct sess_charge* charge);
+
+/** \brief Returns the charge of an `::incarnation` and wakes up the opens waiting for it.
+ * \param[in] session The parent `::session`, on which the caller holds a reference.
+ * \param[in,out] charge The charge obtained with `charge_incarnation()`, cleared so that it is returned only once.
+ */
+void uncharge_incarnation(struct session* session, struct sess_charge* charge);
+
+/** \brief Charges an `::incarnation` its current size, when it is committed.
+ * \param[in] session The parent `::session`, on which the caller holds a reference.
+ * \param[in,out] charge The charge obtained with `charge_incarnation()`, updated to `bytes` on success.
+ * \param[in] bytes The size of the incarnation file.
+ * \returns 0 on success or `-EDQUOT` if the growth would take an account over its limit, in which case the charge is
+ * unchanged.
+ *
+ * A shrunk `::incarnation` returns the difference immediately. The commit does not wait for other incarnations to be
+ * closed, since it can run while the incarnation file is released.
+ */
+int recharge_incarnation(struct session* session, struct sess_charge* charge, u64 bytes);
+
+/** \brief Prints the limits and the accounts in a buffer.
+ * \param[out] buf The buffer.
+ * \param[in] size The size of `buf`.
+ * \returns The number of bytes written.
+ *
+ * The first lines contain a name and a value: the limits (`limit_file`, `limit_root`, `limit_uid`, `wait_ms`) and the
+ * number of opens that have waited (`waited`) and of the opens and commits that have been refused (`denied`). Then each account is printed in a
+ * line as `root [pathname] [bytes]` or `uid [uid] [bytes]`, until the buffer is full.
+ */
+ssize_t print_quota(char* buf, size_t size);
+
+#endif
@@ -0,0 +1,237 @@
+/** \file
+ * \brief Implementation of the recorder of the session operations, component of the _Session Statistics_ submodule.
+ *
+ * The relay channel is created the first time the recording is started and it lives until the module is unloaded, so
+ * that the trace can be read after the recording is stopped. The writers read the channel under RCU, so that it can be
+ * closed after a grace period.
+ */
+
+///Prefix of the messages printed by the recorder.
+#define pr_fmt(fmt) "SessionFS session record: " fmt
+
+#include "session_record.h"
+#include "session_stats.h"
+#include "session_usage.h"
+//for the relay channel
+#include <linux/relay.h>
+//for debugfs
+#include <linux/debugfs.h>
+//for the keyed hash of the pathnames
+#include <linux/siphash.h>
+//for get_random_bytes
+#include <linux/random.h>
+//for the control lock
+#include <linux/mutex.h>
+//for the RCU APIs
+#include <linux/rcupdate.h>
+//for kstrtobool_from_user and scnprintf
+#include <linux/kernel.h>
+//for string APIs
+#include <linux/string.h>
+//for simple_read_from_buffer
+#include <linux/fs.h>
+//for THIS_MODULE
+#include <linux/module.h>
+//for num_online_cpus
+#include <linux/cpumask.h>
+
+unsigned int record_subbufs=RECORD_SUBBUFS;
+
+///Set while the recording is enabled, checked without locks by the writers.
+bool record_enabled=false;
+
+///The relay channel, created the first time the recording is started.
+struct rchan __rcu* record_chan=NULL;
+
+///The key of the hash of the pathnames, chosen when the channel is created.
+siphash_key_t record_key;
+
+///The number of records dropped because the buffers of a CPU were full.
+atomic64_t record_dropped=ATOMIC64_INIT(0);
+
+///Serializes the changes of the recording state.
+DEFINE_MUTEX(record_lock);
+
+///The memory of the buffers of the channel, counted in the usage of the module.
+size_t record_bytes=0;
+
+///The debugfs directory in which the channel files are created.
+struct dentry* record_dir=NULL;
+
+/** \brief Creates the file of the buffer of a CPU in debugfs.
+ * \param[in] filename The name of the file, `record` followed by the CPU number.
+ * \param[in] parent The directory given to `relay_open()`.
+ * \param[in] mode The permissions of the file.
+ * \param[in] buf The buffer of the CPU.
+ * \param[out] is_global Left to 0, since there is a buffer per CPU.
+ * \returns The dentry of the file, or `NULL` on failure.
+ */
+struct dentry* create_record_file(const char* filename, struct dentry* parent, umode_t mode, struct rchan_buf* buf,
+	int* is_global){
+	return debugfs_create_file(filename,mode,parent,buf,&relay_file_operations);
+}
+
+/** \brief Removes the file of the buffer of a CPU.
+ * \param[in] dentry The dentry returned by `create_record_file()`.
+ * \returns 0.
+ */
+int remove_record_file(struct dentry* dentry){
+	debugfs_remove(dentry);
+	return 0;
+}
+
+/** \brief Switches to a new sub-buffer, unless the buffer is full.
+ * \param[in] buf The buffer of the CPU.
+ * \param[in] subbuf Unused.
+ * \param[in] prev_subbuf Unused.
+ * \param[in] prev_padding Unused, the sub-buffers have no padding since the records divide them exactly.
+ * \returns 1 if the record can be written, 0 if it is dropped.
+ *
+ * The trace is not overwritten when the readers can't keep up, so that it has no holes in its middle.
+ */
+int record_subbuf_start(struct rchan_buf* buf, void* subbuf, void* prev_subbuf, size_t prev_padding){
+	if(relay_buf_full(buf)){
+		atomic64_inc(&record_dropped);
+		return 0;
+	}
+	return 1;
+}
+
+///The callbacks of the relay channel.
+struct rchan_callbacks record_callbacks={
+	.subbuf_start=record_subbuf_start,
+	.create_buf_file=create_record_file,
+	.remove_buf_file=remove_record_file,
+};
+
+void record_session_op(int op, const char* pathname, const char* inc_pathname, pid_t pid, u64 size, u64 bytes, u16 flags,
+	int res, u64 start){
+	struct sess_record record;
+	struct rchan* chan;
+	if(!READ_ONCE(record_enabled)){
+		return;
+	}
+	memset(&record,0,sizeof(struct sess_record));
+	record.ts_ns=start;
+	record.latency_ns=ktime_get_ns()-start;
+	record.file_id=siphash(pathname,strlen(pathname),&record_key);
+	record.inc_id=(inc_pathname!=NULL) ? siphash(inc_pathname,strlen(inc_pathname),&record_key) : 0;
+	record.size=size;
+	record.bytes=bytes;
+	record.pid=pid;
+	record.res=res;
+	record.op=op;
+	record.version=RECORD_VERSION;
+	record.flags=flags;
+	rcu_read_lock();
+	chan=rcu_dereference(record_chan);
+	if(chan!=NULL){
+		relay_write(chan,&record,sizeof(struct sess_record));
+	}
+	rcu_read_unlock();
+}
+
+/** \brief Starts the recording, creating the relay channel if necessary.
+ * \returns 0 or an error code.
+ */
+int start_record(void){
+	struct rchan* chan;
+	mutex_lock(&record_lock);
+	if(rcu_access_pointer(record_chan)==NULL){
+		//the key is set before the channel is published, so the writers always see it
+		get_random_bytes(&record_key,sizeof(siphash_key_t));
+		chan=relay_open("record",record_dir,RECORD_SUBBUF_SIZE,record_subbufs,&record_callbacks,NULL);
+		if(!chan){
+			mutex_unlock(&record_lock);
+			pr_err("unable to create the relay channel\n");
+			return -ENOMEM;
+		}
+		rcu_assign_pointer(record_chan,chan);
+		record_bytes=(size_t)RECORD_SUBBUF_SIZE*record_subbufs*num_online_cpus();
+		usage_alloc(MEM_RECORD,record_bytes);
+	}
+	WRITE_ONCE(record_enabled,true);
+	mutex_unlock(&record_lock);
+	pr_debug("recording started\n");
+	return 0;
+}
+
+/** \brief Stops the recording and flushes the partially filled sub-buffers.
+ *
+ * Records written concurrently can end up after the flush, they are read when the sub-buffer is full or at the next flush.
+ */
+void stop_record(void){
+	struct rchan* chan;
+	mutex_lock(&record_lock);
+	WRITE_ONCE(record_enabled,false);
+	chan=rcu_dereference_protected(record_chan,lockdep_is_held(&record_lock));
+	if(chan!=NULL){
+		relay_flush(chan);
+	}
+	mutex_unlock(&record_lock);
+	pr_debug("recording stopped\n");
+}
+
+/** \brief Shows the state of the recording.
+ * \param[in] file The opened file.
+ * \param[out] buf The user buffer.
+ * \param[in] len The length of `buf`.
+ * \param[in,out] ppos The position in the file.
+ * \returns The number of bytes read or an error code.
+ */
+ssize_t record_read(struct file* file, char __user* buf, size_t len, loff_t* ppos){
+	char state[64];
+	int n=scnprintf(state,sizeof(state),"enabled %d\ndropped %lld\n",READ_ONCE(record_enabled),
+		atomic64_read(&record_dropped));
+	return simple_read_from_buffer(buf,len,ppos,state,n);
+}
+
+/** \brief Starts or stops the recording.
+ * \param[in] file The opened file.
+ * \param[in] buf A boolean value, as accepted by `kstrtobool()`.
+ * \param[in] len The number of written bytes.
+ * \param[in] ppos Ignored.
+ * \returns `len` or an error code.
+ */
+ssize_t record_write(struct file* file, const char __user* buf, size_t len, loff_t* ppos){
+	bool enable;
+	int res=kstrtobool_from_user(buf,len,&enable);
+	if(res<0){
+		return res;
+	}
+	if(enable){
+		res=start_record();
+	} else {
+		stop_record();
+	}
+	return (res<0) ? res : len;
+}
+
+///The operations of the `record` file.
+const struct file_operations record_fops={
+	.owner=THIS_MODULE,
+	.read=record_read,
+	.write=record_write,
+	.llseek=default_llseek,
+};
+
+void init_record(struct dentry* dir){
+	record_dir=dir;
+	debugfs_create_file("record",0600,dir,NULL,&record_fops);
+}
+
+void release_record(void){
+	struct rchan* chan;
+	mutex_lock(&record_lock);
+	WRITE_ONCE(record_enabled,false);
+	chan=rcu_dereference_protected(record_chan,lockdep_is_held(&record_lock));
+	RCU_INIT_POINTER(record_chan,NULL);
+	mutex_unlock(&record_lock);
+	if(chan!=NULL){
+		//we wait for the writers that have seen the channel
+		synchronize_rcu();
+		relay_close(chan);
+		usage_free(MEM_RECORD,record_bytes);
+	}
+	record_dir=NULL;
+}
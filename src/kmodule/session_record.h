@@ -0,0 +1,61 @@
+/** \file
+ * \brief Recorder of the session operations, component of the _Session Statistics_ submodule.
+ *
+ * The session opens and closes are appended as `::sess_record`(s) to a relay channel in the ::STATS_DIR directory of
+ * debugfs, see sessionfs_record.h for the format. The recording is controlled by the `record` file:
+ * - writing 1 starts the recording, creating the channel the first time;
+ * - writing 0 stops the recording and flushes the buffers, so that the last records can be read;
+ * - reading it shows if the recording is enabled and the number of records dropped because the buffers were full.
+ */
+#ifndef SESSION_RECORD_H
+#define SESSION_RECORD_H
+
+#include <linux/types.h>
+#include <linux/fs.h>
+
+#include "sessionfs_record.h"
+#include "device_sessionfs.h"
+
+///The size of each sub-buffer of the relay channel, a multiple of the size of a `::sess_record`.
+#define RECORD_SUBBUF_SIZE 65536
+
+///The default number of sub-buffers of each CPU.
+#define RECORD_SUBBUFS 16
+
+///The number of sub-buffers of each CPU, a module parameter.
+extern unsigned int record_subbufs;
+
+/** \brief Returns the `flags` of the records of the sessions with a policy.
+ * \param[in] policy The `::sess_policy` of the session.
+ * \returns The `commit_mode` in the low byte and the `copy_engine` in the high byte.
+ */
+static inline u16 policy_record_flags(const struct sess_policy* policy){
+	return (policy->commit_mode & 0xff) | ((policy->copy_engine & 0xff)<<8);
+}
+
+/** \brief Appends an operation to the trace, if the recording is enabled.
+ * \param[in] op `::RECORD_OPEN` or `::RECORD_CLOSE`.
+ * \param[in] pathname The pathname of the original file.
+ * \param[in] inc_pathname The pathname of the incarnation file, `NULL` if the open has failed.
+ * \param[in] pid The process that owns the incarnation.
+ * \param[in] size The size of the original file (open) or of the incarnation (close).
+ * \param[in] bytes The bytes copied by the operation.
+ * \param[in] flags The `commit_mode` and `copy_engine` of the session, as in `::sess_record`.
+ * \param[in] res The result of the operation.
+ * \param[in] start The timestamp returned by `stat_start()` when the operation started.
+ *
+ * Can be called in atomic context.
+ */
+void record_session_op(int op, const char* pathname, const char* inc_pathname, pid_t pid, u64 size, u64 bytes, u16 flags,
+	int res, u64 start);
+
+/** \brief Creates the `record` control file.
+ * \param[in] dir The debugfs directory of the statistics.
+ */
+void init_record(struct dentry* dir);
+
+/** \brief Stops the recording and closes the relay channel, before the debugfs directory is removed.
+ */
+void release_record(void);
+
+#endif
@@ -0,0 +1,351 @@
+/** \file
+ * \brief Implementation of the session roots, component of the _Character Device_ submodule.
+ *
+ * The roots are published in the ::sess_roots hash table, which is read under RCU, while adding and removing roots is
+ * serialized by ::roots_lock. A removed root is freed when its last reference is dropped, after a grace period.
+ */
+
+///Prefix of the messages printed by the session roots.
+#define pr_fmt(fmt) "SessionFS session roots: " fmt
+
+#include "session_roots.h"
+//for default_policy
+#include "session_manager.h"
+//for usage_alloc
+#include "session_usage.h"
+
+//for memory APIs
+#include <linux/slab.h>
+//for the hash table APIs
+#include <linux/hashtable.h>
+//for the writers lock
+#include <linux/mutex.h>
+//for kern_path and follow_up
+#include <linux/namei.h>
+//for dget_parent and d_path
+#include <linux/dcache.h>
+//for string APIs
+#include <linux/string.h>
+//for struct vfsmount
+#include <linux/mount.h>
+//error managemnt macros
+#include <linux/err.h>
+//for error numbers
+#include <uapi/asm-generic/errno.h>
+// for PATH_MAX
+#include <uapi/linux/limits.h>
+
+///The session roots, indexed by the dentry of their directory.
+DEFINE_HASHTABLE(sess_roots,ROOTS_HASH_BITS);
+
+///Serializes the writers of `::sess_roots`.
+DEFINE_MUTEX(roots_lock);
+
+/** \brief Releases a `::sess_root` when its last reference is dropped.
+ * \param[in] ref The `ref` member of the `::sess_root`.
+ *
+ * The path is unpinned immediately, while the memory is freed after a grace period since RCU readers could still be
+ * trying to get a reference on the root.
+ */
+void release_sess_root(struct kref* ref){
+	struct sess_root* root=container_of(ref,struct sess_root,ref);
+	path_put(&(root->path));
+	usage_free(MEM_ROOTS,ksize(root));
+	kfree_rcu(root,rcu);
+}
+
+void put_sess_root(struct sess_root* root){
+	kref_put(&(root->ref),release_sess_root);
+}
+
+/** \brief Creates a `::sess_root`, without publishing it.
+ * \param[in] name The absolute pathname of the directory.
+ * \param[in] policy The policy of the sessions opened in the directory.
+ * \returns The new `::sess_root` or an error code.
+ *
+ * The directory is looked up and pinned once here, so that the path checks don't have to resolve it on every open.
+ */
+struct sess_root* alloc_sess_root(const char* name,const struct sess_policy* policy){
+	struct sess_root* root;
+	int res,len;
+	if(name[0]!='/'){
+		pr_warn("relative path specified, session roots must be absolute\n");
+		return ERR_PTR(-EINVAL);
+	}
+	if((policy->commit_mode!=COMMIT_ON_CLOSE && policy->commit_mode!=COMMIT_DISCARD) ||
+			(policy->copy_engine!=COPY_READ_WRITE && policy->copy_engine!=COPY_FILE_RANGE)){
+		return ERR_PTR(-EINVAL);
+	}
+	len=strnlen(name,PATH_MAX-1);
+	root=kzalloc(sizeof(struct sess_root)+sizeof(char)*(len+1),GFP_KERNEL);
+	if(root==NULL){
+		return ERR_PTR(-ENOMEM);
+	}
+	memcpy(root->name,name,sizeof(char)*len);
+	root->len=len;
+	res=kern_path(root->name,LOOKUP_FOLLOW|LOOKUP_DIRECTORY,&(root->path));
+	if(res<0){
+		pr_debug("can't find %s, error %d\n",root->name,res);
+		kfree(root);
+		return ERR_PTR(res);
+	}
+	kref_init(&(root->ref));
+	INIT_HLIST_NODE(&(root->node));
+	root->policy=*policy;
+	usage_alloc(MEM_ROOTS,ksize(root));
+	return root;
+}
+
+/** \brief Searches the published `::sess_root` of a directory.
+ * \param[in] dentry The dentry of the directory.
+ * \returns The `::sess_root` of `dentry` with a reference held, or `NULL`.
+ */
+struct sess_root* lookup_sess_root(struct dentry* dentry){
+	struct sess_root* root;
+	rcu_read_lock();
+	hash_for_each_possible_rcu(sess_roots,root,node,(unsigned long)dentry){
+		if(root->path.dentry==dentry && kref_get_unless_zero(&(root->ref))){
+			rcu_read_unlock();
+			return root;
+		}
+	}
+	rcu_read_unlock();
+	return NULL;
+}
+
+/** \brief Unpublishes the `::sess_root` of a directory.
+ * \param[in] dentry The dentry of the directory.
+ * \returns The removed `::sess_root`, whose reference must be dropped after releasing ::roots_lock, or `NULL`.
+ *
+ * Must be called holding ::roots_lock.
+ */
+struct sess_root* unlink_sess_root(struct dentry* dentry){
+	struct sess_root* root;
+	hash_for_each_possible(sess_roots,root,node,(unsigned long)dentry){
+		if(root->path.dentry==dentry){
+			hash_del_rcu(&(root->node));
+			return root;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * If the directory is already a session root its policy is replaced, the existing sessions keep the policy they were
+ * created with.
+ */
+int insert_sess_root(const char* name,const struct sess_policy* policy){
+	struct sess_root *root,*old;
+	root=alloc_sess_root(name,policy);
+	if(IS_ERR(root)){
+		return PTR_ERR(root);
+	}
+	pr_debug("adding session root %s\n",root->name);
+	mutex_lock(&roots_lock);
+	old=unlink_sess_root(root->path.dentry);
+	hash_add_rcu(sess_roots,&(root->node),(unsigned long)root->path.dentry);
+	mutex_unlock(&roots_lock);
+	if(old!=NULL){
+		put_sess_root(old);
+	}
+	return 0;
+}
+
+int delete_sess_root(const char* name){
+	struct sess_root* old;
+	struct path path;
+	int res;
+	res=kern_path(name,LOOKUP_FOLLOW|LOOKUP_DIRECTORY,&path);
+	if(res<0){
+		return res;
+	}
+	pr_debug("removing session root %s\n",name);
+	mutex_lock(&roots_lock);
+	old=unlink_sess_root(path.dentry);
+	mutex_unlock(&roots_lock);
+	path_put(&path);
+	if(old==NULL){
+		return -ENOENT;
+	}
+	put_sess_root(old);
+	return 0;
+}
+
+/**
+ * The new root is published in the same critical section that removes the old ones, so a concurrent open finds either
+ * the old roots or the new one.
+ */
+int replace_sess_roots(const char* name){
+	struct sess_root *root,*it;
+	struct hlist_node* tmp;
+	int bkt;
+	root=alloc_sess_root(name,&default_policy);
+	if(IS_ERR(root)){
+		return PTR_ERR(root);
+	}
+	pr_debug("replacing the session roots with %s\n",root->name);
+	mutex_lock(&roots_lock);
+	hash_for_each_safe(sess_roots,bkt,tmp,it,node){
+		hash_del_rcu(&(it->node));
+		put_sess_root(it);
+	}
+	hash_add_rcu(sess_roots,&(root->node),(unsigned long)root->path.dentry);
+	mutex_unlock(&roots_lock);
+	return 0;
+}
+
+/** \brief Gets the pathname of a file from its resolved path.
+ * \param[in] path The resolved path of the file, or of its parent directory if the file does not exist yet.
+ * \param[in] name The name of the file in `path`, `NULL` if `path` is the file.
+ * \returns The pathname, to be freed with `kfree()`, or an error code.
+ */
+char* real_pathname(const struct path* path, const char* name){
+	char *buf,*dir,*real;
+	size_t len,name_len=(name!=NULL) ? strlen(name) : 0;
+	buf=kmalloc(PATH_MAX,GFP_KERNEL);
+	if(buf==NULL){
+		return ERR_PTR(-ENOMEM);
+	}
+	dir=d_path(path,buf,PATH_MAX);
+	if(IS_ERR(dir)){
+		kfree(buf);
+		return dir;
+	}
+	len=strlen(dir);
+	real=kmalloc(len+name_len+2,GFP_KERNEL);
+	if(real==NULL){
+		kfree(buf);
+		return ERR_PTR(-ENOMEM);
+	}
+	memcpy(real,dir,len);
+	kfree(buf);
+	if(name!=NULL){
+		//the separator is not needed if the parent is the filesystem root
+		if(len>1){
+			real[len++]='/';
+		}
+		memcpy(real+len,name,name_len);
+		len+=name_len;
+	}
+	real[len]='\0';
+	return real;
+}
+
+/**
+ * The pathname, or its parent directory if the file does not exist yet, is resolved following symlinks and `..`
+ * components, then its ancestors are looked up in ::sess_roots, crossing mount points with `follow_up()`.
+ * The roots are matched by dentry, so a bind mount of a session root is a session root too.
+ *
+ * A reference is held on each ancestor while it is inspected, so the walk is safe against concurrent renames, which
+ * can only make the result reflect either the old or the new position of the file.
+ *
+ * When a root is found the resolved pathname is returned in `real`, so that the pathnames that reach the same file
+ * through symbolic links share its session.
+ */
+struct sess_root* find_sess_root(const char* pathname, char** real){
+	struct sess_root* root=NULL;
+	struct dentry* parent;
+	struct path path,file;
+	char *dir,*name=NULL;
+	int res,len,end;
+	*real=NULL;
+	res=kern_path(pathname,LOOKUP_FOLLOW,&path);
+	if(res==-ENOENT){
+		//files that don't exist yet will be created in their parent directory
+		dir=kstrdup(pathname,GFP_KERNEL);
+		if(dir==NULL){
+			return ERR_PTR(-ENOMEM);
+		}
+		len=strlen(dir);
+		//we remove the trailing '/' and then the last component
+		while(len>1 && dir[len-1]=='/'){
+			len--;
+		}
+		end=len;
+		while(len>0 && dir[len-1]!='/'){
+			len--;
+		}
+		name=kstrndup(dir+len,end-len,GFP_KERNEL);
+		//we keep '/' if the file is in the filesystem root
+		dir[(len>1) ? len-1 : len]='\0';
+		pr_debug("%s is non-existent, checking its parent %s\n",pathname,dir);
+		if(name==NULL){
+			res=-ENOMEM;
+		} else {
+			res=(dir[0]=='\0') ? -ENOENT : kern_path(dir,LOOKUP_FOLLOW|LOOKUP_DIRECTORY,&path);
+		}
+		kfree(dir);
+	}
+	if(res<0){
+		pr_debug("can't get %s dentry\n",pathname);
+		kfree(name);
+		return ERR_PTR(res);
+	}
+	//the walk moves path to the ancestors, so we keep the resolved file
+	file=path;
+	path_get(&file);
+	for(;;){
+		root=lookup_sess_root(path.dentry);
+		if(root!=NULL){
+			break;
+		}
+		if(path.dentry==path.mnt->mnt_root){
+			//we continue from the mount point, if this is not the topmost mount
+			if(!follow_up(&path)){
+				break;
+			}
+			continue;
+		}
+		if(IS_ROOT(path.dentry)){
+			break;
+		}
+		parent=dget_parent(path.dentry);
+		dput(path.dentry);
+		path.dentry=parent;
+	}
+	path_put(&path);
+	if(root!=NULL){
+		*real=real_pathname(&file,name);
+		if(IS_ERR(*real)){
+			put_sess_root(root);
+			root=ERR_CAST(*real);
+			*real=NULL;
+		}
+	}
+	path_put(&file);
+	kfree(name);
+	return root;
+}
+
+ssize_t print_sess_roots(char* buf,size_t buflen){
+	struct sess_root* root;
+	size_t len=0;
+	int bkt;
+	rcu_read_lock();
+	hash_for_each_rcu(sess_roots,bkt,root,node){
+		//the newline separates the pathnames
+		if(len+root->len+(len>0)>buflen){
+			rcu_read_unlock();
+			return -EINVAL;
+		}
+		if(len>0){
+			buf[len++]='\n';
+		}
+		memcpy(buf+len,root->name,sizeof(char)*root->len);
+		len+=root->len;
+	}
+	rcu_read_unlock();
+	return len;
+}
+
+void release_roots(void){
+	struct sess_root* it;
+	struct hlist_node* tmp;
+	int bkt;
+	mutex_lock(&roots_lock);
+	hash_for_each_safe(sess_roots,bkt,tmp,it,node){
+		hash_del_rcu(&(it->node));
+		put_sess_root(it);
+	}
+	mutex_unlock(&roots_lock);
+}
@@ -0,0 +1,89 @@
+/** \file
+ * \brief The directories in which the session semantic is enabled, component of the _Character Device_ submodule.
+ *
+ * Each directory is a `::sess_root`, that pins the directory path and holds the `::sess_policy` of the sessions opened in it.
+ * The roots are kept in a hash table indexed by their dentry: to find the root of a pathname its dentry is resolved and its
+ * ancestors are looked up in the table, so the cost depends on the depth of the pathname and not on the number of roots.
+ */
+#ifndef SESSION_ROOTS_H
+#define SESSION_ROOTS_H
+
+#include <linux/kref.h>
+#include <linux/rcupdate.h>
+#include <linux/list.h>
+#include <linux/path.h>
+
+#include "device_sessionfs.h"
+
+///The number of bits of the hash table that contains the session roots.
+#define ROOTS_HASH_BITS 6
+
+///The maximum number of bytes returned when the session roots are read from the device.
+#define ROOTS_READ_MAX 65536
+
+/** \struct sess_root
+ * \brief A directory in which the session semantic is enabled.
+ * \param ref The references on the root, the one of the hash table is dropped when the root is removed.
+ * \param rcu Used to free the root after a grace period, since readers can still be looking at it.
+ * \param node Links the root in the hash table of the roots.
+ * \param path The pinned path of the directory.
+ * \param policy The policy of the sessions opened in the directory.
+ * \param len The length of `name`, without the terminator.
+ * \param name The pathname of the directory, as it was given.
+ *
+ * The root is never modified after being published, changing its policy replaces it.
+ */
+struct sess_root{
+	struct kref ref;
+	struct rcu_head rcu;
+	struct hlist_node node;
+	struct path path;
+	struct sess_policy policy;
+	int len;
+	char name[];
+};
+
+/** \brief Adds a session root, replacing the one of the same directory.
+ * \param[in] name The absolute pathname of the directory, in kernel memory.
+ * \param[in] policy The policy of the sessions opened in the directory.
+ * \returns 0 on success or an error code (`-EINVAL` if the policy is invalid, or the error of the directory lookup).
+ */
+int insert_sess_root(const char* name,const struct sess_policy* policy);
+
+/** \brief Removes a session root, without affecting existing sessions.
+ * \param[in] name The pathname of the directory, in kernel memory.
+ * \returns 0 on success or an error code (`-ENOENT` if the directory is not a session root).
+ */
+int delete_sess_root(const char* name);
+
+/** \brief Replaces all the session roots with a single root, that uses the default policy.
+ * \param[in] name The absolute pathname of the directory, in kernel memory.
+ * \returns 0 on success or an error code.
+ */
+int replace_sess_roots(const char* name);
+
+/** \brief Finds the session root that contains a pathname.
+ * \param[in] pathname The absolute pathname, in kernel memory, that can refer to a file that does not exist yet.
+ * \param[out] real The pathname with its symbolic links and `..` components resolved, to be freed with `kfree()`, or
+ * `NULL` if no session root has been found.
+ * \returns The nearest `::sess_root` that is an ancestor of `pathname`, which must be released with `put_sess_root()`,
+ * `NULL` if there is none or an error code.
+ */
+struct sess_root* find_sess_root(const char* pathname, char** real);
+
+/** \brief Drops a reference on a `::sess_root`.
+ * \param[in] root The `::sess_root` obtained with `find_sess_root()`.
+ */
+void put_sess_root(struct sess_root* root);
+
+/** \brief Writes the pathnames of the session roots, separated by newlines.
+ * \param[out] buf The buffer where the pathnames are written.
+ * \param[in] buflen The length of `buf`.
+ * \returns The number of bytes written, without terminator, or `-EINVAL` if `buf` is too small.
+ */
+ssize_t print_sess_roots(char* buf,size_t buflen);
+
+/** \brief Removes all the session roots.
+ */
+void release_roots(void);
+#endif
@@ -0,0 +1,295 @@
+/** \file
+ * \brief Implementation of the _Session Statistics_ submodule.
+ */
+
+///Prefix of the messages printed by the session statistics.
+#define pr_fmt(fmt) "SessionFS session stats: " fmt
+
+#include "session_stats.h"
+#include "session_manager.h"
+#include "session_record.h"
+//for the per-CPU variables
+#include <linux/percpu.h>
+//for debugfs
+#include <linux/debugfs.h>
+//for seq_file
+#include <linux/seq_file.h>
+//for ilog2
+#include <linux/log2.h>
+//for memory APIs
+#include <linux/slab.h>
+//for string APIs
+#include <linux/string.h>
+
+/** \struct stat_histogram
+ * \brief Latency histogram of an operation.
+ * \param buckets The number of operations whose latency falls in each bucket.
+ * \param count The number of recorded operations.
+ * \param sum_ns The total latency of the recorded operations, in nanoseconds.
+ */
+struct stat_histogram{
+	u64 buckets[STAT_BUCKETS];
+	u64 count;
+	u64 sum_ns;
+};
+
+/** \struct stat_cpu
+ * \brief The histograms of a CPU.
+ * \param hist A histogram for each `::sess_stat`.
+ */
+struct stat_cpu{
+	struct stat_histogram hist[STAT_NUM];
+};
+
+/** \struct top_session
+ * \brief An entry of the `top_sessions` file.
+ * \param pathname A copy of the pathname of the `::session`.
+ * \param ops The number of operations on the `::session`, used to sort the entries.
+ * \param count The counters of the `::session`, for each `::sess_stat`.
+ * \param time_ns The total times of the `::session`, for each `::sess_stat`.
+ */
+struct top_session{
+	char* pathname;
+	u64 ops;
+	u64 count[STAT_NUM];
+	u64 time_ns[STAT_NUM];
+};
+
+///The per-CPU histograms.
+DEFINE_PER_CPU(struct stat_cpu, cpu_stats);
+
+///The names of the operations, as shown in debugfs.
+const char* stat_names[STAT_NUM]={"ioctl_open","path_check","lookup","snapshot_copy","commit_copy","lock_wait"};
+
+///The debugfs directory of the statistics.
+struct dentry* stats_dir=NULL;
+
+u64 stat_record(enum sess_stat stat, u64 start){
+	u64 elapsed=ktime_get_ns()-start;
+	int bucket=(elapsed>0) ? ilog2(elapsed) : 0;
+	if(bucket>=STAT_BUCKETS){
+		bucket=STAT_BUCKETS-1;
+	}
+	//the this_cpu operations are safe against preemption
+	this_cpu_inc(cpu_stats.hist[stat].buckets[bucket]);
+	this_cpu_inc(cpu_stats.hist[stat].count);
+	this_cpu_add(cpu_stats.hist[stat].sum_ns,elapsed);
+	return elapsed;
+}
+
+void session_stat_record(struct sess_stats* stats, enum sess_stat stat, u64 start){
+	u64 elapsed=stat_record(stat,start);
+	atomic64_inc(&(stats->count[stat]));
+	atomic64_add(elapsed,&(stats->time_ns[stat]));
+}
+
+void reset_session_stats(struct sess_stats* stats){
+	int i;
+	for(i=0;i<STAT_NUM;i++){
+		atomic64_set(&(stats->count[i]),0);
+		atomic64_set(&(stats->time_ns[i]),0);
+	}
+}
+
+/** \brief Returns the upper bound of the bucket which contains the given percentile.
+ * \param[in] hist The histogram.
+ * \param[in] percentile The percentile, between 1 and 100.
+ * \returns The upper bound of the bucket in nanoseconds, or 0 if the histogram is empty.
+ */
+u64 stat_percentile(struct stat_histogram* hist, int percentile){
+	u64 target, seen=0;
+	int i;
+	if(hist->count==0){
+		return 0;
+	}
+	target=div_u64(hist->count*percentile+99,100);
+	for(i=0;i<STAT_BUCKETS;i++){
+		seen+=hist->buckets[i];
+		if(seen>=target){
+			break;
+		}
+	}
+	return (i>=STAT_BUCKETS-1) ? U64_MAX : (1ULL<<(i+1));
+}
+
+/** \brief Shows the global histograms, summing the histograms of each CPU.
+ * \param[in] m The seq_file of the `latency` file.
+ * \param[in] v Unused.
+ * \returns 0.
+ */
+int latency_show(struct seq_file* m, void* v){
+	struct stat_histogram* hist, *cpu_hist;
+	int cpu,i,j;
+	hist=kcalloc(STAT_NUM,sizeof(struct stat_histogram),GFP_KERNEL);
+	if(!hist){
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu){
+		cpu_hist=per_cpu_ptr(&cpu_stats,cpu)->hist;
+		for(i=0;i<STAT_NUM;i++){
+			for(j=0;j<STAT_BUCKETS;j++){
+				hist[i].buckets[j]+=READ_ONCE(cpu_hist[i].buckets[j]);
+			}
+			hist[i].count+=READ_ONCE(cpu_hist[i].count);
+			hist[i].sum_ns+=READ_ONCE(cpu_hist[i].sum_ns);
+		}
+	}
+	for(i=0;i<STAT_NUM;i++){
+		seq_printf(m,"%s: count=%llu avg_ns=%llu p50_ns<%llu p90_ns<%llu p99_ns<%llu\n",stat_names[i],hist[i].count,
+			(hist[i].count>0) ? div64_u64(hist[i].sum_ns,hist[i].count) : 0,stat_percentile(&hist[i],50),
+			stat_percentile(&hist[i],90),stat_percentile(&hist[i],99));
+		for(j=0;j<STAT_BUCKETS;j++){
+			if(hist[i].buckets[j]>0){
+				seq_printf(m,"\t[%llu, %llu) ns: %llu\n",(j>0) ? (1ULL<<j) : 0,1ULL<<(j+1),hist[i].buckets[j]);
+			}
+		}
+	}
+	kfree(hist);
+	return 0;
+}
+
+/** \brief Opens the `latency` file.
+ * \param[in] inode The inode of the file.
+ * \param[in] file The opened file.
+ * \returns 0 or an error code.
+ */
+int latency_open(struct inode* inode, struct file* file){
+	return single_open(file,latency_show,NULL);
+}
+
+/** \brief Resets the global histograms when something is written in the `latency` file.
+ * \param[in] file The opened file.
+ * \param[in] buf Ignored.
+ * \param[in] len The number of written bytes.
+ * \param[in] ppos Ignored.
+ * \returns `len`.
+ *
+ * Operations recorded concurrently with the reset can be partially lost.
+ */
+ssize_t latency_write(struct file* file, const char __user* buf, size_t len, loff_t* ppos){
+	int cpu;
+	for_each_possible_cpu(cpu){
+		memset(per_cpu_ptr(&cpu_stats,cpu),0,sizeof(struct stat_cpu));
+	}
+	return len;
+}
+
+///The operations of the `latency` file.
+const struct file_operations latency_fops={
+	.owner=THIS_MODULE,
+	.open=latency_open,
+	.read=seq_read,
+	.write=latency_write,
+	.llseek=seq_lseek,
+	.release=single_release,
+};
+
+/** \brief Adds a `::session` to the top sessions, if it has more operations than the last one.
+ * \param[in] session The `::session`, on which the caller holds a reference.
+ * \param[in,out] data The array of ::STATS_TOP_N `::top_session` entries, sorted by operations.
+ *
+ * Called by `walk_sessions()` while in an RCU read-side critical section, so it can't sleep.
+ */
+void add_top_session(struct session* session, void* data){
+	struct top_session* top=data, entry;
+	int i;
+	memset(&entry,0,sizeof(struct top_session));
+	for(i=0;i<STAT_NUM;i++){
+		entry.count[i]=atomic64_read(&(session->stats.count[i]));
+		entry.time_ns[i]=atomic64_read(&(session->stats.time_ns[i]));
+	}
+	entry.ops=entry.count[STAT_SNAPSHOT_COPY]+entry.count[STAT_COMMIT_COPY];
+	if(entry.ops==0 || (top[STATS_TOP_N-1].pathname!=NULL && top[STATS_TOP_N-1].ops>=entry.ops)){
+		return;
+	}
+	entry.pathname=kstrdup(session->pathname,GFP_ATOMIC);
+	if(!entry.pathname){
+		return;
+	}
+	//we drop the last entry and insert the new one keeping the array sorted
+	kfree(top[STATS_TOP_N-1].pathname);
+	for(i=STATS_TOP_N-1;i>0 && (top[i-1].pathname==NULL || top[i-1].ops<entry.ops);i--){
+		top[i]=top[i-1];
+	}
+	top[i]=entry;
+}
+
+/** \brief Shows the counters of the ::STATS_TOP_N `::session`(s) with most operations.
+ * \param[in] m The seq_file of the `top_sessions` file.
+ * \param[in] v Unused.
+ * \returns 0 or an error code.
+ */
+int top_sessions_show(struct seq_file* m, void* v){
+	struct top_session* top;
+	int i,j;
+	top=kcalloc(STATS_TOP_N,sizeof(struct top_session),GFP_KERNEL);
+	if(!top){
+		return -ENOMEM;
+	}
+	walk_sessions(add_top_session,top);
+	for(i=0;i<STATS_TOP_N && top[i].pathname!=NULL;i++){
+		seq_printf(m,"%s:",top[i].pathname);
+		for(j=STAT_LOOKUP+1;j<STAT_NUM;j++){
+			seq_printf(m," %s=%llu/%lluns",stat_names[j],top[i].count[j],
+				(top[i].count[j]>0) ? div64_u64(top[i].time_ns[j],top[i].count[j]) : 0);
+		}
+		seq_putc(m,'\n');
+		kfree(top[i].pathname);
+	}
+	kfree(top);
+	return 0;
+}
+
+/** \brief Opens the `top_sessions` file.
+ * \param[in] inode The inode of the file.
+ * \param[in] file The opened file.
+ * \returns 0 or an error code.
+ */
+int top_sessions_open(struct inode* inode, struct file* file){
+	return single_open(file,top_sessions_show,NULL);
+}
+
+/** \brief Resets the counters of a `::session`, called by `walk_sessions()`.
+ * \param[in] session The `::session`.
+ * \param[in] data Unused.
+ */
+void reset_top_session(struct session* session, void* data){
+	reset_session_stats(&(session->stats));
+}
+
+/** \brief Resets the counters of every `::session` when something is written in the `top_sessions` file.
+ * \param[in] file The opened file.
+ * \param[in] buf Ignored.
+ * \param[in] len The number of written bytes.
+ * \param[in] ppos Ignored.
+ * \returns `len`.
+ */
+ssize_t top_sessions_write(struct file* file, const char __user* buf, size_t len, loff_t* ppos){
+	walk_sessions(reset_top_session,NULL);
+	return len;
+}
+
+///The operations of the `top_sessions` file.
+const struct file_operations top_sessions_fops={
+	.owner=THIS_MODULE,
+	.open=top_sessions_open,
+	.read=seq_read,
+	.write=top_sessions_write,
+	.llseek=seq_lseek,
+	.release=single_release,
+};
+
+void init_stats(void){
+	stats_dir=debugfs_create_dir(STATS_DIR,NULL);
+	debugfs_create_file("latency",0600,stats_dir,NULL,&latency_fops);
+	debugfs_create_file("top_sessions",0600,stats_dir,NULL,&top_sessions_fops);
+	init_record(stats_dir);
+	pr_debug("statistics published in debugfs\n");
+}
+
+void release_stats(void){
+	//the relay channel removes its own files
+	release_record();
+	debugfs_remove_recursive(stats_dir);
+	stats_dir=NULL;
+}
@@ -0,0 +1,64 @@
+/** \file
+ * \brief Latency histograms of the session operations, component of the _Session Statistics_ submodule.
+ *
+ * Each `::sess_stat` has a log2-bucketed histogram, kept per-CPU to avoid contention between concurrent sessions.
+ * The histograms are published in debugfs, in the ::STATS_DIR directory:
+ * - `latency`: the global histograms, writing anything in the file resets them;
+ * - `top_sessions`: the latency counters of the ::STATS_TOP_N `::session`(s) with most operations, writing anything in the
+ * file resets the counters of every `::session`;
+ * - `record`: controls the recording of the session operations, see session_record.h.
+ */
+#ifndef SESSION_STATS_H
+#define SESSION_STATS_H
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+
+#include "session_types.h"
+
+///The directory of the statistics in debugfs.
+#define STATS_DIR "sessionfs"
+
+///Number of buckets of each histogram, the bucket `i` counts the latencies in [2^i, 2^(i+1)) ns, the last one counts also all the longer latencies.
+#define STAT_BUCKETS 32
+
+///Number of sessions shown in the `top_sessions` file.
+#define STATS_TOP_N 10
+
+/** \brief Returns the timestamp to be given to `stat_record()` when an operation starts.
+ * \returns The current monotonic time, in nanoseconds.
+ */
+static inline u64 stat_start(void){
+	return ktime_get_ns();
+}
+
+/** \brief Records the latency of an operation in its global histogram.
+ * \param[in] stat The recorded operation.
+ * \param[in] start The timestamp returned by `stat_start()` when the operation started.
+ * \returns The latency of the operation, in nanoseconds.
+ */
+u64 stat_record(enum sess_stat stat, u64 start);
+
+/** \brief Records the latency of an operation in its global histogram and in the counters of a `::session`.
+ * \param[in] stats The counters of the `::session`.
+ * \param[in] stat The recorded operation.
+ * \param[in] start The timestamp returned by `stat_start()` when the operation started.
+ */
+void session_stat_record(struct sess_stats* stats, enum sess_stat stat, u64 start);
+
+/** \brief Resets the counters of a `::session`.
+ * \param[in] stats The counters to reset.
+ */
+void reset_session_stats(struct sess_stats* stats);
+
+/** \brief Creates the debugfs files of the statistics.
+ *
+ * Errors are ignored, since the module works also without debugfs.
+ */
+void init_stats(void);
+
+/** \brief Removes the debugfs files of the statistics.
+ */
+void release_stats(void);
+
+#endif
@@ -7,69 +7,175 @@
 
 
 #include <linux/kobject.h>
+#include <linux/kref.h>
+#include <linux/atomic.h>
+#include <linux/spinlock.h>
+#include <linux/rwsem.h>
+#include <linux/list.h>
+
+//for struct sess_policy
+#include "device_sessionfs.h"
+
+struct sess_owner;
+struct sess_account;
+
+/** \enum sess_stat
+ * \brief The session operations whose latency is recorded by the _Session Statistics_ submodule.
+ */
+enum sess_stat{
+	STAT_IOCTL_OPEN,	///< A successful `::IOCTL_SEQ_OPEN` ioctl, from its start to its end.
+	STAT_PATH_CHECK,	///< The check that a pathname is contained in the session path.
+	STAT_LOOKUP,		///< The search of a `::session` in the sessions list.
+	STAT_SNAPSHOT_COPY,	///< The copy of the original file over a new incarnation file.
+	STAT_COMMIT_COPY,	///< The copy of an incarnation file over the original file.
+	STAT_LOCK_WAIT,		///< The wait for the `sess_lock` of a `::session`.
+	STAT_NUM		///< Number of recorded operations.
+};
+
+/** \struct sess_stats
+ * \brief Latency counters of a single `::session`.
+ * \param count The number of operations recorded, for each `::sess_stat`.
+ * \param time_ns The total time spent in the recorded operations, in nanoseconds.
+ */
+struct sess_stats{
+	atomic64_t count[STAT_NUM];
+	atomic64_t time_ns[STAT_NUM];
+};
+
+/** \enum sess_counter
+ * \brief The throughput counters kept for each `::session` and for the whole module by the _Session Information_ submodule.
+ */
+enum sess_counter{
+	CNT_OPENS,		///< Incarnations created.
+	CNT_CLOSES,		///< Incarnations closed.
+	CNT_BYTES_SNAPSHOT,	///< Bytes copied from the original file to the incarnations.
+	CNT_BYTES_COMMITTED,	///< Bytes copied from the incarnations to the original file.
+	CNT_COMMITS_SKIPPED,	///< Incarnations closed without overwriting the original file.
+	CNT_FAILURES,		///< Failed opens, snapshots and commits.
+	CNT_NUM			///< Number of counters.
+};
 
 /** \struct sess_info
  * \brief Infromations on a `::session` used by SysFS.
  * \param kobj The `::session` kernel object.
  * \param inc_num_attr The kernel object attribute that represents the number of incarnations for the original file.
- * \param f_name Formatted filename of the session object, where each '/' is replaced by a '-'.
  * \param inc_num The actual number of open incarnations for the original file.
+ * \param counters_attr The kernel object attribute that contains the throughput counters of the original file.
+ * \param counters The throughput counters of the original file, one for each `::sess_counter`.
+ * \param name The pathname of the original file, used to name the kernel object when it is published, replacing each '/' with a '-'.
+ * \param pending Links the `::sess_info` in the list of the kernel objects waiting to be published, empty otherwise.
  *
  * This struct represents the published information about a `::session`.
  */
 struct sess_info{
 	struct kobject* kobj;
 	struct kobj_attribute inc_num_attr;
-	char* f_name;
 	atomic_t inc_num;
+	struct kobj_attribute counters_attr;
+	atomic64_t counters[CNT_NUM];
+	const char* name;
+	struct list_head pending;
+};
+
+/** \struct inc_info
+ * \brief Informations on an `::incarnation` used by SysFS.
+ * \param attr The kernel object attribute that contains the name of the owner process, its name is `NULL` until it is published.
+ * \param parent The `::sess_info` of the parent `::session`.
+ * \param pending Links the `::inc_info` in the list of the attributes waiting to be published, empty otherwise.
+ * \param pid The pid of the owner process, used to name the attribute.
+ * \param fdes The file descriptor of the incarnation, used to name the attribute.
+ */
+struct inc_info{
+	struct kobj_attribute attr;
+	struct sess_info* parent;
+	struct list_head pending;
+	pid_t pid;
+	int fdes;
+};
+
+/** \struct sess_charge
+ * \brief The bytes charged to the accounts by an `::incarnation`, see session_quota.h.
+ * \param root The account of the session root, `NULL` if the incarnation has been opened outside of a session root.
+ * \param user The account of the user that has opened the incarnation, `NULL` if the charge has been returned.
+ * \param bytes The bytes charged.
+ */
+struct sess_charge{
+	struct sess_account* root;
+	struct sess_account* user;
+	u64 bytes;
 };
 
 /** \struct incarnation
  * \brief Informations on an incarnation of a file.
- * \param node Next `::incarnation` on the list.
+ * \param node Links the `::incarnation` in the `incarnations` list of the parent `::session`.
  * \param file The struct file that represents the incarantion file.
- * \param inc_attr a kernel object attribute that is used to read `::incarnation` `owner_pid` and the process name.
+ * \param info The information on the `::incarnation` published in SysFS, used to read `::incarnation` `owner_pid` and the process name.
  * \param pathname The pathanme of the incarnation file.
  * \param filedes File descriptor of the incarnation file.
  * \param owner_pid Pid of the process that has requested the `::incarnation`.
  * \param status Contains the error code that could have invalidated the `::incarnation`. If its value is less than 0 then the incarnation is invalid and must be closed as soon as possible.
+ * \param session The parent `::session`, only valid while the `::incarnation` has not been closed.
+ * \param kref Reference counter of the `::incarnation`: one reference is held by the parent `::session` list, until the `::incarnation` is closed, and one by the incarnation file.
+ * \param closed Set to 1 by the first path that closes the `::incarnation` (release of the file, close ioctl or cleanup), so that it is closed only once.
+ * \param bytes_snapshot The bytes copied from the original file when the `::incarnation` has been created.
+ * \param bytes_committed The bytes copied over the original file when the `::incarnation` has been closed.
+ * \param owner The `::sess_owner` that indexes the `::incarnation` by `filedes`, `NULL` if it is not indexed.
+ * \param usage_node Links the `::incarnation` in the list of the incarnation files counted in the disk usage, until the file is released.
+ * \param charge The bytes charged by the `::incarnation` to its accounts, until it is closed.
  *
  * This struct represents an incarnation file and it refers a `::session` struct.
  */
 struct incarnation{
-	struct llist_node node;
+	struct list_head node;
 	struct file* file;
-	struct kobj_attribute inc_attr;
+	struct inc_info info;
 	const char* pathname;
 	int filedes;
 	pid_t owner_pid;
 	int status;
+	struct session* session;
+	struct kref kref;
+	atomic_t closed;
+	u64 bytes_snapshot;
+	u64 bytes_committed;
+	struct sess_owner* owner;
+	struct list_head usage_node;
+	struct sess_charge charge;
 };
 
 /** \struct session
  * \brief General information on a `::session`.
- * \param incarnations List (lockless) of the active `::incarnation`(s) of the file.
+ * \param incarnations List of the active `::incarnation`(s) of the file, an `::incarnation` is removed when it is closed.
+ * \param inc_lock Spinlock that protects `incarnations`.
  * \param info Informations on the current original file, represented by a`::sess_info` struct.
  * \param file The struct file that represents the original file.
  * \param rcu_node Pointer to the `::session_rcu` that contains the current session object.
  * \param pathname Pathname of the file that is opened with session semantic.
- * \param sess_lock read-write lock used to ensure serialization in the session closures.
+ * \param sess_lock read-write semaphore used to ensure serialization in the session closures, a semaphore since the copies
+ * made while holding it can sleep.
  * \param filedes Descriptor of the file opened with session semantic.
  * \param refcount The number of processes that are currently using this `::session`.
- * \param valid This parameter is used (after having gained the rwlock) to check if this struct `::session` is still attached to the rculist.
+ * \param valid This parameter is used (after having gained `sess_lock`) to check if this struct `::session` is still attached to the rculist.
+ * \param stats Latency counters of the operations on this `::session`.
+ * \param policy The policy of the session root in which the `::session` has been created.
+ * \param charged The bytes charged by the open `::incarnation`(s) of the original file.
  *
  * This struct represent an original file with its active `::incarnation`(s).
  * If the session object has been removed from the rculist the value of this parameter will be different from `::VALID_NODE`.
  */
 struct session{
-	struct llist_head incarnations;
+	struct list_head incarnations;
+	spinlock_t inc_lock;
 	struct sess_info info;
 	struct session_rcu* rcu_node;
 	struct file* file;
 	const char* pathname;
-	rwlock_t sess_lock;
+	struct rw_semaphore sess_lock;
 	atomic_t refcount;
 	atomic_t valid;
+	struct sess_stats stats;
+	struct sess_policy policy;
+	atomic64_t charged;
 };
 
 /** \struct session_rcu
@@ -0,0 +1,210 @@
+/** \file
+ * \brief Implementation of the accounting of the memory and disk usage, component of the _Session Information_ submodule.
+ *
+ * The incarnations with an incarnation file are kept in the ::usage_incarnations list, protected by ::usage_lock, which
+ * is walked by `print_usage()` and `check_usage()`: reading the usage costs a walk of the incarnations, while opening and
+ * closing an incarnation only adds and removes it from the list.
+ */
+
+///Prefix of the messages printed by the usage accounting.
+#define pr_fmt(fmt) "SessionFS usage: " fmt
+
+#include "session_usage.h"
+//for scnprintf
+#include <linux/kernel.h>
+//for memset
+#include <linux/string.h>
+//for the per-CPU variables
+#include <linux/percpu.h>
+//for the incarnations list
+#include <linux/list.h>
+#include <linux/spinlock.h>
+//for inode_get_bytes and i_size_read
+#include <linux/fs.h>
+//for rcu_read_lock
+#include <linux/rcupdate.h>
+//for find_vpid
+#include <linux/pid.h>
+//for pid_task
+#include <linux/sched.h>
+
+/** \enum inc_usage
+ * \brief The states of the incarnations counted in the disk usage.
+ */
+enum inc_usage{
+	INC_OPEN,	///< Open incarnations.
+	INC_CLOSED,	///< Closed incarnations, whose file has not been released yet.
+	INC_ORPHANED,	///< Open incarnations whose owner process has exited.
+	INC_NUM		///< Number of states.
+};
+
+/** \struct mem_usage
+ * \brief The kernel memory counters, kept per-CPU since they are updated on every open and close.
+ * \param bytes The bytes allocated on the CPU for each `::sess_mem`, negative if they have been freed on another CPU.
+ */
+struct mem_usage{
+	s64 bytes[MEM_NUM];
+};
+
+/** \struct disk_usage
+ * \brief The disk usage measured by `measure_disk_usage()`.
+ * \param num The number of incarnations in each `::inc_usage` state.
+ * \param bytes The disk space of the incarnation files in each `::inc_usage` state.
+ * \param size The size of all the incarnation files.
+ */
+struct disk_usage{
+	u64 num[INC_NUM];
+	u64 bytes[INC_NUM];
+	u64 size;
+};
+
+unsigned long usage_warn_mem=0;
+
+unsigned long usage_warn_disk=0;
+
+///The per-CPU kernel memory counters.
+DEFINE_PER_CPU(struct mem_usage, mem_usage);
+
+///The incarnations with an incarnation file, linked by their `usage_node`.
+LIST_HEAD(usage_incarnations);
+
+///Protects ::usage_incarnations.
+DEFINE_SPINLOCK(usage_lock);
+
+///Set while the kernel memory is over ::usage_warn_mem, so that the warning is printed once.
+bool mem_warned=false;
+
+///Set while the disk space is over ::usage_warn_disk, so that the warning is printed once.
+bool disk_warned=false;
+
+///The names of the `::sess_mem` types, as shown by `print_usage()`.
+const char* mem_names[MEM_NUM]={"mem_sessions","mem_incarnations","mem_owners","mem_roots","mem_record","mem_accounts"};
+
+///The names of the `::inc_usage` states, as shown by `print_usage()`.
+const char* inc_usage_names[INC_NUM]={"incarnations_open","incarnations_closed","incarnations_orphaned"};
+
+void usage_alloc(enum sess_mem type, size_t bytes){
+	this_cpu_add(mem_usage.bytes[type],bytes);
+}
+
+void usage_free(enum sess_mem type, size_t bytes){
+	this_cpu_sub(mem_usage.bytes[type],bytes);
+}
+
+void usage_add_incarnation(struct incarnation* incarnation){
+	spin_lock(&usage_lock);
+	list_add_tail(&(incarnation->usage_node),&usage_incarnations);
+	spin_unlock(&usage_lock);
+}
+
+void usage_remove_incarnation(struct incarnation* incarnation){
+	spin_lock(&usage_lock);
+	list_del_init(&(incarnation->usage_node));
+	spin_unlock(&usage_lock);
+}
+
+/** \brief Sums the per-CPU kernel memory counters.
+ * \param[out] bytes The bytes allocated for each `::sess_mem`.
+ * \returns The bytes allocated for all the types.
+ */
+u64 measure_mem_usage(u64* bytes){
+	s64 sum, total=0;
+	int cpu,i;
+	for(i=0;i<MEM_NUM;i++){
+		sum=0;
+		for_each_possible_cpu(cpu){
+			sum+=READ_ONCE(per_cpu_ptr(&mem_usage,cpu)->bytes[i]);
+		}
+		//the counters of the CPUs are read at different times
+		bytes[i]=(sum<0) ? 0 : sum;
+		total+=bytes[i];
+	}
+	return total;
+}
+
+/** \brief Measures the disk space of the incarnation files.
+ * \param[out] usage The disk usage, filled by walking ::usage_incarnations.
+ * \returns The disk space of all the incarnation files.
+ *
+ * The owner process is looked up without taking references, like in the session table.
+ */
+u64 measure_disk_usage(struct disk_usage* usage){
+	struct incarnation* incarnation;
+	struct inode* inode;
+	enum inc_usage state;
+	u64 total=0;
+	int i;
+	memset(usage,0,sizeof(struct disk_usage));
+	rcu_read_lock();
+	spin_lock(&usage_lock);
+	list_for_each_entry(incarnation,&usage_incarnations,usage_node){
+		inode=file_inode(incarnation->file);
+		if(atomic_read(&(incarnation->closed))!=0){
+			state=INC_CLOSED;
+		} else if(pid_task(find_vpid(incarnation->owner_pid),PIDTYPE_PID)==NULL){
+			state=INC_ORPHANED;
+		} else {
+			state=INC_OPEN;
+		}
+		usage->num[state]++;
+		usage->bytes[state]+=inode_get_bytes(inode);
+		usage->size+=i_size_read(inode);
+	}
+	spin_unlock(&usage_lock);
+	rcu_read_unlock();
+	for(i=0;i<INC_NUM;i++){
+		total+=usage->bytes[i];
+	}
+	return total;
+}
+
+ssize_t print_usage(char* buf, size_t size){
+	u64 bytes[MEM_NUM];
+	struct disk_usage usage;
+	u64 mem_total, disk_total;
+	ssize_t len=0;
+	int i;
+	mem_total=measure_mem_usage(bytes);
+	disk_total=measure_disk_usage(&usage);
+	for(i=0;i<MEM_NUM;i++){
+		len+=scnprintf(buf+len,size-len,"%s %llu\n",mem_names[i],bytes[i]);
+	}
+	len+=scnprintf(buf+len,size-len,"mem_total %llu\n",mem_total);
+	for(i=0;i<INC_NUM;i++){
+		len+=scnprintf(buf+len,size-len,"%s %llu\n%s_bytes %llu\n",inc_usage_names[i],usage.num[i],inc_usage_names[i],
+			usage.bytes[i]);
+	}
+	len+=scnprintf(buf+len,size-len,"disk_bytes %llu\ndisk_size %llu\n",disk_total,usage.size);
+	return len;
+}
+
+/** \brief Prints a warning when a usage crosses its limit.
+ * \param[in] name The name of the usage in the message.
+ * \param[in] value The current usage.
+ * \param[in] limit The limit, 0 if disabled.
+ * \param[in,out] warned Whether the usage was already over the limit.
+ */
+void check_limit(const char* name, u64 value, unsigned long limit, bool* warned){
+	if(limit!=0 && value>limit){
+		if(!*warned){
+			pr_warn("%s usage is %llu bytes, over the limit of %lu bytes\n",name,value,limit);
+		}
+		*warned=true;
+	} else {
+		if(*warned){
+			pr_info("%s usage is back to %llu bytes\n",name,value);
+		}
+		*warned=false;
+	}
+}
+
+/**
+ * The disk space is measured only when its limit is set, since it walks all the incarnations.
+ */
+void check_usage(void){
+	u64 bytes[MEM_NUM];
+	struct disk_usage usage;
+	unsigned long mem_limit=READ_ONCE(usage_warn_mem), disk_limit=READ_ONCE(usage_warn_disk);
+	check_limit("kernel memory",measure_mem_usage(bytes),mem_limit,&mem_warned);
+	check_limit("disk",(disk_limit!=0) ? measure_disk_usage(&usage) : 0,disk_limit,&disk_warned);
+}
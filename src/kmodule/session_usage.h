@@ -0,0 +1,86 @@
+/** \file
+ * \brief Accounting of the kernel memory and of the disk space used by the module, component of the _Session Information_ submodule.
+ *
+ * The kernel memory is counted, for each `::sess_mem` type, when the objects are allocated and freed, in per-CPU
+ * counters like the throughput counters.
+ * The disk space can't be counted in the same way, since the processes write the incarnation files directly, so it is
+ * measured when it is read, by walking the incarnations that still have an incarnation file: an incarnation leaves the
+ * list when its file is released, so the incarnations already closed and the ones whose owner process has exited, while
+ * another process still holds their file, are counted too.
+ *
+ * The usage is shown in the SysFS `usage` attribute of the device, see `print_usage()`, and is checked by the periodic
+ * sweep of the session manager with `check_usage()`, which warns when it goes over the ::usage_warn_mem and
+ * ::usage_warn_disk module parameters.
+ */
+#ifndef SESSION_USAGE_H
+#define SESSION_USAGE_H
+
+#include <linux/types.h>
+
+#include "session_types.h"
+
+/** \enum sess_mem
+ * \brief The types of the objects whose kernel memory is counted.
+ */
+enum sess_mem{
+	MEM_SESSIONS,		///< The `::session` and `::session_rcu` objects and their pathnames.
+	MEM_INCARNATIONS,	///< The `::incarnation` objects, their pathnames, file operations and SysFS names.
+	MEM_OWNERS,		///< The `::sess_owner` objects of the owners index.
+	MEM_ROOTS,		///< The `::sess_root` objects.
+	MEM_RECORD,		///< The buffers of the relay channel of the recorder.
+	MEM_ACCOUNTS,		///< The `::sess_account` objects of the admission control.
+	MEM_NUM			///< Number of types.
+};
+
+///The kernel memory, in bytes, over which `check_usage()` warns, 0 to disable the warning.
+extern unsigned long usage_warn_mem;
+
+///The disk space used by the incarnation files, in bytes, over which `check_usage()` warns, 0 to disable the warning.
+extern unsigned long usage_warn_disk;
+
+/** \brief Counts the kernel memory of an allocated object.
+ * \param[in] type The type of the object.
+ * \param[in] bytes The bytes allocated, e.g. from `ksize()` or `kmem_cache_size()`.
+ */
+void usage_alloc(enum sess_mem type, size_t bytes);
+
+/** \brief Counts the kernel memory of a freed object.
+ * \param[in] type The type of the object.
+ * \param[in] bytes The bytes counted by `usage_alloc()`.
+ */
+void usage_free(enum sess_mem type, size_t bytes);
+
+/** \brief Starts counting the disk space of an incarnation file.
+ * \param[in] incarnation The `::incarnation`, whose `file` must remain valid until `usage_remove_incarnation()`.
+ */
+void usage_add_incarnation(struct incarnation* incarnation);
+
+/** \brief Stops counting the disk space of an incarnation file, before the file is released.
+ * \param[in] incarnation The `::incarnation`, it can be removed more than once.
+ */
+void usage_remove_incarnation(struct incarnation* incarnation);
+
+/** \brief Prints the memory and disk usage in a buffer.
+ * \param[out] buf The buffer.
+ * \param[in] size The size of `buf`.
+ * \returns The number of bytes written.
+ *
+ * Each line contains a name and a value:
+ * - `mem_sessions`, `mem_incarnations`, `mem_owners`, `mem_roots`, `mem_record`, `mem_accounts`: the kernel memory of
+ * each `::sess_mem`;
+ * - `mem_total`: the sum of them;
+ * - `incarnations_open`, `incarnations_closed`, `incarnations_orphaned`: the incarnation files of the open incarnations,
+ * of the closed incarnations whose file is still open and of the open incarnations whose owner has exited, each followed
+ * by a line with the disk space of the files, e.g. `incarnations_open_bytes`;
+ * - `disk_bytes`: the disk space of all the incarnation files, the blocks allocated by the filesystem;
+ * - `disk_size`: the size of all the incarnation files.
+ */
+ssize_t print_usage(char* buf, size_t size);
+
+/** \brief Warns when the memory or the disk usage goes over the module parameters, called by the periodic sweep.
+ *
+ * The warning is printed once, when the usage goes over the limit, and again only after it has gone back under it.
+ */
+void check_usage(void);
+
+#endif
@@ -0,0 +1,820 @@
+/** \file
+ * \brief Implementation of the stackable filesystem, component of the _Stacked Filesystem_ submodule.
+ *
+ * This file contains a filesystem which is stacked over a directory (the lower directory): directories and attributes are
+ * taken from the lower directory, while each regular file opened through the mount point is backed by a new
+ * `::incarnation` created by the session manager, which is committed when the file is released.
+ *
+ * Since the session semantic is selected by the mount point, files can be opened with any libc function or system call,
+ * also by statically linked programs.
+ *
+ * Creating, removing and renaming files and directories is passed to the lower directory, where it is not subject to
+ * the session semantic, while the incarnation files that the session manager creates next to the original files are
+ * hidden from lookups and directory listings.
+ * Regular files can be memory mapped, the mapping is backed by the incarnation file: what is written through a shared
+ * mapping before the file is closed is committed with the rest of the incarnation, what is written after it is lost.
+ */
+
+///Prefix of the messages printed by the stacked filesystem.
+#define pr_fmt(fmt) "SessionFS stacked filesystem: " fmt
+
+#include "sessionfs_mount.h"
+#include "session_manager.h"
+
+//for the file_system_type and the VFS APIs
+#include <linux/fs.h>
+//for fsstack_copy_attr_all
+#include <linux/fs_stack.h>
+//for kern_path and lookup_one_len_unlocked
+#include <linux/namei.h>
+//for mntget
+#include <linux/mount.h>
+//for dentry management
+#include <linux/dcache.h>
+//for memory APIs
+#include <linux/slab.h>
+//for struct iov_iter
+#include <linux/uio.h>
+//for struct vm_area_struct
+#include <linux/mm.h>
+//for THIS_MODULE
+#include <linux/module.h>
+//for current
+#include <linux/sched.h>
+//for current_cred
+#include <linux/cred.h>
+//for struct kstatfs
+#include <linux/statfs.h>
+// for PATH_MAX
+#include <uapi/linux/limits.h>
+//for errno numbers
+#include <uapi/asm-generic/errno.h>
+
+/// The inode of the lower filesystem, which is stored in `i_private`.
+#define LOWER_INODE(inode) ((struct inode*)(inode)->i_private)
+
+/// The path in the lower filesystem of a dentry, which is stored in `d_fsdata`.
+#define LOWER_PATH(dentry) (&(((struct sessionfs_dentry*)(dentry)->d_fsdata)->lower))
+
+/** \struct sessionfs_dentry
+ * \brief Information on a dentry of the stacked filesystem.
+ * \param lower The path of the corresponding dentry in the lower filesystem, on which we hold a reference.
+ */
+struct sessionfs_dentry{
+	struct path lower;
+};
+
+struct inode* sessionfs_iget(struct super_block* sb, struct inode* lower);
+
+/** \brief Checks if a dentry of the stacked filesystem is still valid.
+ * \param[in] dentry The dentry to be checked.
+ * \param[in] flags The lookup flags.
+ * \returns 1 if the dentry is valid, 0 if it must be looked up again or `-ECHILD` if we are in RCU walk mode.
+ *
+ * Negative dentries are never cached, since the file could have been created in the lower directory, positive dentries
+ * are valid as long as their lower dentry is valid.
+ */
+int sessionfs_d_revalidate(struct dentry* dentry, unsigned int flags){
+	struct dentry* lower=NULL;
+	if(flags & LOOKUP_RCU){
+		return -ECHILD;
+	}
+	if(dentry->d_fsdata==NULL){
+		return 0;
+	}
+	lower=LOWER_PATH(dentry)->dentry;
+	if(d_unhashed(lower) || d_is_negative(lower)){
+		return 0;
+	}
+	if(lower->d_flags & DCACHE_OP_REVALIDATE){
+		return lower->d_op->d_revalidate(lower,flags);
+	}
+	return 1;
+}
+
+/** \brief Releases the reference on the lower path when a dentry is freed.
+ * \param[in] dentry The dentry being freed.
+ */
+void sessionfs_d_release(struct dentry* dentry){
+	struct sessionfs_dentry* info=dentry->d_fsdata;
+	if(info!=NULL){
+		path_put(&(info->lower));
+		kfree(info);
+		dentry->d_fsdata=NULL;
+	}
+}
+
+///Operations on the dentries of the stacked filesystem.
+const struct dentry_operations sessionfs_dops={
+	.d_revalidate=sessionfs_d_revalidate,
+	.d_release=sessionfs_d_release,
+};
+
+/** \brief Looks up a name in a directory of the stacked filesystem.
+ * \param[in] dir The inode of the parent directory.
+ * \param[in,out] dentry The dentry to be filled.
+ * \param[in] flags The lookup flags.
+ * \returns `NULL`, an alias of `dentry` or an error code.
+ *
+ * The name is looked up in the lower directory, if the lower dentry is positive a new inode is created from the lower
+ * inode with `sessionfs_iget()`. The names of the incarnation files, checked with `is_incarnation_name()`, are always
+ * negative.
+ */
+struct dentry* sessionfs_lookup(struct inode* dir, struct dentry* dentry, unsigned int flags){
+	struct path* parent=LOWER_PATH(dentry->d_parent);
+	struct sessionfs_dentry* info=NULL;
+	struct dentry* lower=NULL;
+	struct inode* inode=NULL;
+	//the incarnation files in the lower directory are not shown
+	if(is_incarnation_name(dentry->d_name.name,dentry->d_name.len)){
+		return d_splice_alias(NULL,dentry);
+	}
+	lower=lookup_one_len_unlocked(dentry->d_name.name,parent->dentry,dentry->d_name.len);
+	if(IS_ERR(lower)){
+		return ERR_CAST(lower);
+	}
+	if(d_is_negative(lower)){
+		dput(lower);
+		return d_splice_alias(NULL,dentry);
+	}
+	info=kzalloc(sizeof(struct sessionfs_dentry),GFP_KERNEL);
+	if(!info){
+		dput(lower);
+		return ERR_PTR(-ENOMEM);
+	}
+	info->lower.dentry=lower;
+	info->lower.mnt=mntget(parent->mnt);
+	//the reference on the lower path is released by sessionfs_d_release()
+	dentry->d_fsdata=info;
+	inode=sessionfs_iget(dir->i_sb,d_inode(lower));
+	if(IS_ERR(inode)){
+		return ERR_CAST(inode);
+	}
+	return d_splice_alias(inode,dentry);
+}
+
+/** \brief Gets the attributes of a file, from the lower filesystem.
+ * \param[in] path The path of the file.
+ * \param[out] stat The attributes of the file.
+ * \param[in] request_mask The requested attributes.
+ * \param[in] flags The query flags.
+ * \returns 0 on success or an error code.
+ */
+int sessionfs_getattr(const struct path* path, struct kstat* stat, u32 request_mask, unsigned int flags){
+	struct inode* inode=d_inode(path->dentry);
+	int res=0;
+	res=vfs_getattr(LOWER_PATH(path->dentry),stat,request_mask,flags);
+	if(res==0){
+		fsstack_copy_attr_all(inode,LOWER_INODE(inode));
+		stat->dev=inode->i_sb->s_dev;
+	}
+	return res;
+}
+
+/** \brief Changes the attributes of a regular file.
+ * \param[in] dentry The dentry of the file.
+ * \param[in] attr The attributes to change.
+ * \returns 0 on success or an error code (`-EPERM` if the change is not supported).
+ *
+ * Only the truncation of an open file (`ftruncate()` or `O_TRUNC`) is supported, since it is applied to its
+ * `::incarnation`, any other change would modify the original file outside of a session.
+ */
+int sessionfs_setattr(struct dentry* dentry, struct iattr* attr){
+	struct incarnation* incarnation=NULL;
+	if(!(attr->ia_valid & ATTR_SIZE) || !(attr->ia_valid & ATTR_FILE)){
+		return -EPERM;
+	}
+	incarnation=attr->ia_file->private_data;
+	return vfs_truncate(&(incarnation->file->f_path),attr->ia_size);
+}
+
+/** \brief Follows a symbolic link of the lower filesystem.
+ * \param[in] dentry The dentry of the link, `NULL` in RCU walk mode.
+ * \param[in] inode The inode of the link.
+ * \param[in] done Used to release the link body.
+ * \returns The link body or an error code.
+ */
+const char* sessionfs_get_link(struct dentry* dentry, struct inode* inode, struct delayed_call* done){
+	if(dentry==NULL){
+		return ERR_PTR(-ECHILD);
+	}
+	return vfs_get_link(LOWER_PATH(dentry)->dentry,done);
+}
+
+/** \brief Looks up the name of a dentry in the lower directory, locking the lower directory.
+ * \param[in] dentry The dentry of the stacked filesystem, whose parent is locked by the VFS.
+ * \returns The lower dentry, on which a reference is held, or an error code (`-EPERM` for the names of the incarnation
+ * files).
+ *
+ * On success the caller has write access to the lower mount and holds the lock of the lower directory, both are released
+ * with `sessionfs_unlock_lower()`.
+ */
+struct dentry* sessionfs_lock_lower(struct dentry* dentry){
+	struct path* parent=LOWER_PATH(dentry->d_parent);
+	struct dentry* lower=NULL;
+	int res=0;
+	if(is_incarnation_name(dentry->d_name.name,dentry->d_name.len)){
+		return ERR_PTR(-EPERM);
+	}
+	res=mnt_want_write(parent->mnt);
+	if(res<0){
+		return ERR_PTR(res);
+	}
+	inode_lock_nested(d_inode(parent->dentry),I_MUTEX_PARENT);
+	lower=lookup_one_len(dentry->d_name.name,parent->dentry,dentry->d_name.len);
+	if(IS_ERR(lower)){
+		inode_unlock(d_inode(parent->dentry));
+		mnt_drop_write(parent->mnt);
+	}
+	return lower;
+}
+
+/** \brief Releases the lower directory locked by `sessionfs_lock_lower()`.
+ * \param[in] dentry The dentry of the stacked filesystem.
+ * \param[in] lower The lower dentry returned by `sessionfs_lock_lower()`, whose reference is dropped.
+ *
+ * The parent directory gets the attributes of the lower directory, which have been changed by the operation.
+ */
+void sessionfs_unlock_lower(struct dentry* dentry, struct dentry* lower){
+	struct path* parent=LOWER_PATH(dentry->d_parent);
+	fsstack_copy_attr_all(d_inode(dentry->d_parent),d_inode(parent->dentry));
+	fsstack_copy_inode_size(d_inode(dentry->d_parent),d_inode(parent->dentry));
+	inode_unlock(d_inode(parent->dentry));
+	dput(lower);
+	mnt_drop_write(parent->mnt);
+}
+
+/** \brief Fills a negative dentry of the stacked filesystem with a new lower dentry.
+ * \param[in,out] dentry The dentry of the stacked filesystem.
+ * \param[in] lower The lower dentry, which has just been created.
+ * \returns 0 on success or an error code.
+ */
+int sessionfs_instantiate(struct dentry* dentry, struct dentry* lower){
+	struct sessionfs_dentry* info=NULL;
+	struct inode* inode=NULL;
+	info=kzalloc(sizeof(struct sessionfs_dentry),GFP_KERNEL);
+	if(!info){
+		return -ENOMEM;
+	}
+	inode=sessionfs_iget(dentry->d_sb,d_inode(lower));
+	if(IS_ERR(inode)){
+		kfree(info);
+		return PTR_ERR(inode);
+	}
+	info->lower.dentry=dget(lower);
+	info->lower.mnt=mntget(LOWER_PATH(dentry->d_parent)->mnt);
+	//the reference on the lower path is released by sessionfs_d_release()
+	dentry->d_fsdata=info;
+	d_instantiate(dentry,inode);
+	return 0;
+}
+
+/** \brief Creates a regular file in the lower directory.
+ * \param[in] dir The inode of the parent directory.
+ * \param[in,out] dentry The negative dentry of the new file.
+ * \param[in] mode The mode of the new file.
+ * \param[in] excl Set if the file is created with `O_EXCL`.
+ * \returns 0 on success or an error code.
+ *
+ * The file is created empty, so the `::incarnation` created when it is opened starts empty too.
+ */
+int sessionfs_create(struct inode* dir, struct dentry* dentry, umode_t mode, bool excl){
+	struct dentry* lower=NULL;
+	int res=0;
+	lower=sessionfs_lock_lower(dentry);
+	if(IS_ERR(lower)){
+		return PTR_ERR(lower);
+	}
+	res=vfs_create(d_inode(LOWER_PATH(dentry->d_parent)->dentry),lower,mode,excl);
+	if(res==0){
+		res=sessionfs_instantiate(dentry,lower);
+	}
+	sessionfs_unlock_lower(dentry,lower);
+	return res;
+}
+
+/** \brief Creates a directory in the lower directory.
+ * \param[in] dir The inode of the parent directory.
+ * \param[in,out] dentry The negative dentry of the new directory.
+ * \param[in] mode The mode of the new directory.
+ * \returns 0 on success or an error code.
+ */
+int sessionfs_mkdir(struct inode* dir, struct dentry* dentry, umode_t mode){
+	struct dentry* lower=NULL;
+	int res=0;
+	lower=sessionfs_lock_lower(dentry);
+	if(IS_ERR(lower)){
+		return PTR_ERR(lower);
+	}
+	res=vfs_mkdir(d_inode(LOWER_PATH(dentry->d_parent)->dentry),lower,mode);
+	if(res==0){
+		res=sessionfs_instantiate(dentry,lower);
+	}
+	sessionfs_unlock_lower(dentry,lower);
+	return res;
+}
+
+/** \brief Removes a file from the lower directory.
+ * \param[in] dir The inode of the parent directory.
+ * \param[in] dentry The dentry of the file.
+ * \returns 0 on success or an error code.
+ *
+ * The open `::incarnation`(s) of the file are not committed, since their original file has been removed.
+ */
+int sessionfs_unlink(struct inode* dir, struct dentry* dentry){
+	struct inode* inode=d_inode(dentry);
+	struct dentry* lower=NULL;
+	int res=0;
+	lower=sessionfs_lock_lower(dentry);
+	if(IS_ERR(lower)){
+		return PTR_ERR(lower);
+	}
+	res=vfs_unlink(d_inode(LOWER_PATH(dentry->d_parent)->dentry),lower,NULL);
+	sessionfs_unlock_lower(dentry,lower);
+	if(res==0){
+		set_nlink(inode,LOWER_INODE(inode)->i_nlink);
+		inode->i_ctime=dir->i_ctime;
+		d_drop(dentry);
+	}
+	return res;
+}
+
+/** \brief Removes a directory from the lower directory.
+ * \param[in] dir The inode of the parent directory.
+ * \param[in] dentry The dentry of the directory.
+ * \returns 0 on success or an error code.
+ */
+int sessionfs_rmdir(struct inode* dir, struct dentry* dentry){
+	struct dentry* lower=NULL;
+	int res=0;
+	lower=sessionfs_lock_lower(dentry);
+	if(IS_ERR(lower)){
+		return PTR_ERR(lower);
+	}
+	res=vfs_rmdir(d_inode(LOWER_PATH(dentry->d_parent)->dentry),lower);
+	sessionfs_unlock_lower(dentry,lower);
+	if(res==0){
+		clear_nlink(d_inode(dentry));
+		d_drop(dentry);
+	}
+	return res;
+}
+
+/** \brief Renames a file or a directory in the lower filesystem.
+ * \param[in] old_dir The inode of the source directory.
+ * \param[in] old_dentry The dentry to be renamed.
+ * \param[in] new_dir The inode of the target directory.
+ * \param[in] new_dentry The dentry of the new name.
+ * \param[in] flags The `RENAME_*` flags, checked by the lower filesystem.
+ * \returns 0 on success or an error code (`-EPERM` if the new name is the name of an incarnation file).
+ *
+ * The lower dentry moved by `vfs_rename()` is the one referenced by `old_dentry`, so it keeps pointing to the renamed
+ * file. The open `::incarnation`(s) of a renamed file are committed to the file with its new name.
+ */
+int sessionfs_rename(struct inode* old_dir, struct dentry* old_dentry, struct inode* new_dir, struct dentry* new_dentry,
+		unsigned int flags){
+	struct path *old_parent=LOWER_PATH(old_dentry->d_parent), *new_parent=LOWER_PATH(new_dentry->d_parent);
+	struct dentry *lower_old=NULL, *lower_new=NULL, *trap=NULL;
+	int res=0;
+	if(is_incarnation_name(new_dentry->d_name.name,new_dentry->d_name.len)){
+		return -EPERM;
+	}
+	res=mnt_want_write(old_parent->mnt);
+	if(res<0){
+		return res;
+	}
+	trap=lock_rename(new_parent->dentry,old_parent->dentry);
+	lower_old=lookup_one_len(old_dentry->d_name.name,old_parent->dentry,old_dentry->d_name.len);
+	if(IS_ERR(lower_old)){
+		res=PTR_ERR(lower_old);
+	} else {
+		lower_new=lookup_one_len(new_dentry->d_name.name,new_parent->dentry,new_dentry->d_name.len);
+		if(IS_ERR(lower_new)){
+			res=PTR_ERR(lower_new);
+		} else {
+			if(d_is_negative(lower_old)){
+				res=-ENOENT;
+			} else if(lower_old==trap){
+				//the source is an ancestor of the target
+				res=-EINVAL;
+			} else if(lower_new==trap){
+				//the target is an ancestor of the source
+				res=-ENOTEMPTY;
+			} else {
+				res=vfs_rename(d_inode(old_parent->dentry),lower_old,d_inode(new_parent->dentry),lower_new,NULL,flags);
+			}
+			dput(lower_new);
+		}
+		dput(lower_old);
+	}
+	if(res==0){
+		fsstack_copy_attr_all(new_dir,d_inode(new_parent->dentry));
+		fsstack_copy_inode_size(new_dir,d_inode(new_parent->dentry));
+		if(new_dir!=old_dir){
+			fsstack_copy_attr_all(old_dir,d_inode(old_parent->dentry));
+			fsstack_copy_inode_size(old_dir,d_inode(old_parent->dentry));
+		}
+	}
+	unlock_rename(new_parent->dentry,old_parent->dentry);
+	mnt_drop_write(old_parent->mnt);
+	return res;
+}
+
+///Operations on the directory inodes.
+const struct inode_operations sessionfs_dir_iops={
+	.lookup=sessionfs_lookup,
+	.getattr=sessionfs_getattr,
+	.create=sessionfs_create,
+	.mkdir=sessionfs_mkdir,
+	.unlink=sessionfs_unlink,
+	.rmdir=sessionfs_rmdir,
+	.rename=sessionfs_rename,
+};
+
+///Operations on the regular file inodes.
+const struct inode_operations sessionfs_file_iops={
+	.getattr=sessionfs_getattr,
+	.setattr=sessionfs_setattr,
+};
+
+///Operations on the symbolic link inodes.
+const struct inode_operations sessionfs_link_iops={
+	.get_link=sessionfs_get_link,
+	.getattr=sessionfs_getattr,
+};
+
+/** \brief Opens a directory, by opening the lower directory.
+ * \param[in] inode The inode of the directory.
+ * \param[in,out] file The opened file, its `private_data` will hold the lower file.
+ * \returns 0 on success or an error code.
+ */
+int sessionfs_dir_open(struct inode* inode, struct file* file){
+	struct file* lower=NULL;
+	lower=dentry_open(LOWER_PATH(file->f_path.dentry),file->f_flags,current_cred());
+	if(IS_ERR(lower)){
+		return PTR_ERR(lower);
+	}
+	file->private_data=lower;
+	return 0;
+}
+
+/** \struct sessionfs_readdir_ctx
+ * \brief Directory context used to read the lower directory.
+ * \param ctx The context passed to the lower directory.
+ * \param caller The context of the caller, which receives the entries.
+ */
+struct sessionfs_readdir_ctx{
+	struct dir_context ctx;
+	struct dir_context* caller;
+};
+
+/** \brief Passes an entry of the lower directory to the caller, unless it is an incarnation file.
+ * \param[in] ctx The `ctx` member of a `::sessionfs_readdir_ctx`.
+ * \param[in] name The name of the entry.
+ * \param[in] len The length of `name`.
+ * \param[in] offset The offset of the entry.
+ * \param[in] ino The inode number of the entry.
+ * \param[in] type The type of the entry.
+ * \returns 0 to continue reading the directory, as returned by the caller.
+ */
+int sessionfs_filldir(struct dir_context* ctx, const char* name, int len, loff_t offset, u64 ino, unsigned int type){
+	struct sessionfs_readdir_ctx* buf=container_of(ctx,struct sessionfs_readdir_ctx,ctx);
+	if(is_incarnation_name(name,len)){
+		return 0;
+	}
+	return buf->caller->actor(buf->caller,name,len,offset,ino,type);
+}
+
+/** \brief Reads the entries of a directory from the lower directory, without the incarnation files.
+ * \param[in] file The directory.
+ * \param[in,out] ctx The directory context.
+ * \returns 0 on success or an error code.
+ */
+int sessionfs_readdir(struct file* file, struct dir_context* ctx){
+	struct file* lower=file->private_data;
+	struct sessionfs_readdir_ctx buf={
+		.ctx.actor=sessionfs_filldir,
+		.caller=ctx
+	};
+	int res=0;
+	res=iterate_dir(lower,&(buf.ctx));
+	ctx->pos=lower->f_pos;
+	file->f_pos=lower->f_pos;
+	return res;
+}
+
+/** \brief Changes the position in a directory.
+ * \param[in] file The directory.
+ * \param[in] offset The new offset.
+ * \param[in] whence How `offset` must be interpreted.
+ * \returns The new position or an error code.
+ */
+loff_t sessionfs_dir_llseek(struct file* file, loff_t offset, int whence){
+	struct file* lower=file->private_data;
+	loff_t res=0;
+	res=vfs_llseek(lower,offset,whence);
+	if(res>=0){
+		file->f_pos=res;
+	}
+	return res;
+}
+
+/** \brief Closes a directory, by closing the lower directory.
+ * \param[in] inode The inode of the directory.
+ * \param[in] file The directory.
+ * \returns 0.
+ */
+int sessionfs_dir_release(struct inode* inode, struct file* file){
+	fput(file->private_data);
+	return 0;
+}
+
+///Operations on the directories.
+const struct file_operations sessionfs_dir_fops={
+	.owner=THIS_MODULE,
+	.open=sessionfs_dir_open,
+	.iterate_shared=sessionfs_readdir,
+	.llseek=sessionfs_dir_llseek,
+	.read=generic_read_dir,
+	.release=sessionfs_dir_release,
+};
+
+/** \brief Opens a regular file with the session semantic.
+ * \param[in] inode The inode of the file.
+ * \param[in,out] file The opened file, its `private_data` will hold the `::incarnation`.
+ * \returns 0 on success or an error code.
+ *
+ * A new `::incarnation` of the lower file is created with `create_session()`, without a file descriptor.
+ * The incarnation file is always opened for reading and writing, since the access mode requested by the user is
+ * enforced by the VFS on the stacked file.
+ */
+int sessionfs_open(struct inode* inode, struct file* file){
+	struct incarnation* incarnation=NULL;
+	char *buf=NULL, *pathname=NULL;
+	int flags, res;
+	buf=kzalloc(sizeof(char)*PATH_MAX,GFP_KERNEL);
+	if(!buf){
+		return -ENOMEM;
+	}
+	pathname=d_path(LOWER_PATH(file->f_path.dentry),buf,PATH_MAX);
+	if(IS_ERR(pathname)){
+		kfree(buf);
+		return PTR_ERR(pathname);
+	}
+	//the file has already been created in the lower directory by sessionfs_create() and the truncation is applied to
+	//the incarnation by sessionfs_setattr()
+	flags=(file->f_flags & ~(O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_NOCTTY | O_DIRECT)) | O_RDWR;
+	incarnation=create_session(pathname,flags,current->tgid,-1,NO_FD,NULL,NULL);
+	kfree(buf);
+	if(IS_ERR(incarnation)){
+		return PTR_ERR(incarnation);
+	}
+	if(incarnation->status<0){
+		res=incarnation->status;
+		close_session_file(incarnation);
+		return res;
+	}
+	file->private_data=incarnation;
+	return 0;
+}
+
+/** \brief Reads from the incarnation of a regular file.
+ * \param[in] iocb The I/O control block, which holds the file and the position.
+ * \param[out] iter The destination of the read.
+ * \returns The number of bytes read or an error code.
+ */
+ssize_t sessionfs_read_iter(struct kiocb* iocb, struct iov_iter* iter){
+	struct incarnation* incarnation=iocb->ki_filp->private_data;
+	return vfs_iter_read(incarnation->file,iter,&(iocb->ki_pos),0);
+}
+
+/** \brief Writes on the incarnation of a regular file.
+ * \param[in] iocb The I/O control block, which holds the file and the position.
+ * \param[in] iter The source of the write.
+ * \returns The number of bytes written or an error code.
+ */
+ssize_t sessionfs_write_iter(struct kiocb* iocb, struct iov_iter* iter){
+	struct incarnation* incarnation=iocb->ki_filp->private_data;
+	return vfs_iter_write(incarnation->file,iter,&(iocb->ki_pos),0);
+}
+
+/** \brief Changes the position in a regular file, the size of the file is the size of its incarnation.
+ * \param[in] file The regular file.
+ * \param[in] offset The new offset.
+ * \param[in] whence How `offset` must be interpreted.
+ * \returns The new position or an error code.
+ */
+loff_t sessionfs_llseek(struct file* file, loff_t offset, int whence){
+	struct incarnation* incarnation=file->private_data;
+	return generic_file_llseek_size(file,offset,whence,MAX_LFS_FILESIZE,i_size_read(file_inode(incarnation->file)));
+}
+
+/** \brief Maps the incarnation of a regular file in memory.
+ * \param[in] file The regular file.
+ * \param[in,out] vma The memory area, which will map the incarnation file.
+ * \returns 0 on success or an error code (`-ENODEV` if the incarnation file can't be mapped).
+ *
+ * The memory area takes a reference on the incarnation file in place of the regular file, like the files of overlayfs,
+ * so the pages and faults are handled by the lower filesystem.
+ */
+int sessionfs_mmap(struct file* file, struct vm_area_struct* vma){
+	struct incarnation* incarnation=file->private_data;
+	int res=0;
+	if(!incarnation->file->f_op->mmap){
+		return -ENODEV;
+	}
+	vma->vm_file=get_file(incarnation->file);
+	res=call_mmap(vma->vm_file,vma);
+	if(res<0){
+		//the memory area keeps the regular file
+		vma->vm_file=file;
+		fput(incarnation->file);
+	} else {
+		fput(file);
+	}
+	return res;
+}
+
+/** \brief Flushes the incarnation of a regular file to the disk.
+ * \param[in] file The regular file.
+ * \param[in] start The start of the range to flush.
+ * \param[in] end The end of the range to flush.
+ * \param[in] datasync If set only the data is flushed.
+ * \returns 0 on success or an error code.
+ */
+int sessionfs_fsync(struct file* file, loff_t start, loff_t end, int datasync){
+	struct incarnation* incarnation=file->private_data;
+	return vfs_fsync_range(incarnation->file,start,end,datasync);
+}
+
+/** \brief Closes the session of a regular file, using `close_session_file()`.
+ * \param[in] inode The inode of the file.
+ * \param[in] file The regular file.
+ * \returns 0.
+ */
+int sessionfs_release(struct inode* inode, struct file* file){
+	close_session_file(file->private_data);
+	return 0;
+}
+
+///Operations on the regular files.
+const struct file_operations sessionfs_file_fops={
+	.owner=THIS_MODULE,
+	.open=sessionfs_open,
+	.read_iter=sessionfs_read_iter,
+	.write_iter=sessionfs_write_iter,
+	.llseek=sessionfs_llseek,
+	.mmap=sessionfs_mmap,
+	.fsync=sessionfs_fsync,
+	.release=sessionfs_release,
+};
+
+/** \brief Creates an inode of the stacked filesystem from an inode of the lower filesystem.
+ * \param[in] sb The superblock of the stacked filesystem.
+ * \param[in] lower The inode of the lower filesystem.
+ * \returns The new inode or an error code.
+ *
+ * The new inode holds a reference on the lower inode, which is released by `sessionfs_evict_inode()`.
+ */
+struct inode* sessionfs_iget(struct super_block* sb, struct inode* lower){
+	struct inode* inode=NULL;
+	inode=new_inode(sb);
+	if(!inode){
+		return ERR_PTR(-ENOMEM);
+	}
+	inode->i_private=igrab(lower);
+	if(inode->i_private==NULL){
+		iput(inode);
+		return ERR_PTR(-ESTALE);
+	}
+	inode->i_ino=lower->i_ino;
+	fsstack_copy_attr_all(inode,lower);
+	fsstack_copy_inode_size(inode,lower);
+	if(S_ISDIR(lower->i_mode)){
+		inode->i_op=&sessionfs_dir_iops;
+		inode->i_fop=&sessionfs_dir_fops;
+	} else if(S_ISREG(lower->i_mode)){
+		inode->i_op=&sessionfs_file_iops;
+		inode->i_fop=&sessionfs_file_fops;
+	} else if(S_ISLNK(lower->i_mode)){
+		inode->i_op=&sessionfs_link_iops;
+	} else {
+		init_special_inode(inode,lower->i_mode,lower->i_rdev);
+	}
+	return inode;
+}
+
+/** \brief Releases an inode of the stacked filesystem and the reference on its lower inode.
+ * \param[in] inode The inode to be released.
+ */
+void sessionfs_evict_inode(struct inode* inode){
+	truncate_inode_pages_final(&(inode->i_data));
+	clear_inode(inode);
+	iput(LOWER_INODE(inode));
+}
+
+/** \brief Gets the statistics of the lower filesystem.
+ * \param[in] dentry A dentry of the stacked filesystem.
+ * \param[out] buf The statistics of the filesystem.
+ * \returns 0 on success or an error code.
+ */
+int sessionfs_statfs(struct dentry* dentry, struct kstatfs* buf){
+	int res=0;
+	res=vfs_statfs(LOWER_PATH(dentry),buf);
+	buf->f_type=SESSIONFS_MAGIC;
+	return res;
+}
+
+///Operations on the superblock of the stacked filesystem.
+const struct super_operations sessionfs_sops={
+	.statfs=sessionfs_statfs,
+	.evict_inode=sessionfs_evict_inode,
+	.drop_inode=generic_delete_inode,
+};
+
+/** \brief Fills the superblock of the stacked filesystem.
+ * \param[in,out] sb The superblock.
+ * \param[in] data The lower directory, as a struct path.
+ * \param[in] silent unused, but necessary to be used with `mount_nodev()`.
+ * \returns 0 on success or an error code.
+ */
+int sessionfs_fill_super(struct super_block* sb, void* data, int silent){
+	struct path* lower=data;
+	struct sessionfs_dentry* info=NULL;
+	struct inode* inode=NULL;
+	sb->s_stack_depth=lower->dentry->d_sb->s_stack_depth+1;
+	if(sb->s_stack_depth>FILESYSTEM_MAX_STACK_DEPTH){
+		pr_warn("maximum stacking depth exceeded\n");
+		return -EINVAL;
+	}
+	sb->s_magic=SESSIONFS_MAGIC;
+	sb->s_op=&sessionfs_sops;
+	sb->s_d_op=&sessionfs_dops;
+	sb->s_maxbytes=MAX_LFS_FILESIZE;
+	sb->s_time_gran=1;
+	info=kzalloc(sizeof(struct sessionfs_dentry),GFP_KERNEL);
+	if(!info){
+		return -ENOMEM;
+	}
+	inode=sessionfs_iget(sb,d_inode(lower->dentry));
+	if(IS_ERR(inode)){
+		kfree(info);
+		return PTR_ERR(inode);
+	}
+	sb->s_root=d_make_root(inode);
+	if(!sb->s_root){
+		kfree(info);
+		return -ENOMEM;
+	}
+	path_get(lower);
+	info->lower=*lower;
+	sb->s_root->d_fsdata=info;
+	return 0;
+}
+
+/** \brief Mounts the stacked filesystem.
+ * \param[in] fs_type The stacked filesystem type.
+ * \param[in] flags The mount flags.
+ * \param[in] dev_name The path of the lower directory.
+ * \param[in] data unused, the filesystem has no mount options.
+ * \returns The root dentry or an error code.
+ */
+struct dentry* sessionfs_mount(struct file_system_type* fs_type, int flags, const char* dev_name, void* data){
+	struct path lower;
+	struct dentry* root=NULL;
+	int res=0;
+	if(dev_name==NULL){
+		return ERR_PTR(-EINVAL);
+	}
+	res=kern_path(dev_name,LOOKUP_FOLLOW | LOOKUP_DIRECTORY,&lower);
+	if(res<0){
+		return ERR_PTR(res);
+	}
+	pr_debug("mounting over %s\n",dev_name);
+	root=mount_nodev(fs_type,flags,&lower,sessionfs_fill_super);
+	path_put(&lower);
+	return root;
+}
+
+///The stacked filesystem type.
+struct file_system_type sessionfs_type={
+	.owner=THIS_MODULE,
+	.name=SESSIONFS_NAME,
+	.mount=sessionfs_mount,
+	.kill_sb=kill_anon_super,
+};
+
+int init_stacked_fs(void){
+	int res;
+	res=register_filesystem(&sessionfs_type);
+	if(res<0){
+		pr_alert("failed to register the filesystem\n");
+		return res;
+	}
+	pr_info("filesystem %s registered\n",SESSIONFS_NAME);
+	return 0;
+}
+
+void release_stacked_fs(void){
+	unregister_filesystem(&sessionfs_type);
+}
@@ -0,0 +1,25 @@
+/** \file
+ * \brief APIs of the stackable filesystem, component of the _Stacked Filesystem_ submodule.
+ *
+ * The filesystem is mounted over a directory, (e.g. `mount -t sessionfs /mnt/dir-A /mnt/sess-A`) and every regular file
+ * opened through the mount point is opened with the session semantic, without the need of the shared library.
+ */
+#ifndef SESSIONFS_MOUNT_H
+#define SESSIONFS_MOUNT_H
+
+///The name of the filesystem type, used in `mount -t`.
+#define SESSIONFS_NAME "sessionfs"
+
+///The magic number of the filesystem, returned by `statfs`.
+#define SESSIONFS_MAGIC 0x5e55f5
+
+/** \brief Registers the stackable filesystem.
+ * \returns 0 on success or an error code.
+ */
+int init_stacked_fs(void);
+
+/** \brief Unregisters the stackable filesystem.
+ */
+void release_stacked_fs(void);
+
+#endif
@@ -0,0 +1,57 @@
+/** \file
+ * \brief Format of the binary trace of the session operations, shared by the module and the replay tools, component of the _Session Statistics_ submodule.
+ *
+ * When recording is enabled, by writing 1 in the `record` file of the statistics directory in debugfs, each session
+ * open and close appends a `::sess_record` to a relay channel, whose per-CPU buffers are the `record[cpu]` files of the
+ * same directory. A trace is captured by concatenating them, e.g. `cat /sys/kernel/debug/sessionfs/record[0-9]* > trace.bin`;
+ * the records are not ordered across CPUs, so readers sort them by `ts_ns`.
+ *
+ * The pathnames are anonymized with a keyed hash, whose key is chosen randomly when the channel is created: the same
+ * file has the same `file_id` in the whole trace, but the pathname can't be recovered.
+ */
+#ifndef SESSIONFS_RECORD_H
+#define SESSIONFS_RECORD_H
+
+#include <linux/types.h>
+
+///The version of the record format, stored in each record.
+#define RECORD_VERSION 1
+
+///A session has been opened: `size` is the size of the original file and `bytes` the bytes copied in the incarnation.
+#define RECORD_OPEN 1
+
+///A session has been closed: `size` is the size of the incarnation and `bytes` the bytes committed over the original file.
+#define RECORD_CLOSE 2
+
+/**
+ * \struct sess_record
+ * \brief A recorded session operation, 64 bytes long so that it never crosses the sub-buffers of the relay channel.
+ * \param ts_ns The start of the operation, from the monotonic clock, in nanoseconds.
+ * \param file_id The hash of the pathname of the original file.
+ * \param inc_id The hash of the pathname of the incarnation file, which matches a close with its open.
+ * \param size The size of the original file (open) or of the incarnation (close), the difference between the two is the data written by the process.
+ * \param bytes The bytes copied by the operation.
+ * \param latency_ns The duration of the operation, in nanoseconds.
+ * \param pid The process that owns the incarnation.
+ * \param res The status of the new incarnation (open) or the result of the commit (close), a negative error code on failure.
+ * \param op `::RECORD_OPEN` or `::RECORD_CLOSE`.
+ * \param version `::RECORD_VERSION`.
+ * \param flags The `commit_mode` of the session in the low byte and its `copy_engine` in the high byte.
+ * \param reserved Zero.
+ */
+struct sess_record{
+	__u64 ts_ns;
+	__u64 file_id;
+	__u64 inc_id;
+	__u64 size;
+	__u64 bytes;
+	__u64 latency_ns;
+	__u32 pid;
+	__s32 res;
+	__u8 op;
+	__u8 version;
+	__u16 flags;
+	__u32 reserved;
+};
+
+#endif
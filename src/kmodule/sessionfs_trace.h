@@ -0,0 +1,161 @@
+/** \file
+ * \brief Tracepoints of the SessionFS module.
+ *
+ * The events are registered under the `sessionfs` trace system and can be enabled with ftrace
+ * (e.g. `echo 1 > /sys/kernel/tracing/events/sessionfs/enable`) or recorded with `perf record -e 'sessionfs:*'`.
+ * When an event is disabled its tracepoint is a static branch, so no formatting is done on the hot paths.
+ *
+ * The tracepoints are defined in session_manager.c, where `CREATE_TRACE_POINTS` is set.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM sessionfs
+
+#if !defined(SESSIONFS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define SESSIONFS_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/fs.h>
+
+/** \brief A session has been opened, `status` is the status of the new incarnation or an error code.
+ */
+TRACE_EVENT(sessionfs_session_open,
+	TP_PROTO(const char* pathname, int flags, pid_t pid, int fd, int status),
+	TP_ARGS(pathname, flags, pid, fd, status),
+	TP_STRUCT__entry(
+		__string(pathname, pathname)
+		__field(int, flags)
+		__field(pid_t, pid)
+		__field(int, fd)
+		__field(int, status)
+	),
+	TP_fast_assign(
+		__assign_str(pathname, pathname);
+		__entry->flags=flags;
+		__entry->pid=pid;
+		__entry->fd=fd;
+		__entry->status=status;
+	),
+	TP_printk("pathname=%s flags=0x%x pid=%d fd=%d status=%d",__get_str(pathname),__entry->flags,__entry->pid,
+		__entry->fd,__entry->status)
+);
+
+/** \brief A new incarnation file has been created for a session.
+ */
+TRACE_EVENT(sessionfs_incarnation_create,
+	TP_PROTO(const char* pathname, const char* incarnation, pid_t pid, int fd),
+	TP_ARGS(pathname, incarnation, pid, fd),
+	TP_STRUCT__entry(
+		__string(pathname, pathname)
+		__string(incarnation, incarnation)
+		__field(pid_t, pid)
+		__field(int, fd)
+	),
+	TP_fast_assign(
+		__assign_str(pathname, pathname);
+		__assign_str(incarnation, incarnation);
+		__entry->pid=pid;
+		__entry->fd=fd;
+	),
+	TP_printk("pathname=%s incarnation=%s pid=%d fd=%d",__get_str(pathname),__get_str(incarnation),__entry->pid,
+		__entry->fd)
+);
+
+/** \brief The copy of a file over another one has started.
+ */
+TRACE_EVENT(sessionfs_copy_start,
+	TP_PROTO(struct file* src, struct file* dst),
+	TP_ARGS(src, dst),
+	TP_STRUCT__entry(
+		__field(unsigned long, src_ino)
+		__field(unsigned long, dst_ino)
+		__field(loff_t, size)
+	),
+	TP_fast_assign(
+		__entry->src_ino=file_inode(src)->i_ino;
+		__entry->dst_ino=file_inode(dst)->i_ino;
+		__entry->size=i_size_read(file_inode(src));
+	),
+	TP_printk("src_ino=%lu dst_ino=%lu size=%lld",__entry->src_ino,__entry->dst_ino,__entry->size)
+);
+
+/** \brief The copy of a file over another one has ended, `res` is 0 or an error code.
+ */
+TRACE_EVENT(sessionfs_copy_end,
+	TP_PROTO(struct file* src, struct file* dst, loff_t copied, int res),
+	TP_ARGS(src, dst, copied, res),
+	TP_STRUCT__entry(
+		__field(unsigned long, src_ino)
+		__field(unsigned long, dst_ino)
+		__field(loff_t, copied)
+		__field(int, res)
+	),
+	TP_fast_assign(
+		__entry->src_ino=file_inode(src)->i_ino;
+		__entry->dst_ino=file_inode(dst)->i_ino;
+		__entry->copied=copied;
+		__entry->res=res;
+	),
+	TP_printk("src_ino=%lu dst_ino=%lu copied=%lld res=%d",__entry->src_ino,__entry->dst_ino,__entry->copied,
+		__entry->res)
+);
+
+/** \brief An incarnation has been closed, `overwrite` tells if its content had to be copied over the original file.
+ */
+TRACE_EVENT(sessionfs_commit,
+	TP_PROTO(const char* pathname, const char* incarnation, int overwrite, int res),
+	TP_ARGS(pathname, incarnation, overwrite, res),
+	TP_STRUCT__entry(
+		__string(pathname, pathname)
+		__string(incarnation, incarnation)
+		__field(int, overwrite)
+		__field(int, res)
+	),
+	TP_fast_assign(
+		__assign_str(pathname, pathname);
+		__assign_str(incarnation, incarnation);
+		__entry->overwrite=overwrite;
+		__entry->res=res;
+	),
+	TP_printk("pathname=%s incarnation=%s overwrite=%d res=%d",__get_str(pathname),__get_str(incarnation),
+		__entry->overwrite,__entry->res)
+);
+
+/** \brief No valid session has been found for a pathname.
+ */
+TRACE_EVENT(sessionfs_lookup_miss,
+	TP_PROTO(const char* pathname),
+	TP_ARGS(pathname),
+	TP_STRUCT__entry(
+		__string(pathname, pathname)
+	),
+	TP_fast_assign(
+		__assign_str(pathname, pathname);
+	),
+	TP_printk("pathname=%s",__get_str(pathname))
+);
+
+/** \brief An incarnation owned by a dead process has been reaped.
+ */
+TRACE_EVENT(sessionfs_reap,
+	TP_PROTO(const char* pathname, const char* incarnation, pid_t pid),
+	TP_ARGS(pathname, incarnation, pid),
+	TP_STRUCT__entry(
+		__string(pathname, pathname)
+		__string(incarnation, incarnation)
+		__field(pid_t, pid)
+	),
+	TP_fast_assign(
+		__assign_str(pathname, pathname);
+		__assign_str(incarnation, incarnation);
+		__entry->pid=pid;
+	),
+	TP_printk("pathname=%s incarnation=%s pid=%d",__get_str(pathname),__get_str(incarnation),__entry->pid)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE sessionfs_trace
+#include <trace/define_trace.h>
@@ -2,6 +2,12 @@
  * \brief Implementation of the userspace shared library.
  *
  * Used to provide a trasparent interface to the userspace application, that can use the libc open and close functions, along with the ::O_SESS flag to work with sessions. To change session path instead, it can use the get_sess_path() and write_sess_path() utility functions, to avoid the  direct communication with the `SessionFS_dev` device.
+ *
+ * The wrapped functions are `open`, `open64`, `openat`, `openat64`, `fopen` and `fopen64` (where sessions are enabled by
+ * the `S` character in the mode string), along with `chdir` and `fchdir`, to keep track of the current working directory.
+ * `close`, `fclose`, `dup` and `dup2` are not wrapped, since sessions are committed by the kernel module when the last
+ * reference to the incarnation file is released, while `creat` can't receive the ::O_SESS flag.
+ * Each wrapper calls libc directly when the ::O_SESS flag is not present.
 */
 
 /// Enables RTLD_NEXT macro.
@@ -19,356 +25,531 @@
 #include <stdarg.h>
 
 #include "libsessionfs.h"
+#include "libsessionfs_log.h"
 
 ///The path of our device file
 #define DEV_PATH "/dev/SessionFS_dev"
 
-///A typedef that aliases the function pointer to the libc `open`.
-typedef int (*orig_open_type)(const char* pathname, int flags);
+///The character that enables the session semantic in the `fopen()` mode string.
+#define FOPEN_SESS 'S'
+
+///Tells the compiler that `x` is almost always true, used on the paths that don't involve sessions.
+#define likely(x) __builtin_expect(!!(x),1)
+
+///Tells the compiler that `x` is almost always false, used on the paths that involve sessions.
+#define unlikely(x) __builtin_expect(!!(x),0)
+
+///Checks if the ::O_SESS flag is present in `flags`.
+#define IS_SESS_OPEN(flags) (((flags) & O_SESS)==O_SESS)
 
-///A typedef to aliases the function pointer to the libc `close`.
-typedef int (*orig_close_type)(int filedes);
+///Checks if the open family functions have the optional `mode` argument, as done by libc.
+#define OPEN_NEEDS_MODE(flags) (((flags) & O_CREAT) || ((flags) & O_TMPFILE)==O_TMPFILE)
+
+/** \struct libc_functions
+ * \brief The libc functions wrapped by the library.
+ * \param open libc `open`.
+ * \param open64 libc `open64`.
+ * \param openat libc `openat`.
+ * \param openat64 libc `openat64`.
+ * \param fopen libc `fopen`.
+ * \param fopen64 libc `fopen64`.
+ * \param close libc `close`, used to close the char device.
+ * \param chdir libc `chdir`.
+ * \param fchdir libc `fchdir`.
+ *
+ * The table is filled once by `init_method()`, so each wrapper only needs an indirect call to reach libc.
+ */
+struct libc_functions{
+	int (*open)(const char* pathname, int flags, ...);
+	int (*open64)(const char* pathname, int flags, ...);
+	int (*openat)(int dirfd, const char* pathname, int flags, ...);
+	int (*openat64)(int dirfd, const char* pathname, int flags, ...);
+	FILE* (*fopen)(const char* pathname, const char* mode);
+	FILE* (*fopen64)(const char* pathname, const char* mode);
+	int (*close)(int filedes);
+	int (*chdir)(const char* path);
+	int (*fchdir)(int filedes);
+};
 
-/// Global variable that holds the function pointer for libc `open`
-orig_open_type orig_open;
-/// Global variable that holds the function pointer for libc `close`
-orig_close_type orig_close;
+/// Global variable that holds the function pointers of the wrapped libc functions.
+struct libc_functions libc;
 
-/** \brief A program constructor which saves the original value for the `open` and `close` symbols.
+///Generation of the current working directory of the process, incremented each time `chdir()` or `fchdir()` succeed.
+unsigned long cwd_generation=1;
+
+///Per-thread cache of the current working directory, used to make relative pathnames absolute.
+__thread char cwd_cache[PATH_MAX];
+
+///Length of the string in `::cwd_cache`.
+__thread size_t cwd_len=0;
+
+///Value of `::cwd_generation` when `::cwd_cache` was filled, `::cwd_cache` is valid only if it matches `::cwd_generation`.
+__thread unsigned long cwd_cache_generation=0;
+
+/** \brief A program constructor which fills the `::libc` table with the original libc functions.
 * \return 0 on success or -1 on error, setting `errno`.
 *
-* We save the original open and close since the library needs to understand when it's necessary to use the char device
-* and when the libc implementation must be used.
-* To do so we save them we use the `dlsym` function and we define two new types to avoid using a function pointer directly: `::orig_open_type` and `::orig_close_type`, these are simple typedefs that wrap the function poitner for libc `open` and `close`.
+* We save the original functions since the library needs to understand when it's necessary to use the char device
+* and when the libc implementation must be used, the original close is used to close the char device.
+* The original `chdir` and `fchdir` are wrapped to invalidate `::cwd_cache`.
+* To do so we use the `dlsym` function on each entry of the `::libc_functions` table.
+*
+* The wrappers call this function if they are called before the constructor, e.g. by the constructor of another library.
 */
 static __attribute__((constructor)) int init_method(void){
-	orig_open = (orig_open_type) dlsym(RTLD_NEXT, "open");
-	if(orig_open==NULL){
-		printf("%d libsessionfs error: can't load libc open: %s\n",getpid(),dlerror());
-		errno=ENODATA;
-		return -1;
-	}
-	orig_close = (orig_close_type) dlsym(RTLD_NEXT,"close");
-	if(orig_open==NULL){
-		printf("%d libsessionfs: error: can't load libc close: %s\n",getpid(),dlerror());
-		errno=ENODATA;
-		return -1;
+	unsigned int i;
+	struct {
+		const char* name;
+		void** function;
+	} symbols[]={
+		{"open",(void**)&(libc.open)},
+		{"open64",(void**)&(libc.open64)},
+		{"openat",(void**)&(libc.openat)},
+		{"openat64",(void**)&(libc.openat64)},
+		{"fopen",(void**)&(libc.fopen)},
+		{"fopen64",(void**)&(libc.fopen64)},
+		{"close",(void**)&(libc.close)},
+		{"chdir",(void**)&(libc.chdir)},
+		{"fchdir",(void**)&(libc.fchdir)},
+	};
+	sessfs_log_init();
+	for(i=0;i<sizeof(symbols)/sizeof(symbols[0]);i++){
+		*(symbols[i].function)=dlsym(RTLD_NEXT,symbols[i].name);
+		if(*(symbols[i].function)==NULL){
+			sessfs_log(LOG_ERROR,"can't load libc %s: %s\n",symbols[i].name,dlerror());
+			errno=ENODATA;
+			return -1;
+		}
 	}
 	return 0;
 }
 
 /**
- * \brief Wraps the close determining if it must call the libc `close` or the SessionFS module.
- * \param[in] fd file descriptor to deallocate, same as libc `open`'s `fildes`.
- * \returns 0 on success, -1 on error, setting `errno` to indicate the error value.
- *
- * To determine if libc close must be used, the file pathname is read from `/proc/self/fd`, then `readlink` is used to resolve
- * the pathname and make it absolute, finally, if this pathname contains the `_incarnation_[pid]_` substring then it must be closed
- * by issuing an ioctl with number `::IOCTL_SEQ_CLOSE` to the `SessionFS_dev` device.
- * Otherwise the libc `close` is called.
- * A ::sess_params struct is used to pass parameters to the char device when necessary. After the device completes its operations
- * libc `close` is called to remove the file descriptor and `remove` is called to delete the incarnation file from the disk.
- * If the return value from the ioctl is `-ENODEV` the the device was temporarly disabled and the operation must be retried.
- *
+ * \brief Wraps the libc `chdir`, invalidating the cached current working directory on success.
+ * \param[in] path The new working directory.
+ * \returns 0 on success or -1 on error, setting `errno`.
  */
-int close(int fd){
+int chdir(const char* path){
 	int res;
-	//we prepare a sess_params struct to remove the incarnation
-	struct sess_params* params=malloc(sizeof(struct sess_params));
-	memset(params,0,sizeof(struct sess_params));
-	if(params==NULL){
-		errno=ENOMEM;
-		return -1;
+	if(unlikely(libc.chdir==NULL)){
+		init_method();
 	}
-	char* inc_path=malloc(sizeof(char)*PATH_MAX);
-	memset(inc_path,0,sizeof(char)*PATH_MAX);
-	if(inc_path==NULL){
-		free(params);
-		errno = ENOMEM;
-		return -1;
+	res=libc.chdir(path);
+	if(res==0){
+		__atomic_add_fetch(&cwd_generation,1,__ATOMIC_RELEASE);
 	}
-	char *tmp_path=malloc(sizeof(char)*PATH_MAX);
-	memset(tmp_path,0,sizeof(char)*PATH_MAX);
-	if(tmp_path==NULL){
-		free(params);
-		free(inc_path);
-		errno = ENOMEM;
-		return -1;
+	return res;
+}
+
+/**
+ * \brief Wraps the libc `fchdir`, invalidating the cached current working directory on success.
+ * \param[in] fd The file descriptor of the new working directory.
+ * \returns 0 on success or -1 on error, setting `errno`.
+ */
+int fchdir(int fd){
+	int res;
+	if(unlikely(libc.fchdir==NULL)){
+		init_method();
 	}
-	//we read the incarnation path from the file table
-	res=snprintf(tmp_path,sizeof(char)*PATH_MAX,"/proc/self/fd/%d",fd);
-	if(res < 0){
-		free(params);
-		free(inc_path);
-		free(tmp_path);
-		return res;
+	res=libc.fchdir(fd);
+	if(res==0){
+		__atomic_add_fetch(&cwd_generation,1,__ATOMIC_RELEASE);
 	}
-	res=readlink(tmp_path,inc_path,sizeof(char)*PATH_MAX);
-	if(res<0){
-		free(tmp_path);
-		free(params);
-		free(inc_path);
-		return res;
+	return res;
+}
+
+/** \brief Gets the current working directory, from `::cwd_cache` if it is still valid.
+ * \returns The current working directory or `NULL`, setting `errno`.
+ *
+ * `getcwd()` is called only if `::cwd_cache` has been filled before the last `chdir()` or `fchdir()`.
+ */
+const char* get_cwd(void){
+	unsigned long generation=__atomic_load_n(&cwd_generation,__ATOMIC_ACQUIRE);
+	if(cwd_cache_generation!=generation){
+		if(getcwd(cwd_cache,PATH_MAX)==NULL){
+			return NULL;
+		}
+		cwd_len=strlen(cwd_cache);
+		cwd_cache_generation=generation;
 	}
-	printf("%d libsessionfs: path to the file that must be closed: %s\n",getpid(),inc_path);
-	//we trasform the path to the incarnation to the path to the session
-	char *inc_text=NULL,*sess_path=NULL;
-	sess_path=malloc(sizeof(char)*PATH_MAX);
-	if(sess_path==NULL){
-		free(tmp_path);
-		free(params);
-		free(inc_path);
-		errno=ENOMEM;
+	return cwd_cache;
+}
+
+/** \brief Converts a pathname to an absolute pathname without `.` components and duplicated slashes.
+ * \param[in] base The absolute pathname of the directory used to resolve relative pathnames, or `NULL` to use the current working directory.
+ * \param[in] pathname The pathname to convert.
+ * \param[out] buf The buffer that will contain the absolute pathname.
+ * \param[in] buflen The length of `buf`.
+ * \returns The length of the absolute pathname or -1 on error, setting `errno`.
+ *
+ * The conversion is purely lexical, so no system call is made, apart from `getcwd()` when `::cwd_cache` is not valid.
+ * Relative pathnames are resolved against `base`.
+ * The `..` components are kept, since the component before them can be a symbolic link, so that `link/..` is not the
+ * directory that contains `link`: the kernel module resolves them, along with the symbolic links, when it looks the
+ * pathname up.
+ */
+int canonicalize_path(const char* base, const char* pathname, char* buf, size_t buflen){
+	const char *it=pathname, *comp=NULL;
+	size_t len=0, comp_len=0;
+	if(buflen<2){
+		errno=ENAMETOOLONG;
 		return -1;
 	}
-	memcpy(sess_path,inc_path,sizeof(char)*PATH_MAX);
-	res=snprintf(tmp_path,sizeof(char)*PATH_MAX,"_incarnation_%d_",getpid());
-	if(res < 0){
-		free(params);
-		free(inc_path);
-		free(tmp_path);
-		free(sess_path);
-		return res;
-	}
-	//we search for '_incarnation_[pid]_' in the file path, to understand if is an incarnation to be closed
-	inc_text=strstr(sess_path,tmp_path);
-	free(tmp_path);
-	if(inc_text==NULL){
-		//the file that we need to close is not an incarnation, so we call libc's close
-		printf("%d libsessionfs: file descriptor is not a session incarnation, using libc close\n",getpid());
-		free(params);
-		free(inc_path);
-		free(sess_path);
-		return orig_close(fd);
+	if(pathname[0]!='/'){
+		if(base==NULL){
+			base=get_cwd();
+			if(base==NULL){
+				return -1;
+			}
+			len=cwd_len;
+		} else {
+			len=strlen(base);
+		}
+		if(len+1>buflen){
+			errno=ENAMETOOLONG;
+			return -1;
+		}
+		memcpy(buf,base,len);
 	} else {
-		printf("%d libsessionfs: detected a session incarnation, adjusting path to match original file\n",getpid());
-		//we remove the '_incarnation_...' to obtain the original file path
-		memset(inc_text,0,strlen(inc_text));
-		printf("%d libsessionfs: original file path: %s\n",getpid(),sess_path);
-	}
-	params->orig_path=sess_path;
-	params->filedes=fd;
-	params->pid=getpid();
+		buf[0]='/';
+		len=1;
+	}
+	while(*it!='\0'){
+		//we skip duplicated slashes
+		while(*it=='/'){
+			it++;
+		}
+		if(*it=='\0'){
+			break;
+		}
+		comp=it;
+		while(*it!='\0' && *it!='/'){
+			it++;
+		}
+		comp_len=it-comp;
+		if(comp_len==1 && comp[0]=='.'){
+			continue;
+		}
+		if(len+comp_len+2>buflen){
+			errno=ENAMETOOLONG;
+			return -1;
+		}
+		if(len>1){
+			buf[len++]='/';
+		}
+		memcpy(buf+len,comp,comp_len);
+		len+=comp_len;
+	}
+	buf[len]='\0';
+	return len;
+}
+
+/**
+ * \brief Opens a file with the session semantic, if it is contained in a session path.
+ * \param[in] dirfd The directory used to resolve a relative `pathname`, or `AT_FDCWD`.
+ * \param[in] pathname The pathname of the file to be opened.
+ * \param[in] flags The flags given to the wrapped function, which contain the ::O_SESS flag.
+ * \param[in] mode The permissions to apply if the file is created, or -1.
+ * \returns It will return a file descriptor if the operation is successful, or -1, setting `errno`.
+ *
+ * The pathname is converted to an absolute pathname with `canonicalize_path()`, without system calls, then the
+ * function performs an ioctl call to the SessionFS kernel module, via the `SessionFS_dev` device, to open a new session for it.
+ * The kernel module resolves the symbolic links and the `..` components in the same lookup, and opens the session on the
+ * resolved pathname, so the pathnames of a file share its session.
+ * Relative pathnames are resolved against `dirfd`, whose path is read from `/proc/self/fd`, when it is not `AT_FDCWD`.
+ *
+ * The kernel module decides if the file is contained in a session path, walking its ancestors with `find_sess_root()`, so
+ * the cost does not depend on the number of session paths and the library does not read them.
+ * If the file is not in a session path the `valid` member of `::sess_params` is `::OUTSIDE_ROOTS`, and the function calls
+ * the libc implementation of `openat`, without the ::O_SESS flag.
+ *
+ * To perform the ioctl the `::IOCTL_SEQ_OPEN` number is used and struct `::sess_params` is filled and passed as an argument, to provide all the necessary informations to the device.
+ *
+ * If the opened session is not valid, the function will close the incarnation file descriptor, which removes the invalid session in a clean way, and the function will fail with `EAGAIN`.
+ */
+int open_session(int dirfd, const char* pathname, int flags, mode_t mode){
+	char file_path[PATH_MAX], dir_path[PATH_MAX], proc_path[32];
+	const char* base=NULL;
+	int res=0, dev;
+	ssize_t dir_len=0;
+	struct sess_params params;
+	//relative pathnames are resolved against dirfd
+	if(pathname[0]!='/' && dirfd!=AT_FDCWD){
+		snprintf(proc_path,sizeof(proc_path),"/proc/self/fd/%d",dirfd);
+		dir_len=readlink(proc_path,dir_path,PATH_MAX-1);
+		if(dir_len<0){
+			errno=EBADF;
+			return -1;
+		}
+		dir_path[dir_len]='\0';
+		base=dir_path;
+	}
+	//we convert (if necessary) the give pathname to an absolute pathname
+	if(canonicalize_path(base,pathname,file_path,PATH_MAX)<0){
+		sessfs_log(LOG_ERROR,"path conversion failed\n");
+		return -1;
+	}
+	sessfs_log(LOG_DEBUG,"pathname: %s, absolute pathname: %s\n",pathname,file_path);
+	sessfs_log(LOG_DEBUG,"detected O_SESS flag\n");
 	//we open the device
-	int dev;
-	printf("%d libsessionfs: opening char device\n",getpid());
-	dev=orig_open(DEV_PATH,O_WRONLY);
+	dev=libc.open(DEV_PATH,O_WRONLY);
 	if(dev<0){
-		free(sess_path);
-		free(params);
-		free(inc_path);
-		return dev;
+		return -1;
 	}
-	printf("%d libsessionfs: calling kernel module to remove the session\n",getpid());
-	//we remove the incarnation
-	//we retry if we receive ENODEV, since the module will notice that there is a valid session to be closed
-	res=-ENODEV;
-	res=ioctl(dev,IOCTL_SEQ_CLOSE,params);
-	free(sess_path);
+	//we prepare an instance of the sess_params struct
+	memset(&params,0,sizeof(struct sess_params));
+	params.orig_path=file_path;
+	params.flags=flags;
+	params.mode=mode;
+	params.pid=getpid();
+	params.filedes=-1;
+	sessfs_log(LOG_DEBUG,"calling kernel module to create a new incarnation\n");
+	res=ioctl(dev,IOCTL_SEQ_OPEN,&params);
 	if(res<0){
-		orig_close(dev);
-		if(res==-ENODEV){
-			printf("%d libsessionfs: error: device disabled, retry closing\n",getpid());
-			errno=ENODEV;
-			return -1;
+		res=errno;
+		sessfs_log(LOG_ERROR,"can't create the session, trying to close the invalid session\n");
+		libc.close(dev);
+		if(params.filedes>=0){
+			libc.close(params.filedes);
 		}
-		printf("%d libsessionfs: error during session close\n",getpid());
-		free(inc_path);
-		free(params);
-		errno=-res;
+		errno=res;
 		return -1;
 	}
-	res=orig_close(dev);
+	res=libc.close(dev);
 	if(res<0){
-		printf("%d libsessionfs: error using libc's close to close the device\n",getpid());
+		sessfs_log(LOG_ERROR,"can't close the device with libc's close\n");
 		return res;
 	}
-	printf("%d libsessionfs: calling libc close to remove the file descriptor\n",getpid());
-	//we call libc close
-	res=orig_close(fd);
-	if(res<0){
-		free(inc_path);
-		free(params);
-		return res;
+	//the kernel module has found no session path that contains the file
+	if(params.valid==OUTSIDE_ROOTS){
+		sessfs_log(LOG_DEBUG,"file not in the session path, calling libc open\n");
+		//we flip the O_SESS flag just to be sure we aren't giving an unexpected flag to libc open.
+		return libc.openat(dirfd,pathname,flags & ~O_SESS,mode);
 	}
-	printf("%d libsessionfs: removing the incarnation file\n",getpid());
-	res=remove(inc_path);
-	if(res<0){
-		printf("%d libsessionfs: error during the elimination of the incarnation file\n",getpid());
-		return res;
+	//we check if the created session is valid
+	if(params.valid != VALID_SESS){
+		sessfs_log(LOG_ERROR,"session invalid: closing\n");
+		//the kernel module removes the invalid incarnation when its file is released
+		libc.close(params.filedes);
+		errno=EAGAIN;
+		return -1;
 	}
-	free(inc_path);
-	free(params);
-	return res;
+	sessfs_log(LOG_INFO,"session opened successfully, fd:%d\n",params.filedes);
+	return params.filedes;
+}
+
+/**
+ * \brief Opens a stream with the session semantic.
+ * \param[in] pathname The pathname of the file to be opened.
+ * \param[in] mode The `fopen()` mode string, which contains `::FOPEN_SESS`.
+ * \returns The opened stream, or `NULL` setting `errno`.
+ *
+ * The mode string is converted to the corresponding open flags, the file is opened with `open_session()` and the stream
+ * is created with `fdopen()`, using the mode string without `::FOPEN_SESS`.
+ */
+FILE* fopen_session(const char* pathname, const char* mode){
+	char stream_mode[8];
+	int flags=0, fd, res;
+	size_t i, j=0;
+	FILE* stream=NULL;
+	switch(mode[0]){
+		case 'r':
+			flags=O_RDONLY;
+			break;
+		case 'w':
+			flags=O_WRONLY | O_CREAT | O_TRUNC;
+			break;
+		case 'a':
+			flags=O_WRONLY | O_CREAT | O_APPEND;
+			break;
+		default:
+			errno=EINVAL;
+			return NULL;
+	}
+	for(i=0;mode[i]!='\0' && j<sizeof(stream_mode)-1;i++){
+		if(mode[i]=='+'){
+			flags=(flags & ~O_ACCMODE) | O_RDWR;
+		} else if(mode[i]=='x'){
+			flags|=O_EXCL;
+		} else if(mode[i]=='e'){
+			flags|=O_CLOEXEC;
+		}
+		if(mode[i]!=FOPEN_SESS){
+			stream_mode[j++]=mode[i];
+		}
+	}
+	stream_mode[j]='\0';
+	fd=open_session(AT_FDCWD,pathname,flags | O_SESS,0666);
+	if(fd<0){
+		return NULL;
+	}
+	stream=fdopen(fd,stream_mode);
+	if(stream==NULL){
+		res=errno;
+		libc.close(fd);
+		errno=res;
+	}
+	return stream;
 }
 
 /**
  * \brief Wraps the open determining if it must call the libc `open` or the SessionFS module.
  * \param[in] pathname The pathname of the file to be opened, same usage an type of the libc `open`'s `pathname`.
  * \param[in]  flags Flags to determine the file status flag and the access modes, same as the libc `open`'s `oflag`, however a possible flag is the ::O_SESS flag which enables the session semantic.
- * \param[in] mode An optional parameter, which defines the permissions to set if a file must be created, (when `O_CREAT` is specified).
+ * \param[in] mode An optional parameter, which defines the permissions to set if a file must be created, (when `O_CREAT` or `O_TMPFILE` are specified).
  * \returns It will return a file descriptor if the operation is successful, or -1, setting `errno`.
  *
- * This function will check for the presence of the ::O_SESS flag and if the path of the file to be opened has as a substring the session path.
- *
- * If the checks are successful, the function will perform an ioctl call to the SessionFS kernel module, via the `SessionFS_dev` device, to open a new session for the given pathname.
- * Otherwise, the function will call the libc implementation of the `open` systemcall.
- *
- * To check that the given path has `::sess_path` as a substring, `realpath()` is used, to convert the pathname to absolute.
- * If `realpath()` fails with `ENOENT`, the path provided might be the relative path to a file that must be created, so the path of the current diretory is used as the file path.
- *
- * To perform the ioctl the `::IOCTL_SEQ_OPEN` number is used and struct `::sess_params` is filled and passed as an argument, to provide all the necessary informations to the device.
- *
- * If the opened session is not valid, the function will call `close()` to remove the invalid session in a clean way and the function will fail with `EAGAIN`.
- *
+ * If the ::O_SESS flag is not present the libc `open` is called directly, otherwise the file is opened with `open_session()`.
  */
 int open(const char* pathname, int flags, ...){
-	int flag=0, res=0,dev,mode=-1;
-	char *slash="/";
+	mode_t mode=-1;
+	va_list arg;
 	//we check if mode and if it was we get it as an optional parameter
-	if(flags & O_CREAT){
-		va_list arg;
-		va_start (arg, flags);
-		mode = va_arg (arg, int);
-		va_end (arg);
-	}
-	//we get the session path from the device
-	char *sess_path=malloc(sizeof(char)*PATH_MAX), *file_path=malloc(sizeof(char)*PATH_MAX), *path=NULL;
-	if(sess_path==NULL || file_path==NULL){
-		printf("%d libsessionfs: error: not enough memory\n",getpid());
-		errno=-ENOMEM;
-		return -1;
+	if(OPEN_NEEDS_MODE(flags)){
+		va_start(arg,flags);
+		mode=va_arg(arg,mode_t);
+		va_end(arg);
 	}
-	memset(file_path,0,sizeof(char)*PATH_MAX);
-	//we convert (if necessary) the give pathname to an absolute pathname
-	if(pathname[0]!='/'){
-		printf("%d libsessionfs: converting pathname to absolute...\n",getpid());
-		path=realpath(pathname,file_path);
-		if(path==NULL){
-			//the user might want to create a file
-			if(errno==ENOENT && (flags & O_CREAT)){
-				path=realpath(".",file_path);
-				printf("%d libsessionfs: absolute path for current directory: %s\n",getpid(),file_path);
-				if(path==NULL){
-					return -1;
-				}
-				strncat(file_path,slash,strlen(slash));
-				strncat(file_path,pathname,sizeof(char)*(PATH_MAX-strlen(file_path)+1));
-			}else{
-				printf("%d libsessionfs: error: path conversion failed\n",getpid());
-				free(sess_path);
-				free(file_path);
-				return -1;
-			}
-		}
-	} else {
-		strncpy(file_path,pathname,sizeof(char)*PATH_MAX);
+	if(unlikely(libc.open==NULL)){
+		init_method();
 	}
-	printf("%d libsessionfs: pathname: %s, absolute pathname: %s\n",getpid(),pathname,file_path);
-	memset(sess_path,0,sizeof(char)*PATH_MAX);
-	printf("%d libsessionfs: reading the current session path\n",getpid());
-	res=get_sess_path(sess_path,PATH_MAX);
-	if(res<0){
-		free(file_path);
-		free(sess_path);
-		return res;
+	if(likely(!IS_SESS_OPEN(flags))){
+		return libc.open(pathname,flags,mode);
 	}
-	printf("%d libsessionfs: current session path: %s \t given pathname: %s\n",getpid(), sess_path,file_path);
-	//we check if the file is in the right path
-	path=strstr(file_path,sess_path);
-	// check for the presence of the O_SESS flag
-	flag=flags & O_SESS;
-	free(sess_path);
-	if(flag==O_SESS && path!=NULL){
-		printf("%d libsessionfs: detected O_SESS flag and correct path\n",getpid());
-		//we open the device
-		dev=orig_open(DEV_PATH,O_WRONLY);
-		if(dev<0){
-			free(file_path);
-			return dev;
-		}
-		printf("%d libsessionfs: allocating and filling a sess_params struct\n",getpid());
-		//we prepare an instance of the sess_params struct
-		struct sess_params* params=malloc(sizeof(struct sess_params));
-		memset(params,0,sizeof(struct sess_params));
-		if(params==NULL){
-			orig_close(dev);
-			errno=ENOMEM;
-			free(file_path);
-			return -1;
-		}
-		params->orig_path=file_path;
-		params->flags=flags;
-		params->mode=mode;
-		params->pid=getpid();
-		printf("%d libsessionfs: calling kernel module to create a new incarnation\n",getpid());
-		res=ioctl(dev,IOCTL_SEQ_OPEN,params);
-		if(res<0){
-			printf("%d libsessionfs: error creating the session, trying to close the invalid session\n",getpid());
-			orig_close(dev);
-			close(params->filedes);
-			free(file_path);
-			free(params);
-			errno=-res;
-			return -1;
-		}
-		res=orig_close(dev);
-		if(res<0){
-			printf("%d libsessionfs: error using libc's close to close the device\n",getpid());
-			return res;
-		}
-		//we check if the created session is valid
-		if(params->valid != VALID_SESS){
-			printf("%d libsessionfs: error: session invalid: closing\n",getpid());
-			//if is invalid we need to call our close
-			close(params->filedes);
-			errno=-EAGAIN;
-			free(file_path);
-			free(params);
-			return -1;
-		}
-		free(file_path);
-		printf("%d libsessionfs: session opened successfully, fd:%d\n",getpid(),params->filedes);
-		res=params->filedes;
-		free(params);
-		return res;
-	} else {
-		free(file_path);
-		printf("%d libsessionfs: calling libc open\n",getpid());
-		/// When creating a new file we need to call `creat` since we have the symbol only for the open with two parametrs.
-		if(flags & O_CREAT){
-			res=creat(pathname,mode);
-			if(res<0){
-				return res;
-			}
-		}
-		//we flip the O_SESS flag just to be sure we aren't giving an unexpected flag to libc open.
-		return orig_open(pathname, flags & ~O_SESS & ~O_CREAT);
+	return open_session(AT_FDCWD,pathname,flags,mode);
+}
+
+/**
+ * \brief Wraps `open64`, like `open()`.
+ * \param[in] pathname The pathname of the file to be opened.
+ * \param[in] flags The flags used to open the file, which can contain the ::O_SESS flag.
+ * \param[in] mode An optional parameter, which defines the permissions to set if a file must be created.
+ * \returns It will return a file descriptor if the operation is successful, or -1, setting `errno`.
+ */
+int open64(const char* pathname, int flags, ...){
+	mode_t mode=-1;
+	va_list arg;
+	if(OPEN_NEEDS_MODE(flags)){
+		va_start(arg,flags);
+		mode=va_arg(arg,mode_t);
+		va_end(arg);
+	}
+	if(unlikely(libc.open64==NULL)){
+		init_method();
+	}
+	if(likely(!IS_SESS_OPEN(flags))){
+		return libc.open64(pathname,flags,mode);
+	}
+	return open_session(AT_FDCWD,pathname,flags | O_LARGEFILE,mode);
+}
+
+/**
+ * \brief Wraps `openat`, like `open()`, relative pathnames are resolved against `dirfd`.
+ * \param[in] dirfd The directory used to resolve a relative `pathname`, or `AT_FDCWD`.
+ * \param[in] pathname The pathname of the file to be opened.
+ * \param[in] flags The flags used to open the file, which can contain the ::O_SESS flag.
+ * \param[in] mode An optional parameter, which defines the permissions to set if a file must be created.
+ * \returns It will return a file descriptor if the operation is successful, or -1, setting `errno`.
+ */
+int openat(int dirfd, const char* pathname, int flags, ...){
+	mode_t mode=-1;
+	va_list arg;
+	if(OPEN_NEEDS_MODE(flags)){
+		va_start(arg,flags);
+		mode=va_arg(arg,mode_t);
+		va_end(arg);
+	}
+	if(unlikely(libc.openat==NULL)){
+		init_method();
+	}
+	if(likely(!IS_SESS_OPEN(flags))){
+		return libc.openat(dirfd,pathname,flags,mode);
+	}
+	return open_session(dirfd,pathname,flags,mode);
+}
+
+/**
+ * \brief Wraps `openat64`, like `openat()`.
+ * \param[in] dirfd The directory used to resolve a relative `pathname`, or `AT_FDCWD`.
+ * \param[in] pathname The pathname of the file to be opened.
+ * \param[in] flags The flags used to open the file, which can contain the ::O_SESS flag.
+ * \param[in] mode An optional parameter, which defines the permissions to set if a file must be created.
+ * \returns It will return a file descriptor if the operation is successful, or -1, setting `errno`.
+ */
+int openat64(int dirfd, const char* pathname, int flags, ...){
+	mode_t mode=-1;
+	va_list arg;
+	if(OPEN_NEEDS_MODE(flags)){
+		va_start(arg,flags);
+		mode=va_arg(arg,mode_t);
+		va_end(arg);
+	}
+	if(unlikely(libc.openat64==NULL)){
+		init_method();
+	}
+	if(likely(!IS_SESS_OPEN(flags))){
+		return libc.openat64(dirfd,pathname,flags,mode);
+	}
+	return open_session(dirfd,pathname,flags | O_LARGEFILE,mode);
+}
+
+/**
+ * \brief Wraps `fopen`, the session semantic is enabled by adding `::FOPEN_SESS` to the mode string (e.g. `"r+S"`).
+ * \param[in] pathname The pathname of the file to be opened.
+ * \param[in] mode The mode string, same as the libc `fopen`'s `mode`.
+ * \returns The opened stream, or `NULL` setting `errno`.
+ */
+FILE* fopen(const char* pathname, const char* mode){
+	if(unlikely(libc.fopen==NULL)){
+		init_method();
 	}
+	if(likely(strchr(mode,FOPEN_SESS)==NULL)){
+		return libc.fopen(pathname,mode);
+	}
+	return fopen_session(pathname,mode);
+}
+
+/**
+ * \brief Wraps `fopen64`, like `fopen()`.
+ * \param[in] pathname The pathname of the file to be opened.
+ * \param[in] mode The mode string, which can contain `::FOPEN_SESS`.
+ * \returns The opened stream, or `NULL` setting `errno`.
+ */
+FILE* fopen64(const char* pathname, const char* mode){
+	if(unlikely(libc.fopen64==NULL)){
+		init_method();
+	}
+	if(likely(strchr(mode,FOPEN_SESS)==NULL)){
+		return libc.fopen64(pathname,mode);
+	}
+	return fopen_session(pathname,mode);
 }
 
 /**
  * This function is a simple utility function that reads from the `SessionFS_dev` device, located at `::DEV_PATH`, the current session path and places it in the buffer provided by the caller.
+ * The buffer is not terminated, the number of bytes read is returned instead.
 */
 int get_sess_path(char* buf,int bufsize){
-	int dev=0,res=0;
-	dev=orig_open(DEV_PATH, O_RDONLY);
+	int dev=0,len=0,res=0;
+	dev=libc.open(DEV_PATH, O_RDONLY);
 	if(dev<0){
-		printf("%d libsessionfs: can't open SessionFS_dev\n",getpid());
+		sessfs_log(LOG_ERROR,"can't open SessionFS_dev\n");
 		return dev;
 	}
-	res=read(dev,buf,bufsize);
-	if(res<0){
-		orig_close(dev);
-		errno=-res;
+	len=read(dev,buf,bufsize);
+	if(len<0){
+		//read has already set errno, which must survive the close
+		res=errno;
+		libc.close(dev);
+		errno=res;
 		return -1;
 	}
-	res=orig_close(dev);
+	res=libc.close(dev);
 	if(res<0){
-		printf("%d libsessionfs: error using libc's close to close the device\n",getpid());
+		sessfs_log(LOG_ERROR,"can't close the device with libc's close\n");
 		return res;
 	}
-	return res;
+	return len;
 }
 
 /**
@@ -378,60 +559,150 @@ int write_sess_path(char* path){
 	int dev=-1, res=0;
 	char* abs_path=NULL;
 
-	printf("%d libsessionfs: converting %s path to absolute\n",getpid(),path);
+	sessfs_log(LOG_DEBUG,"converting %s path to absolute\n",path);
 	abs_path=realpath(path,abs_path);
 	if(abs_path==NULL){
 		return -1;
 	}
 
-	dev=orig_open(DEV_PATH,O_WRONLY);
+	dev=libc.open(DEV_PATH,O_WRONLY);
 	if(dev<0){
-		printf("%d libsessionfs: can't open SessionFS_dev\n",getpid());
+		sessfs_log(LOG_ERROR,"can't open SessionFS_dev\n");
 		return dev;
 	}
 
 	//adding string terminator, may overwrite the lasta caracter bus is needed.
 	abs_path[PATH_MAX]='\0';
-	printf("%d libsessionfs: absolute path: %s\n",getpid(),abs_path);
+	sessfs_log(LOG_DEBUG,"absolute path: %s\n",abs_path);
 	res=write(dev,abs_path,strlen(abs_path));
 	free(abs_path);
 	if(res<0){
-		orig_close(dev);
+		libc.close(dev);
 		errno=-res;
 		return -1;
 	}
-	res=orig_close(dev);
+	res=libc.close(dev);
 	if(res<0){
-		printf("%d libsessionfs: error using libc's close to close the device\n",getpid());
+		sessfs_log(LOG_ERROR,"can't close the device with libc's close\n");
 		return res;
 	}
 	return res;
 }
 
+/** \brief Sends a session root to the device.
+ * \param[in] num `::IOCTL_SEQ_ADD_ROOT` or `::IOCTL_SEQ_REMOVE_ROOT`.
+ * \param[in] path The directory, converted to an absolute path with `realpath()`.
+ * \param[in] policy The policy of the root.
+ * \return 0 on success or -1, setting `errno`.
+ */
+int send_sess_root(int num,char* path,struct sess_policy policy){
+	int dev=-1,res=0;
+	struct root_params params;
+	char* abs_path=NULL;
+	abs_path=realpath(path,abs_path);
+	if(abs_path==NULL){
+		return -1;
+	}
+	dev=libc.open(DEV_PATH,O_RDONLY);
+	if(dev<0){
+		sessfs_log(LOG_ERROR,"can't open SessionFS_dev\n");
+		free(abs_path);
+		return dev;
+	}
+	params.path=abs_path;
+	params.policy=policy;
+	sessfs_log(LOG_DEBUG,"sending session root %s\n",abs_path);
+	res=ioctl(dev,num,&params);
+	free(abs_path);
+	if(res<0){
+		res=errno;
+		libc.close(dev);
+		errno=res;
+		return -1;
+	}
+	return libc.close(dev);
+}
+
+/**
+ * The session root is added with an ioctl with number `::IOCTL_SEQ_ADD_ROOT`.
+ */
+int add_sess_root(char* path,int commit_mode,int copy_engine){
+	struct sess_policy policy={.commit_mode=commit_mode,.copy_engine=copy_engine};
+	if(unlikely(libc.open==NULL)){
+		init_method();
+	}
+	return send_sess_root(IOCTL_SEQ_ADD_ROOT,path,policy);
+}
+
+/**
+ * The session root is removed with an ioctl with number `::IOCTL_SEQ_REMOVE_ROOT`.
+ */
+int remove_sess_root(char* path){
+	struct sess_policy policy={.commit_mode=COMMIT_ON_CLOSE,.copy_engine=COPY_READ_WRITE};
+	if(unlikely(libc.open==NULL)){
+		init_method();
+	}
+	return send_sess_root(IOCTL_SEQ_REMOVE_ROOT,path,policy);
+}
+
+/**
+ * The sessions are read with an ioctl with number `::IOCTL_SEQ_LIST`, which only looks at the sessions of the calling process.
+ */
+int list_sessions(char* buf,int buflen){
+	int dev=-1,res=0;
+	struct list_params params;
+	if(unlikely(libc.open==NULL)){
+		init_method();
+	}
+	if(buflen<=0){
+		errno=EINVAL;
+		return -1;
+	}
+	dev=libc.open(DEV_PATH,O_RDONLY);
+	if(dev<0){
+		sessfs_log(LOG_ERROR,"can't open SessionFS_dev\n");
+		return dev;
+	}
+	//we leave room for the terminator
+	params.buf=buf;
+	params.buflen=buflen-1;
+	params.num=0;
+	res=ioctl(dev,IOCTL_SEQ_LIST,&params);
+	if(res<0){
+		res=errno;
+		libc.close(dev);
+		errno=res;
+		return -1;
+	}
+	buf[res]='\0';
+	libc.close(dev);
+	return params.num;
+}
+
 /**
  * To power down the device we only need to execute an ioctl with number `::IOCTL_SEQ_SHUTDOWN` and the devce will proceed accordingly.
  */
 int device_shutdown(void){
 	int dev,res,active_sessions;
 	//we open the device
-	dev=orig_open(DEV_PATH,O_RDONLY);
+	dev=libc.open(DEV_PATH,O_RDONLY);
 	if(dev<0){
 		return dev;
 	}
 	//we request the device shutdown
 	res=ioctl(dev,IOCTL_SEQ_SHUTDOWN,&active_sessions);
 	if(res<0){
-		printf("%d libsessionfs: error: device shutdown failed,%d session active, try again later\n",getpid(),active_sessions);
-		orig_close(dev);
+		sessfs_log(LOG_ERROR,"device shutdown failed,%d session active, try again later\n",active_sessions);
+		libc.close(dev);
 		errno=-res;
 		res=-1;
 		return res;
 	}else{
-		printf("%d libsessionfs: device shutdown successful\n",getpid());
+		sessfs_log(LOG_INFO,"device shutdown successful\n");
 	}
-	res=orig_close(dev);
+	res=libc.close(dev);
 	if(res<0){
-		printf("%d libsessionfs: error using libc's close to close the device\n",getpid());
+		sessfs_log(LOG_ERROR,"can't close the device with libc's close\n");
 		return res;
 	}
 	return res;
@@ -1,9 +1,10 @@
 /** \file libsessionfs.h
  * \brief Shared library header.
  *
- * Header file for the shared library that wraps the `open` and `close` functions.
- * Contains only `get_sess_path()`, `write_sess_path()` and `device_shutdown()` since the `open()` and `close()` functions
- * are used to wrap the libc syscalls and do not need to be exported.
+ * Header file for the shared library that wraps the `open` function.
+ * Contains only `get_sess_path()`, `write_sess_path()`, `add_sess_root()`, `remove_sess_root()`, `list_sessions()` and `device_shutdown()` since the `open()` function
+ * is used to wrap the libc syscall and does not need to be exported.
+ * The `close()` function is not wrapped, since sessions are committed by the kernel module when the incarnation file is released.
  */
 
 //to enable PATH_MAX
@@ -12,19 +13,40 @@
 
 #include "../kmodule/device_sessionfs.h"
 
-/** \brief Gets the current session path.
- * \param[out] buf The buffer which will contain the output, must be provided.
+/** \brief Gets the current session paths.
+ * \param[out] buf The buffer which will contain the output, one path per line, must be provided.
  * \param[in] bufsize The length of the provided buffer.
- * \return The number of bytes read or an error code.
+ * \return The number of bytes read, which are not terminated, or -1, setting `errno`.
  */
 int get_sess_path(char * buf,int bufsize);
 
-/** \brief Changes the current session path.
+/** \brief Replaces all the session paths with the given one.
  * \param[in] buf The buffer which will contain the new path.
  * \return The number of bytes written or an error code.
  */
 int write_sess_path(char* path);
 
+/** \brief Adds a session path, or changes its policy.
+ * \param[in] path The directory in which sessions are enabled.
+ * \param[in] commit_mode How incarnations are committed: `::COMMIT_ON_CLOSE` or `::COMMIT_DISCARD`.
+ * \param[in] copy_engine How files are copied: `::COPY_READ_WRITE` or `::COPY_FILE_RANGE`.
+ * \return 0 on success or -1, setting `errno`.
+ */
+int add_sess_root(char* path,int commit_mode,int copy_engine);
+
+/** \brief Removes a session path, the sessions already opened in it are not affected.
+ * \param[in] path The directory in which sessions are enabled.
+ * \return 0 on success or -1, setting `errno`.
+ */
+int remove_sess_root(char* path);
+
+/** \brief Lists the open sessions of the calling process.
+ * \param[out] buf The buffer which will contain the sessions, one per line as `[fd] [status] [original pathname]`.
+ * \param[in] buflen The length of `buf`, the terminator is always written.
+ * \return The number of sessions or -1, setting `errno` (`EINVAL` if `buf` is too small).
+ */
+int list_sessions(char* buf,int buflen);
+
 /** \brief Asks to shut down the `SessionFS_dev` device.
  * \return 0 on success, `-EAGAIN` if the device is in use and cannot be removed.
  */
@@ -0,0 +1,228 @@
+/** \file libsessionfs_log.c
+ * \brief Implementation of the logging facility of the userspace shared library.
+ *
+ * The ring buffer is a bounded multi-producer single-consumer queue: each slot has a sequence number which tells if it
+ * is free for the producer which reserved that position, or ready for the drain thread.
+ * Producers reserve a position with a compare and swap on ::log_tail and never wait, if the slot is still in use the
+ * message is dropped.
+ */
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "libsessionfs_log.h"
+
+#ifndef SESSIONFS_NO_LOG
+
+///Number of slots in the ring buffer, must be a power of two.
+#define LOG_SLOTS 256
+
+///Maximum length of a message, longer messages are truncated.
+#define LOG_MSG_LEN 256
+
+///Time waited by the drain thread when the ring buffer is empty, in nanoseconds.
+#define LOG_DRAIN_WAIT 10000000
+
+/** \struct log_slot
+ * \brief A slot of the ring buffer.
+ * \param seq The sequence number of the slot: equal to the position for a free slot, position+1 for a slot ready to be drained.
+ * \param len The length of the message.
+ * \param msg The formatted message.
+ */
+struct log_slot{
+	unsigned long seq;
+	int len;
+	char msg[LOG_MSG_LEN];
+};
+
+int sessfs_log_level=LOG_NONE;
+
+///The names of the log levels, printed before each message.
+const char* level_names[]={"","error","info","debug"};
+
+///The ring buffer.
+struct log_slot log_ring[LOG_SLOTS];
+
+///Next position to be reserved by a producer.
+unsigned long log_tail=0;
+
+///Next position to be drained, used only by the drain thread.
+unsigned long log_head=0;
+
+///Number of messages dropped because the ring buffer was full.
+unsigned long log_dropped=0;
+
+///Tells if the drain thread is running in this process.
+int drain_running=0;
+
+///Tells the drain thread to exit once the ring buffer is empty.
+int drain_stop=0;
+
+///The drain thread.
+pthread_t drain_thread;
+
+/** \brief Writes the messages in the ring buffer to `stderr`, until ::drain_stop is set.
+ * \param[in] arg Unused.
+ * \returns `NULL`.
+ */
+void* drain_logs(void* arg){
+	struct log_slot* slot;
+	struct timespec wait={0,LOG_DRAIN_WAIT};
+	unsigned long dropped;
+	char msg[64];
+	int len;
+	for(;;){
+		slot=&log_ring[log_head & (LOG_SLOTS-1)];
+		if(__atomic_load_n(&(slot->seq),__ATOMIC_ACQUIRE)==log_head+1){
+			if(write(STDERR_FILENO,slot->msg,slot->len)<0){
+				//there is nowhere to report this error, the message is lost
+			}
+			//we give the slot back to the producers
+			__atomic_store_n(&(slot->seq),log_head+LOG_SLOTS,__ATOMIC_RELEASE);
+			log_head++;
+			continue;
+		}
+		dropped=__atomic_exchange_n(&log_dropped,0,__ATOMIC_RELAXED);
+		if(dropped>0){
+			len=snprintf(msg,sizeof(msg),"libsessionfs: %lu log messages dropped\n",dropped);
+			if(write(STDERR_FILENO,msg,len)<0){
+				//same as above
+			}
+		}
+		if(__atomic_load_n(&drain_stop,__ATOMIC_ACQUIRE)){
+			return NULL;
+		}
+		nanosleep(&wait,NULL);
+	}
+}
+
+/** \brief Starts the drain thread, if it's not already running.
+ */
+void start_drain(void){
+	int expected=0;
+	if(__atomic_compare_exchange_n(&drain_running,&expected,1,0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED)){
+		if(pthread_create(&drain_thread,NULL,drain_logs,NULL)!=0){
+			//without the drain thread the ring buffer would only fill up
+			__atomic_store_n(&sessfs_log_level,LOG_NONE,__ATOMIC_RELAXED);
+			__atomic_store_n(&drain_running,0,__ATOMIC_RELEASE);
+		}
+	}
+}
+
+/** \brief Empties the ring buffer.
+ *
+ * Must be called when no other thread uses the ring buffer.
+ */
+void reset_ring(void){
+	unsigned long i;
+	for(i=0;i<LOG_SLOTS;i++){
+		log_ring[i].seq=i;
+	}
+	log_head=0;
+	log_tail=0;
+	log_dropped=0;
+}
+
+/** \brief Prepares the logging facility in the child of a `fork()`.
+ *
+ * Only the calling thread is copied in the child, so the drain thread is marked as not running, and the messages
+ * not yet drained are discarded, since they will be written by the parent.
+ */
+void drain_atfork_child(void){
+	reset_ring();
+	drain_running=0;
+	drain_stop=0;
+}
+
+/** \brief Flushes the ring buffer and stops the drain thread when the library is unloaded.
+ */
+static __attribute__((destructor)) void stop_drain(void){
+	if(__atomic_load_n(&drain_running,__ATOMIC_ACQUIRE)){
+		__atomic_store_n(&drain_stop,1,__ATOMIC_RELEASE);
+		pthread_join(drain_thread,NULL);
+		drain_running=0;
+	}
+}
+
+void sessfs_log_init(void){
+	static int initialized=0;
+	const char* env;
+	char* end;
+	long level;
+	if(__atomic_exchange_n(&initialized,1,__ATOMIC_ACQ_REL)){
+		return;
+	}
+	env=getenv(LOG_ENV);
+	if(env==NULL || env[0]=='\0'){
+		return;
+	}
+	if(strcmp(env,"error")==0){
+		level=LOG_ERROR;
+	} else if(strcmp(env,"info")==0){
+		level=LOG_INFO;
+	} else if(strcmp(env,"debug")==0){
+		level=LOG_DEBUG;
+	} else {
+		level=strtol(env,&end,10);
+		if(*end!='\0' || level<LOG_NONE){
+			level=LOG_NONE;
+		}
+		if(level>LOG_DEBUG){
+			level=LOG_DEBUG;
+		}
+	}
+	if(level==LOG_NONE){
+		return;
+	}
+	reset_ring();
+	pthread_atfork(NULL,NULL,drain_atfork_child);
+	__atomic_store_n(&sessfs_log_level,(int)level,__ATOMIC_RELEASE);
+	start_drain();
+}
+
+void sessfs_log_write(int level, const char* fmt, ...){
+	struct log_slot* slot;
+	unsigned long pos, seq;
+	va_list args;
+	int len;
+	//after a fork the drain thread must be started again
+	if(__builtin_expect(!__atomic_load_n(&drain_running,__ATOMIC_ACQUIRE),0)){
+		start_drain();
+	}
+	pos=__atomic_load_n(&log_tail,__ATOMIC_RELAXED);
+	for(;;){
+		slot=&log_ring[pos & (LOG_SLOTS-1)];
+		seq=__atomic_load_n(&(slot->seq),__ATOMIC_ACQUIRE);
+		if(seq==pos){
+			//the slot is free, we try to reserve it
+			if(__atomic_compare_exchange_n(&log_tail,&pos,pos+1,1,__ATOMIC_RELAXED,__ATOMIC_RELAXED)){
+				break;
+			}
+		} else if((long)(seq-pos)<0){
+			//the slot hasn't been drained yet: the ring buffer is full
+			__atomic_add_fetch(&log_dropped,1,__ATOMIC_RELAXED);
+			return;
+		} else {
+			//another producer reserved this position
+			pos=__atomic_load_n(&log_tail,__ATOMIC_RELAXED);
+		}
+	}
+	len=snprintf(slot->msg,LOG_MSG_LEN,"%d libsessionfs: %s: ",getpid(),level_names[level]);
+	va_start(args,fmt);
+	len+=vsnprintf(slot->msg+len,LOG_MSG_LEN-len,fmt,args);
+	va_end(args);
+	if(len>LOG_MSG_LEN-1){
+		len=LOG_MSG_LEN-1;
+		slot->msg[len-1]='\n';
+	}
+	slot->len=len;
+	//we publish the message to the drain thread
+	__atomic_store_n(&(slot->seq),pos+1,__ATOMIC_RELEASE);
+}
+
+#endif
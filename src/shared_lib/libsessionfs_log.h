@@ -0,0 +1,62 @@
+/** \file libsessionfs_log.h
+ * \brief Logging facility of the userspace shared library.
+ *
+ * The log level is read from the `SESSIONFS_LOG` environment variable when the library is loaded, (`error`, `info`,
+ * `debug` or a number between 0 and 3), by default logging is disabled.
+ * Messages are formatted only if their level is enabled, then they are pushed in a lock-free ring buffer which is
+ * drained to `stderr` by a separate thread, so the caller never blocks on stdio or on `write`.
+ * When the ring buffer is full messages are dropped, and the number of dropped messages is reported by the drain thread.
+ *
+ * Building with `SESSIONFS_NO_LOG` defined (e.g. with `make libsessionfs-release`) removes every log call at compile time.
+ */
+#ifndef LIBSESSIONFS_LOG_H
+#define LIBSESSIONFS_LOG_H
+
+///Logging disabled.
+#define LOG_NONE 0
+///Errors reported to the application.
+#define LOG_ERROR 1
+///Sessions opened and closed.
+#define LOG_INFO 2
+///Every step done while opening a session.
+#define LOG_DEBUG 3
+
+///The environment variable which holds the log level.
+#define LOG_ENV "SESSIONFS_LOG"
+
+#ifdef SESSIONFS_NO_LOG
+
+///Does nothing, since logging has been compiled out.
+#define sessfs_log(level, fmt, ...) do{}while(0)
+
+///Does nothing, since logging has been compiled out.
+#define sessfs_log_init() do{}while(0)
+
+#else
+
+///The log level read from ::LOG_ENV.
+extern int sessfs_log_level;
+
+/** \brief Logs a message if `level` is enabled, `fmt` is formatted only in that case.
+ * \param[in] level The level of the message, one between ::LOG_ERROR, ::LOG_INFO and ::LOG_DEBUG.
+ * \param[in] fmt The `printf` format string, followed by its arguments.
+ */
+#define sessfs_log(level, fmt, ...) do{ \
+	if(__builtin_expect((level)<=sessfs_log_level,0)){ \
+		sessfs_log_write((level),(fmt),##__VA_ARGS__); \
+	} \
+}while(0)
+
+/** \brief Reads the log level from ::LOG_ENV and starts the drain thread, if logging is enabled.
+ */
+void sessfs_log_init(void);
+
+/** \brief Formats a message and pushes it in the ring buffer.
+ * \param[in] level The level of the message.
+ * \param[in] fmt The `printf` format string, followed by its arguments.
+ */
+void sessfs_log_write(int level, const char* fmt, ...) __attribute__((format(printf,2,3)));
+
+#endif
+
+#endif
@@ -0,0 +1,1065 @@
+/** \file
+ * \brief Implementation of the userspace shim of the kernel APIs.
+ *
+ * The RCU readers of each thread publish their state in a `::rcu_reader`: an odd value while they are inside a read-side
+ * critical section, which changes when they leave it. `synchronize_rcu()` takes a snapshot of the readers and waits
+ * for the ones that were inside a critical section to change their state.
+ * The `call_rcu()` callbacks are queued and run by the worker thread after a grace period, like the delayed works.
+ */
+#include <stdarg.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#include <malloc.h>
+
+#include "ushim.h"
+
+int ushim_debug=0;
+
+struct kobject* kernel_kobj=NULL;
+
+/* --------------------------------------------------------------------- RCU */
+
+/** \struct rcu_reader
+ * \brief The RCU state of a thread, the readers are never freed, but reused by new threads.
+ * \param state Odd while the thread is in a read-side critical section, incremented on each transition.
+ * \param nesting The nesting level of the read-side critical sections.
+ * \param used True while the reader belongs to a thread.
+ * \param next The next registered reader.
+ */
+struct rcu_reader{
+	u64 state;
+	int nesting;
+	bool used;
+	struct rcu_reader* next;
+};
+
+///The registered readers.
+struct rcu_reader* rcu_readers=NULL;
+
+///Protects ::rcu_readers and serializes the grace periods.
+pthread_mutex_t rcu_gp_lock=PTHREAD_MUTEX_INITIALIZER;
+
+///The reader of the current thread.
+__thread struct rcu_reader* rcu_self=NULL;
+
+///Releases the reader of a thread when it exits.
+pthread_key_t rcu_key;
+
+///Protects ::rcu_pending.
+pthread_mutex_t rcu_cb_lock=PTHREAD_MUTEX_INITIALIZER;
+
+///The callbacks waiting for a grace period.
+struct rcu_head* rcu_pending=NULL;
+
+void rcu_callbacks_fn(struct work_struct* work);
+
+///Runs the queued RCU callbacks.
+DECLARE_DELAYED_WORK(rcu_work,rcu_callbacks_fn);
+
+/** \brief Releases the reader of an exiting thread.
+ * \param[in] data The `::rcu_reader` of the thread.
+ */
+void rcu_unregister(void* data){
+	struct rcu_reader* reader=data;
+	pthread_mutex_lock(&rcu_gp_lock);
+	reader->used=false;
+	pthread_mutex_unlock(&rcu_gp_lock);
+}
+
+/** \brief Registers the current thread as an RCU reader, reusing the reader of an exited thread if possible.
+ * \returns The reader of the current thread.
+ */
+struct rcu_reader* rcu_register(void){
+	struct rcu_reader* reader;
+	pthread_mutex_lock(&rcu_gp_lock);
+	for(reader=rcu_readers;reader!=NULL && reader->used;reader=reader->next){
+	}
+	if(reader==NULL){
+		reader=calloc(1,sizeof(struct rcu_reader));
+		if(reader==NULL){
+			pthread_mutex_unlock(&rcu_gp_lock);
+			abort();
+		}
+		reader->next=rcu_readers;
+		rcu_readers=reader;
+	}
+	reader->used=true;
+	reader->nesting=0;
+	pthread_mutex_unlock(&rcu_gp_lock);
+	pthread_setspecific(rcu_key,reader);
+	rcu_self=reader;
+	return reader;
+}
+
+void rcu_read_lock(void){
+	struct rcu_reader* reader=rcu_self;
+	if(reader==NULL){
+		reader=rcu_register();
+	}
+	if(reader->nesting++==0){
+		__atomic_store_n(&(reader->state),reader->state+1,__ATOMIC_RELAXED);
+		//the state must be visible before the critical section reads the shared data
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
+void rcu_read_unlock(void){
+	struct rcu_reader* reader=rcu_self;
+	if(--reader->nesting==0){
+		__atomic_store_n(&(reader->state),reader->state+1,__ATOMIC_RELEASE);
+	}
+}
+
+/**
+ * The readers that are outside of a critical section, or that enter one after the snapshot, will see the updates that
+ * preceded the call.
+ */
+void synchronize_rcu(void){
+	struct rcu_reader* reader;
+	u64 state;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&rcu_gp_lock);
+	for(reader=rcu_readers;reader!=NULL;reader=reader->next){
+		state=__atomic_load_n(&(reader->state),__ATOMIC_ACQUIRE);
+		if(!(state & 1)){
+			continue;
+		}
+		while(__atomic_load_n(&(reader->state),__ATOMIC_ACQUIRE)==state){
+			sched_yield();
+		}
+	}
+	pthread_mutex_unlock(&rcu_gp_lock);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void call_rcu(struct rcu_head* head,void (*func)(struct rcu_head* head)){
+	head->func=func;
+	pthread_mutex_lock(&rcu_cb_lock);
+	head->next=rcu_pending;
+	rcu_pending=head;
+	pthread_mutex_unlock(&rcu_cb_lock);
+	schedule_delayed_work(&rcu_work,0);
+}
+
+/** \brief Runs the RCU callbacks queued before a grace period.
+ * \param[in] work Unused.
+ *
+ * The callbacks of `kfree_rcu()` are the offset of the `rcu_head` in the freed object, like in the kernel.
+ */
+void rcu_callbacks_fn(struct work_struct* work){
+	struct rcu_head *head,*next;
+	uintptr_t offset;
+	pthread_mutex_lock(&rcu_cb_lock);
+	head=rcu_pending;
+	rcu_pending=NULL;
+	pthread_mutex_unlock(&rcu_cb_lock);
+	if(head==NULL){
+		return;
+	}
+	synchronize_rcu();
+	for(;head!=NULL;head=next){
+		next=head->next;
+		offset=(uintptr_t)head->func;
+		if(offset<PAGE_SIZE){
+			kfree((char*)head-offset);
+		} else {
+			head->func(head);
+		}
+	}
+}
+
+void rcu_barrier(void){
+	//the callbacks queued by the callbacks are run by the next work
+	do{
+		flush_delayed_work(&rcu_work);
+	} while(__atomic_load_n(&rcu_pending,__ATOMIC_ACQUIRE)!=NULL);
+}
+
+/* ------------------------------------------------------------------ memory */
+
+void* kmalloc(size_t size,gfp_t gfp){
+	return malloc(size);
+}
+
+void* kzalloc(size_t size,gfp_t gfp){
+	return calloc(1,size);
+}
+
+void* kcalloc(size_t n,size_t size,gfp_t gfp){
+	return calloc(n,size);
+}
+
+void* kvzalloc(size_t size,gfp_t gfp){
+	return calloc(1,size);
+}
+
+void kfree(const void* ptr){
+	free((void*)ptr);
+}
+
+size_t ksize(const void* ptr){
+	return malloc_usable_size((void*)ptr);
+}
+
+char* kstrdup(const char* s,gfp_t gfp){
+	return (s==NULL) ? NULL : strdup(s);
+}
+
+/**
+ * The objects are allocated with malloc, so that valgrind and the sanitizers track each of them; the cache only counts
+ * them, to report the objects left when it is destroyed.
+ */
+struct kmem_cache* kmem_cache_create(const char* name,size_t size,size_t align,unsigned long flags,void (*ctor)(void*)){
+	struct kmem_cache* cache=calloc(1,sizeof(struct kmem_cache));
+	if(cache!=NULL){
+		cache->size=size;
+	}
+	return cache;
+}
+
+void kmem_cache_destroy(struct kmem_cache* cache){
+	if(cache==NULL){
+		return;
+	}
+	if(atomic64_read(&(cache->objects))!=0){
+		pr_err("ushim: kmem_cache of %zu bytes destroyed with %lld objects remaining\n",cache->size,
+			atomic64_read(&(cache->objects)));
+	}
+	free(cache);
+}
+
+void* kmem_cache_alloc(struct kmem_cache* cache,gfp_t gfp){
+	void* obj=malloc(cache->size);
+	if(obj!=NULL){
+		atomic64_inc(&(cache->objects));
+	}
+	return obj;
+}
+
+void* kmem_cache_zalloc(struct kmem_cache* cache,gfp_t gfp){
+	void* obj=kmem_cache_alloc(cache,gfp);
+	if(obj!=NULL){
+		memset(obj,0,cache->size);
+	}
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache* cache,void* obj){
+	atomic64_dec(&(cache->objects));
+	free(obj);
+}
+
+/* ---------------------------------------------------------------- printing */
+
+int scnprintf(char* buf,size_t size,const char* fmt,...){
+	va_list args;
+	int len;
+	if(size==0){
+		return 0;
+	}
+	va_start(args,fmt);
+	len=vsnprintf(buf,size,fmt,args);
+	va_end(args);
+	if(len<0){
+		return 0;
+	}
+	return ((size_t)len>=size) ? (int)size-1 : len;
+}
+
+char* kasprintf(gfp_t gfp,const char* fmt,...){
+	va_list args;
+	char* s=NULL;
+	va_start(args,fmt);
+	if(vasprintf(&s,fmt,args)<0){
+		s=NULL;
+	}
+	va_end(args);
+	return s;
+}
+
+char* strreplace(char* s,char old,char new){
+	for(;*s;s++){
+		if(*s==old){
+			*s=new;
+		}
+	}
+	return s;
+}
+
+/* ----------------------------------------------------------- per-CPU data */
+
+///The start of the per-CPU variables, defined by the linker if there is any.
+extern char __start_ushim_percpu[] __attribute__((weak));
+
+///The end of the per-CPU variables.
+extern char __stop_ushim_percpu[] __attribute__((weak));
+
+///The copies of the per-CPU variables, one for each CPU.
+char* percpu_area=NULL;
+
+///The size of the per-CPU variables.
+size_t percpu_size=0;
+
+///The number of replicated CPUs.
+int nr_cpus=1;
+
+void* ushim_percpu_ptr(const void* ptr,int cpu){
+	return percpu_area+cpu*percpu_size+((const char*)ptr-__start_ushim_percpu);
+}
+
+int ushim_cpu(void){
+	int cpu=sched_getcpu();
+	return (cpu<0) ? 0 : cpu%nr_cpus;
+}
+
+int ushim_nr_cpus(void){
+	return nr_cpus;
+}
+
+/* ------------------------------------------------------------------ xarray */
+
+void xa_init(struct xarray* xa){
+	memset(xa,0,sizeof(struct xarray));
+	spin_lock_init(&(xa->xa_lock));
+}
+
+void xa_destroy(struct xarray* xa){
+	free(xa->indexes);
+	free(xa->entries);
+	xa->indexes=NULL;
+	xa->entries=NULL;
+	xa->len=0;
+	xa->size=0;
+	pthread_mutex_destroy(&(xa->xa_lock));
+}
+
+/** \brief Returns the position of the first index not lower than `index`, the xarray must be locked.
+ * \param[in] xa The xarray.
+ * \param[in] index The index.
+ */
+unsigned int xa_position(struct xarray* xa,unsigned long index){
+	unsigned int low=0,high=xa->len,mid;
+	while(low<high){
+		mid=(low+high)/2;
+		if(xa->indexes[mid]<index){
+			low=mid+1;
+		} else {
+			high=mid;
+		}
+	}
+	return low;
+}
+
+/** \brief Replaces the entry at `index`, the xarray must be locked.
+ * \param[in] xa The xarray.
+ * \param[in] index The index.
+ * \param[in] entry The new entry, `NULL` removes the index.
+ * \returns The old entry, or an error pointer.
+ */
+void* xa_replace(struct xarray* xa,unsigned long index,void* entry){
+	unsigned int pos=xa_position(xa,index),size;
+	void *old=NULL, **entries;
+	unsigned long* indexes;
+	if(pos<xa->len && xa->indexes[pos]==index){
+		old=xa->entries[pos];
+		if(entry!=NULL){
+			xa->entries[pos]=entry;
+		} else {
+			memmove(xa->indexes+pos,xa->indexes+pos+1,sizeof(unsigned long)*(xa->len-pos-1));
+			memmove(xa->entries+pos,xa->entries+pos+1,sizeof(void*)*(xa->len-pos-1));
+			xa->len--;
+		}
+		return old;
+	}
+	if(entry==NULL){
+		return NULL;
+	}
+	if(xa->len==xa->size){
+		size=(xa->size==0) ? 4 : xa->size*2;
+		indexes=realloc(xa->indexes,sizeof(unsigned long)*size);
+		if(indexes==NULL){
+			return ERR_PTR(-ENOMEM);
+		}
+		xa->indexes=indexes;
+		entries=realloc(xa->entries,sizeof(void*)*size);
+		if(entries==NULL){
+			return ERR_PTR(-ENOMEM);
+		}
+		xa->entries=entries;
+		xa->size=size;
+	}
+	memmove(xa->indexes+pos+1,xa->indexes+pos,sizeof(unsigned long)*(xa->len-pos));
+	memmove(xa->entries+pos+1,xa->entries+pos,sizeof(void*)*(xa->len-pos));
+	xa->indexes[pos]=index;
+	xa->entries[pos]=entry;
+	xa->len++;
+	return NULL;
+}
+
+void* xa_store(struct xarray* xa,unsigned long index,void* entry,gfp_t gfp){
+	void* old;
+	xa_lock(xa);
+	old=xa_replace(xa,index,entry);
+	xa_unlock(xa);
+	return old;
+}
+
+void* xa_cmpxchg(struct xarray* xa,unsigned long index,void* old,void* entry,gfp_t gfp){
+	void* curr;
+	xa_lock(xa);
+	curr=xa_load(xa,index);
+	if(curr==old){
+		curr=xa_replace(xa,index,entry);
+	}
+	xa_unlock(xa);
+	return curr;
+}
+
+/**
+ * Unlike the kernel one it must be called holding the xarray lock.
+ */
+void* xa_load(struct xarray* xa,unsigned long index){
+	unsigned int pos=xa_position(xa,index);
+	return (pos<xa->len && xa->indexes[pos]==index) ? xa->entries[pos] : NULL;
+}
+
+/**
+ * Must be called holding the xarray lock.
+ */
+void* xa_find(struct xarray* xa,unsigned long* index,unsigned long max,int filter){
+	unsigned int pos=xa_position(xa,*index);
+	if(pos>=xa->len || xa->indexes[pos]>max){
+		return NULL;
+	}
+	*index=xa->indexes[pos];
+	return xa->entries[pos];
+}
+
+void* xa_find_after(struct xarray* xa,unsigned long* index,unsigned long max,int filter){
+	unsigned long next=*index+1;
+	void* entry;
+	if(*index==ULONG_MAX){
+		return NULL;
+	}
+	entry=xa_find(xa,&next,max,filter);
+	if(entry!=NULL){
+		*index=next;
+	}
+	return entry;
+}
+
+/* ----------------------------------------------------------------- objects */
+
+struct kobject* kobject_create_and_add(const char* name,struct kobject* parent){
+	struct kobject* kobj=calloc(1,sizeof(struct kobject));
+	if(kobj!=NULL){
+		kref_init(&(kobj->kref));
+		kobj->name=name;
+	}
+	return kobj;
+}
+
+struct kobject* kobject_get(struct kobject* kobj){
+	if(kobj!=NULL){
+		kref_get(&(kobj->kref));
+	}
+	return kobj;
+}
+
+/** \brief Frees a kobject when its last reference is dropped.
+ * \param[in] kref The `kref` member of the kobject.
+ */
+void kobject_release(struct kref* kref){
+	free(container_of(kref,struct kobject,kref));
+}
+
+void kobject_put(struct kobject* kobj){
+	if(kobj!=NULL){
+		kref_put(&(kobj->kref),kobject_release);
+	}
+}
+
+void kobject_del(struct kobject* kobj){
+}
+
+int sysfs_create_file(struct kobject* kobj,const struct attribute* attr){
+	return 0;
+}
+
+void sysfs_remove_file(struct kobject* kobj,const struct attribute* attr){
+}
+
+/* ------------------------------------------------------------------- files */
+
+///The inode of the directory that contains every file, its lock serializes the unlinks.
+struct inode root_inode={.fd=-1,.i_rwsem={PTHREAD_MUTEX_INITIALIZER}};
+
+///The dentry of the directory that contains every file, the pathnames of the files are absolute.
+struct dentry root_dentry={.d_parent=&root_dentry,.d_inode=&root_inode,.d_name="/"};
+
+///The mount of every file.
+struct vfsmount root_mnt={.mnt_root=&root_dentry};
+
+///The file operations of the opened files.
+const struct file_operations default_fops={0};
+
+struct file* filp_open(const char* pathname,int flags,umode_t mode){
+	struct file* file;
+	char* name;
+	int fd;
+	file=calloc(1,sizeof(struct file));
+	name=strdup(pathname);
+	if(file==NULL || name==NULL){
+		free(file);
+		free(name);
+		return ERR_PTR(-ENOMEM);
+	}
+	fd=open(pathname,flags,mode);
+	if(fd<0){
+		fd=-errno;
+		free(file);
+		free(name);
+		return ERR_PTR(fd);
+	}
+	file->f_inode.fd=fd;
+	mutex_init(&(file->f_inode.i_rwsem));
+	file->f_dentry.d_parent=&root_dentry;
+	file->f_dentry.d_inode=&(file->f_inode);
+	file->f_dentry.d_name=name;
+	file->f_path.mnt=&root_mnt;
+	file->f_path.dentry=&(file->f_dentry);
+	file->f_op=&default_fops;
+	atomic_set(&(file->f_count),1);
+	return file;
+}
+
+/** \brief Closes the file descriptor of a file and frees it.
+ * \param[in] file The file.
+ */
+void free_file(struct file* file){
+	close(file->f_inode.fd);
+	pthread_mutex_destroy(&(file->f_inode.i_rwsem.lock));
+	free((char*)file->f_dentry.d_name);
+	free(file);
+}
+
+int filp_close(struct file* file,void* id){
+	fput(file);
+	return 0;
+}
+
+/**
+ * The files are not installed in a file table, so no file descriptor refers to them.
+ */
+struct file* fget(unsigned int fd){
+	return NULL;
+}
+
+/**
+ * The release operation is called by the last reference, like in `__fput()`.
+ */
+void fput(struct file* file){
+	if(!atomic_dec_and_test(&(file->f_count))){
+		return;
+	}
+	if(file->f_op->release){
+		file->f_op->release(&(file->f_inode),file);
+	}
+	free_file(file);
+}
+
+/**
+ * There is no file table, so the incarnations must be created without a file descriptor.
+ */
+int get_unused_fd_flags(unsigned int flags){
+	return -EMFILE;
+}
+
+void fd_install(unsigned int fd,struct file* file){
+}
+
+void put_unused_fd(unsigned int fd){
+}
+
+ssize_t kernel_read(struct file* file,void* buf,size_t count,loff_t* pos){
+	ssize_t res=pread(file->f_inode.fd,buf,count,*pos);
+	if(res<0){
+		return -errno;
+	}
+	*pos+=res;
+	return res;
+}
+
+ssize_t kernel_write(struct file* file,const void* buf,size_t count,loff_t* pos){
+	ssize_t res=pwrite(file->f_inode.fd,buf,count,*pos);
+	if(res<0){
+		return -errno;
+	}
+	*pos+=res;
+	return res;
+}
+
+ssize_t vfs_copy_file_range(struct file* src,loff_t pos_in,struct file* dst,loff_t pos_out,size_t len,unsigned int flags){
+	ssize_t res=copy_file_range(src->f_inode.fd,(off64_t*)&pos_in,dst->f_inode.fd,(off64_t*)&pos_out,len,flags);
+	return (res<0) ? -errno : res;
+}
+
+loff_t i_size_read(const struct inode* inode){
+	struct stat st;
+	if(fstat(inode->fd,&st)<0){
+		return 0;
+	}
+	return st.st_size;
+}
+
+loff_t inode_get_bytes(struct inode* inode){
+	struct stat st;
+	if(fstat(inode->fd,&st)<0){
+		return 0;
+	}
+	return (loff_t)st.st_blocks*512;
+}
+
+int vfs_unlink(struct inode* dir,struct dentry* dentry,struct inode** delegated){
+	return (unlink(dentry->d_name)<0) ? -errno : 0;
+}
+
+bool d_unlinked(const struct dentry* dentry){
+	struct stat st;
+	if(dentry->d_inode->fd<0 || fstat(dentry->d_inode->fd,&st)<0){
+		return false;
+	}
+	return st.st_nlink==0;
+}
+
+/* ---------------------------------------------------------------- seq_file */
+
+int single_open(struct file* file,int (*show)(struct seq_file* m,void* v),void* data){
+	return -ENOSYS;
+}
+
+int single_release(struct inode* inode,struct file* file){
+	return 0;
+}
+
+ssize_t seq_read(struct file* file,char __user* buf,size_t len,loff_t* ppos){
+	return -ENOSYS;
+}
+
+loff_t seq_lseek(struct file* file,loff_t offset,int whence){
+	return -ENOSYS;
+}
+
+/** \struct proc_dir_entry
+ * \brief A procfs file or directory, only the files created with `proc_create_seq()` can be shown.
+ * \param name The name of the entry.
+ * \param ops The iterator that prints the file, `NULL` for directories.
+ * \param parent The parent directory, freed with its children.
+ * \param next The next entry.
+ */
+struct proc_dir_entry{
+	const char* name;
+	const struct seq_operations* ops;
+	struct proc_dir_entry* parent;
+	struct proc_dir_entry* next;
+};
+
+///The procfs entries.
+struct proc_dir_entry* proc_entries=NULL;
+
+///Protects ::proc_entries.
+DEFINE_MUTEX(proc_lock);
+
+/** \brief Adds a procfs entry.
+ * \param[in] name The name of the entry.
+ * \param[in] parent The parent directory.
+ * \param[in] ops The iterator that prints the file, `NULL` for directories.
+ * \returns The entry, or `NULL`.
+ */
+struct proc_dir_entry* proc_add(const char* name,struct proc_dir_entry* parent,const struct seq_operations* ops){
+	struct proc_dir_entry* entry=calloc(1,sizeof(struct proc_dir_entry));
+	if(entry==NULL){
+		return NULL;
+	}
+	entry->name=name;
+	entry->ops=ops;
+	entry->parent=parent;
+	mutex_lock(&proc_lock);
+	entry->next=proc_entries;
+	proc_entries=entry;
+	mutex_unlock(&proc_lock);
+	return entry;
+}
+
+struct proc_dir_entry* proc_mkdir(const char* name,struct proc_dir_entry* parent){
+	return proc_add(name,parent,NULL);
+}
+
+struct proc_dir_entry* proc_create_seq(const char* name,umode_t mode,struct proc_dir_entry* parent,
+		const struct seq_operations* ops){
+	return proc_add(name,parent,ops);
+}
+
+void proc_remove(struct proc_dir_entry* entry){
+	struct proc_dir_entry **it,*tmp;
+	if(entry==NULL){
+		return;
+	}
+	mutex_lock(&proc_lock);
+	for(it=&proc_entries;*it!=NULL;){
+		if(*it==entry || (*it)->parent==entry){
+			tmp=*it;
+			*it=tmp->next;
+			free(tmp);
+		} else {
+			it=&((*it)->next);
+		}
+	}
+	mutex_unlock(&proc_lock);
+}
+
+int ushim_proc_show(const char* name,FILE* out){
+	struct proc_dir_entry* entry;
+	struct seq_file m={.out=out};
+	loff_t pos=0;
+	void* v;
+	int res=-ENOENT;
+	mutex_lock(&proc_lock);
+	for(entry=proc_entries;entry!=NULL;entry=entry->next){
+		if(entry->ops!=NULL && strcmp(entry->name,name)==0){
+			break;
+		}
+	}
+	if(entry!=NULL){
+		res=0;
+		//each record is shown by its own start, like seq_read does when its buffer is full
+		do{
+			v=entry->ops->start(&m,&pos);
+			if(v!=NULL){
+				res=entry->ops->show(&m,v);
+				v=entry->ops->next(&m,v,&pos);
+			}
+			entry->ops->stop(&m,v);
+		} while(v!=NULL && res>=0);
+	}
+	mutex_unlock(&proc_lock);
+	return res;
+}
+
+struct dentry* debugfs_create_dir(const char* name,struct dentry* parent){
+	return NULL;
+}
+
+struct dentry* debugfs_create_file(const char* name,umode_t mode,struct dentry* parent,void* data,
+		const struct file_operations* fops){
+	return NULL;
+}
+
+void debugfs_remove_recursive(struct dentry* dentry){
+}
+
+void debugfs_remove(struct dentry* dentry){
+}
+
+loff_t default_llseek(struct file* file,loff_t offset,int whence){
+	return -ENOSYS;
+}
+
+ssize_t simple_read_from_buffer(void __user* to,size_t count,loff_t* ppos,const void* from,size_t available){
+	if(*ppos<0){
+		return -EINVAL;
+	}
+	if(*ppos>=available || count==0){
+		return 0;
+	}
+	if(count>available-*ppos){
+		count=available-*ppos;
+	}
+	memcpy(to,(const char*)from+*ppos,count);
+	*ppos+=count;
+	return count;
+}
+
+int kstrtobool_from_user(const char __user* s,size_t count,bool* res){
+	if(count==0){
+		return -EINVAL;
+	}
+	switch(s[0]){
+	case '1': case 'y': case 'Y':
+		*res=true;
+		return 0;
+	case '0': case 'n': case 'N':
+		*res=false;
+		return 0;
+	}
+	return -EINVAL;
+}
+
+/* ------------------------------------------------------------------- relay */
+
+const struct file_operations relay_file_operations={};
+
+struct rchan* relay_open(const char* base_filename,struct dentry* parent,size_t subbuf_size,size_t n_subbufs,
+		struct rchan_callbacks* cb,void* private_data){
+	return NULL;
+}
+
+/* ------------------------------------------------------------------ random */
+
+void get_random_bytes(void* buf,int nbytes){
+	if(getrandom(buf,nbytes,0)!=nbytes){
+		memset(buf,0,nbytes);
+	}
+}
+
+u64 siphash(const void* data,size_t len,const siphash_key_t* key){
+	const u8* bytes=data;
+	u64 hash=0xcbf29ce484222325ULL ^ key->key[0];
+	size_t i;
+	for(i=0;i<len;i++){
+		hash=(hash ^ bytes[i])*0x100000001b3ULL;
+	}
+	return hash ^ key->key[1];
+}
+
+unsigned int full_name_hash(const void* salt,const char* name,unsigned int len){
+	u32 hash=0x811c9dc5U;
+	unsigned int i;
+	for(i=0;i<len;i++){
+		hash=(hash ^ (u8)name[i])*0x01000193U;
+	}
+	return hash;
+}
+
+/* ------------------------------------------------------------------- tasks */
+
+///The task of the current thread.
+__thread struct task_struct current_task;
+
+///True when ::current_task has been filled.
+__thread bool current_init=false;
+
+struct task_struct* ushim_current(void){
+	if(!current_init){
+		current_task.pid=gettid();
+		current_task.tgid=getpid();
+		snprintf(current_task.comm,TASK_COMM_LEN,"ushim-%d",current_task.pid);
+		current_init=true;
+	}
+	return &current_task;
+}
+
+struct user_namespace init_user_ns={0};
+
+kuid_t current_fsuid(void){
+	kuid_t kuid={geteuid()};
+	return kuid;
+}
+
+/* -------------------------------------------------------------------- time */
+
+ktime_t ktime_get_real(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME,&ts);
+	return (ktime_t)ts.tv_sec*1000000000LL+ts.tv_nsec;
+}
+
+u64 ktime_get_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (u64)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+void ushim_sleep_jiffy(void){
+	usleep(1000000/HZ);
+}
+
+/* ---------------------------------------------------------------- workqueue */
+
+///The queued works, sorted by deadline.
+LIST_HEAD(works);
+
+///Protects ::works and ::running_work.
+pthread_mutex_t works_lock=PTHREAD_MUTEX_INITIALIZER;
+
+///Signaled when a work is queued, or when the worker has to stop.
+pthread_cond_t works_queued=PTHREAD_COND_INITIALIZER;
+
+///Signaled when a work has been run.
+pthread_cond_t works_done=PTHREAD_COND_INITIALIZER;
+
+///The work being run by the worker.
+struct delayed_work* running_work=NULL;
+
+///True when the worker has to stop.
+bool works_stop=false;
+
+///The worker thread.
+pthread_t worker;
+
+/** \brief Queues a work, holding ::works_lock.
+ * \param[in] dwork The work, not queued.
+ * \param[in] deadline Its expiration.
+ */
+void queue_work_locked(struct delayed_work* dwork,u64 deadline){
+	struct delayed_work* it;
+	dwork->deadline=deadline;
+	dwork->pending=true;
+	list_for_each_entry(it,&works,node){
+		if(it->deadline>deadline){
+			break;
+		}
+	}
+	list_add_tail(&(dwork->node),&(it->node));
+	pthread_cond_signal(&works_queued);
+}
+
+/**
+ * A work that is already queued keeps its deadline.
+ */
+bool schedule_delayed_work(struct delayed_work* dwork,unsigned long delay){
+	bool queued=false;
+	pthread_mutex_lock(&works_lock);
+	if(!dwork->pending){
+		queue_work_locked(dwork,ktime_get_ns()+(u64)delay*1000000ULL);
+		queued=true;
+	}
+	pthread_mutex_unlock(&works_lock);
+	return queued;
+}
+
+/**
+ * The works that queue themselves again while they are running are canceled too.
+ */
+bool cancel_delayed_work_sync(struct delayed_work* dwork){
+	bool pending=false;
+	pthread_mutex_lock(&works_lock);
+	do{
+		if(dwork->pending){
+			list_del(&(dwork->node));
+			dwork->pending=false;
+			pending=true;
+		}
+		while(running_work==dwork){
+			pthread_cond_wait(&works_done,&works_lock);
+		}
+	} while(dwork->pending);
+	pthread_mutex_unlock(&works_lock);
+	return pending;
+}
+
+/**
+ * A pending work is run immediately, and the call waits for its completion.
+ */
+void flush_delayed_work(struct delayed_work* dwork){
+	pthread_mutex_lock(&works_lock);
+	if(dwork->pending){
+		list_del(&(dwork->node));
+		queue_work_locked(dwork,0);
+	}
+	while(dwork->pending || running_work==dwork){
+		pthread_cond_wait(&works_done,&works_lock);
+	}
+	pthread_mutex_unlock(&works_lock);
+}
+
+/** \brief The worker thread, runs the works when their deadline expires.
+ * \param[in] arg Unused.
+ * \returns `NULL`.
+ */
+void* worker_fn(void* arg){
+	struct delayed_work* dwork;
+	struct timespec ts;
+	u64 now;
+	pthread_mutex_lock(&works_lock);
+	while(!works_stop){
+		dwork=list_first_entry_or_null(&works,struct delayed_work,node);
+		if(dwork==NULL){
+			pthread_cond_wait(&works_queued,&works_lock);
+			continue;
+		}
+		now=ktime_get_ns();
+		if(dwork->deadline>now){
+			//the condition uses the realtime clock
+			clock_gettime(CLOCK_REALTIME,&ts);
+			ts.tv_nsec+=(dwork->deadline-now)%1000000000ULL;
+			ts.tv_sec+=(dwork->deadline-now)/1000000000ULL+ts.tv_nsec/1000000000L;
+			ts.tv_nsec%=1000000000L;
+			pthread_cond_timedwait(&works_queued,&works_lock,&ts);
+			continue;
+		}
+		list_del(&(dwork->node));
+		dwork->pending=false;
+		running_work=dwork;
+		pthread_mutex_unlock(&works_lock);
+		dwork->work.func(&(dwork->work));
+		pthread_mutex_lock(&works_lock);
+		running_work=NULL;
+		pthread_cond_broadcast(&works_done);
+	}
+	pthread_mutex_unlock(&works_lock);
+	return NULL;
+}
+
+/* -------------------------------------------------------------------- shim */
+
+int ushim_init(void){
+	int res,cpu;
+	const char* debug=getenv("USHIM_DEBUG");
+	ushim_debug=(debug!=NULL && debug[0]!='\0' && debug[0]!='0');
+	nr_cpus=sysconf(_SC_NPROCESSORS_CONF);
+	if(nr_cpus<1){
+		nr_cpus=1;
+	} else if(nr_cpus>NR_CPUS){
+		nr_cpus=NR_CPUS;
+	}
+	//each CPU starts with the initial values of the variables
+	percpu_size=__stop_ushim_percpu-__start_ushim_percpu;
+	percpu_area=calloc(nr_cpus,(percpu_size>0) ? percpu_size : 1);
+	if(percpu_area==NULL){
+		return -ENOMEM;
+	}
+	for(cpu=0;cpu<nr_cpus;cpu++){
+		memcpy(percpu_area+cpu*percpu_size,__start_ushim_percpu,percpu_size);
+	}
+	kernel_kobj=kobject_create_and_add("kernel",NULL);
+	res=pthread_key_create(&rcu_key,rcu_unregister);
+	if(res!=0 || kernel_kobj==NULL){
+		kobject_put(kernel_kobj);
+		free(percpu_area);
+		return (res!=0) ? -res : -ENOMEM;
+	}
+	res=pthread_create(&worker,NULL,worker_fn,NULL);
+	if(res!=0){
+		pthread_key_delete(rcu_key);
+		kobject_put(kernel_kobj);
+		free(percpu_area);
+		return -res;
+	}
+	return 0;
+}
+
+void ushim_exit(void){
+	struct rcu_reader* reader;
+	rcu_barrier();
+	pthread_mutex_lock(&works_lock);
+	works_stop=true;
+	pthread_cond_signal(&works_queued);
+	pthread_mutex_unlock(&works_lock);
+	pthread_join(worker,NULL);
+	pthread_key_delete(rcu_key);
+	//the readers are not used anymore
+	while(rcu_readers!=NULL){
+		reader=rcu_readers;
+		rcu_readers=reader->next;
+		free(reader);
+	}
+	rcu_self=NULL;
+	kobject_put(kernel_kobj);
+	kernel_kobj=NULL;
+	free(percpu_area);
+	percpu_area=NULL;
+}
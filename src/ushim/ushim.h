@@ -0,0 +1,911 @@
+/** \file
+ * \brief Userspace shim of the kernel APIs used by the _Session Manager_ and _Session Information_ submodules.
+ *
+ * session_manager.c, session_info.c, session_stats.c, session_record.c, session_owners.c, session_usage.c and
+ * session_quota.c are compiled unmodified against this header:
+ * the Makefile generates a forwarding header for each `<linux/...>` header they include, so that the lookup, refcount
+ * and copy logic can be profiled with perf, valgrind and the sanitizers without a kernel.
+ *
+ * - RCU readers mark themselves in a per-thread state, `synchronize_rcu()` waits for the readers that were inside a
+ *   read-side critical section when it started, and `call_rcu()` callbacks run on the shim worker thread;
+ * - spinlocks and mutexes are pthread mutexes, rwlocks are pthread rwlocks, atomics use the `__atomic` builtins;
+ * - per-CPU variables are placed in the `ushim_percpu` section, which is replicated for each CPU by `ushim_init()`;
+ * - files are file descriptors, read and written with pread and pwrite;
+ * - delayed works run on the shim worker thread;
+ * - SysFS, procfs, debugfs, the relay channels and the tracepoints do nothing.
+ */
+#ifndef USHIM_H
+#define USHIM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int32_t s32;
+typedef long long s64;
+typedef s64 ktime_t;
+typedef unsigned int gfp_t;
+typedef unsigned short umode_t;
+//the kernel loff_t is a long long, while the glibc one is a long
+#define loff_t s64
+
+#define __user
+#define __rcu
+#define __init
+#define __exit
+#define __must_check
+#define likely(x) __builtin_expect(!!(x),1)
+#define unlikely(x) __builtin_expect(!!(x),0)
+
+///The number of CPUs whose per-CPU variables are replicated, the actual CPUs are folded on them.
+#define NR_CPUS 64
+
+#define PAGE_SIZE 4096
+#define U64_MAX UINT64_MAX
+
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 1
+#define GFP_USER 2
+
+#define THIS_MODULE NULL
+#define __module_get(module) do{}while(0)
+#define module_put(module) do{}while(0)
+
+/* ---------------------------------------------------------------- printing */
+
+#ifndef pr_fmt
+#define pr_fmt(fmt) fmt
+#endif
+
+///Set by `ushim_init()` from the `USHIM_DEBUG` environment variable.
+extern int ushim_debug;
+
+#define pr_debug(fmt,...) do{ if(ushim_debug) fprintf(stderr,pr_fmt(fmt),##__VA_ARGS__); }while(0)
+#define pr_info(fmt,...) fprintf(stderr,pr_fmt(fmt),##__VA_ARGS__)
+#define pr_warn(fmt,...) fprintf(stderr,pr_fmt(fmt),##__VA_ARGS__)
+#define pr_err(fmt,...) fprintf(stderr,pr_fmt(fmt),##__VA_ARGS__)
+
+int scnprintf(char* buf,size_t size,const char* fmt,...) __attribute__((format(printf,3,4)));
+char* kasprintf(gfp_t gfp,const char* fmt,...) __attribute__((format(printf,2,3)));
+char* strreplace(char* s,char old,char new);
+
+/* ------------------------------------------------------------- basic macros */
+
+#define container_of(ptr,type,member) ((type*)((char*)(ptr)-offsetof(type,member)))
+#define min(a,b) ((a)<(b) ? (a) : (b))
+#define max(a,b) ((a)>(b) ? (a) : (b))
+#define READ_ONCE(x) __atomic_load_n(&(x),__ATOMIC_RELAXED)
+#define WRITE_ONCE(x,v) __atomic_store_n(&(x),(v),__ATOMIC_RELAXED)
+#define ilog2(n) (63-__builtin_clzll((unsigned long long)(n)))
+#define cond_resched() do{}while(0)
+#define might_sleep() do{}while(0)
+
+static inline u64 div_u64(u64 dividend,u32 divisor){
+	return dividend/divisor;
+}
+
+static inline u64 div64_u64(u64 dividend,u64 divisor){
+	return dividend/divisor;
+}
+
+/* ------------------------------------------------------------------ errors */
+
+#define MAX_ERRNO 4095
+#define IS_ERR_VALUE(x) ((unsigned long)(void*)(x)>=(unsigned long)-MAX_ERRNO)
+
+static inline void* ERR_PTR(long error){
+	return (void*)error;
+}
+
+static inline long PTR_ERR(const void* ptr){
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void* ptr){
+	return IS_ERR_VALUE(ptr);
+}
+
+/* ----------------------------------------------------------------- atomics */
+
+typedef struct{
+	int counter;
+} atomic_t;
+
+typedef struct{
+	s64 counter;
+} atomic64_t;
+
+#define ATOMIC_INIT(i) {(i)}
+#define ATOMIC64_INIT(i) {(i)}
+
+static inline int atomic_read(const atomic_t* v){
+	return __atomic_load_n(&(v->counter),__ATOMIC_RELAXED);
+}
+
+static inline void atomic_set(atomic_t* v,int i){
+	__atomic_store_n(&(v->counter),i,__ATOMIC_RELAXED);
+}
+
+static inline void atomic_add(int i,atomic_t* v){
+	__atomic_fetch_add(&(v->counter),i,__ATOMIC_RELAXED);
+}
+
+static inline void atomic_sub(int i,atomic_t* v){
+	__atomic_fetch_sub(&(v->counter),i,__ATOMIC_RELAXED);
+}
+
+static inline void atomic_inc(atomic_t* v){
+	atomic_add(1,v);
+}
+
+static inline void atomic_dec(atomic_t* v){
+	atomic_sub(1,v);
+}
+
+static inline int atomic_add_return(int i,atomic_t* v){
+	return __atomic_add_fetch(&(v->counter),i,__ATOMIC_SEQ_CST);
+}
+
+static inline int atomic_sub_return(int i,atomic_t* v){
+	return __atomic_sub_fetch(&(v->counter),i,__ATOMIC_SEQ_CST);
+}
+
+static inline bool atomic_dec_and_test(atomic_t* v){
+	return atomic_sub_return(1,v)==0;
+}
+
+static inline int atomic_cmpxchg(atomic_t* v,int old,int new){
+	__atomic_compare_exchange_n(&(v->counter),&old,new,false,__ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST);
+	return old;
+}
+
+static inline bool atomic_add_unless(atomic_t* v,int a,int u){
+	int c=atomic_read(v);
+	while(c!=u){
+		if(__atomic_compare_exchange_n(&(v->counter),&c,c+a,false,__ATOMIC_SEQ_CST,__ATOMIC_RELAXED)){
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline s64 atomic64_read(const atomic64_t* v){
+	return __atomic_load_n(&(v->counter),__ATOMIC_RELAXED);
+}
+
+static inline void atomic64_set(atomic64_t* v,s64 i){
+	__atomic_store_n(&(v->counter),i,__ATOMIC_RELAXED);
+}
+
+static inline void atomic64_add(s64 i,atomic64_t* v){
+	__atomic_fetch_add(&(v->counter),i,__ATOMIC_RELAXED);
+}
+
+static inline void atomic64_sub(s64 i,atomic64_t* v){
+	__atomic_fetch_sub(&(v->counter),i,__ATOMIC_RELAXED);
+}
+
+static inline void atomic64_inc(atomic64_t* v){
+	atomic64_add(1,v);
+}
+
+static inline void atomic64_dec(atomic64_t* v){
+	atomic64_sub(1,v);
+}
+
+static inline s64 atomic64_add_return(s64 i,atomic64_t* v){
+	return __atomic_add_fetch(&(v->counter),i,__ATOMIC_SEQ_CST);
+}
+
+static inline bool atomic64_try_cmpxchg(atomic64_t* v,s64* old,s64 new){
+	return __atomic_compare_exchange_n(&(v->counter),old,new,false,__ATOMIC_SEQ_CST,__ATOMIC_RELAXED);
+}
+
+/* ------------------------------------------------------------------- locks */
+
+typedef pthread_mutex_t spinlock_t;
+typedef pthread_rwlock_t rwlock_t;
+struct mutex{
+	pthread_mutex_t lock;
+};
+struct rw_semaphore{
+	pthread_rwlock_t lock;
+};
+
+#define DEFINE_SPINLOCK(name) spinlock_t name=PTHREAD_MUTEX_INITIALIZER
+#define DEFINE_MUTEX(name) struct mutex name={PTHREAD_MUTEX_INITIALIZER}
+#define spin_lock_init(lock) pthread_mutex_init((lock),NULL)
+#define spin_lock(lock) pthread_mutex_lock(lock)
+#define spin_unlock(lock) pthread_mutex_unlock(lock)
+#define spin_lock_irqsave(lock,flags) do{ (void)(flags); pthread_mutex_lock(lock); }while(0)
+#define spin_unlock_irqrestore(lock,flags) pthread_mutex_unlock(lock)
+#define rwlock_init(lock) pthread_rwlock_init((lock),NULL)
+#define read_lock(lock) pthread_rwlock_rdlock(lock)
+#define read_unlock(lock) pthread_rwlock_unlock(lock)
+#define write_lock(lock) pthread_rwlock_wrlock(lock)
+#define write_unlock(lock) pthread_rwlock_unlock(lock)
+#define init_rwsem(sem) pthread_rwlock_init(&((sem)->lock),NULL)
+#define down_read(sem) pthread_rwlock_rdlock(&((sem)->lock))
+#define up_read(sem) pthread_rwlock_unlock(&((sem)->lock))
+#define down_write(sem) pthread_rwlock_wrlock(&((sem)->lock))
+#define up_write(sem) pthread_rwlock_unlock(&((sem)->lock))
+#define mutex_init(m) pthread_mutex_init(&((m)->lock),NULL)
+#define mutex_lock(m) pthread_mutex_lock(&((m)->lock))
+#define mutex_unlock(m) pthread_mutex_unlock(&((m)->lock))
+
+/* ------------------------------------------------------------------- lists */
+
+struct list_head{
+	struct list_head *next, *prev;
+};
+
+struct hlist_head{
+	struct hlist_node* first;
+};
+
+struct hlist_node{
+	struct hlist_node *next, **pprev;
+};
+
+#define LIST_HEAD_INIT(name) {&(name),&(name)}
+#define LIST_HEAD(name) struct list_head name=LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head* list){
+	WRITE_ONCE(list->next,list);
+	list->prev=list;
+}
+
+static inline void __list_add(struct list_head* new,struct list_head* prev,struct list_head* next){
+	next->prev=new;
+	new->next=next;
+	new->prev=prev;
+	WRITE_ONCE(prev->next,new);
+}
+
+static inline void list_add(struct list_head* new,struct list_head* head){
+	__list_add(new,head,head->next);
+}
+
+static inline void list_add_tail(struct list_head* new,struct list_head* head){
+	__list_add(new,head->prev,head);
+}
+
+static inline void __list_del(struct list_head* prev,struct list_head* next){
+	next->prev=prev;
+	WRITE_ONCE(prev->next,next);
+}
+
+static inline void list_del(struct list_head* entry){
+	__list_del(entry->prev,entry->next);
+	entry->next=NULL;
+	entry->prev=NULL;
+}
+
+static inline void list_del_init(struct list_head* entry){
+	__list_del(entry->prev,entry->next);
+	INIT_LIST_HEAD(entry);
+}
+
+static inline int list_empty(const struct list_head* head){
+	return READ_ONCE(head->next)==head;
+}
+
+#define list_entry(ptr,type,member) container_of(ptr,type,member)
+#define list_first_entry(ptr,type,member) list_entry((ptr)->next,type,member)
+#define list_next_entry(pos,member) list_entry((pos)->member.next,__typeof__(*(pos)),member)
+#define list_first_entry_or_null(ptr,type,member) (!list_empty(ptr) ? list_first_entry(ptr,type,member) : NULL)
+#define list_for_each_entry(pos,head,member) \
+	for(pos=list_first_entry(head,__typeof__(*pos),member);&(pos->member)!=(head);pos=list_next_entry(pos,member))
+#define list_for_each_entry_safe(pos,n,head,member) \
+	for(pos=list_first_entry(head,__typeof__(*pos),member),n=list_next_entry(pos,member);&(pos->member)!=(head); \
+		pos=n,n=list_next_entry(n,member))
+
+#define INIT_HLIST_NODE(node) do{ (node)->next=NULL; (node)->pprev=NULL; }while(0)
+#define hlist_entry(ptr,type,member) container_of(ptr,type,member)
+#define hlist_entry_safe(ptr,type,member) \
+	({ __typeof__(ptr) ____ptr=(ptr); ____ptr ? hlist_entry(____ptr,type,member) : NULL; })
+
+/* --------------------------------------------------------------------- RCU */
+
+struct rcu_head{
+	struct rcu_head* next;
+	void (*func)(struct rcu_head* head);
+};
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void synchronize_rcu(void);
+void call_rcu(struct rcu_head* head,void (*func)(struct rcu_head* head));
+void rcu_barrier(void);
+
+#define rcu_dereference(p) __atomic_load_n(&(p),__ATOMIC_CONSUME)
+#define rcu_dereference_raw(p) rcu_dereference(p)
+#define rcu_assign_pointer(p,v) __atomic_store_n(&(p),(v),__ATOMIC_RELEASE)
+#define rcu_access_pointer(p) __atomic_load_n(&(p),__ATOMIC_RELAXED)
+#define rcu_dereference_protected(p,c) (p)
+#define RCU_INIT_POINTER(p,v) __atomic_store_n(&(p),(v),__ATOMIC_RELAXED)
+#define lockdep_is_held(lock) 1
+
+//like in the kernel, the callback of kfree_rcu() is the offset of the rcu_head in the object
+#define kfree_rcu(ptr,field) \
+	call_rcu(&((ptr)->field),(void (*)(struct rcu_head*))(void*)(uintptr_t)offsetof(__typeof__(*(ptr)),field))
+
+static inline void list_add_rcu(struct list_head* new,struct list_head* head){
+	struct list_head* next=head->next;
+	new->next=next;
+	new->prev=head;
+	rcu_assign_pointer(head->next,new);
+	next->prev=new;
+}
+
+static inline void list_del_rcu(struct list_head* entry){
+	__list_del(entry->prev,entry->next);
+	entry->prev=NULL;
+}
+
+#define list_entry_rcu(ptr,type,member) container_of(rcu_dereference(ptr),type,member)
+#define list_first_or_null_rcu(ptr,type,member) \
+	({ struct list_head* __ptr=(ptr); struct list_head* __next=rcu_dereference(__ptr->next); \
+		(__ptr!=__next) ? container_of(__next,type,member) : NULL; })
+#define list_next_or_null_rcu(head,ptr,type,member) \
+	({ struct list_head* __head=(head); struct list_head* __next=rcu_dereference((ptr)->next); \
+		(__head!=__next) ? container_of(__next,type,member) : NULL; })
+#define list_for_each_entry_rcu(pos,head,member,...) \
+	for(pos=list_entry_rcu((head)->next,__typeof__(*pos),member);&(pos->member)!=(head); \
+		pos=list_entry_rcu(pos->member.next,__typeof__(*pos),member))
+
+static inline void hlist_add_head_rcu(struct hlist_node* n,struct hlist_head* h){
+	struct hlist_node* first=h->first;
+	n->next=first;
+	n->pprev=&(h->first);
+	rcu_assign_pointer(h->first,n);
+	if(first){
+		first->pprev=&(n->next);
+	}
+}
+
+static inline void hlist_del_rcu(struct hlist_node* n){
+	struct hlist_node* next=n->next;
+	WRITE_ONCE(*(n->pprev),next);
+	if(next){
+		next->pprev=n->pprev;
+	}
+	n->pprev=NULL;
+}
+
+#define hlist_for_each_entry_rcu(pos,head,member,...) \
+	for(pos=hlist_entry_safe(rcu_dereference((head)->first),__typeof__(*(pos)),member);pos; \
+		pos=hlist_entry_safe(rcu_dereference((pos)->member.next),__typeof__(*(pos)),member))
+#define hlist_for_each_entry_safe(pos,n,head,member) \
+	for(pos=hlist_entry_safe((head)->first,__typeof__(*pos),member);pos && ({ n=pos->member.next; 1; }); \
+		pos=hlist_entry_safe(n,__typeof__(*pos),member))
+
+/* -------------------------------------------------------------- hash table */
+
+#define DEFINE_HASHTABLE(name,bits) struct hlist_head name[1<<(bits)]
+#define HASH_SIZE(name) (sizeof(name)/sizeof((name)[0]))
+#define hash_min(val,bits) ((u32)(((u64)(val)*0x61C8864680B583EBULL)>>(64-(bits))))
+#define hash_bits_of(name) (__builtin_ctzll(HASH_SIZE(name)))
+#define hash_add_rcu(table,node,key) hlist_add_head_rcu(node,&(table)[hash_min(key,hash_bits_of(table))])
+#define hash_del_rcu(node) hlist_del_rcu(node)
+#define hash_for_each_possible_rcu(table,obj,member,key,...) \
+	hlist_for_each_entry_rcu(obj,&(table)[hash_min(key,hash_bits_of(table))],member)
+#define hash_for_each_possible(table,obj,member,key) hash_for_each_possible_rcu(table,obj,member,key)
+#define hash_for_each_rcu(table,bkt,obj,member) \
+	for((bkt)=0;(bkt)<HASH_SIZE(table);(bkt)++) hlist_for_each_entry_rcu(obj,&(table)[bkt],member)
+#define hash_for_each_safe(table,bkt,tmp,obj,member) \
+	for((bkt)=0;(bkt)<HASH_SIZE(table);(bkt)++) hlist_for_each_entry_safe(obj,tmp,&(table)[bkt],member)
+
+/* -------------------------------------------------------------------- kref */
+
+struct kref{
+	atomic_t refcount;
+};
+
+static inline void kref_init(struct kref* kref){
+	atomic_set(&(kref->refcount),1);
+}
+
+static inline unsigned int kref_read(const struct kref* kref){
+	return atomic_read(&(kref->refcount));
+}
+
+static inline void kref_get(struct kref* kref){
+	atomic_add(1,&(kref->refcount));
+}
+
+static inline int kref_put(struct kref* kref,void (*release)(struct kref* kref)){
+	if(atomic_dec_and_test(&(kref->refcount))){
+		release(kref);
+		return 1;
+	}
+	return 0;
+}
+
+static inline int kref_put_lock(struct kref* kref,void (*release)(struct kref* kref),spinlock_t* lock){
+	if(atomic_add_unless(&(kref->refcount),-1,1)){
+		return 0;
+	}
+	spin_lock(lock);
+	if(!atomic_dec_and_test(&(kref->refcount))){
+		spin_unlock(lock);
+		return 0;
+	}
+	//the release function drops the lock
+	release(kref);
+	return 1;
+}
+
+static inline int kref_get_unless_zero(struct kref* kref){
+	return atomic_add_unless(&(kref->refcount),1,0);
+}
+
+/* ------------------------------------------------------------------ memory */
+
+struct kmem_cache{
+	size_t size;
+	atomic64_t objects;
+};
+
+void* kmalloc(size_t size,gfp_t gfp);
+void* kzalloc(size_t size,gfp_t gfp);
+void* kcalloc(size_t n,size_t size,gfp_t gfp);
+void* kvzalloc(size_t size,gfp_t gfp);
+void kfree(const void* ptr);
+#define kvfree(ptr) kfree(ptr)
+char* kstrdup(const char* s,gfp_t gfp);
+struct kmem_cache* kmem_cache_create(const char* name,size_t size,size_t align,unsigned long flags,void (*ctor)(void*));
+#define KMEM_CACHE(type,flags) kmem_cache_create(#type,sizeof(struct type),__alignof__(struct type),(flags),NULL)
+void kmem_cache_destroy(struct kmem_cache* cache);
+void* kmem_cache_alloc(struct kmem_cache* cache,gfp_t gfp);
+void* kmem_cache_zalloc(struct kmem_cache* cache,gfp_t gfp);
+void kmem_cache_free(struct kmem_cache* cache,void* obj);
+size_t ksize(const void* ptr);
+
+static inline unsigned int kmem_cache_size(struct kmem_cache* cache){
+	return cache->size;
+}
+
+/* ----------------------------------------------------------- per-CPU data */
+
+#define DEFINE_PER_CPU(type,name) __attribute__((section("ushim_percpu"))) __typeof__(type) name
+#define DECLARE_PER_CPU(type,name) extern __typeof__(type) name
+
+void* ushim_percpu_ptr(const void* ptr,int cpu);
+int ushim_cpu(void);
+int ushim_nr_cpus(void);
+
+#define per_cpu_ptr(ptr,cpu) ((__typeof__(ptr))ushim_percpu_ptr((ptr),(cpu)))
+#define this_cpu_ptr(ptr) per_cpu_ptr(ptr,ushim_cpu())
+#define for_each_possible_cpu(cpu) for((cpu)=0;(cpu)<ushim_nr_cpus();(cpu)++)
+#define num_online_cpus() ushim_nr_cpus()
+//two threads can run on the same CPU, so the per-CPU updates are atomic
+#define this_cpu_add(pcp,val) __atomic_fetch_add(this_cpu_ptr(&(pcp)),(val),__ATOMIC_RELAXED)
+#define this_cpu_inc(pcp) this_cpu_add(pcp,1)
+#define this_cpu_sub(pcp,val) __atomic_fetch_sub(this_cpu_ptr(&(pcp)),(val),__ATOMIC_RELAXED)
+#define this_cpu_dec(pcp) this_cpu_sub(pcp,1)
+#define this_cpu_read(pcp) __atomic_load_n(this_cpu_ptr(&(pcp)),__ATOMIC_RELAXED)
+
+struct percpu_counter{
+	atomic64_t count;
+};
+
+static inline int percpu_counter_init(struct percpu_counter* fbc,s64 amount,gfp_t gfp){
+	atomic64_set(&(fbc->count),amount);
+	return 0;
+}
+
+static inline void percpu_counter_destroy(struct percpu_counter* fbc){
+}
+
+static inline void percpu_counter_add(struct percpu_counter* fbc,s64 amount){
+	atomic64_add(amount,&(fbc->count));
+}
+
+#define percpu_counter_inc(fbc) percpu_counter_add((fbc),1)
+#define percpu_counter_dec(fbc) percpu_counter_add((fbc),-1)
+#define percpu_counter_sum(fbc) atomic64_read(&((fbc)->count))
+#define percpu_counter_read(fbc) atomic64_read(&((fbc)->count))
+
+/* ------------------------------------------------------------------ xarray */
+
+/** \struct xarray
+ * \brief A sorted array of (index, entry) pairs, enough for the few entries of each owner.
+ */
+struct xarray{
+	spinlock_t xa_lock;
+	unsigned long* indexes;
+	void** entries;
+	unsigned int len;
+	unsigned int size;
+};
+
+void xa_init(struct xarray* xa);
+void xa_destroy(struct xarray* xa);
+void* xa_store(struct xarray* xa,unsigned long index,void* entry,gfp_t gfp);
+void* xa_cmpxchg(struct xarray* xa,unsigned long index,void* old,void* entry,gfp_t gfp);
+void* xa_load(struct xarray* xa,unsigned long index);
+void* xa_find(struct xarray* xa,unsigned long* index,unsigned long max,int filter);
+void* xa_find_after(struct xarray* xa,unsigned long* index,unsigned long max,int filter);
+#define xa_lock(xa) spin_lock(&((xa)->xa_lock))
+#define xa_unlock(xa) spin_unlock(&((xa)->xa_lock))
+#define XA_PRESENT 0
+//the errors are returned as error pointers
+#define xa_is_err(entry) IS_ERR(entry)
+#define xa_err(entry) ((int)PTR_ERR(entry))
+#define xa_for_each(xa,index,entry) \
+	for((index)=0,entry=xa_find((xa),&(index),ULONG_MAX,XA_PRESENT);entry; \
+		entry=xa_find_after((xa),&(index),ULONG_MAX,XA_PRESENT))
+
+/* ----------------------------------------------------------------- objects */
+
+struct kobject{
+	struct kref kref;
+	const char* name;
+};
+
+struct attribute{
+	const char* name;
+	umode_t mode;
+};
+
+struct kobj_attribute{
+	struct attribute attr;
+	ssize_t (*show)(struct kobject* kobj,struct kobj_attribute* attr,char* buf);
+	ssize_t (*store)(struct kobject* kobj,struct kobj_attribute* attr,const char* buf,size_t count);
+};
+
+#define VERIFY_OCTAL_PERMISSIONS(perms) (perms)
+#define __ATTR(_name,_mode,_show,_store) {.attr={.name=#_name,.mode=(_mode)},.show=(_show),.store=(_store)}
+#define __ATTR_RO(_name) __ATTR(_name,0444,_name##_show,NULL)
+
+extern struct kobject* kernel_kobj;
+struct kobject* kobject_create_and_add(const char* name,struct kobject* parent);
+struct kobject* kobject_get(struct kobject* kobj);
+void kobject_put(struct kobject* kobj);
+void kobject_del(struct kobject* kobj);
+int sysfs_create_file(struct kobject* kobj,const struct attribute* attr);
+void sysfs_remove_file(struct kobject* kobj,const struct attribute* attr);
+
+/* ------------------------------------------------------------------- files */
+
+struct inode{
+	int fd;
+	struct mutex i_rwsem;
+};
+
+struct dentry{
+	struct dentry* d_parent;
+	struct inode* d_inode;
+	const char* d_name;
+};
+
+struct vfsmount{
+	struct dentry* mnt_root;
+};
+
+struct path{
+	struct vfsmount* mnt;
+	struct dentry* dentry;
+};
+
+struct file;
+
+struct file_operations{
+	void* owner;
+	loff_t (*llseek)(struct file* file,loff_t offset,int whence);
+	ssize_t (*read)(struct file* file,char __user* buf,size_t len,loff_t* ppos);
+	ssize_t (*write)(struct file* file,const char __user* buf,size_t len,loff_t* ppos);
+	int (*open)(struct inode* inode,struct file* file);
+	int (*release)(struct inode* inode,struct file* file);
+};
+
+/** \struct file
+ * \brief An open file, backed by a file descriptor of the process.
+ * \param f_path The dentry holds the pathname, used to unlink the file.
+ * \param f_op The file operations, whose `release` is called by the last `fput()`.
+ * \param f_count The references to the file.
+ * \param f_inode The inode, that holds the file descriptor.
+ * \param f_dentry The dentry of `f_path`.
+ */
+struct file{
+	struct path f_path;
+	const struct file_operations* f_op;
+	atomic_t f_count;
+	struct inode f_inode;
+	struct dentry f_dentry;
+};
+
+#define I_MUTEX_PARENT 1
+#define IS_ROOT(dentry) ((dentry)==(dentry)->d_parent)
+
+struct file* filp_open(const char* pathname,int flags,umode_t mode);
+int filp_close(struct file* file,void* id);
+struct file* fget(unsigned int fd);
+void fput(struct file* file);
+int get_unused_fd_flags(unsigned int flags);
+void fd_install(unsigned int fd,struct file* file);
+void put_unused_fd(unsigned int fd);
+ssize_t kernel_read(struct file* file,void* buf,size_t count,loff_t* pos);
+ssize_t kernel_write(struct file* file,const void* buf,size_t count,loff_t* pos);
+ssize_t vfs_copy_file_range(struct file* src,loff_t pos_in,struct file* dst,loff_t pos_out,size_t len,unsigned int flags);
+loff_t i_size_read(const struct inode* inode);
+loff_t inode_get_bytes(struct inode* inode);
+int vfs_unlink(struct inode* dir,struct dentry* dentry,struct inode** delegated);
+bool d_unlinked(const struct dentry* dentry);
+#define fsnotify_open(file) do{}while(0)
+#define file_inode(file) (&((file)->f_inode))
+#define d_inode(dentry) ((dentry)->d_inode)
+
+static inline struct dentry* dget(struct dentry* dentry){
+	return dentry;
+}
+
+static inline void dput(struct dentry* dentry){
+}
+
+#define dget_parent(dentry) ((dentry)->d_parent)
+#define inode_lock_nested(inode,subclass) mutex_lock(&((inode)->i_rwsem))
+#define inode_lock(inode) mutex_lock(&((inode)->i_rwsem))
+#define inode_unlock(inode) mutex_unlock(&((inode)->i_rwsem))
+#define mnt_want_write(mnt) 0
+#define mnt_drop_write(mnt) do{}while(0)
+
+/* ---------------------------------------------------------------- seq_file */
+
+struct seq_file{
+	FILE* out;
+};
+
+#define seq_printf(m,fmt,...) fprintf((m)->out,fmt,##__VA_ARGS__)
+#define seq_putc(m,c) fputc((c),(m)->out)
+#define seq_puts(m,s) fputs((s),(m)->out)
+struct seq_operations{
+	void* (*start)(struct seq_file* m,loff_t* pos);
+	void (*stop)(struct seq_file* m,void* v);
+	void* (*next)(struct seq_file* m,void* v,loff_t* pos);
+	int (*show)(struct seq_file* m,void* v);
+};
+
+int single_open(struct file* file,int (*show)(struct seq_file* m,void* v),void* data);
+int single_release(struct inode* inode,struct file* file);
+ssize_t seq_read(struct file* file,char __user* buf,size_t len,loff_t* ppos);
+loff_t seq_lseek(struct file* file,loff_t offset,int whence);
+
+struct proc_dir_entry;
+struct proc_dir_entry* proc_mkdir(const char* name,struct proc_dir_entry* parent);
+struct proc_dir_entry* proc_create_seq(const char* name,umode_t mode,struct proc_dir_entry* parent,
+	const struct seq_operations* ops);
+void proc_remove(struct proc_dir_entry* entry);
+struct dentry* debugfs_create_dir(const char* name,struct dentry* parent);
+struct dentry* debugfs_create_file(const char* name,umode_t mode,struct dentry* parent,void* data,
+	const struct file_operations* fops);
+void debugfs_remove_recursive(struct dentry* dentry);
+void debugfs_remove(struct dentry* dentry);
+loff_t default_llseek(struct file* file,loff_t offset,int whence);
+ssize_t simple_read_from_buffer(void __user* to,size_t count,loff_t* ppos,const void* from,size_t available);
+int kstrtobool_from_user(const char __user* s,size_t count,bool* res);
+
+/** \brief Prints the content of a procfs file created with `proc_create_seq()`.
+ * \param[in] name The name of the file.
+ * \param[in] out The stream where the content is printed.
+ * \returns 0, an error returned by the show operation, or -ENOENT if the file does not exist.
+ *
+ * The iterator is stopped and restarted after each record, like `seq_read()` does when its buffer is full.
+ */
+int ushim_proc_show(const char* name,FILE* out);
+
+/* ------------------------------------------------------------------- relay */
+
+//the relay channels can't be opened, since debugfs does nothing, so the session operations are never recorded
+struct rchan;
+struct rchan_buf;
+
+struct rchan_callbacks{
+	int (*subbuf_start)(struct rchan_buf* buf,void* subbuf,void* prev_subbuf,size_t prev_padding);
+	struct dentry* (*create_buf_file)(const char* filename,struct dentry* parent,umode_t mode,struct rchan_buf* buf,
+		int* is_global);
+	int (*remove_buf_file)(struct dentry* dentry);
+};
+
+extern const struct file_operations relay_file_operations;
+
+struct rchan* relay_open(const char* base_filename,struct dentry* parent,size_t subbuf_size,size_t n_subbufs,
+	struct rchan_callbacks* cb,void* private_data);
+static inline void relay_write(struct rchan* chan,const void* data,size_t length){
+}
+static inline void relay_flush(struct rchan* chan){
+}
+static inline void relay_close(struct rchan* chan){
+}
+static inline int relay_buf_full(struct rchan_buf* buf){
+	return 0;
+}
+
+/* ------------------------------------------------------------------ random */
+
+typedef struct{
+	u64 key[2];
+} siphash_key_t;
+
+void get_random_bytes(void* buf,int nbytes);
+
+/** \brief Keyed hash of a buffer, a keyed FNV-1a instead of the SipHash of the kernel.
+ * \param[in] data The buffer.
+ * \param[in] len The length of `data`.
+ * \param[in] key The key.
+ * \returns The hash.
+ */
+u64 siphash(const void* data,size_t len,const siphash_key_t* key);
+
+/** \brief Hash of a name, the FNV-1a of `siphash()` without a key.
+ * \param[in] salt Ignored.
+ * \param[in] name The name.
+ * \param[in] len The length of `name`.
+ * \returns The hash.
+ */
+unsigned int full_name_hash(const void* salt,const char* name,unsigned int len);
+
+/* ------------------------------------------------------------------- tasks */
+
+#define TASK_COMM_LEN 16
+#define PF_EXITING 0x00000004
+#define PF_KTHREAD 0x00200000
+
+struct task_struct{
+	unsigned int flags;
+	pid_t pid;
+	pid_t tgid;
+	char comm[TASK_COMM_LEN];
+};
+
+struct pid;
+enum pid_type{
+	PIDTYPE_PID
+};
+
+struct task_struct* ushim_current(void);
+#define current ushim_current()
+#define task_tgid_nr(task) ((task)->tgid)
+#define task_pid_nr(task) ((task)->pid)
+//the processes of the replayed traces don't exist, so they are never found
+static inline struct pid* find_get_pid(pid_t nr){
+	return NULL;
+}
+
+static inline struct pid* find_vpid(pid_t nr){
+	return NULL;
+}
+
+static inline struct task_struct* pid_task(struct pid* pid,enum pid_type type){
+	return NULL;
+}
+
+static inline struct task_struct* get_pid_task(struct pid* pid,enum pid_type type){
+	return NULL;
+}
+
+static inline void put_pid(struct pid* pid){
+}
+
+static inline void put_task_struct(struct task_struct* task){
+}
+
+static inline int send_sig(int sig,struct task_struct* task,int priv){
+	return 0;
+}
+
+typedef struct{
+	uid_t val;
+} kuid_t;
+
+struct user_namespace{
+	int level;
+};
+
+extern struct user_namespace init_user_ns;
+
+///The fsuid of the current task is the effective uid of the process.
+kuid_t current_fsuid(void);
+
+static inline uid_t from_kuid(struct user_namespace* ns,kuid_t kuid){
+	return kuid.val;
+}
+
+/* -------------------------------------------------------------------- time */
+
+ktime_t ktime_get_real(void);
+u64 ktime_get_ns(void);
+
+#define HZ 1000
+#define msecs_to_jiffies(ms) ((unsigned long)(ms))
+
+/* -------------------------------------------------------------- wait queues */
+
+typedef struct{
+	int unused;
+} wait_queue_head_t;
+
+///Sleeps for a jiffy.
+void ushim_sleep_jiffy(void);
+
+//nobody sleeps on the wait queues: the waits check their condition once per jiffy, so the wake ups do nothing
+#define DECLARE_WAIT_QUEUE_HEAD(name) wait_queue_head_t name={0}
+#define wq_has_sleeper(wq) false
+#define wake_up_all(wq) do{}while(0)
+#define wait_event_interruptible_timeout(wq,condition,timeout) ({ \
+	long __left=(timeout); \
+	bool __done; \
+	while(!(__done=(condition)) && __left>0){ \
+		ushim_sleep_jiffy(); \
+		__left--; \
+	} \
+	__done ? ((__left>0) ? __left : 1) : 0; \
+})
+
+/* ---------------------------------------------------------------- workqueue */
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct* work);
+
+struct work_struct{
+	work_func_t func;
+};
+
+/** \struct delayed_work
+ * \brief A work run by the shim worker thread when its deadline expires.
+ * \param work The work.
+ * \param deadline The expiration, in nanoseconds of `ktime_get_ns()`.
+ * \param node Links the pending works.
+ * \param pending True if the work is queued.
+ */
+struct delayed_work{
+	struct work_struct work;
+	u64 deadline;
+	struct list_head node;
+	bool pending;
+};
+
+#define DECLARE_DELAYED_WORK(name,fn) struct delayed_work name={.work={.func=(fn)},.node={NULL,NULL},.pending=false}
+bool schedule_delayed_work(struct delayed_work* dwork,unsigned long delay);
+bool cancel_delayed_work_sync(struct delayed_work* dwork);
+void flush_delayed_work(struct delayed_work* dwork);
+
+/* ----------------------------------------------------------------- tracing */
+
+//the tracepoints are empty functions, so the calls are optimized away
+#define TP_PROTO(...) __VA_ARGS__
+#define TP_ARGS(...) __VA_ARGS__
+#define TRACE_EVENT(name,proto,args,tstruct,assign,print) \
+	static inline void trace_##name(proto){}
+#define DECLARE_EVENT_CLASS(name,proto,args,tstruct,assign,print)
+#define DEFINE_EVENT(template,name,proto,args) \
+	static inline void trace_##name(proto){}
+
+/* -------------------------------------------------------------------- shim */
+
+/** \brief Initializes the shim, must be called before using the kernel APIs.
+ * \returns 0 or an error code.
+ *
+ * Replicates the per-CPU variables and starts the worker thread.
+ */
+int ushim_init(void);
+
+/** \brief Stops the worker thread, running the pending RCU callbacks, and frees the per-CPU variables.
+ */
+void ushim_exit(void);
+#endif
@@ -0,0 +1,912 @@
+/** \file
+ * \brief Replays a trace of session opens and closes against the session manager built in userspace.
+ *
+ * The trace is the text output of the `sessionfs_incarnation_create` and `sessionfs_commit` tracepoints, as printed by
+ * ftrace (`/sys/kernel/tracing/trace`, `trace-cmd report`) or by `perf script`: each incarnation is opened by its
+ * create event and closed by the commit event with the same incarnation pathname. The other lines are ignored.
+ * A binary trace recorded by the module, see sessionfs_record.h, is recognized and replayed too.
+ * A synthetic trace can be generated instead, with `-S`.
+ *
+ * The original files of the trace are replaced by files in the replay directory, created with the requested size.
+ * The events of each process are replayed in order by the same thread, the processes are spread over the threads,
+ * and the latency of `create_session()` and `close_session_file()` is recorded in a `::latency_hist`.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "latency_hist.h"
+#include "session_trace.h"
+#include "session_manager.h"
+#include "session_info.h"
+#include "session_stats.h"
+
+///Default size of the original files.
+#define DEFAULT_FILE_SIZE 4096
+
+///Default number of threads.
+#define DEFAULT_THREADS 1
+
+///Permissions of the original and incarnation files.
+#define DEFAULT_PERM 0644
+
+///The number of processes of a synthetic trace.
+#define SYNTH_PROCS 64
+
+///The maximum number of incarnations opened by each process of a synthetic trace.
+#define SYNTH_OPEN_MAX 4
+
+///The interval between two events of a synthetic trace, in nanoseconds.
+#define SYNTH_INTERVAL_NS 1000
+
+///The maximum length of a trace line.
+#define LINE_MAX_LEN 8192
+
+/** \enum replay_op
+ * \brief The replayed operations.
+ */
+enum replay_op{
+	OP_OPEN,	///< `create_session()`, which copies the original file over the incarnation.
+	OP_CLOSE,	///< `close_session_file()`, which commits the incarnation over the original file.
+	OP_NUM		///< Number of replayed operations.
+};
+
+///Names of the replayed operations, indexed by `::replay_op`.
+const char* op_names[OP_NUM]={"open","close"};
+
+/**
+ * \struct replay_event
+ * \brief An event of the trace.
+ * \param ts The timestamp of the event, in nanoseconds.
+ * \param op The operation.
+ * \param pid The process that has done the operation.
+ * \param file The original file, an index of the files of the trace.
+ * \param slot The incarnation, an index of the incarnations of the trace.
+ */
+struct replay_event{
+	uint64_t ts;
+	enum replay_op op;
+	pid_t pid;
+	int file;
+	int slot;
+};
+
+/**
+ * \struct name_map
+ * \brief Assigns consecutive ids to strings, with open addressing.
+ * \param names The strings, `NULL` in the empty buckets.
+ * \param ids The id of each string.
+ * \param size The number of buckets, a power of two.
+ * \param num The number of strings.
+ */
+struct name_map{
+	char** names;
+	int* ids;
+	int size;
+	int num;
+};
+
+/**
+ * \struct replay_trace
+ * \brief The trace to replay.
+ * \param events The events, in order.
+ * \param num The number of events.
+ * \param size The allocated events.
+ * \param files The pathnames of the original files of the trace.
+ * \param incarnations The pathnames of the incarnations of the trace.
+ */
+struct replay_trace{
+	struct replay_event* events;
+	long num;
+	long size;
+	struct name_map files;
+	struct name_map incarnations;
+};
+
+/**
+ * \struct replay_config
+ * \brief The parameters of the replay.
+ * \param dir The directory of the original files.
+ * \param file_size The size of the original files.
+ * \param write_size The bytes written in each incarnation before closing it.
+ * \param threads The number of threads.
+ * \param speed The replay speed relative to the trace, 0 replays the events without waiting.
+ * \param policy The policy of the sessions.
+ * \param show_table If set the session table is printed at the end of the replay.
+ * \param json If set the results are printed as JSON instead of a table.
+ * \param trace The pathname of the trace, `NULL` for a synthetic trace.
+ * \param synth_files The number of original files of the synthetic trace.
+ * \param synth_opens The number of opens of the synthetic trace.
+ */
+struct replay_config{
+	const char* dir;
+	long file_size;
+	long write_size;
+	int threads;
+	double speed;
+	struct sess_policy policy;
+	int show_table;
+	int json;
+	const char* trace;
+	int synth_files;
+	long synth_opens;
+};
+
+/**
+ * \struct replay_thread
+ * \brief The state of a replay thread.
+ * \param config The parameters of the replay.
+ * \param trace The trace.
+ * \param thread The pthread that replays the events.
+ * \param events The indexes of the events replayed by the thread.
+ * \param num The number of events replayed by the thread.
+ * \param hist The latency of each operation.
+ * \param errors The number of failed opens.
+ * \param start The start of the replay, from `now_ns()`.
+ */
+struct replay_thread{
+	const struct replay_config* config;
+	const struct replay_trace* trace;
+	pthread_t thread;
+	long* events;
+	long num;
+	struct latency_hist hist[OP_NUM];
+	long errors;
+	uint64_t start;
+};
+
+///The open incarnations, indexed by the `slot` of their events.
+struct incarnation** slots=NULL;
+
+/** \brief Returns the current time of the monotonic clock, in nanoseconds.
+ */
+uint64_t now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+/** \brief Hashes a string with FNV-1a.
+ * \param[in] str The string.
+ */
+uint64_t hash_name(const char* str){
+	uint64_t hash=14695981039346656037ULL;
+	for(;*str!='\0';str++){
+		hash=(hash^(unsigned char)*str)*1099511628211ULL;
+	}
+	return hash;
+}
+
+/** \brief Returns the id of a string, assigning the next one if the string is new.
+ * \param[in,out] map The map.
+ * \param[in] name The string.
+ * \returns The id or -1 if there is not enough memory.
+ */
+int map_name(struct name_map* map,const char* name){
+	struct name_map grown;
+	int i,pos;
+	if(map->num*2>=map->size){
+		grown.size=(map->size==0) ? 64 : map->size*2;
+		grown.num=map->num;
+		grown.names=calloc(grown.size,sizeof(char*));
+		grown.ids=calloc(grown.size,sizeof(int));
+		if(grown.names==NULL || grown.ids==NULL){
+			free(grown.names);
+			free(grown.ids);
+			return -1;
+		}
+		for(i=0;i<map->size;i++){
+			if(map->names[i]==NULL){
+				continue;
+			}
+			for(pos=hash_name(map->names[i])&(grown.size-1);grown.names[pos]!=NULL;pos=(pos+1)&(grown.size-1)){
+			}
+			grown.names[pos]=map->names[i];
+			grown.ids[pos]=map->ids[i];
+		}
+		free(map->names);
+		free(map->ids);
+		*map=grown;
+	}
+	for(pos=hash_name(name)&(map->size-1);map->names[pos]!=NULL;pos=(pos+1)&(map->size-1)){
+		if(strcmp(map->names[pos],name)==0){
+			return map->ids[pos];
+		}
+	}
+	map->names[pos]=strdup(name);
+	if(map->names[pos]==NULL){
+		return -1;
+	}
+	map->ids[pos]=map->num++;
+	return map->ids[pos];
+}
+
+/** \brief Returns the id of a string, if it has one.
+ * \param[in] map The map.
+ * \param[in] name The string.
+ * \returns The id or -1.
+ */
+int find_name(const struct name_map* map,const char* name){
+	int pos;
+	if(map->size==0){
+		return -1;
+	}
+	for(pos=hash_name(name)&(map->size-1);map->names[pos]!=NULL;pos=(pos+1)&(map->size-1)){
+		if(strcmp(map->names[pos],name)==0){
+			return map->ids[pos];
+		}
+	}
+	return -1;
+}
+
+/** \brief Frees the strings of a map.
+ * \param[in,out] map The map.
+ */
+void free_map(struct name_map* map){
+	int i;
+	for(i=0;i<map->size;i++){
+		free(map->names[i]);
+	}
+	free(map->names);
+	free(map->ids);
+	memset(map,0,sizeof(struct name_map));
+}
+
+/** \brief Appends an event to the trace.
+ * \param[in,out] trace The trace.
+ * \param[in] event The event.
+ * \returns 0 or -1 if there is not enough memory.
+ */
+int add_event(struct replay_trace* trace,const struct replay_event* event){
+	struct replay_event* events;
+	if(trace->num==trace->size){
+		events=realloc(trace->events,sizeof(struct replay_event)*((trace->size==0) ? 1024 : trace->size*2));
+		if(events==NULL){
+			return -1;
+		}
+		trace->events=events;
+		trace->size=(trace->size==0) ? 1024 : trace->size*2;
+	}
+	trace->events[trace->num++]=*event;
+	return 0;
+}
+
+/** \brief Copies the value of a `key=value` field of a trace line.
+ * \param[in] line The trace line.
+ * \param[in] key The key, followed by '='.
+ * \param[out] value The value, which ends at the first blank.
+ * \param[in] len The length of `value`.
+ * \returns 0 or -1 if the field is missing.
+ */
+int get_field(const char* line,const char* key,char* value,size_t len){
+	const char* it;
+	size_t i;
+	for(it=strstr(line,key);it!=NULL;it=strstr(it+1,key)){
+		//the key must be a whole word
+		if(it==line || it[-1]==' '){
+			break;
+		}
+	}
+	if(it==NULL){
+		return -1;
+	}
+	it+=strlen(key);
+	for(i=0;i+1<len && it[i]!='\0' && it[i]!=' ' && it[i]!='\n';i++){
+		value[i]=it[i];
+	}
+	value[i]='\0';
+	return 0;
+}
+
+/** \brief Parses the timestamp of a trace line, the word before the event name.
+ * \param[in] line The trace line.
+ * \param[in] event The position of the event name in `line`.
+ * \returns The timestamp in nanoseconds, 0 if it can't be parsed.
+ */
+uint64_t get_timestamp(const char* line,const char* event){
+	const char* it=event;
+	//perf prefixes the event name with the trace system
+	while(it>line && it[-1]!=' '){
+		it--;
+	}
+	while(it>line && it[-1]==' '){
+		it--;
+	}
+	while(it>line && it[-1]!=' '){
+		it--;
+	}
+	return (uint64_t)(strtod(it,NULL)*1e9);
+}
+
+/** \brief Reads a trace printed by ftrace or perf.
+ * \param[in] pathname The pathname of the trace, "-" for the standard input.
+ * \param[out] trace The trace.
+ * \returns 0 or -1 on error.
+ *
+ * The commits without a matching open, of incarnations created before the trace started, are skipped.
+ */
+int read_trace(const char* pathname,struct replay_trace* trace){
+	char line[LINE_MAX_LEN], path[PATH_MAX], incarnation[PATH_MAX], pid[32];
+	struct replay_event event;
+	const char* name;
+	pid_t* owners=NULL, *grown;
+	int owners_size=0;
+	FILE* in;
+	int res=0;
+	in=(strcmp(pathname,"-")==0) ? stdin : fopen(pathname,"r");
+	if(in==NULL){
+		fprintf(stderr,"can't open %s: %s\n",pathname,strerror(errno));
+		return -1;
+	}
+	while(res==0 && fgets(line,sizeof(line),in)!=NULL){
+		if((name=strstr(line,"sessionfs_incarnation_create: "))!=NULL){
+			event.op=OP_OPEN;
+		} else if((name=strstr(line,"sessionfs_commit: "))!=NULL){
+			event.op=OP_CLOSE;
+		} else {
+			continue;
+		}
+		if(get_field(name,"pathname=",path,sizeof(path))<0 || get_field(name,"incarnation=",incarnation,sizeof(incarnation))<0){
+			continue;
+		}
+		event.ts=get_timestamp(line,name);
+		if(event.op==OP_OPEN){
+			event.pid=(get_field(name,"pid=",pid,sizeof(pid))==0) ? atoi(pid) : 0;
+			event.file=map_name(&(trace->files),path);
+			event.slot=map_name(&(trace->incarnations),incarnation);
+			if(event.file<0 || event.slot<0){
+				res=-1;
+				break;
+			}
+			if(event.slot>=owners_size){
+				grown=realloc(owners,sizeof(pid_t)*(event.slot+1)*2);
+				if(grown==NULL){
+					res=-1;
+					break;
+				}
+				owners=grown;
+				owners_size=(event.slot+1)*2;
+			}
+			owners[event.slot]=event.pid;
+		} else {
+			event.slot=find_name(&(trace->incarnations),incarnation);
+			if(event.slot<0){
+				continue;
+			}
+			//the commit is replayed by the thread of the open, the process could be exiting
+			event.pid=owners[event.slot];
+			event.file=find_name(&(trace->files),path);
+		}
+		res=add_event(trace,&event);
+	}
+	free(owners);
+	if(in!=stdin){
+		fclose(in);
+	}
+	if(res<0){
+		fprintf(stderr,"not enough memory to read the trace\n");
+	}
+	return res;
+}
+
+/** \brief Reads a binary trace recorded by the module.
+ * \param[in] pathname The pathname of the trace.
+ * \param[out] trace The trace.
+ * \returns 0 or -1 on error.
+ *
+ * The hashes of the pathnames are used as names; the failed opens and the closes without a matching open are skipped.
+ */
+int read_records(const char* pathname,struct replay_trace* trace){
+	struct session_trace records={0};
+	const struct sess_record* record;
+	struct replay_event event;
+	char path[32], incarnation[32];
+	pid_t* owners=NULL, *grown;
+	int owners_size=0;
+	long i;
+	int res;
+	res=read_session_trace(pathname,&records);
+	if(res<0){
+		return -1;
+	}
+	sort_session_trace(&records);
+	for(i=0;res==0 && i<records.num;i++){
+		record=&(records.records[i]);
+		if(record->op==RECORD_OPEN && (record->res<0 || record->inc_id==0)){
+			continue;
+		}
+		snprintf(path,sizeof(path),"%016llx",(unsigned long long)record->file_id);
+		snprintf(incarnation,sizeof(incarnation),"%016llx",(unsigned long long)record->inc_id);
+		event.ts=record->ts_ns;
+		if(record->op==RECORD_OPEN){
+			event.op=OP_OPEN;
+			event.pid=record->pid;
+			event.file=map_name(&(trace->files),path);
+			event.slot=map_name(&(trace->incarnations),incarnation);
+			if(event.file<0 || event.slot<0){
+				res=-1;
+				break;
+			}
+			if(event.slot>=owners_size){
+				grown=realloc(owners,sizeof(pid_t)*(event.slot+1)*2);
+				if(grown==NULL){
+					res=-1;
+					break;
+				}
+				owners=grown;
+				owners_size=(event.slot+1)*2;
+			}
+			owners[event.slot]=event.pid;
+		} else {
+			event.op=OP_CLOSE;
+			event.slot=find_name(&(trace->incarnations),incarnation);
+			if(event.slot<0){
+				continue;
+			}
+			event.pid=owners[event.slot];
+			event.file=find_name(&(trace->files),path);
+		}
+		res=add_event(trace,&event);
+	}
+	free(owners);
+	free_session_trace(&records);
+	if(res<0){
+		fprintf(stderr,"not enough memory to read the trace\n");
+	}
+	return res;
+}
+
+/** \brief Generates a synthetic trace.
+ * \param[in] files The number of original files.
+ * \param[in] opens The number of opens.
+ * \param[out] trace The trace.
+ * \returns 0 or -1 if there is not enough memory.
+ *
+ * ::SYNTH_PROCS processes open uniformly random files, each one keeps at most ::SYNTH_OPEN_MAX incarnations open and
+ * closes them in order; the incarnations still open at the end are closed by the last events.
+ */
+int synth_trace(int files,long opens,struct replay_trace* trace){
+	int open[SYNTH_PROCS][SYNTH_OPEN_MAX], num[SYNTH_PROCS]={0};
+	struct replay_event event;
+	char name[64];
+	unsigned short seed[3]={1,2,3};
+	long opened=0;
+	int i,proc;
+	for(i=0;i<files;i++){
+		snprintf(name,sizeof(name),"%d",i);
+		if(map_name(&(trace->files),name)<0){
+			return -1;
+		}
+	}
+	event.ts=0;
+	while(opened<opens){
+		proc=nrand48(seed)%SYNTH_PROCS;
+		event.pid=proc+1;
+		event.ts+=SYNTH_INTERVAL_NS;
+		if(num[proc]==SYNTH_OPEN_MAX || (num[proc]>0 && nrand48(seed)%2==0)){
+			event.op=OP_CLOSE;
+			event.slot=open[proc][0];
+			memmove(open[proc],open[proc]+1,sizeof(int)*(--num[proc]));
+		} else {
+			event.op=OP_OPEN;
+			event.file=nrand48(seed)%files;
+			event.slot=trace->incarnations.num++;
+			open[proc][num[proc]++]=event.slot;
+			opened++;
+		}
+		if(add_event(trace,&event)<0){
+			return -1;
+		}
+	}
+	event.op=OP_CLOSE;
+	for(proc=0;proc<SYNTH_PROCS;proc++){
+		event.pid=proc+1;
+		for(i=0;i<num[proc];i++){
+			event.ts+=SYNTH_INTERVAL_NS;
+			event.slot=open[proc][i];
+			if(add_event(trace,&event)<0){
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+/** \brief Returns the pathname of an original file in the replay directory.
+ * \param[in] config The parameters of the replay.
+ * \param[in] file The index of the file.
+ * \param[out] pathname The pathname, ::PATH_MAX bytes long.
+ */
+void file_pathname(const struct replay_config* config,int file,char* pathname){
+	snprintf(pathname,PATH_MAX,"%s/ushim-replay-%d",config->dir,file);
+}
+
+/** \brief Creates an original file.
+ * \param[in] pathname The pathname of the file.
+ * \param[in] size The size of the file.
+ * \returns 0 on success or -1, setting `errno`.
+ */
+int create_file(const char* pathname,long size){
+	char buf[DEFAULT_FILE_SIZE];
+	long written=0;
+	ssize_t res;
+	int fd;
+	fd=open(pathname,O_CREAT | O_TRUNC | O_WRONLY,DEFAULT_PERM);
+	if(fd<0){
+		return -1;
+	}
+	memset(buf,'a',sizeof(buf));
+	while(written<size){
+		res=write(fd,buf,(size-written<(long)sizeof(buf)) ? size-written : (long)sizeof(buf));
+		if(res<0){
+			close(fd);
+			return -1;
+		}
+		written+=res;
+	}
+	return close(fd);
+}
+
+/** \brief Waits for the time of an event, if the replay is paced.
+ * \param[in] t The thread state.
+ * \param[in] event The event.
+ */
+void wait_event(const struct replay_thread* t,const struct replay_event* event){
+	uint64_t target,now;
+	struct timespec ts;
+	if(t->config->speed<=0){
+		return;
+	}
+	target=t->start+(uint64_t)((event->ts-t->trace->events[0].ts)/t->config->speed);
+	now=now_ns();
+	if(target>now){
+		ts.tv_sec=(target-now)/1000000000;
+		ts.tv_nsec=(target-now)%1000000000;
+		nanosleep(&ts,NULL);
+	}
+}
+
+/** \brief Closes an incarnation, writing in it first.
+ * \param[in,out] t The thread state.
+ * \param[in] incarnation The incarnation.
+ * \param[in] buf The data written in the incarnation.
+ */
+void replay_close(struct replay_thread* t,struct incarnation* incarnation,const char* buf){
+	loff_t pos=0;
+	uint64_t start;
+	if(t->config->write_size>0 && incarnation->status==0){
+		kernel_write(incarnation->file,buf,t->config->write_size,&pos);
+	}
+	start=now_ns();
+	close_session_file(incarnation);
+	hist_record(&(t->hist[OP_CLOSE]),now_ns()-start);
+}
+
+/** \brief Body of a replay thread.
+ * \param[in,out] arg The `::replay_thread` of the thread.
+ * \returns `NULL`.
+ */
+void* replay_thread_fn(void* arg){
+	struct replay_thread* t=arg;
+	const struct replay_event* event;
+	struct incarnation* incarnation;
+	char pathname[PATH_MAX];
+	uint64_t start;
+	char* buf;
+	long i;
+	buf=malloc((t->config->write_size>0) ? t->config->write_size : 1);
+	if(buf==NULL){
+		t->errors++;
+		return NULL;
+	}
+	memset(buf,'b',(t->config->write_size>0) ? t->config->write_size : 1);
+	for(i=0;i<t->num;i++){
+		event=&(t->trace->events[t->events[i]]);
+		wait_event(t,event);
+		if(event->op==OP_OPEN){
+			file_pathname(t->config,event->file,pathname);
+			start=now_ns();
+			incarnation=create_session(pathname,O_RDWR,event->pid,DEFAULT_PERM,NO_FD,&(t->config->policy),NULL);
+			hist_record(&(t->hist[OP_OPEN]),now_ns()-start);
+			if(IS_ERR(incarnation)){
+				t->errors++;
+				continue;
+			}
+			slots[event->slot]=incarnation;
+		} else if(slots[event->slot]!=NULL){
+			replay_close(t,slots[event->slot],buf);
+			slots[event->slot]=NULL;
+		}
+	}
+	free(buf);
+	return NULL;
+}
+
+/** \brief Prints the results as a table, in microseconds.
+ * \param[in] config The parameters of the replay.
+ * \param[in] hist The merged latency of each operation.
+ * \param[in] elapsed The duration of the replay, in nanoseconds.
+ * \param[in] errors The number of failed opens.
+ */
+void print_results(const struct replay_config* config,const struct latency_hist* hist,uint64_t elapsed,long errors){
+	int i;
+	printf("ushim-replay: %s, file size %ld, write size %ld, threads %d, %ld failed opens, %.0f sessions/s\n",
+		(config->trace!=NULL) ? config->trace : "synthetic trace",config->file_size,config->write_size,config->threads,
+		errors,(elapsed>0) ? hist[OP_CLOSE].count*1e9/elapsed : 0);
+	printf("%-6s %10s %10s %10s %10s %10s %10s %10s\n","op","count","min us","mean us","p50 us","p99 us","p999 us","max us");
+	for(i=0;i<OP_NUM;i++){
+		printf("%-6s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",op_names[i],(unsigned long long)hist[i].count,
+			(hist[i].count>0) ? hist[i].min/1e3 : 0,hist_mean(&hist[i])/1e3,hist_percentile(&hist[i],50)/1e3,
+			hist_percentile(&hist[i],99)/1e3,hist_percentile(&hist[i],99.9)/1e3,hist[i].max/1e3);
+	}
+}
+
+/** \brief Prints the results as a JSON object, in nanoseconds.
+ * \param[in] config The parameters of the replay.
+ * \param[in] hist The merged latency of each operation.
+ * \param[in] elapsed The duration of the replay, in nanoseconds.
+ * \param[in] errors The number of failed opens.
+ *
+ * The pathname of the trace is not printed, so it needs no escaping.
+ */
+void print_json(const struct replay_config* config,const struct latency_hist* hist,uint64_t elapsed,long errors){
+	int i;
+	printf("{\"config\":{\"synthetic\":%s,\"file_size\":%ld,\"write_size\":%ld,\"threads\":%d,\"speed\":%g,\"copy_engine\":%d,"
+		"\"commit_mode\":%d},",(config->trace==NULL) ? "true" : "false",config->file_size,config->write_size,config->threads,
+		config->speed,config->policy.copy_engine,config->policy.commit_mode);
+	printf("\"elapsed_ns\":%llu,\"sessions_per_s\":%.0f,\"errors\":%ld,\"results\":{",(unsigned long long)elapsed,
+		(elapsed>0) ? hist[OP_CLOSE].count*1e9/elapsed : 0,errors);
+	for(i=0;i<OP_NUM;i++){
+		printf("%s\"%s\":{\"count\":%llu,\"min_ns\":%llu,\"mean_ns\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+			(i>0) ? "," : "",op_names[i],(unsigned long long)hist[i].count,(unsigned long long)((hist[i].count>0) ? hist[i].min : 0),
+			hist_mean(&hist[i]),(unsigned long long)hist_percentile(&hist[i],50),(unsigned long long)hist_percentile(&hist[i],99),
+			(unsigned long long)hist_percentile(&hist[i],99.9),(unsigned long long)hist[i].max);
+	}
+	printf("}}\n");
+}
+
+/** \brief Prints the usage of the replay driver.
+ * \param[in] name The name of the program.
+ */
+void usage(const char* name){
+	printf("usage: %s -d dir [-s file size] [-w write size] [-t threads] [-x speed] [-c rw|range] [-D] [-P] [-j] trace|-S files,opens\n",name);
+	printf("  -d  directory of the original files\n");
+	printf("  -s  size of the original files in bytes (default %d)\n",DEFAULT_FILE_SIZE);
+	printf("  -w  bytes written in each incarnation before closing it (default 0)\n");
+	printf("  -t  number of threads, the processes of the trace are spread over them (default %d)\n",DEFAULT_THREADS);
+	printf("  -x  replay speed relative to the trace, 0 replays without waiting (default 0)\n");
+	printf("  -c  copy engine of the sessions (default rw)\n");
+	printf("  -D  discard the incarnations instead of committing them\n");
+	printf("  -P  print the session table at the end of the replay\n");
+	printf("  -j  print the results as JSON, in nanoseconds\n");
+	printf("  -S  replay a synthetic trace of opens over the given number of files\n");
+	printf("  the trace is the ftrace or perf script output of the sessionfs tracepoints, - for the standard input,\n");
+	printf("  or a binary trace recorded by the module\n");
+}
+
+/** \brief Parses the command line.
+ * \param[in] argc The number of arguments.
+ * \param[in] argv The arguments.
+ * \param[out] config The parameters of the replay.
+ * \returns 0 on success or -1 if the arguments are invalid.
+ */
+int parse_args(int argc,char** argv,struct replay_config* config){
+	int opt;
+	memset(config,0,sizeof(struct replay_config));
+	config->file_size=DEFAULT_FILE_SIZE;
+	config->threads=DEFAULT_THREADS;
+	config->policy=default_policy;
+	while((opt=getopt(argc,argv,"d:s:w:t:x:c:DPjS:h"))!=-1){
+		switch(opt){
+			case 'd':
+				config->dir=optarg;
+				break;
+			case 's':
+				config->file_size=atol(optarg);
+				break;
+			case 'w':
+				config->write_size=atol(optarg);
+				break;
+			case 't':
+				config->threads=atoi(optarg);
+				break;
+			case 'x':
+				config->speed=atof(optarg);
+				break;
+			case 'c':
+				if(strcmp(optarg,"rw")==0){
+					config->policy.copy_engine=COPY_READ_WRITE;
+				} else if(strcmp(optarg,"range")==0){
+					config->policy.copy_engine=COPY_FILE_RANGE;
+				} else {
+					return -1;
+				}
+				break;
+			case 'D':
+				config->policy.commit_mode=COMMIT_DISCARD;
+				break;
+			case 'P':
+				config->show_table=1;
+				break;
+			case 'j':
+				config->json=1;
+				break;
+			case 'S':
+				if(sscanf(optarg,"%d,%ld",&(config->synth_files),&(config->synth_opens))!=2){
+					return -1;
+				}
+				break;
+			default:
+				return -1;
+		}
+	}
+	if(optind<argc){
+		config->trace=argv[optind++];
+	}
+	if(config->dir==NULL || config->file_size<0 || config->write_size<0 || config->threads<=0 || config->speed<0 ||
+			optind<argc || (config->trace==NULL && (config->synth_files<=0 || config->synth_opens<=0))){
+		return -1;
+	}
+	return 0;
+}
+
+/** \brief Replays a trace with the session manager.
+ * \param[in] config The parameters of the replay.
+ * \param[in] trace The trace.
+ * \returns 0, or -1 if an open has failed or some incarnations have been left open.
+ *
+ * The session manager is initialized and released like in the module; the incarnations left open by the trace are
+ * closed at the end.
+ */
+int replay(const struct replay_config* config,const struct replay_trace* trace){
+	struct replay_thread* threads;
+	struct latency_hist hist[OP_NUM];
+	struct kobject* kobj;
+	uint64_t start,elapsed;
+	long i,errors=0;
+	int j,created,left,res=0;
+	threads=calloc(config->threads,sizeof(struct replay_thread));
+	slots=calloc(trace->incarnations.num+1,sizeof(struct incarnation*));
+	if(threads==NULL || slots==NULL){
+		fprintf(stderr,"not enough memory for the replay\n");
+		free(threads);
+		free(slots);
+		return -1;
+	}
+	//each process is replayed by a single thread, so its events stay in order
+	for(j=0;j<config->threads;j++){
+		threads[j].config=config;
+		threads[j].trace=trace;
+		threads[j].events=malloc(sizeof(long)*(trace->num+1));
+		if(threads[j].events==NULL){
+			res=-1;
+		}
+		hist_init(&(threads[j].hist[OP_OPEN]));
+		hist_init(&(threads[j].hist[OP_CLOSE]));
+	}
+	for(i=0;res==0 && i<trace->num;i++){
+		j=(unsigned int)trace->events[i].pid%config->threads;
+		threads[j].events[threads[j].num++]=i;
+	}
+	kobj=kobject_create_and_add(SESS_KOBJ_NAME,kernel_kobj);
+	if(res<0 || kobj==NULL || init_manager()<0){
+		fprintf(stderr,"can't initialize the session manager\n");
+		res=-1;
+	} else if(init_info(kobj)<0){
+		fprintf(stderr,"can't initialize the session info\n");
+		release_manager();
+		res=-1;
+	}
+	if(res<0){
+		kobject_put(kobj);
+		for(j=0;j<config->threads;j++){
+			free(threads[j].events);
+		}
+		free(threads);
+		free(slots);
+		return -1;
+	}
+	init_stats();
+	start=now_ns();
+	for(created=0;created<config->threads;created++){
+		threads[created].start=start;
+		if(pthread_create(&(threads[created].thread),NULL,replay_thread_fn,&threads[created])!=0){
+			fprintf(stderr,"can't create thread %d\n",created);
+			res=-1;
+			break;
+		}
+	}
+	for(j=0;j<created;j++){
+		pthread_join(threads[j].thread,NULL);
+	}
+	elapsed=now_ns()-start;
+	if(config->show_table){
+		ushim_proc_show(PROC_SESSIONS,stdout);
+	}
+	hist_init(&hist[OP_OPEN]);
+	hist_init(&hist[OP_CLOSE]);
+	for(j=0;j<config->threads;j++){
+		//the incarnations left open by the trace are closed by the first thread
+		for(i=0;j==0 && i<trace->incarnations.num;i++){
+			if(slots[i]!=NULL){
+				replay_close(&threads[0],slots[i],"");
+				slots[i]=NULL;
+			}
+		}
+		hist_merge(&hist[OP_OPEN],&(threads[j].hist[OP_OPEN]));
+		hist_merge(&hist[OP_CLOSE],&(threads[j].hist[OP_CLOSE]));
+		errors+=threads[j].errors;
+		free(threads[j].events);
+	}
+	if(config->json){
+		print_json(config,hist,elapsed,errors);
+	} else {
+		print_results(config,hist,elapsed,errors);
+	}
+	left=clean_manager();
+	if(left!=0){
+		fprintf(stderr,"%d incarnations left open\n",left);
+		res=-1;
+	} else {
+		release_stats();
+		release_info();
+		release_manager();
+	}
+	kobject_put(kobj);
+	free(threads);
+	free(slots);
+	return (res<0 || errors>0) ? -1 : 0;
+}
+
+int main(int argc, char** argv){
+	struct replay_config config;
+	struct replay_trace trace;
+	char pathname[PATH_MAX];
+	int i,res;
+	if(parse_args(argc,argv,&config)<0){
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	memset(&trace,0,sizeof(struct replay_trace));
+	if(config.trace==NULL){
+		res=synth_trace(config.synth_files,config.synth_opens,&trace);
+	} else if(strcmp(config.trace,"-")!=0 && is_session_trace(config.trace)){
+		res=read_records(config.trace,&trace);
+	} else {
+		res=read_trace(config.trace,&trace);
+	}
+	if(res==0 && trace.num==0){
+		fprintf(stderr,"the trace has no session events\n");
+		res=-1;
+	}
+	for(i=0;res==0 && i<trace.files.num;i++){
+		file_pathname(&config,i,pathname);
+		if(create_file(pathname,config.file_size)<0){
+			fprintf(stderr,"can't create %s: %s\n",pathname,strerror(errno));
+			res=-1;
+		}
+	}
+	if(res==0){
+		res=ushim_init();
+		if(res<0){
+			fprintf(stderr,"can't initialize the shim: %s\n",strerror(-res));
+		} else {
+			res=replay(&config,&trace);
+			ushim_exit();
+		}
+	}
+	for(i=0;i<trace.files.num;i++){
+		file_pathname(&config,i,pathname);
+		unlink(pathname);
+	}
+	free(trace.events);
+	free_map(&(trace.files));
+	free_map(&(trace.incarnations));
+	return (res<0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}